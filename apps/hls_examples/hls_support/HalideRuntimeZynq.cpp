@@ -11,6 +11,7 @@
 #include <fcntl.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <pthread.h>
 
 #include "HalideRuntime.h"
 
@@ -30,6 +31,50 @@ typedef struct cma_buffer_t {
 } cma_buffer_t;
 #endif
 
+#ifndef CMA_SG_BUFFER_T_DEFINED
+#define CMA_SG_BUFFER_T_DEFINED
+#define CMA_SG_MAX_BLOCKS 64
+typedef struct cma_block_t {
+  unsigned int phys_addr; // Bus address of the first row
+  unsigned int width; // Bytes per row
+  unsigned int stride; // Bytes between rows
+  unsigned int height; // Number of rows
+} cma_block_t;
+typedef struct cma_sg_buffer_t {
+  unsigned int num_blocks;
+  cma_block_t blocks[CMA_SG_MAX_BLOCKS];
+} cma_sg_buffer_t;
+#endif
+
+#ifndef REGISTER_T_DEFINED
+#define REGISTER_T_DEFINED
+typedef struct hwacc_reg_t {
+    unsigned int offset;
+    unsigned int value;
+} hwacc_reg_t;
+#endif
+
+#ifndef HALIDE_DEVICE_INTERFACE_H
+#define HALIDE_DEVICE_INTERFACE_H
+// Same layout as in src/runtime/device_interface.h.
+struct halide_device_interface_t {
+    void (*use_module)();
+    void (*release_module)();
+    int (*device_malloc)(void *user_context, struct halide_buffer_t *buf);
+    int (*device_free)(void *user_context, struct halide_buffer_t *buf);
+    int (*device_sync)(void *user_context, struct halide_buffer_t *buf);
+    int (*device_release)(void *user_context);
+    int (*copy_to_host)(void *user_context, struct halide_buffer_t *buf);
+    int (*copy_to_device)(void *user_context, struct halide_buffer_t *buf);
+    int (*device_and_host_malloc)(void *user_context, struct halide_buffer_t *buf);
+    int (*device_and_host_free)(void *user_context, struct halide_buffer_t *buf);
+};
+#endif
+
+#ifndef HALIDE_ZYNQ_UNSUPPORTED
+#define HALIDE_ZYNQ_UNSUPPORTED (-4)
+#endif
+
 #ifndef _IOCTL_CMDS_H_
 #define _IOCTL_CMDS_H_
 
@@ -39,6 +84,9 @@ typedef struct cma_buffer_t {
 #define FREE_IMAGE 1002 // Release buffer
 #define PROCESS_IMAGE 1003 // Push to stencil path
 #define PEND_PROCESSED 1004 // Retreive from stencil path
+#define SET_REG32 1005 // Set configuration register
+#define IMPORT_DMABUF 1006 // Look up the bus address of a dma-buf
+#define PROCESS_IMAGE_SG 1007 // Push to stencil path, with scatter-gather buffers
 
 #endif
 
@@ -46,23 +94,130 @@ typedef struct cma_buffer_t {
 int fd_hwacc = 0;
 int fd_cma = 0;
 
+// When set, CMA buffers come from anonymous memory instead of
+// /dev/cmabuffer0, so the runtime can be exercised without the driver.
+static bool fake_cma = false;
+static unsigned int fake_cma_next_addr = 0x10000000;
+
+// A mapped CMA buffer owned by the pool. buf->device points at cbuf,
+// which must stay the first member. Wrapped entries describe memory
+// owned by the caller (see halide_zynq_cma_wrap()); they are never
+// linked into the pool.
+struct cma_pool_entry {
+    cma_buffer_t cbuf;
+    uint8_t *host;
+    size_t size;
+    bool in_use;
+    bool wrapped;
+    int dmabuf_fd; // -1 unless imported with halide_zynq_dmabuf_wrap()
+    cma_pool_entry *next;
+};
+
+int halide_zynq_cma_unwrap(struct halide_buffer_t *buf);
+const struct halide_device_interface_t *halide_zynq_device_interface();
+
+// Whether the CMA driver imports dma-bufs: -1 until the first import
+// is tried, then 0 or 1.
+static int dmabuf_import_supported = -1;
+
+static cma_pool_entry *cma_pool = NULL;
+static uint64_t cma_pool_hits = 0;
+static uint64_t cma_pool_misses = 0;
+
+struct halide_zynq_cma_pool_stats_t {
+    uint64_t hits;           // allocations served from the pool
+    uint64_t misses;         // allocations that went to the driver
+    int buffers_in_use;
+    int buffers_cached;
+    uint64_t bytes_in_use;
+    uint64_t bytes_cached;
+};
+
+// Number of runs allowed to stay in flight when a pipelined launch
+// returns. Zero makes every launch synchronous.
+static int hwacc_depth = 0;
+
+#define MAX_HWACC_IN_FLIGHT 16
+#define MAX_STAGED_REGS 256
+#define MAX_HWACC_DEVICES 8
+
+// An accelerator IP, driven through /dev/hwaccN.
+struct hwacc_device {
+    int fd;
+    // Guards the pending runs and the staged registers, as tiles of a
+    // parallel loop launch runs from several threads.
+    pthread_mutex_t lock;
+    // Task ids of runs that are launched but not synced yet, kept in
+    // launch order in a ring buffer.
+    int pending[MAX_HWACC_IN_FLIGHT];
+    int pending_head;
+    int pending_count;
+    // Config register writes staged by halide_zynq_stage_reg_on(),
+    // applied right before the next launch.
+    hwacc_reg_t staged_regs[MAX_STAGED_REGS];
+    int staged_reg_count;
+};
+
+static hwacc_device hwacc_devices[MAX_HWACC_DEVICES];
+static int num_hwacc_devices = 0;
+static int hwacc_apply_staged_regs(hwacc_device *dev);
+
+int halide_zynq_set_hwacc_depth(int depth);
+
 int halide_zynq_init() {
     if (fd_cma || fd_hwacc) {
         printf("Zynq runtime is already initialized.\n");
         return -1;
     }
-    fd_cma = open("/dev/cmabuffer0", O_RDWR, 0644);
-    if(fd_cma == -1) {
-        printf("Failed to open cma provider!\n");
-        fd_cma = fd_hwacc = 0;
-        return -2;
+    const char *fake_str = getenv("HL_ZYNQ_FAKE_CMA");
+    fake_cma = fake_str && atoi(fake_str) != 0;
+    if (fake_cma) {
+        // No device to open; -1 only marks the runtime as initialized.
+        fd_cma = -1;
+    } else {
+        fd_cma = open("/dev/cmabuffer0", O_RDWR, 0644);
+        if(fd_cma == -1) {
+            printf("Failed to open cma provider!\n");
+            fd_cma = fd_hwacc = 0;
+            return -2;
+        }
     }
     fd_hwacc = open("/dev/hwacc0", O_RDWR, 0644);
     if(fd_hwacc == -1) {
-        printf("Failed to open hwacc device!\n");
-        close(fd_cma);
-        fd_cma = fd_hwacc = 0;
-        return -2;
+        if (fake_cma) {
+            // Allocation still works; launches report an uninitialized device.
+            fd_hwacc = 0;
+        } else {
+            printf("Failed to open hwacc device!\n");
+            close(fd_cma);
+            fd_cma = fd_hwacc = 0;
+            return -2;
+        }
+    }
+    // Device 0 is /dev/hwacc0; further IPs of the pipeline are bound
+    // to /dev/hwacc1, /dev/hwacc2, ... in order, as far as they exist.
+    num_hwacc_devices = 0;
+    if (fd_hwacc != 0) {
+        char path[] = "/dev/hwacc0";
+        while (num_hwacc_devices < MAX_HWACC_DEVICES) {
+            int fd = fd_hwacc;
+            if (num_hwacc_devices > 0) {
+                path[sizeof(path) - 2] = '0' + num_hwacc_devices;
+                fd = open(path, O_RDWR, 0644);
+                if (fd == -1) {
+                    break;
+                }
+            }
+            hwacc_device *dev = &hwacc_devices[num_hwacc_devices++];
+            dev->fd = fd;
+            pthread_mutex_init(&dev->lock, NULL);
+            dev->pending_head = dev->pending_count = 0;
+            dev->staged_reg_count = 0;
+        }
+    }
+    const char *depth_str = getenv("HL_ZYNQ_HWACC_DEPTH");
+    if (depth_str) {
+        halide_zynq_set_hwacc_depth(atoi(depth_str));
     }
     return 0;
 }
@@ -72,61 +227,131 @@ void halide_zynq_free(void *user_context, void *ptr) {
 }
 
 static int cma_get_buffer(cma_buffer_t* ptr) {
+    if (fake_cma) {
+        size_t size = ptr->stride * ptr->height * ptr->depth;
+        void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED) {
+            return -1;
+        }
+        ptr->kern_addr = mem;
+        ptr->phys_addr = fake_cma_next_addr;
+        ptr->mmap_offset = 0;
+        fake_cma_next_addr += size;
+        return 0;
+    }
     return ioctl(fd_cma, GET_BUFFER, (long unsigned int)ptr);
 }
 
 static int cma_free_buffer(cma_buffer_t* ptr) {
+    if (fake_cma) {
+        // The anonymous mapping is dropped by the caller.
+        return 0;
+    }
     return ioctl(fd_cma, FREE_IMAGE, (long unsigned int)ptr);
 }
 
-int halide_zynq_cma_alloc(struct halide_buffer_t *buf) {
-    if (fd_cma == 0) {
-        printf("Zynq runtime is uninitialized.\n");
-        return -1;
-    }
-
-    cma_buffer_t *cbuf = (cma_buffer_t *)malloc(sizeof(cma_buffer_t));
-    if (cbuf == NULL) {
-        printf("malloc failed.\n");
-        return -1;
-    }
+// Unmap and give back a pool entry that is not in use.
+static void cma_pool_release(cma_pool_entry *entry) {
+    munmap((void *)entry->host, entry->size);
+    cma_free_buffer(&entry->cbuf);
+    free(entry);
+}
 
+// Compute the cma_buffer_t geometry of BUF. Currently kernel buffer
+// only supports 2-D data layout, so we fold lower dimensions into the
+// 'depth' field.
+static int cma_buffer_shape(const struct halide_buffer_t *buf, cma_buffer_t *shape) {
     // TODO check the strides of buf are monotonically increasing
-
-    // Currently kernel buffer only supports 2-D data layout,
-    // so we fold lower dimensions into the 'depth' field.
     size_t nDims = buf->dimensions;
     if (nDims < 2) {
-        free(cbuf);
         printf("buffer_t has less than 2 dimension, not supported in CMA driver.");
         return -3;
     }
-    cbuf->depth = buf->type.bytes();
+    shape->depth = buf->type.bytes();
     if (nDims > 2) {
         for (size_t i = 0; i < nDims - 2; i++)
-            cbuf->depth *= buf->dim[i].extent;
+            shape->depth *= buf->dim[i].extent;
+    }
+    shape->width = buf->dim[nDims-2].extent;
+    shape->height = buf->dim[nDims-1].extent;
+    shape->stride = shape->width;
+    return 0;
+}
+
+int halide_zynq_cma_alloc(struct halide_buffer_t *buf) {
+    if (fd_cma == 0) {
+        printf("Zynq runtime is uninitialized.\n");
+        return -1;
     }
-    cbuf->width = buf->dim[nDims-2].extent;
-    cbuf->height = buf->dim[nDims-1].extent;
-    // TODO check stride of dimension are the same as width
-    cbuf->stride = cbuf->width;
 
-    int status = cma_get_buffer(cbuf);
+    cma_buffer_t shape;
+    int status = cma_buffer_shape(buf, &shape);
     if (status != 0) {
-        free(cbuf);
+        return status;
+    }
+    size_t size = shape.stride * shape.height * shape.depth;
+
+    // Reuse the smallest free buffer that fits without wasting more
+    // than half of it. Only the geometry is rewritten; the physical
+    // pages, the mapping and the driver id stay the same.
+    cma_pool_entry *best = NULL;
+    for (cma_pool_entry *e = cma_pool; e; e = e->next) {
+        if (!e->in_use && e->size >= size && e->size / 2 < size &&
+            (best == NULL || e->size < best->size)) {
+            best = e;
+        }
+    }
+    if (best) {
+        cma_pool_hits++;
+        best->cbuf.width = shape.width;
+        best->cbuf.height = shape.height;
+        best->cbuf.depth = shape.depth;
+        best->cbuf.stride = shape.stride;
+        best->in_use = true;
+        buf->device = (uint64_t) &best->cbuf;
+        buf->device_interface = halide_zynq_device_interface();
+        buf->host = best->host;
+        return 0;
+    }
+    cma_pool_misses++;
+
+    cma_pool_entry *entry = (cma_pool_entry *)malloc(sizeof(cma_pool_entry));
+    if (entry == NULL) {
+        printf("malloc failed.\n");
+        return -1;
+    }
+    entry->cbuf = shape;
+    entry->size = size;
+    entry->wrapped = false;
+    entry->dmabuf_fd = -1;
+
+    status = cma_get_buffer(&entry->cbuf);
+    if (status != 0) {
+        free(entry);
         printf("cma_get_buffer() returned %d (failed).\n", status);
         return -2;
     }
 
-    buf->device = (uint64_t) cbuf;
-    buf->host = (uint8_t*) mmap(NULL, cbuf->stride * cbuf->height * cbuf->depth,
-                                PROT_WRITE, MAP_SHARED, fd_cma, cbuf->mmap_offset);
-
-    if ((void *) buf->host == (void *) -1) {
-        free(cbuf);
+    if (fake_cma) {
+        entry->host = (uint8_t *) entry->cbuf.kern_addr;
+    } else {
+        entry->host = (uint8_t *) mmap(NULL, size, PROT_WRITE, MAP_SHARED,
+                                       fd_cma, entry->cbuf.mmap_offset);
+    }
+    if ((void *) entry->host == MAP_FAILED) {
+        cma_free_buffer(&entry->cbuf);
+        free(entry);
         printf("mmap failed.\n");
         return -3;
     }
+
+    entry->in_use = true;
+    entry->next = cma_pool;
+    cma_pool = entry;
+    buf->device = (uint64_t) &entry->cbuf;
+    buf->device_interface = halide_zynq_device_interface();
+    buf->host = entry->host;
     return 0;
 }
 
@@ -136,11 +361,148 @@ int halide_zynq_cma_free(struct halide_buffer_t *buf) {
         return -1;
     }
 
-    cma_buffer_t *cbuf = (cma_buffer_t *)buf->device;
-    munmap((void*)buf->host, cbuf->stride * cbuf->height * cbuf->depth);
-    cma_free_buffer(cbuf);
-    free(cbuf);
+    cma_pool_entry *entry = (cma_pool_entry *)buf->device;
+    if (entry->wrapped) {
+        return halide_zynq_cma_unwrap(buf);
+    }
+
+    // The buffer stays mapped in the pool for the next allocation;
+    // halide_zynq_cma_pool_trim() gives the memory back to the driver.
+    entry->in_use = false;
     buf->device = 0;
+    buf->device_interface = NULL;
+    return 0;
+}
+
+// Make BUF refer to the memory at BUF->host, whose bus address is
+// PHYS_ADDR, with the row stride of BUF.
+static int cma_wrap(struct halide_buffer_t *buf, unsigned int phys_addr, int dmabuf_fd) {
+    if (buf->host == NULL) {
+        printf("Can't wrap a buffer with no host memory.\n");
+        return -1;
+    }
+    if (buf->device != 0) {
+        printf("Buffer already has a device allocation.\n");
+        return -1;
+    }
+    cma_buffer_t shape;
+    int status = cma_buffer_shape(buf, &shape);
+    if (status != 0) {
+        return status;
+    }
+    // The pixels of a row must be packed; rows may be padded.
+    size_t nDims = buf->dimensions;
+    int bytes = buf->type.bytes();
+    if ((unsigned int)(buf->dim[nDims-2].stride * bytes) != shape.depth ||
+        (buf->dim[nDims-1].stride * bytes) % shape.depth != 0) {
+        printf("Buffer layout can't be described to the DMA.\n");
+        return -3;
+    }
+    shape.stride = buf->dim[nDims-1].stride * bytes / shape.depth;
+
+    cma_pool_entry *entry = (cma_pool_entry *)malloc(sizeof(cma_pool_entry));
+    if (entry == NULL) {
+        printf("malloc failed.\n");
+        return -1;
+    }
+    entry->cbuf = shape;
+    // The driver identifies an imported dma-buf by its fd.
+    entry->cbuf.id = dmabuf_fd == -1 ? 0 : dmabuf_fd;
+    entry->cbuf.phys_addr = phys_addr;
+    entry->cbuf.kern_addr = buf->host;
+    entry->cbuf.cvals = NULL;
+    entry->cbuf.mmap_offset = 0;
+    entry->host = buf->host;
+    entry->size = shape.stride * shape.height * shape.depth;
+    entry->in_use = true;
+    entry->wrapped = true;
+    entry->dmabuf_fd = dmabuf_fd;
+    entry->next = NULL;
+    buf->device = (uint64_t) &entry->cbuf;
+    buf->device_interface = halide_zynq_device_interface();
+    return 0;
+}
+
+int halide_zynq_cma_wrap(struct halide_buffer_t *buf, unsigned int phys_addr) {
+    return cma_wrap(buf, phys_addr, -1);
+}
+
+int halide_zynq_dmabuf_wrap(struct halide_buffer_t *buf, int dmabuf_fd) {
+    if (fd_cma == 0) {
+        printf("Zynq runtime is uninitialized.\n");
+        return -1;
+    }
+    if (fake_cma || dmabuf_import_supported == 0) {
+        return HALIDE_ZYNQ_UNSUPPORTED;
+    }
+    // The driver attaches the dma-buf passed in id and returns its
+    // bus address; FREE_IMAGE detaches it again.
+    cma_buffer_t import;
+    import.id = dmabuf_fd;
+    if (ioctl(fd_cma, IMPORT_DMABUF, (long unsigned int)&import) != 0) {
+        if (dmabuf_import_supported == -1) {
+            // The drivers don't know the ioctl yet.
+            dmabuf_import_supported = 0;
+            return HALIDE_ZYNQ_UNSUPPORTED;
+        }
+        printf("Failed to import dma-buf %d.\n", dmabuf_fd);
+        return -2;
+    }
+    dmabuf_import_supported = 1;
+    return cma_wrap(buf, import.phys_addr, dmabuf_fd);
+}
+
+int halide_zynq_cma_unwrap(struct halide_buffer_t *buf) {
+    cma_pool_entry *entry = (cma_pool_entry *)buf->device;
+    if (entry == NULL || !entry->wrapped) {
+        printf("Buffer was not wrapped with halide_zynq_cma_wrap().\n");
+        return -1;
+    }
+    int status = 0;
+    if (entry->dmabuf_fd != -1 && !fake_cma) {
+        status = cma_free_buffer(&entry->cbuf);
+    }
+    free(entry);
+    buf->device = 0;
+    buf->device_interface = NULL;
+    return status;
+}
+
+int halide_zynq_cma_pool_trim(size_t max_cached_bytes) {
+    size_t cached = 0;
+    for (cma_pool_entry *e = cma_pool; e; e = e->next) {
+        if (!e->in_use) {
+            cached += e->size;
+        }
+    }
+    cma_pool_entry **prev = &cma_pool;
+    while (*prev && cached > max_cached_bytes) {
+        cma_pool_entry *e = *prev;
+        if (e->in_use) {
+            prev = &e->next;
+            continue;
+        }
+        *prev = e->next;
+        cached -= e->size;
+        cma_pool_release(e);
+    }
+    return 0;
+}
+
+int halide_zynq_cma_pool_get_stats(struct halide_zynq_cma_pool_stats_t *stats) {
+    stats->hits = cma_pool_hits;
+    stats->misses = cma_pool_misses;
+    stats->buffers_in_use = stats->buffers_cached = 0;
+    stats->bytes_in_use = stats->bytes_cached = 0;
+    for (cma_pool_entry *e = cma_pool; e; e = e->next) {
+        if (e->in_use) {
+            stats->buffers_in_use++;
+            stats->bytes_in_use += e->size;
+        } else {
+            stats->buffers_cached++;
+            stats->bytes_cached += e->size;
+        }
+    }
     return 0;
 }
 
@@ -157,21 +519,294 @@ int halide_zynq_subimage(const struct halide_buffer_t* image, struct cma_buffer_
     return 0;
 }
 
-int halide_zynq_hwacc_launch(struct cma_buffer_t bufs[]) {
+int halide_zynq_subimage_nd(const struct halide_buffer_t* image, struct cma_sg_buffer_t* subimage, void *address_of_subimage_origin, int dimensions, const int *strides, const int *extents) {
+    const cma_buffer_t *cbuf = (const cma_buffer_t *)image->device;
+    if (cbuf == NULL) {
+        printf("Buffer has no CMA allocation.\n");
+        return -1;
+    }
+    unsigned int phys_addr = cbuf->phys_addr +
+        (unsigned int)((uint8_t *)address_of_subimage_origin - image->host);
+    int bytes = image->type.bytes();
+
+    // Merge the innermost dimensions that are contiguous in memory
+    // into the width of the rows.
+    int d = 0;
+    unsigned int width = bytes;
+    while (d < dimensions && (extents[d] == 1 || strides[d] * bytes == (int)width)) {
+        width *= extents[d];
+        d++;
+    }
+    unsigned int height = 1, stride = width;
+    if (d < dimensions) {
+        height = extents[d];
+        stride = strides[d] * bytes;
+        d++;
+    }
+    int num_blocks = 1;
+    for (int i = d; i < dimensions; i++) {
+        num_blocks *= extents[i];
+    }
+    if (num_blocks > CMA_SG_MAX_BLOCKS) {
+        printf("Sub-image needs %d DMA blocks, more than %d.\n", num_blocks, CMA_SG_MAX_BLOCKS);
+        return -2;
+    }
+
+    subimage->num_blocks = num_blocks;
+    for (int b = 0; b < num_blocks; b++) {
+        // Decompose the block index over the outer dimensions.
+        int offset = 0;
+        int rest = b;
+        for (int i = d; i < dimensions; i++) {
+            offset += (rest % extents[i]) * strides[i] * bytes;
+            rest /= extents[i];
+        }
+        subimage->blocks[b].phys_addr = phys_addr + offset;
+        subimage->blocks[b].width = width;
+        subimage->blocks[b].stride = stride;
+        subimage->blocks[b].height = height;
+    }
+    return 0;
+}
+
+// Returns the given accelerator device, or NULL if there is none.
+static hwacc_device *hwacc_get_device(int device) {
     if (fd_hwacc == 0) {
         printf("Zynq runtime is uninitialized.\n");
+        return NULL;
+    }
+    if (device < 0 || device >= num_hwacc_devices) {
+        printf("There is no hwacc device %d.\n", device);
+        return NULL;
+    }
+    return &hwacc_devices[device];
+}
+
+// Apply the staged registers and start a run with the PROCESS_IMAGE
+// or PROCESS_IMAGE_SG command. Called with dev->lock held.
+static int hwacc_launch_locked(hwacc_device *dev, int cmd, void *bufs) {
+    int res = hwacc_apply_staged_regs(dev);
+    if (res < 0) {
+        return res;
+    }
+    res = ioctl(dev->fd, cmd, (long unsigned int)bufs);
+    return res;
+}
+
+int halide_zynq_hwacc_launch_on(int device, struct cma_buffer_t bufs[]) {
+    hwacc_device *dev = hwacc_get_device(device);
+    if (dev == NULL) {
         return -1;
     }
-    int res = ioctl(fd_hwacc, PROCESS_IMAGE, (long unsigned int)bufs);
+    pthread_mutex_lock(&dev->lock);
+    int res = hwacc_launch_locked(dev, PROCESS_IMAGE, bufs);
+    pthread_mutex_unlock(&dev->lock);
+    return res;
+}
+
+int halide_zynq_hwacc_launch_sg_on(int device, struct cma_sg_buffer_t bufs[]) {
+    hwacc_device *dev = hwacc_get_device(device);
+    if (dev == NULL) {
+        return -1;
+    }
+    pthread_mutex_lock(&dev->lock);
+    int res = hwacc_launch_locked(dev, PROCESS_IMAGE_SG, bufs);
+    pthread_mutex_unlock(&dev->lock);
+    return res;
+}
+
+int halide_zynq_hwacc_launch(struct cma_buffer_t bufs[]) {
+    return halide_zynq_hwacc_launch_on(0, bufs);
+}
+
+int halide_zynq_hwacc_sync_on(int device, int task_id) {
+    hwacc_device *dev = hwacc_get_device(device);
+    if (dev == NULL) {
+        return -1;
+    }
+    if (task_id < 0) {
+        // The launch failed; pass its error on.
+        return task_id;
+    }
+    int res = ioctl(dev->fd, PEND_PROCESSED, (long unsigned int)task_id);
     return res;
 }
 
 int halide_zynq_hwacc_sync(int task_id){
-    if (fd_hwacc == 0) {
-        printf("Zynq runtime is uninitialized.\n");
+    return halide_zynq_hwacc_sync_on(0, task_id);
+}
+
+static int hwacc_retire(hwacc_device *dev, int max_pending) {
+    int status = 0;
+    while (dev->pending_count > max_pending) {
+        int res = ioctl(dev->fd, PEND_PROCESSED, (long unsigned int)dev->pending[dev->pending_head]);
+        dev->pending_head = (dev->pending_head + 1) % MAX_HWACC_IN_FLIGHT;
+        dev->pending_count--;
+        if (res < 0 && status == 0) {
+            status = res;
+        }
+    }
+    return status;
+}
+
+int halide_zynq_stage_reg_on(int device, unsigned int offset, unsigned int value) {
+    hwacc_device *dev = hwacc_get_device(device);
+    if (dev == NULL) {
         return -1;
     }
-    int res = ioctl(fd_hwacc, PEND_PROCESSED, (long unsigned int)task_id);
+    int res = 0;
+    pthread_mutex_lock(&dev->lock);
+    int i = 0;
+    while (i < dev->staged_reg_count && dev->staged_regs[i].offset != offset) {
+        i++;
+    }
+    if (i == MAX_STAGED_REGS) {
+        printf("Too many staged config registers.\n");
+        res = -1;
+    } else {
+        dev->staged_regs[i].offset = offset;
+        dev->staged_regs[i].value = value;
+        if (i == dev->staged_reg_count) {
+            dev->staged_reg_count++;
+        }
+    }
+    pthread_mutex_unlock(&dev->lock);
     return res;
 }
 
+int halide_zynq_stage_reg(unsigned int offset, unsigned int value) {
+    return halide_zynq_stage_reg_on(0, offset, value);
+}
+
+static int hwacc_apply_staged_regs(hwacc_device *dev) {
+    if (dev->staged_reg_count == 0) {
+        return 0;
+    }
+    // The accelerator latches its config registers when a run starts.
+    // They may change while one run is in flight, but not while a
+    // queued run has yet to start.
+    int status = hwacc_retire(dev, 1);
+    for (int i = 0; i < dev->staged_reg_count; i++) {
+        int res = ioctl(dev->fd, SET_REG32, (long unsigned int)&dev->staged_regs[i]);
+        if (res < 0 && status == 0) {
+            status = res;
+        }
+    }
+    dev->staged_reg_count = 0;
+    return status;
+}
+
+int halide_zynq_set_hwacc_depth(int depth) {
+    if (depth < 0 || depth >= MAX_HWACC_IN_FLIGHT) {
+        printf("hwacc depth must be in [0, %d].\n", MAX_HWACC_IN_FLIGHT - 1);
+        return -1;
+    }
+    int res = 0;
+    for (int i = 0; i < num_hwacc_devices; i++) {
+        pthread_mutex_lock(&hwacc_devices[i].lock);
+        int r = hwacc_retire(&hwacc_devices[i], depth);
+        pthread_mutex_unlock(&hwacc_devices[i].lock);
+        if (r < 0 && res == 0) {
+            res = r;
+        }
+    }
+    hwacc_depth = depth;
+    return res;
+}
+
+static int hwacc_launch_pipelined(int device, int cmd, void *bufs) {
+    hwacc_device *dev = hwacc_get_device(device);
+    if (dev == NULL) {
+        return -1;
+    }
+    pthread_mutex_lock(&dev->lock);
+    int task_id = hwacc_launch_locked(dev, cmd, bufs);
+    int res = 0;
+    if (task_id >= 0) {
+        int tail = (dev->pending_head + dev->pending_count) % MAX_HWACC_IN_FLIGHT;
+        dev->pending[tail] = task_id;
+        dev->pending_count++;
+        res = hwacc_retire(dev, hwacc_depth);
+    }
+    pthread_mutex_unlock(&dev->lock);
+    if (task_id < 0) {
+        return task_id;
+    }
+    return res < 0 ? res : task_id;
+}
+
+int halide_zynq_hwacc_launch_pipelined_on(int device, struct cma_buffer_t bufs[]) {
+    return hwacc_launch_pipelined(device, PROCESS_IMAGE, bufs);
+}
+
+int halide_zynq_hwacc_launch_pipelined_sg_on(int device, struct cma_sg_buffer_t bufs[]) {
+    return hwacc_launch_pipelined(device, PROCESS_IMAGE_SG, bufs);
+}
+
+int halide_zynq_hwacc_launch_pipelined(struct cma_buffer_t bufs[]) {
+    return halide_zynq_hwacc_launch_pipelined_on(0, bufs);
+}
+
+int halide_zynq_hwacc_sync_all_on(int device) {
+    hwacc_device *dev = hwacc_get_device(device);
+    if (dev == NULL) {
+        return -1;
+    }
+    pthread_mutex_lock(&dev->lock);
+    int res = hwacc_retire(dev, 0);
+    pthread_mutex_unlock(&dev->lock);
+    return res;
+}
+
+int halide_zynq_hwacc_sync_all() {
+    return halide_zynq_hwacc_sync_all_on(0);
+}
+
+// There is no JIT module to keep alive.
+static void zynq_use_module() {
+}
+
+// CMA buffers are mapped into the host, so there is nothing to copy.
+
+static int zynq_device_malloc(void *user_context, struct halide_buffer_t *buf) {
+    return halide_zynq_cma_alloc(buf);
+}
+
+static int zynq_device_free(void *user_context, struct halide_buffer_t *buf) {
+    return halide_zynq_cma_free(buf);
+}
+
+static int zynq_device_sync(void *user_context, struct halide_buffer_t *buf) {
+    return 0;
+}
+
+static int zynq_device_release(void *user_context) {
+    return halide_zynq_cma_pool_trim(0);
+}
+
+static int zynq_copy(void *user_context, struct halide_buffer_t *buf) {
+    return 0;
+}
+
+static int zynq_device_and_host_free(void *user_context, struct halide_buffer_t *buf) {
+    int result = halide_zynq_cma_free(buf);
+    buf->host = NULL;
+    return result;
+}
+
+static halide_device_interface_t zynq_device_interface = {
+    zynq_use_module,
+    zynq_use_module,
+    zynq_device_malloc,
+    zynq_device_free,
+    zynq_device_sync,
+    zynq_device_release,
+    zynq_copy,
+    zynq_copy,
+    zynq_device_malloc,
+    zynq_device_and_host_free,
+};
+
+const struct halide_device_interface_t *halide_zynq_device_interface() {
+    return &zynq_device_interface;
+}
@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 #include <assert.h>
 
 ///Forward declarations
@@ -253,6 +254,40 @@ void stencil_to_file(FILE *fp, const char *name,
     }
 }
 
+/** The packed layout of a stencil is the in-memory layout of
+ * Stencil::value on a little-endian host, so stencils can be packed and
+ * unpacked 64 bits at a time instead of element by element.
+ */
+static inline bool host_is_little_endian() {
+    const uint16_t one = 1;
+    return *(const uint8_t *)&one == 1;
+}
+
+template <typename T, size_t EXTENT_0, size_t EXTENT_1, size_t EXTENT_2, size_t EXTENT_3>
+void pack_stencil_words(const Stencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> &stencil,
+                        AxiPackedStencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> &packed) {
+    const size_t bytes = sizeof(T) * EXTENT_0 * EXTENT_1 * EXTENT_2 * EXTENT_3;
+    const uint8_t *src = (const uint8_t *)stencil.value;
+    for (size_t lo = 0; lo < bytes; lo += 8) {
+        const size_t n = bytes - lo < 8 ? bytes - lo : 8;
+        uint64_t word = 0;
+        memcpy(&word, src + lo, n);
+        packed.value.range(8 * (lo + n) - 1, 8 * lo) = word;
+    }
+}
+
+template <typename T, size_t EXTENT_0, size_t EXTENT_1, size_t EXTENT_2, size_t EXTENT_3>
+void unpack_stencil_words(const AxiPackedStencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> &packed,
+                          Stencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> &stencil) {
+    const size_t bytes = sizeof(T) * EXTENT_0 * EXTENT_1 * EXTENT_2 * EXTENT_3;
+    uint8_t *dst = (uint8_t *)stencil.value;
+    for (size_t lo = 0; lo < bytes; lo += 8) {
+        const size_t n = bytes - lo < 8 ? bytes - lo : 8;
+        uint64_t word = packed.value.range(8 * (lo + n) - 1, 8 * lo).to_uint64();
+        memcpy(dst + lo, &word, n);
+    }
+}
+
 template <typename T, size_t EXTENT_0, size_t EXTENT_1, size_t EXTENT_2, size_t EXTENT_3>
 void subimage_to_stream(const struct halide_buffer_t *buf_noop,
                         hls::stream<AxiPackedStencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> > &stream,
@@ -266,6 +301,36 @@ void subimage_to_stream(const struct halide_buffer_t *buf_noop,
     assert(subimage_extent_2 % EXTENT_2 == 0);
     assert(subimage_extent_3 % EXTENT_3 == 0);
     (void) buf_noop;  // avoid unused warnning
+    if (stride_0 == 1 && host_is_little_endian()) {
+        // The rows of each stencil are contiguous in the subimage:
+        // copy them whole and pack the stencil a word at a time.
+        const T *rows[EXTENT_3][EXTENT_2][EXTENT_1];
+        for(size_t idx_3 = 0; idx_3 < (unsigned)subimage_extent_3; idx_3 += EXTENT_3)
+        for(size_t idx_2 = 0; idx_2 < (unsigned)subimage_extent_2; idx_2 += EXTENT_2)
+        for(size_t idx_1 = 0; idx_1 < (unsigned)subimage_extent_1; idx_1 += EXTENT_1) {
+            for(size_t st_idx_3 = 0; st_idx_3 < EXTENT_3; st_idx_3++)
+            for(size_t st_idx_2 = 0; st_idx_2 < EXTENT_2; st_idx_2++)
+            for(size_t st_idx_1 = 0; st_idx_1 < EXTENT_1; st_idx_1++) {
+                rows[st_idx_3][st_idx_2][st_idx_1] = (const T *)subimage +
+                    (idx_1 + st_idx_1) * stride_1 +
+                    (idx_2 + st_idx_2) * stride_2 +
+                    (idx_3 + st_idx_3) * stride_3;
+            }
+            for(size_t idx_0 = 0; idx_0 < (unsigned)subimage_extent_0; idx_0 += EXTENT_0) {
+                Stencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> stencil;
+                for(size_t st_idx_3 = 0; st_idx_3 < EXTENT_3; st_idx_3++)
+                for(size_t st_idx_2 = 0; st_idx_2 < EXTENT_2; st_idx_2++)
+                for(size_t st_idx_1 = 0; st_idx_1 < EXTENT_1; st_idx_1++) {
+                    memcpy(stencil.value[st_idx_3][st_idx_2][st_idx_1],
+                           rows[st_idx_3][st_idx_2][st_idx_1] + idx_0, EXTENT_0 * sizeof(T));
+                }
+                AxiPackedStencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> axi_stencil;
+                pack_stencil_words(stencil, axi_stencil);
+                stream.write(axi_stencil);
+            }
+        }
+        return;
+    }
     for(size_t idx_3 = 0; idx_3 < (unsigned)subimage_extent_3; idx_3 += EXTENT_3)
     for(size_t idx_2 = 0; idx_2 < (unsigned)subimage_extent_2; idx_2 += EXTENT_2)
     for(size_t idx_1 = 0; idx_1 < (unsigned)subimage_extent_1; idx_1 += EXTENT_1)
@@ -298,21 +363,38 @@ void stream_to_subimage(const struct halide_buffer_t *buf_noop,
     assert(subimage_extent_2 % EXTENT_2 == 0);
     assert(subimage_extent_3 % EXTENT_3 == 0);
     (void) buf_noop;  // avoid unused warnning
+    const bool contiguous_rows = stride_0 == 1 && host_is_little_endian();
     for(size_t idx_3 = 0; idx_3 < (unsigned)subimage_extent_3; idx_3 += EXTENT_3)
     for(size_t idx_2 = 0; idx_2 < (unsigned)subimage_extent_2; idx_2 += EXTENT_2)
     for(size_t idx_1 = 0; idx_1 < (unsigned)subimage_extent_1; idx_1 += EXTENT_1)
     for(size_t idx_0 = 0; idx_0 < (unsigned)subimage_extent_0; idx_0 += EXTENT_0) {
         AxiPackedStencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> axi_stencil = stream.read();
-        Stencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> stencil = axi_stencil;
-        for(size_t st_idx_3 = 0; st_idx_3 < EXTENT_3; st_idx_3++)
-        for(size_t st_idx_2 = 0; st_idx_2 < EXTENT_2; st_idx_2++)
-        for(size_t st_idx_1 = 0; st_idx_1 < EXTENT_1; st_idx_1++)
-        for(size_t st_idx_0 = 0; st_idx_0 < EXTENT_0; st_idx_0++) {
-            int offset = (idx_0 + st_idx_0) * stride_0 +
-                (idx_1 + st_idx_1) * stride_1 +
-                (idx_2 + st_idx_2) * stride_2 +
-                (idx_3 + st_idx_3) * stride_3;
-            *((T *)subimage + offset) = stencil(st_idx_0, st_idx_1, st_idx_2, st_idx_3);
+        if (contiguous_rows) {
+            // unpack a word at a time and copy whole stencil rows
+            Stencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> stencil;
+            unpack_stencil_words(axi_stencil, stencil);
+            for(size_t st_idx_3 = 0; st_idx_3 < EXTENT_3; st_idx_3++)
+            for(size_t st_idx_2 = 0; st_idx_2 < EXTENT_2; st_idx_2++)
+            for(size_t st_idx_1 = 0; st_idx_1 < EXTENT_1; st_idx_1++) {
+                int offset = idx_0 +
+                    (idx_1 + st_idx_1) * stride_1 +
+                    (idx_2 + st_idx_2) * stride_2 +
+                    (idx_3 + st_idx_3) * stride_3;
+                memcpy((T *)subimage + offset, stencil.value[st_idx_3][st_idx_2][st_idx_1],
+                       EXTENT_0 * sizeof(T));
+            }
+        } else {
+            Stencil<T, EXTENT_0, EXTENT_1, EXTENT_2, EXTENT_3> stencil = axi_stencil;
+            for(size_t st_idx_3 = 0; st_idx_3 < EXTENT_3; st_idx_3++)
+            for(size_t st_idx_2 = 0; st_idx_2 < EXTENT_2; st_idx_2++)
+            for(size_t st_idx_1 = 0; st_idx_1 < EXTENT_1; st_idx_1++)
+            for(size_t st_idx_0 = 0; st_idx_0 < EXTENT_0; st_idx_0++) {
+                int offset = (idx_0 + st_idx_0) * stride_0 +
+                    (idx_1 + st_idx_1) * stride_1 +
+                    (idx_2 + st_idx_2) * stride_2 +
+                    (idx_3 + st_idx_3) * stride_3;
+                *((T *)subimage + offset) = stencil(st_idx_0, st_idx_1, st_idx_2, st_idx_3);
+            }
         }
         // check TLAST
         if (idx_3 == subimage_extent_3 - EXTENT_3 &&
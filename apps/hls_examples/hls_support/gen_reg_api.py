@@ -18,22 +18,39 @@ if __name__ == "__main__":
                       help="Output file name")
     parser.add_option("-d", "--debug", action="store_true", dest="debug",
                       help="Include debug printf")
+    parser.add_option("--device", type="int", default=0,
+                      help="Accelerator device (/dev/hwaccN) the IP is bound to")
+    parser.add_option("-a", "--append", action="store_true", dest="append",
+                      help="Append to the output files, for pipelines with several IPs")
 
     (options, file_list) = parser.parse_args() 
 
     foutname = options.output
     foutheader = os.path.splitext(options.output)[0]+".h"
     f_name = file_list[0]
+    mode = 'a' if options.append else 'w'
+
+    # The IP on device 0 keeps the plain function names. The IP on
+    # device N is named hls_targetN by the compiler, which prefixes its
+    # register setting functions accordingly. This follows
+    # hw_register_setter_name() in src/ExtractHWKernelDAG.cpp: the
+    # register names already start with '_'.
+    if options.device > 0:
+        prefix = "halide_zynq_set_hls_target%d"%(options.device)
+        stage_reg = "halide_zynq_stage_reg_on(%d, "%(options.device)
+    else:
+        prefix = "halide_zynq_set_"
+        stage_reg = "halide_zynq_stage_reg("
 
     try:
-        fout = open(foutname,'w')
+        fout = open(foutname,mode)
     except:
         print >> sys.stderr, "Fail to open {}.".format(foutname)
         parser.print_help()
         sys.exit()
 
     try:
-        fhead = open(foutheader,'w')
+        fhead = open(foutheader,mode)
     except:
         print >> sys.stderr, "Fail to open {}.".format(foutname)
         parser.print_help()
@@ -60,6 +77,11 @@ typedef struct hwacc_reg_t {
 
 extern int fd_hwacc;
 
+// Register writes are staged and applied by the runtime right before
+// the next launch, so they can be issued while a frame is running.
+int halide_zynq_stage_reg(unsigned int offset, unsigned int value);
+int halide_zynq_stage_reg_on(int device, unsigned int offset, unsigned int value);
+
 
 '''
     print >> fhead, header
@@ -92,14 +114,14 @@ extern int fd_hwacc;
 
         else: # scalar array
             if datawidth=="32":
-                print >> fout, "int halide_zynq_set_%s(unsigned int %s) {"%(orgname,orgname)
-                print >> fhead, "int halide_zynq_set_%s(unsigned int %s);"%(orgname,orgname)
+                print >> fout, prefix+"%s(unsigned int %s) {"%(orgname,orgname)
+                print >> fhead, prefix+"%s(unsigned int %s);"%(orgname,orgname)
             elif datawidth=="16":
-                print >> fout, "int halide_zynq_set_%s(unsigned short %s) {"%(orgname,orgname)
-                print >> fhead, "int halide_zynq_set_%s(unsigned short %s);"%(orgname,orgname)
+                print >> fout, prefix+"%s(unsigned short %s) {"%(orgname,orgname)
+                print >> fhead, prefix+"%s(unsigned short %s);"%(orgname,orgname)
             else: # datawidth=="8":
-                print >> fout, "int halide_zynq_set_%s(unsigned char %s) {"%(orgname,orgname)
-                print >> fhead, "int halide_zynq_set_%s(unsigned char %s);"%(orgname,orgname)
+                print >> fout, prefix+"%s(unsigned char %s) {"%(orgname,orgname)
+                print >> fhead, prefix+"%s(unsigned char %s);"%(orgname,orgname)
 
             if options.debug:
                 print >> fout, "  printf(\"Setting %s\\n\");"%(orgname)
@@ -116,7 +138,7 @@ extern int fd_hwacc;
                 print >> fout, "    printf(\"  r.offset = %x\\n\", r.offset);"
                 print >> fout, "    printf(\"  r.value  = %d\\n\", r.value );"
 
-            print >> fout, "  ioctl(fd_hwacc, SET_REG32, &r);"
+            print >> fout, "  "+stage_reg+"r.offset, r.value);"
             print >> fout, "  return 0;"
 
             print >> fout, "}"
@@ -127,8 +149,8 @@ extern int fd_hwacc;
         offset     = array_list[k]["offset"]
         size       = array_list[k]["size"]
 
-        print >> fout, "int halide_zynq_set_%s(unsigned char *%s) {"%(orgname,orgname)
-        print >> fhead, "int halide_zynq_set_%s(unsigned char *%s);"%(orgname,orgname)
+        print >> fout, prefix+"%s(unsigned char *%s) {"%(orgname,orgname)
+        print >> fhead, prefix+"%s(unsigned char *%s);"%(orgname,orgname)
 
         print >> fout, "  hwacc_reg_t r;"
         print >> fout, "  if (fd_hwacc == 0) {"
@@ -148,21 +170,21 @@ extern int fd_hwacc;
             if datawidth=="32":
                 print >> fout, "    r.offset = %s + (unsigned long int)p - (unsigned long int)%s;"%(offset[i], orgname)
                 print >> fout, "    r.value  = (unsigned int)(*p);"
-                print >> fout, "    ioctl(fd_hwacc, SET_REG32, &r);"
+                print >> fout, "    "+stage_reg+"r.offset, r.value);"
             elif datawidth=="16":
                 print >> fout, "    if ((i&1)==0) {"
                 print >> fout, "        r.value  = 0;"
                 print >> fout, "        r.offset = %s + (unsigned long int)p - (unsigned long int)%s;"%(offset[i], orgname)
                 print >> fout, "    }"
                 print >> fout, "    r.value  |= (*(p+(i&1)))<<(16*(i&1));"
-                print >> fout, "    if (((i%2)==1)||(i==(%s-1))) ioctl(fd_hwacc, SET_REG32, &r);"%(size[i])
+                print >> fout, ("    if (((i%2)==1)||(i==(%s-1))) "+stage_reg+"r.offset, r.value);")%(size[i])
             else: # widht==8
                 print >> fout, "    if ((i&3)==0) {"
                 print >> fout, "        r.value  = 0;"
                 print >> fout, "        r.offset = %s + (unsigned long int)p - (unsigned long int)%s;"%(offset[i], orgname)
                 print >> fout, "    }"
                 print >> fout, "    r.value  |= (*(p+(i&3)))<<(8*(i&3));"
-                print >> fout, "    if (((i&3)==3)||(i==(%s-1))) ioctl(fd_hwacc, SET_REG32, &r);"%(size[i])
+                print >> fout, ("    if (((i&3)==3)||(i==(%s-1))) "+stage_reg+"r.offset, r.value);")%(size[i])
             print >> fout, "  }"
         print >> fout, "  return 0;"
         print >> fout, "}"
@@ -20,9 +20,11 @@ if __name__ == "__main__":
 
     #import pdb;pdb.set_trace()
 
-    # Extract register map table from the generated FIRRTL file
-    reg_map = {}
-    reg_map_pattern = re.compile("; 0x(\w+) : (\w+)$")
+    # Extract register map table from the generated FIRRTL file.
+    # Stencil elements are packed, "name [hi:lo], name [hi:lo], ...".
+    reg_map = {} # name -> (address, lo, width)
+    reg_map_pattern = re.compile("; 0x(\w+) : (\w+( \[\d+:\d+\])?(, \w+ \[\d+:\d+\])*)$")
+    field_pattern = re.compile("(\w+)( \[(\d+):(\d+)\])?")
     reg_map_begin = False
     with open(options.map) as f:
         for line in f:
@@ -39,7 +41,13 @@ if __name__ == "__main__":
             m = reg_map_pattern.match(line)
             if m :
                 #print line
-                reg_map[m.group(2)] = m.group(1)
+                for field in m.group(2).split(", "):
+                    fm = field_pattern.match(field)
+                    if fm.group(2):
+                        lo = int(fm.group(4))
+                        reg_map[fm.group(1)] = (m.group(1), lo, int(fm.group(3)) - lo + 1)
+                    else:
+                        reg_map[fm.group(1)] = (m.group(1), 0, 32)
 
     f.close()
 
@@ -48,15 +56,30 @@ if __name__ == "__main__":
 
     # Read configuration value from the generated param.dat dumped during test run.
     # and convert to physical offset file.
+    # Elements sharing a word are merged into one write.
     value_pattern = re.compile("(\w+) (-?\w+)$")
+    words = {}
+    order = []
     with open(options.value) as f:
-        with open(options.output, "w") as fw:
-            for line in f:
-                line = line.strip()
-                m = value_pattern.match(line)
-                if m :
-                    #print reg_map[m.group(1)], m.group(2)
-                    fw.write("%s %s\n"%(reg_map[m.group(1)], m.group(2)))
+        for line in f:
+            line = line.strip()
+            m = value_pattern.match(line)
+            if m :
+                addr, lo, width = reg_map[m.group(1)]
+                if width == 32:
+                    value = int(m.group(2))
+                else:
+                    value = (int(m.group(2)) & ((1 << width) - 1)) << lo
+                if not addr in words:
+                    words[addr] = 0
+                    order.append(addr)
+                words[addr] |= value
+
+    with open(options.output, "w") as fw:
+        for addr in order:
+            value = words[addr]
+            if value >= (1 << 31): value -= (1 << 32)
+            fw.write("%s %d\n"%(addr, value))
 
     f.close()
     fw.close()
@@ -3,9 +3,17 @@ set HLS_INC_FLAGS "-I${HALIDE_PATH}/include -I$env(RUN_PATH)/../hls_support"
 set INC_FLAGS "-I${HALIDE_PATH}/include -I${HALIDE_PATH}/tools -I$env(RUN_PATH)/../../support -I$env(RUN_PATH)/../hls_support"
 set LD_FLAGS "$env(RUN_PATH)/pipeline_native.o -lpthread -ldl -lpng12 -ljpeg"
 
+# The IP to synthesize and its project. hls_target.cpp holds all the
+# IPs of a pipeline, so further IPs (hls_target1, ...) are synthesized
+# by setting HLS_TOP and HLS_PRJ.
+set TOP hls_target
+if {[info exists env(HLS_TOP)]} { set TOP $env(HLS_TOP) }
+set PRJ hls_prj
+if {[info exists env(HLS_PRJ)]} { set PRJ $env(HLS_PRJ) }
+
 # creating the project and seting up the environtment
-open_project hls_prj
-set_top hls_target
+open_project $PRJ
+set_top $TOP
 add_files hls_target.cpp -cflags "-std=c++0x $HLS_INC_FLAGS"
 add_files -tb pipeline_hls.cpp -cflags "-std=c++0x $INC_FLAGS"
 add_files -tb run.cpp -cflags "-std=c++0x $INC_FLAGS"
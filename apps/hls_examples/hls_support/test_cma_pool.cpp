@@ -0,0 +1,151 @@
+// Exercises the CMA buffer pool of the Zynq runtime on a machine
+// without the Zynq drivers, with buffers backed by anonymous memory
+// (HL_ZYNQ_FAKE_CMA=1).
+#include "HalideRuntimeZynq.cpp"
+
+#include <string.h>
+
+static halide_dimension_t dims[8][2];
+static int num_bufs = 0;
+
+static halide_buffer_t make_buffer(int width, int height) {
+    assert(num_bufs < 8);
+    halide_buffer_t buf = halide_buffer_t();
+    buf.type.code = halide_type_uint;
+    buf.type.bits = 8;
+    buf.type.lanes = 1;
+    buf.dimensions = 2;
+    buf.dim = dims[num_bufs++];
+    buf.dim[0].min = 0;
+    buf.dim[0].extent = width;
+    buf.dim[0].stride = 1;
+    buf.dim[1].min = 0;
+    buf.dim[1].extent = height;
+    buf.dim[1].stride = width;
+    return buf;
+}
+
+static bool check_stats(const char *when, uint64_t hits, uint64_t misses,
+                        int in_use, uint64_t bytes_in_use,
+                        int cached, uint64_t bytes_cached) {
+    halide_zynq_cma_pool_stats_t stats;
+    halide_zynq_cma_pool_get_stats(&stats);
+    if (stats.hits != hits || stats.misses != misses ||
+        stats.buffers_in_use != in_use || stats.bytes_in_use != bytes_in_use ||
+        stats.buffers_cached != cached || stats.bytes_cached != bytes_cached) {
+        printf("%s: %llu hits, %llu misses, %d (%llu bytes) in use, %d (%llu bytes) cached, "
+               "expected %llu, %llu, %d (%llu), %d (%llu)\n", when,
+               (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+               stats.buffers_in_use, (unsigned long long)stats.bytes_in_use,
+               stats.buffers_cached, (unsigned long long)stats.bytes_cached,
+               (unsigned long long)hits, (unsigned long long)misses,
+               in_use, (unsigned long long)bytes_in_use,
+               cached, (unsigned long long)bytes_cached);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    setenv("HL_ZYNQ_FAKE_CMA", "1", 1);
+    if (halide_zynq_init() != 0) {
+        printf("halide_zynq_init() failed\n");
+        return -1;
+    }
+
+    // A new buffer comes from the driver, and stays mapped in the pool
+    // when it is freed.
+    halide_buffer_t a = make_buffer(64, 64);
+    if (halide_zynq_cma_alloc(&a) != 0 || a.host == NULL ||
+        a.device_interface != halide_zynq_device_interface()) {
+        printf("Allocating a failed\n");
+        return -1;
+    }
+    memset(a.host, 0x5a, 64 * 64);
+    uint8_t *a_host = a.host;
+    if (!check_stats("alloc a", 0, 1, 1, 4096, 0, 0)) return -1;
+    halide_zynq_cma_free(&a);
+    if (a.device != 0 || a.device_interface != NULL) {
+        printf("Freeing a did not detach it\n");
+        return -1;
+    }
+    if (!check_stats("free a", 0, 1, 0, 0, 1, 4096)) return -1;
+
+    // The same size, and a smaller one that uses more than half of the
+    // buffer, reuse it.
+    halide_buffer_t b = make_buffer(64, 64);
+    halide_zynq_cma_alloc(&b);
+    if (b.host != a_host || b.host[0] != 0x5a) {
+        printf("b does not reuse the buffer of a\n");
+        return -1;
+    }
+    if (!check_stats("alloc b", 1, 1, 1, 4096, 0, 0)) return -1;
+    halide_zynq_cma_free(&b);
+    halide_buffer_t c = make_buffer(48, 64);
+    halide_zynq_cma_alloc(&c);
+    if (c.host != a_host) {
+        printf("c does not reuse the buffer of a\n");
+        return -1;
+    }
+    cma_buffer_t *c_cbuf = (cma_buffer_t *)c.device;
+    if (c_cbuf->width != 48 || c_cbuf->height != 64 || c_cbuf->stride != 48) {
+        printf("The geometry of c is %dx%d, stride %d\n", c_cbuf->width, c_cbuf->height, c_cbuf->stride);
+        return -1;
+    }
+    if (!check_stats("alloc c", 2, 1, 1, 4096, 0, 0)) return -1;
+    halide_zynq_cma_free(&c);
+
+    // A buffer of half the size or less, or a larger one, does not.
+    halide_buffer_t d = make_buffer(32, 64);
+    halide_zynq_cma_alloc(&d);
+    halide_buffer_t e = make_buffer(128, 64);
+    halide_zynq_cma_alloc(&e);
+    if (d.host == a_host || e.host == a_host) {
+        printf("d or e reuses a buffer of the wrong size\n");
+        return -1;
+    }
+    if (!check_stats("alloc d, e", 2, 3, 2, 2048 + 8192, 1, 4096)) return -1;
+    halide_zynq_cma_free(&d);
+    halide_zynq_cma_free(&e);
+    if (!check_stats("free d, e", 2, 3, 0, 0, 3, 4096 + 2048 + 8192)) return -1;
+
+    // The smallest buffer that fits is taken: of 2048, 4096 and 8192
+    // bytes, only 4096 fits 2560 bytes without wasting more than half.
+    halide_buffer_t f = make_buffer(40, 64);
+    halide_zynq_cma_alloc(&f);
+    if (f.host != a_host) {
+        printf("f does not reuse the buffer of a\n");
+        return -1;
+    }
+    if (!check_stats("alloc f", 3, 3, 1, 4096, 2, 2048 + 8192)) return -1;
+
+    // Trimming releases cached buffers only, until at most the given
+    // number of bytes stays cached.
+    halide_zynq_cma_pool_trim(8192);
+    halide_zynq_cma_pool_stats_t stats;
+    halide_zynq_cma_pool_get_stats(&stats);
+    if (stats.buffers_in_use != 1 || stats.bytes_in_use != 4096 ||
+        stats.bytes_cached > 8192 || stats.buffers_cached != 1) {
+        printf("trim(8192) left %d (%llu bytes) in use, %d (%llu bytes) cached\n",
+               stats.buffers_in_use, (unsigned long long)stats.bytes_in_use,
+               stats.buffers_cached, (unsigned long long)stats.bytes_cached);
+        return -1;
+    }
+    if (f.host[0] != 0x5a) {
+        printf("Trimming touched a buffer in use\n");
+        return -1;
+    }
+    halide_zynq_cma_free(&f);
+    halide_zynq_cma_pool_trim(0);
+    if (!check_stats("trim(0)", 3, 3, 0, 0, 0, 0)) return -1;
+
+    // An empty pool serves the next allocation from the driver again.
+    halide_buffer_t g = make_buffer(64, 64);
+    halide_zynq_cma_alloc(&g);
+    if (!check_stats("alloc g", 3, 4, 1, 4096, 0, 0)) return -1;
+    halide_zynq_cma_free(&g);
+    halide_zynq_cma_pool_trim(0);
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,93 @@
+#include "Halide.h"
+
+using namespace Halide;
+
+Var x("x"), y("y");
+Var xo("xo"), xi("xi"), yi("yi"), yo("yo");
+
+// Two accelerators in one pipeline, each with a parameter of its own.
+// The first one scales the input by gain/16, the second one adds
+// offset. They become the IPs hls_target (/dev/hwacc0) and hls_target1
+// (/dev/hwacc1), whose parameters are set by halide_zynq_set__gain()
+// and halide_zynq_set_hls_target1_offset().
+class MyPipeline {
+    ImageParam input;
+    Param<uint8_t> gain;
+    Param<uint8_t> offset;
+    Func in1, hw_output1, scaled;
+    Func in2, hw_output2, output;
+    std::vector<Argument> args;
+
+public:
+    MyPipeline() : input(UInt(8), 2, "input"),
+                   gain("gain"), offset("offset"),
+                   in1("in1"), hw_output1("hw_output1"), scaled("scaled"),
+                   in2("in2"), hw_output2("hw_output2"), output("output") {
+        in1(x, y) = input(x, y);
+        hw_output1(x, y) = cast<uint8_t>(min(cast<uint16_t>(in1(x, y)) * gain / 16, 255));
+        scaled(x, y) = hw_output1(x, y);
+
+        in2(x, y) = scaled(x, y);
+        hw_output2(x, y) = cast<uint8_t>(min(cast<uint16_t>(in2(x, y)) + offset, 255));
+        output(x, y) = hw_output2(x, y);
+
+        args = {input, gain, offset};
+    }
+
+    void compile_cpu() {
+        std::cout << "\ncompiling cpu code..." << std::endl;
+
+        output.tile(x, y, xo, yo, xi, yi, 256, 256);
+        output.bound(x, 0, 256).bound(y, 0, 256);
+
+        output.compile_to_header("pipeline_native.h", args, "pipeline_native");
+        output.compile_to_object("pipeline_native.o", args, "pipeline_native");
+
+        std::vector<Target::Feature> features({Target::Zynq});
+        Target target(Target::Linux, Target::ARM, 32, features);
+        output.compile_to_header("pipeline_arm.h", args, "pipeline_native", target);
+        output.compile_to_object("pipeline_arm.o", args, "pipeline_native", target);
+    }
+
+    void compile_hls() {
+        std::cout << "\ncompiling HLS code..." << std::endl;
+
+        // The first accelerator produces scaled, tile by tile.
+        scaled.compute_root();
+        scaled.tile(x, y, xo, yo, xi, yi, 256, 256);
+        scaled.bound(x, 0, 256).bound(y, 0, 256);
+        in1.compute_at(scaled, xo);
+        hw_output1.compute_at(scaled, xo);
+        hw_output1.tile(x, y, xo, yo, xi, yi, 256, 256);
+        hw_output1.accelerate({in1}, xi, xo);
+
+        // The second one consumes it.
+        output.tile(x, y, xo, yo, xi, yi, 256, 256);
+        output.bound(x, 0, 256).bound(y, 0, 256);
+        in2.compute_at(output, xo);
+        hw_output2.compute_at(output, xo);
+        hw_output2.tile(x, y, xo, yo, xi, yi, 256, 256);
+        hw_output2.accelerate({in2}, xi, xo);
+
+        Target hls_target = get_target_from_environment();
+        hls_target.set_feature(Target::CPlusPlusMangling);
+        output.compile_to_hls("pipeline_hls.cpp", args, "pipeline_hls", hls_target);
+        output.compile_to_header("pipeline_hls.h", args, "pipeline_hls", hls_target);
+
+        std::vector<Target::Feature> features({Target::Zynq});
+        Target target(Target::Linux, Target::ARM, 32, features);
+        target.set_feature(Target::CPlusPlusMangling);
+        output.compile_to_zynq_c("pipeline_zynq.cpp", args, "pipeline_hls", target);
+        output.compile_to_header("pipeline_zynq.h", args, "pipeline_hls", target);
+    }
+};
+
+int main(int argc, char **argv) {
+    MyPipeline p1;
+    p1.compile_cpu();
+
+    MyPipeline p2;
+    p2.compile_hls();
+
+    return 0;
+}
@@ -0,0 +1,234 @@
+#include "AnalyzeDataflow.h"
+#include "SizeFIFODepths.h"
+#include "IROperator.h"
+#include "Simplify.h"
+#include "Debug.h"
+#include "Error.h"
+#include "Util.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::ostringstream;
+using std::string;
+using std::vector;
+
+namespace {
+
+int64_t gcd(int64_t a, int64_t b) {
+    while (b != 0) {
+        int64_t t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+// The number of windows shifted by STEP over the extent of BOUND, or
+// -1 if the extent is not constant.
+int64_t windows(const Interval &bound, int step) {
+    const int64_t *extent = as_const_int(simplify(bound.max - bound.min + 1));
+    if (!extent) {
+        return -1;
+    }
+    step = std::max(step, 1);
+    return (*extent + step - 1) / step;
+}
+
+// The number of stencils a kernel producing stencils of DIMS
+// (shifted by their steps) streams over REGION.
+int64_t stencils_over(const vector<StencilDimSpecs> &dims,
+                      const vector<StencilDimSpecs> &region) {
+    int64_t n = 1;
+    for (size_t i = 0; i < dims.size() && i < region.size(); i++) {
+        int64_t w = windows(region[i].store_bound, dims[i].step);
+        if (w < 0) {
+            return -1;
+        }
+        n *= w;
+    }
+    return n;
+}
+
+// Prints A/B in lowest terms.
+string print_rate(int64_t a, int64_t b) {
+    if (a < 0 || b <= 0) {
+        return "?";
+    }
+    int64_t g = gcd(a, b);
+    ostringstream oss;
+    oss << a / g;
+    if (b / g != 1) {
+        oss << "/" << b / g;
+    }
+    return oss.str();
+}
+
+}
+
+string analyze_dataflow(const HWKernelDAG &dag) {
+    ostringstream report;
+    report << "Dataflow analysis of HW kernel DAG " << dag.name << ":\n";
+
+    // Firings of every streamed kernel per frame, one per stencil.
+    map<string, int64_t> firings;
+    for (const auto &p : dag.kernels) {
+        const HWKernel &k = p.second;
+        if (!k.is_inlined) {
+            firings[k.name] = stencils_over(k.dims, k.dims);
+        }
+    }
+
+    report << " FIFOs:\n";
+    bool below_bound = false;
+    for (const auto &p : dag.kernels) {
+        const HWKernel &producer = p.second;
+        if (producer.is_inlined) {
+            continue;
+        }
+        for (const auto &c : producer.consumer_stencils) {
+            const string &consumer = c.first;
+            if (consumer == producer.name || !firings.count(consumer)) {
+                continue;
+            }
+            if (producer.is_ping_pong) {
+                // The consumer reads the memory at random and waits
+                // for the whole tile, so there is no FIFO to bound.
+                report << "  " << producer.name << " -> " << consumer
+                       << ": ping-pong buffer of 2 x " << firings[producer.name] << " stencils\n";
+                continue;
+            }
+            int64_t tokens = stencils_over(producer.dims, c.second);
+            int depth = producer.consumer_fifo_depths.count(consumer) ?
+                producer.consumer_fifo_depths.find(consumer)->second : 0;
+            int bound = required_fifo_depth(dag, producer.name, consumer);
+            report << "  " << producer.name << " -> " << consumer
+                   << ": " << tokens << " of " << firings[producer.name] << " stencils per frame"
+                   << ", " << print_rate(tokens, firings[consumer]) << " per firing of " << consumer
+                   << ", depth " << depth << " (bound " << bound << ")";
+            if (depth < bound) {
+                // The dispatcher only forwards a stencil when every
+                // consumer FIFO has room, so a full FIFO on the short
+                // path of a reconvergent pair may starve the long one.
+                report << " BELOW BOUND";
+                below_bound = true;
+                user_warning << "The FIFO from " << producer.name << " to " << consumer
+                             << " has depth " << depth << ", but the latency estimate has " << consumer
+                             << " wait " << bound << " stencils for its other inputs."
+                             << " The design may stall or deadlock; increase the depth with Func::fifo_depth().\n";
+            }
+            report << "\n";
+        }
+    }
+
+    // The kernels run concurrently, so the one with the most cycles per
+    // frame bounds the throughput of the DAG.
+    report << " Kernels:\n";
+    string bottleneck;
+    int64_t period = 0;
+    int64_t latency = 0;
+    for (const auto &p : firings) {
+        const HWKernel &k = dag.kernels.find(p.first)->second;
+        int64_t cycles = p.second < 0 ? -1 : p.second * k.initiation_interval;
+        if (cycles > period) {
+            period = cycles;
+            bottleneck = k.name;
+        }
+        latency = std::max(latency, hw_kernel_start_time(dag, k.name) + cycles);
+    }
+    for (const auto &p : firings) {
+        const HWKernel &k = dag.kernels.find(p.first)->second;
+        int64_t cycles = p.second < 0 ? -1 : p.second * k.initiation_interval;
+        report << "  " << k.name << ": " << p.second << " firings, II " << k.initiation_interval
+               << ", " << cycles << " cycles per frame";
+        if (cycles > 0 && period > 0) {
+            report << ", " << (100 * cycles / period) << "% busy";
+        }
+        report << "\n";
+    }
+    report << " Steady state: " << period << " cycles per frame, bound by " << bottleneck
+           << "; latency " << latency << " cycles\n";
+    if (below_bound) {
+        report << " Some FIFOs are below the estimated bound; the DAG may deadlock.\n";
+    }
+
+    debug(1) << report.str();
+
+    string file = get_env_variable("HL_DATAFLOW_REPORT");
+    if (!file.empty()) {
+        std::ofstream out(file, std::ios::app);
+        user_assert(out) << "Could not open dataflow report file " << file << "\n";
+        out << report.str();
+    }
+    return report.str();
+}
+
+namespace {
+
+vector<StencilDimSpecs> test_window(int size, int extent) {
+    StencilDimSpecs d;
+    d.size = size;
+    d.step = 1;
+    d.min_pos = 0;
+    d.store_bound = Interval(0, extent - 1);
+    return {d, d};
+}
+
+HWKernel test_kernel(const string &name, const vector<string> &inputs) {
+    HWKernel k(Function(name), name);
+    k.dims = test_window(1, 64);
+    k.input_streams = inputs;
+    return k;
+}
+
+bool contains(const string &report, const string &s) {
+    return report.find(s) != string::npos;
+}
+
+}
+
+void analyze_dataflow_test() {
+    // A reconvergent DAG over a 64x64 tile: blur reads a 3x3 window
+    // of in, and out reads both in and blur.
+    HWKernelDAG dag;
+    dag.name = "out";
+    HWKernel in = test_kernel("in", {});
+    in.consumer_stencils["blur"] = test_window(3, 64);
+    in.consumer_stencils["out"] = test_window(1, 64);
+    HWKernel blur = test_kernel("blur", {"in"});
+    blur.consumer_stencils["out"] = test_window(1, 64);
+    blur.initiation_interval = 2;
+    HWKernel out = test_kernel("out", {"in", "blur"});
+    out.is_output = true;
+    dag.kernels["in"] = in;
+    dag.kernels["blur"] = blur;
+    dag.kernels["out"] = out;
+
+    // With the FIFOs sized, no FIFO is below its bound. blur fires
+    // once per pixel, every 2 cycles, and bounds the throughput.
+    size_fifo_depths(dag);
+    string report = analyze_dataflow(dag);
+    internal_assert(!contains(report, "BELOW BOUND")) << report;
+    internal_assert(contains(report, "in -> out: 4096 of 4096 stencils per frame, 1 per firing of out")) << report;
+    internal_assert(contains(report, "blur: 4096 firings, II 2, 8192 cycles per frame, 100% busy")) << report;
+    internal_assert(contains(report, "Steady state: 8192 cycles per frame, bound by blur")) << report;
+
+    // The short path of the reconvergent pair is too shallow to
+    // cover the rows blur waits for.
+    dag.kernels["in"].consumer_fifo_depths["out"] = 2;
+    report = analyze_dataflow(dag);
+    internal_assert(contains(report, "in -> out: 4096 of 4096 stencils per frame, 1 per firing of out, "
+                             "depth 2 (bound 134) BELOW BOUND")) << report;
+    internal_assert(contains(report, "in -> blur: 4096 of 4096 stencils per frame, 1 per firing of blur, "
+                             "depth 0 (bound 0)\n")) << report;
+
+    debug(0) << "analyze_dataflow test passed\n";
+}
+
+}
+}
@@ -0,0 +1,41 @@
+#ifndef HALIDE_ANALYZE_DATAFLOW_H
+#define HALIDE_ANALYZE_DATAFLOW_H
+
+/** \file
+ *
+ * Defines the static deadlock and throughput analysis of HW kernel DAGs
+ */
+
+#include "ExtractHWKernelDAG.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Analyze the DAG as a synchronous dataflow graph and report the
+ * result. Every streamed kernel is an actor that produces one stencil
+ * per firing, every initiation_interval cycles; over a frame it fires
+ * once per step of its store region, and each consumer takes the
+ * stencils of its own region. The report lists, for every FIFO, the
+ * stencils it carries per frame, the consumption rate and its depth
+ * against the bound required by the latency model of
+ * size_fifo_depths(), and, for every kernel, the cycles per frame. A
+ * FIFO shallower than its bound is reported with a warning, as the
+ * design may stall or deadlock on a reconvergent path. The bound is
+ * the estimate of size_fifo_depths(), with a fixed latency per
+ * kernel, so it is neither a proof of a deadlock nor of its absence.
+ * A ping-pong buffered kernel hands its whole tile to its consumer
+ * instead (see Func::ping_pong()). The slowest kernel bounds the
+ * steady-state throughput.
+ *
+ * The report is printed at debug level 1, appended to the file named
+ * by the environment variable HL_DATAFLOW_REPORT if it is set, and
+ * returned.
+ */
+std::string analyze_dataflow(const HWKernelDAG &dag);
+
+EXPORT void analyze_dataflow_test();
+
+}
+}
+
+#endif
@@ -0,0 +1,181 @@
+#include "CoScheduleHWTiles.h"
+#include "IRMutator.h"
+#include "IROperator.h"
+#include "Scope.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+
+namespace {
+
+// Checks whether the body of a loop may run its iterations
+// concurrently next to the accelerator.
+class AnalyzeTileBody : public IRVisitor {
+    const Scope<int> &outer_allocations;
+    Scope<int> inner_allocations;
+    int loop_depth;
+
+    using IRVisitor::visit;
+
+    void check_write(const string &name) {
+        if (outer_allocations.contains(name) && !inner_allocations.contains(name)) {
+            debug(3) << "  writes " << name << ", allocated outside the loop\n";
+            safe = false;
+        }
+    }
+
+    void visit(const ProducerConsumer *op) {
+        if (op->is_producer && starts_with(op->name, "_hls_target.")) {
+            // The hardware loops inside are not host work.
+            if (loop_depth == 0) {
+                launches++;
+            } else {
+                nested_launch = true;
+            }
+        } else {
+            IRVisitor::visit(op);
+        }
+    }
+
+    void visit(const For *op) {
+        host_work = true;
+        loop_depth++;
+        IRVisitor::visit(op);
+        loop_depth--;
+    }
+
+    void visit(const Store *op) {
+        host_work = true;
+        check_write(op->name);
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Allocate *op) {
+        inner_allocations.push(op->name, 0);
+        IRVisitor::visit(op);
+        inner_allocations.pop(op->name);
+    }
+
+    void visit(const Call *op) {
+        if (op->is_intrinsic("stream_subimage")) {
+            // The DMA may write the buffer; stream_subimage refers to
+            // it by its buffer_t, named <buffer>.buffer.
+            const Variable *buffer_var = op->args[1].as<Variable>();
+            internal_assert(buffer_var);
+            string name = buffer_var->name;
+            if (ends_with(name, ".buffer")) {
+                name = name.substr(0, name.size() - 7);
+            }
+            check_write(name);
+        }
+        IRVisitor::visit(op);
+    }
+
+public:
+    int launches;
+    bool nested_launch;
+    bool host_work;
+    bool safe;
+
+    AnalyzeTileBody(const Scope<int> &o)
+        : outer_allocations(o), loop_depth(0),
+          launches(0), nested_launch(false), host_work(false), safe(true) {}
+};
+
+class CoScheduleHWTiles : public IRMutator {
+    Scope<int> allocations;
+    int parallel_depth;
+
+    using IRMutator::visit;
+
+    void visit(const Allocate *op) {
+        allocations.push(op->name, 0);
+        IRMutator::visit(op);
+        allocations.pop(op->name);
+    }
+
+    void visit(const For *op) {
+        if (op->for_type != ForType::Serial || parallel_depth > 0) {
+            parallel_depth += op->is_parallel();
+            IRMutator::visit(op);
+            parallel_depth -= op->is_parallel();
+            return;
+        }
+
+        AnalyzeTileBody tile(allocations);
+        op->body.accept(&tile);
+        // Only loops over the pure definition can be reordered.
+        bool pure = op->name.find(".s0.") != string::npos;
+        if (tile.launches == 1 && !tile.nested_launch &&
+            tile.host_work && tile.safe && pure) {
+            debug(1) << "Overlapping host stages with the accelerator in loop "
+                     << op->name << "\n";
+            stmt = For::make(op->name, op->min, op->extent,
+                             ForType::Parallel, op->device_api, op->body);
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+public:
+    CoScheduleHWTiles() : parallel_depth(0) {}
+};
+
+}
+
+Stmt co_schedule_hw_tiles(Stmt s) {
+    return CoScheduleHWTiles().mutate(s);
+}
+
+namespace {
+
+// Whether the outermost loop of S is parallel after the pass.
+bool co_scheduled(Stmt s) {
+    const For *loop = co_schedule_hw_tiles(s).as<For>();
+    internal_assert(loop);
+    return loop->for_type == ForType::Parallel;
+}
+
+}
+
+void co_schedule_hw_tiles_test() {
+    Expr x = Variable::make(Int(32), "x");
+    Stmt launch = ProducerConsumer::make("_hls_target.hw_output", true, Evaluate::make(0));
+    Stmt post = Store::make("output", x, x, Parameter(), const_true());
+    Stmt pre = Store::make("in", x, x, Parameter(), const_true());
+    Stmt per_tile_pre = Allocate::make("in", Int(32), {64}, const_true(), Block::make(pre, launch));
+
+    // A tile loop that launches the accelerator and post-processes
+    // into the output qualifies.
+    internal_assert(co_scheduled(For::make("output.s0.x.xo", 0, 16, ForType::Serial, DeviceAPI::None,
+                                           Block::make(launch, post))));
+
+    // So does one that pre-processes into a buffer of its own.
+    internal_assert(co_scheduled(For::make("output.s0.x.xo", 0, 16, ForType::Serial, DeviceAPI::None,
+                                           per_tile_pre)));
+
+    // There is nothing to overlap without host work...
+    internal_assert(!co_scheduled(For::make("output.s0.x.xo", 0, 16, ForType::Serial, DeviceAPI::None,
+                                            launch)));
+
+    // ...or with more than one launch per iteration.
+    internal_assert(!co_scheduled(For::make("output.s0.x.xo", 0, 16, ForType::Serial, DeviceAPI::None,
+                                            Block::make({launch, launch, post}))));
+
+    // A buffer allocated outside the loop is shared by the iterations.
+    Stmt shared = Allocate::make("in", Int(32), {64}, const_true(),
+                                 For::make("output.s0.x.xo", 0, 16, ForType::Serial, DeviceAPI::None,
+                                           Block::make(pre, launch)));
+    internal_assert(co_schedule_hw_tiles(shared).as<Allocate>()->body.as<For>()->for_type == ForType::Serial);
+
+    // Update definitions run in order.
+    internal_assert(!co_scheduled(For::make("output.s1.x.xo", 0, 16, ForType::Serial, DeviceAPI::None,
+                                            Block::make(launch, post))));
+
+    debug(0) << "co_schedule_hw_tiles test passed\n";
+}
+
+}
+}
@@ -0,0 +1,34 @@
+#ifndef HALIDE_CO_SCHEDULE_HW_TILES_H
+#define HALIDE_CO_SCHEDULE_HW_TILES_H
+
+/** \file
+ * Defines the lowering pass that overlaps the host stages of a tiled
+ * pipeline with the hardware accelerator
+ */
+
+#include "IR.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Run the tile loop around an accelerator launch on the thread pool.
+ * A serial loop qualifies when it launches an accelerator once per
+ * iteration, also computes host stages (e.g. the pre-processing of
+ * the accelerator inputs and the output(x, y) = hw_output(x, y)
+ * post-processing), and only writes buffers allocated per iteration
+ * or the pipeline outputs. While the fabric processes one tile, other
+ * threads then pre-process the next tiles and post-process the
+ * previous ones.
+ *
+ * The pass is run by the Zynq LLVM code generator on the lowered
+ * functions, as parallel loops run on the Halide thread pool there.
+ * The Zynq C code generator has no thread pool, so it keeps the loop
+ * serial and pipelines the runs of the accelerator instead. */
+Stmt co_schedule_hw_tiles(Stmt s);
+
+EXPORT void co_schedule_hw_tiles_test();
+
+}
+}
+
+#endif
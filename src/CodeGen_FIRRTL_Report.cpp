@@ -0,0 +1,381 @@
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+
+#include "CodeGen_FIRRTL_Report.h"
+#include "IROperator.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::string;
+using std::vector;
+
+double firrtl_op_delay(const string &op, int bits) {
+    if (op == "add" || op == "sub" || op == "neg" ||
+        op == "lt" || op == "leq" || op == "gt" || op == "geq" ||
+        op == "eq" || op == "neq") {
+        return 0.5 + 0.03 * bits; // carry chain
+    } else if (op == "mul") {
+        return bits <= 18 ? 3.0 : 4.5; // one or two DSP slices
+    } else if (op == "div" || op == "rem") {
+        return 0.4 * bits * std::ceil(std::log2((double)std::max(bits, 2)));
+    } else if (op == "dshl" || op == "dshr") {
+        return 0.3 * std::ceil(std::log2((double)std::max(bits, 2)));
+    } else if (op == "mux" || op == "and" || op == "or" || op == "xor" || op == "not" ||
+               op == "andr" || op == "orr" || op == "xorr") {
+        return 0.4;
+    }
+    return 0;
+}
+
+namespace {
+
+// Clock-to-output delay of a block RAM read port in ns.
+const double bram_clock_to_out = 2.1;
+
+// Memories smaller than this many bits map to distributed RAM.
+const long distributed_ram_bits = 1024;
+
+// Bits of a counter from 0 to max.
+int counter_bits(long max) {
+    return std::max((int)std::ceil(std::log2((double)max + 1)), 1);
+}
+
+// Bits of all the elements of a stencil type.
+long stencil_bits(const FIRRTL_Type &t) {
+    long bits = t.elemType.bits();
+    for (const Range &r : t.bounds) {
+        const int64_t *e = as_const_int(r.extent);
+        bits *= e ? *e : 1;
+    }
+    return bits;
+}
+
+vector<int> stencil_extents(const FIRRTL_Type &t) {
+    vector<int> extents;
+    for (const Range &r : t.bounds) {
+        const int64_t *e = as_const_int(r.extent);
+        extents.push_back(e ? (int)*e : 1);
+    }
+    return extents;
+}
+
+// LUTs of a FIRRTL primitive operation on BITS-wide values.
+long op_luts(const string &op, int bits) {
+    if (op == "add" || op == "sub" || op == "neg" ||
+        op == "mux" || op == "and" || op == "or" || op == "xor" || op == "not") {
+        return bits;
+    } else if (op == "lt" || op == "leq" || op == "gt" || op == "geq" ||
+               op == "eq" || op == "neq") {
+        return (bits + 1) / 2;
+    } else if (op == "div" || op == "rem") {
+        return (long)bits * bits;
+    } else if (op == "dshl" || op == "dshr") {
+        return bits * counter_bits(bits);
+    } else if (op == "andr" || op == "orr" || op == "xorr") {
+        return (bits + 5) / 6;
+    }
+    return 0;
+}
+
+// DSP48 slices of a BITS x BITS multiplier, built from 25x18 products.
+long mul_dsps(int bits) {
+    return (long)((bits + 23) / 24) * ((bits + 16) / 17);
+}
+
+string component_type_name(ComponentType t) {
+    switch (t) {
+    case ComponentType::Input: return "InputIO";
+    case ComponentType::Output: return "OutputIO";
+    case ComponentType::Linebuffer: return "LineBuffer";
+    case ComponentType::Fifo: return "FIFO";
+    case ComponentType::Dispatcher: return "Dispatch";
+    case ComponentType::Forblock: return "ForBlock";
+    case ComponentType::Slaveif: return "SlaveIf";
+    case ComponentType::Pingpong: return "PingPong";
+    default: return "Other";
+    }
+}
+
+}
+
+void CodeGen_FIRRTL_Report::add_memory(Estimate &e, long depth, long width) {
+    if (depth * width < distributed_ram_bits) {
+        e.lut += width * ((depth + 63) / 64);
+        return;
+    }
+    // The cheapest of the aspect ratios of a RAMB18.
+    const int widths[] = {1, 2, 4, 9, 18, 36};
+    const int depths[] = {16384, 8192, 4096, 2048, 1024, 512};
+    long best = -1;
+    for (int k = 0; k < 6; k++) {
+        long n = ((width + widths[k] - 1) / widths[k]) * ((depth + depths[k] - 1) / depths[k]);
+        if (best < 0 || n < best) {
+            best = n;
+        }
+    }
+    e.bram18 += best;
+}
+
+CodeGen_FIRRTL_Report::Estimate CodeGen_FIRRTL_Report::estimate_io(IO *c) {
+    // AXI stream conversion with TLAST/position counters.
+    Estimate e;
+    long width = 0;
+    for (auto &p : c->getOutputs()) {
+        width = std::max(width, stencil_bits(p.second));
+    }
+    for (auto &p : c->getInputs()) {
+        width = std::max(width, stencil_bits(p.second));
+    }
+    int dims = std::max((int)c->getStoreExtents().size(), 1);
+    e.ff = width + 32 * dims + 2;
+    e.lut = width / 4 + 32 * dims;
+    e.critical_path = firrtl_op_delay("add", 32) + firrtl_op_delay("eq", 32) + firrtl_op_delay("and", 1);
+    return e;
+}
+
+CodeGen_FIRRTL_Report::Estimate CodeGen_FIRRTL_Report::estimate_fifo(FIFO *c) {
+    // DEPTH + 1 entries of an asynchronous-read memory, pointers and
+    // an output register (see print_fifo()).
+    Estimate e;
+    long width = 0;
+    for (auto &p : c->getInputs()) {
+        width = stencil_bits(p.second);
+    }
+    long entries = std::stol(c->getDepth()) + 1;
+    int ptr_bits = counter_bits(entries - 1);
+    int level_bits = counter_bits(entries);
+    e.lut = width * ((entries + 63) / 64) + 2 * ptr_bits + level_bits + width;
+    e.ff = width + 2 * ptr_bits + level_bits + 3;
+    e.critical_path = firrtl_op_delay("add", ptr_bits) + firrtl_op_delay("eq", ptr_bits) +
+        firrtl_op_delay("mux", (int)width);
+    return e;
+}
+
+CodeGen_FIRRTL_Report::Estimate CodeGen_FIRRTL_Report::estimate_linebuffer(LineBuffer *c) {
+    Estimate e;
+    FIRRTL_Type in, out;
+    for (auto &p : c->getInputs()) {
+        in = p.second;
+    }
+    for (auto &p : c->getOutputs()) {
+        out = p.second;
+    }
+    vector<int> inEl = stencil_extents(in);
+    vector<int> outEl = stencil_extents(out);
+    vector<int> L = c->getStoreExtents();
+    int bits = in.elemType.bits();
+
+    // The output window is assembled in registers.
+    e.ff = stencil_bits(out);
+    e.lut = stencil_bits(out);
+    e.critical_path = firrtl_op_delay("mux", bits);
+
+    // Rows (or planes) of the highest dimension the window grows in
+    // are buffered in banks, one per buffered slice, addressed by
+    // input word.
+    int top = -1;
+    for (size_t d = 0; d < inEl.size() && d < outEl.size(); d++) {
+        if (outEl[d] != inEl[d]) {
+            top = d;
+        }
+    }
+    if (top > 0) {
+        long banks = outEl[top] / std::max(inEl[top], 1) - 1;
+        long words = 1;
+        for (int d = 0; d < top && d < (int)L.size(); d++) {
+            words *= L[d] / std::max(inEl[d], 1);
+        }
+        for (long b = 0; b < banks; b++) {
+            add_memory(e, words, stencil_bits(in));
+        }
+        int col_bits = counter_bits(words);
+        e.ff += 2 * col_bits + counter_bits(banks);
+        e.lut += 2 * col_bits + stencil_bits(out);
+        double read = banks > 0 && words * stencil_bits(in) >= distributed_ram_bits ? bram_clock_to_out : 0.5;
+        e.critical_path = std::max(firrtl_op_delay("add", col_bits) + firrtl_op_delay("eq", col_bits) +
+                                   firrtl_op_delay("mux", col_bits),
+                                   read + 2 * firrtl_op_delay("mux", bits));
+    }
+    return e;
+}
+
+CodeGen_FIRRTL_Report::Estimate CodeGen_FIRRTL_Report::estimate_dispatch(Dispatch *c) {
+    // A position counter per dimension and a window compare per
+    // consumer and dimension.
+    Estimate e;
+    vector<int> store = c->getStoreExtents();
+    int counter_total = 0, widest = 1;
+    for (int s : store) {
+        int b = counter_bits(s);
+        counter_total += b;
+        widest = std::max(widest, b);
+    }
+    int consumers = std::max(c->getNumOfConsumer(), 1);
+    e.ff = counter_total + consumers;
+    e.lut = 2 * counter_total + consumers * counter_total;
+    e.critical_path = firrtl_op_delay("add", widest) + firrtl_op_delay("geq", widest) +
+        firrtl_op_delay("and", 1) + firrtl_op_delay("mux", widest);
+    return e;
+}
+
+CodeGen_FIRRTL_Report::Estimate CodeGen_FIRRTL_Report::estimate_pingpong(PingPong *c) {
+    // Two banks of the whole tile, a position counter per dimension,
+    // the element counter and the bank flags (see print_pingpong()).
+    // The read port adds an address computation and a bank select,
+    // and the write port an element select.
+    Estimate e;
+    int bits = 0;
+    for (auto &p : c->getInputs()) {
+        bits = p.second.elemType.bits();
+    }
+    long depth = 1;
+    for (int s : c->getStoreExtents()) {
+        depth *= s;
+    }
+    add_memory(e, depth, bits);
+    add_memory(e, depth, bits);
+    int dims = std::max((int)c->getStoreExtents().size(), 1);
+    int elems = 1;
+    for (int s : c->getStencilSteps()) {
+        elems *= s;
+    }
+    int ports = c->getNumOfReads() > 0 ? 1 : 0;
+    e.ff = 32 * (dims + 1) + 5;
+    e.lut = 2 * 32 * (dims + 1) + elems * (bits + 32) + ports * (32 * dims + bits);
+    double read = depth * bits >= distributed_ram_bits ? bram_clock_to_out : 0.5;
+    // The read address is registered in the memory, so the address
+    // computation and the bank select are in different stages.
+    e.critical_path = std::max(std::max(firrtl_op_delay("mul", 32) + dims * firrtl_op_delay("add", 32),
+                                        read + firrtl_op_delay("mux", bits)),
+                               firrtl_op_delay("add", 32) + firrtl_op_delay("eq", 32) + firrtl_op_delay("mux", 1));
+    return e;
+}
+
+CodeGen_FIRRTL_Report::Estimate CodeGen_FIRRTL_Report::estimate_forblock(ForBlock *c) {
+    Estimate e;
+    for (auto &p : c->getOperations()) {
+        for (auto &b : p.second) {
+            if (p.first == "mul") {
+                e.dsp += mul_dsps(b.first) * b.second;
+            } else {
+                e.lut += op_luts(p.first, b.first) * b.second;
+            }
+        }
+    }
+
+    // Datapath registers, loop counters and the pipeline control.
+    int depth = c->getPipelineDepth();
+    for (auto &p : c->getRegs()) {
+        e.ff += stencil_bits(p.second);
+    }
+    e.ff += 32 * c->getVars().size() + 32 * (depth + 1) * c->getStencilVars().size() + 2 * depth + 4;
+    e.lut += 32 * (c->getVars().size() + c->getStencilVars().size()) * 2;
+    if (c->getInitiationInterval() > 1) {
+        e.ff += counter_bits(c->getInitiationInterval() - 1);
+    }
+    e.critical_path = std::max(c->getCriticalPath(), firrtl_op_delay("add", 32) + firrtl_op_delay("eq", 32));
+    return e;
+}
+
+CodeGen_FIRRTL_Report::Estimate CodeGen_FIRRTL_Report::estimate_slaveif(SlaveIf *c) {
+    // AXI-lite decoding, the configuration registers with stencil
+    // elements packed into 32-bit words, and the shadow bank.
+    Estimate e;
+    long regs = 0, words = 0;
+    for (auto &p : c->getRegs()) {
+        if (p.second.type == FIRRTL_Type::StencilContainerType::Stencil) {
+            long elems = stencil_bits(p.second) / p.second.elemType.bits();
+            int lanes = SlaveIf::lanesPerWord(p.second.elemType.bits());
+            long w = (elems + lanes - 1) / lanes;
+            e.ff += 32 * w;
+            words += w;
+        } else {
+            e.ff += p.second.elemType.bits();
+            words++;
+        }
+        regs++;
+    }
+    e.lut = 150 + e.ff / 4;
+    add_memory(e, words, 32);
+    e.ff += 80 + 64;
+    e.critical_path = firrtl_op_delay("eq", 32) + firrtl_op_delay("mux", 32) * counter_bits(regs);
+    return e;
+}
+
+void CodeGen_FIRRTL_Report::print_estimate(const Estimate &e) {
+    stream << "\"lut\": " << e.lut
+           << ", \"ff\": " << e.ff
+           << ", \"dsp\": " << e.dsp
+           << ", \"bram18\": " << e.bram18
+           << ", \"critical_path_ns\": " << std::fixed << std::setprecision(2) << e.critical_path;
+}
+
+void CodeGen_FIRRTL_Report::print(TopLevel *top) {
+    Estimate total;
+    stream << "{\n";
+    stream << "  \"design\": \"" << top->getInstanceName() << "\",\n";
+    stream << "  \"components\": [";
+
+    bool first = true;
+    for (auto &i : top->getInstances()) {
+        Component *c = top->getComponent(i.second);
+        Estimate e;
+        switch (c->getType()) {
+        case ComponentType::Input:
+        case ComponentType::Output:
+            e = estimate_io(static_cast<IO *>(c));
+            break;
+        case ComponentType::Fifo:
+            e = estimate_fifo(static_cast<FIFO *>(c));
+            break;
+        case ComponentType::Linebuffer:
+            e = estimate_linebuffer(static_cast<LineBuffer *>(c));
+            break;
+        case ComponentType::Dispatcher:
+            e = estimate_dispatch(static_cast<Dispatch *>(c));
+            break;
+        case ComponentType::Forblock:
+            e = estimate_forblock(static_cast<ForBlock *>(c));
+            break;
+        case ComponentType::Slaveif:
+            e = estimate_slaveif(static_cast<SlaveIf *>(c));
+            break;
+        case ComponentType::Pingpong:
+            e = estimate_pingpong(static_cast<PingPong *>(c));
+            break;
+        default:
+            break;
+        }
+        total.lut += e.lut;
+        total.ff += e.ff;
+        total.dsp += e.dsp;
+        total.bram18 += e.bram18;
+        total.critical_path = std::max(total.critical_path, e.critical_path);
+
+        stream << (first ? "\n" : ",\n");
+        stream << "    {\"instance\": \"" << i.first << "\", \"module\": \"" << i.second
+               << "\", \"type\": \"" << component_type_name(c->getType()) << "\", ";
+        print_estimate(e);
+        if (c->getType() == ComponentType::Forblock) {
+            ForBlock *fb = static_cast<ForBlock *>(c);
+            stream << ", \"pipeline_depth\": " << fb->getPipelineDepth()
+                   << ", \"initiation_interval\": " << fb->getInitiationInterval();
+        } else if (c->getType() == ComponentType::Fifo) {
+            stream << ", \"depth\": " << static_cast<FIFO *>(c)->getDepth();
+        }
+        stream << "}";
+        first = false;
+    }
+    stream << "\n  ],\n";
+    stream << "  \"total\": {";
+    print_estimate(total);
+    stream << "}\n";
+    stream << "}\n";
+}
+
+}
+}
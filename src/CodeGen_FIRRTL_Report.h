@@ -0,0 +1,64 @@
+#ifndef HALIDE_CODEGEN_FIRRTL_REPORT_H
+#define HALIDE_CODEGEN_FIRRTL_REPORT_H
+
+/** \file
+ *
+ * Defines the resource and timing estimation report of the FIRRTL
+ * component graph
+ */
+#include <string>
+
+#include "Component.h"
+
+namespace Halide {
+
+namespace Internal {
+
+/** Rough combinational delay in ns of a FIRRTL primitive operation on
+ * BITS-wide values, after mapping to a 7-series FPGA. Operations that
+ * only select or extend bits are free. */
+double firrtl_op_delay(const std::string &op, int bits);
+
+/** This class emits a JSON report of the design rooted at a TopLevel
+ * component, with estimated LUT, FF, DSP and BRAM18 counts and the
+ * critical path of every component instance and of the whole design.
+ * The estimates follow the structure print_*() emits for each
+ * component type (FIFO depth times width, line buffer banks, ForBlock
+ * operations by bit width), so that infeasible schedules can be
+ * pruned without running synthesis.
+ */
+class CodeGen_FIRRTL_Report {
+public:
+    CodeGen_FIRRTL_Report(std::ostream &s) : stream(s) {}
+
+    /** Emit the report of the design rooted at TOP. */
+    void print(TopLevel *top);
+
+protected:
+    std::ostream &stream;
+
+    struct Estimate {
+        long lut, ff, dsp, bram18;
+        double critical_path; // ns
+        Estimate() : lut(0), ff(0), dsp(0), bram18(0), critical_path(0) {}
+    };
+
+    Estimate estimate_io(IO *c);
+    Estimate estimate_fifo(FIFO *c);
+    Estimate estimate_linebuffer(LineBuffer *c);
+    Estimate estimate_dispatch(Dispatch *c);
+    Estimate estimate_pingpong(PingPong *c);
+    Estimate estimate_forblock(ForBlock *c);
+    Estimate estimate_slaveif(SlaveIf *c);
+
+    /** Adds a memory of DEPTH words of WIDTH bits to E, as block RAM
+     * or, when small, as distributed RAM. */
+    void add_memory(Estimate &e, long depth, long width);
+
+    void print_estimate(const Estimate &e);
+};
+
+}
+}
+
+#endif
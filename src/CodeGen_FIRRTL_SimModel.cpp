@@ -0,0 +1,664 @@
+#include <iostream>
+#include <sstream>
+
+#include "CodeGen_FIRRTL_SimModel.h"
+#include "IROperator.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::ostringstream;
+using std::string;
+using std::vector;
+
+namespace {
+
+// The simulation kernel shared by all generated models. Every
+// component is stepped once per cycle and decides using only the
+// registered state of the FIFOs, so the stepping order does not
+// matter; FIFOs commit the transfers at the end of the cycle.
+const string sim_kernel = R"INLINE_CODE(
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace {
+
+long cycle = 0;
+
+// A FIFO as emitted by print_fifo(): DEPTH + 1 storage entries followed
+// by an output register. 'full' is registered, so space freed by a pop
+// is visible to the producer one cycle later.
+struct Fifo {
+    std::string name;
+    int depth;
+    int level;
+    bool out_valid, full, pushed, taken, moved;
+    std::vector<long> histogram; // cycles spent at each occupancy
+
+    Fifo(const char *n, int d)
+        : name(n), depth(d), level(0), out_valid(false), full(false),
+          pushed(false), taken(false), moved(false), histogram(d + 3, 0) {}
+
+    bool can_read() const { return out_valid; }
+    bool can_write() const { return !full; }
+    void read() { taken = true; }
+    void write() { pushed = true; }
+
+    void tick() {
+        histogram[level + (out_valid ? 1 : 0)]++;
+        bool pop = (taken || !out_valid) && level > 0;
+        if (pop) {
+            level--;
+            out_valid = true;
+        } else if (taken) {
+            out_valid = false;
+        }
+        if (pushed) {
+            level++;
+        }
+        full = level > depth;
+        moved = pop || pushed || taken;
+        pushed = taken = false;
+    }
+};
+
+bool all_readable(const std::vector<Fifo *> &fifos) {
+    for (Fifo *f : fifos) {
+        if (!f->can_read()) return false;
+    }
+    return true;
+}
+
+bool all_writable(const std::vector<Fifo *> &fifos) {
+    for (Fifo *f : fifos) {
+        if (!f->can_write()) return false;
+    }
+    return true;
+}
+
+// Walks an N-D position from 0 to MAX (inclusive) by STEP, dimension 0
+// innermost.
+struct Counter {
+    std::vector<int> pos, max, step;
+
+    Counter(const std::vector<int> &max, const std::vector<int> &step)
+        : pos(max.size(), 0), max(max), step(step) {}
+
+    long count() const {
+        long n = 1;
+        for (size_t i = 0; i < max.size(); i++) n *= max[i] / step[i] + 1;
+        return n;
+    }
+
+    void next() {
+        for (size_t i = 0; i < pos.size(); i++) {
+            if (pos[i] + step[i] <= max[i]) {
+                pos[i] += step[i];
+                return;
+            }
+            pos[i] = 0;
+        }
+    }
+};
+
+struct Node {
+    std::string name;
+    long busy, starved, blocked; // cycles moving data, waiting on inputs, waiting on outputs
+
+    Node(const char *n) : name(n), busy(0), starved(0), blocked(0) {}
+    virtual ~Node() {}
+    virtual void step() = 0;
+};
+
+struct InputIO : public Node {
+    Fifo *out;
+    long total, sent;
+
+    InputIO(const char *n, Fifo *out, long total)
+        : Node(n), out(out), total(total), sent(0) {}
+
+    void step() {
+        if (sent == total) return;
+        if (out->can_write()) {
+            out->write();
+            sent++;
+            busy++;
+        } else {
+            blocked++;
+        }
+    }
+};
+
+struct OutputIO : public Node {
+    Fifo *in;
+    long total, received, pixels_per_token;
+
+    OutputIO(const char *n, Fifo *in, long total, long pixels_per_token)
+        : Node(n), in(in), total(total), received(0), pixels_per_token(pixels_per_token) {}
+
+    bool done() const { return received == total; }
+
+    void step() {
+        if (done()) return;
+        if (in->can_read()) {
+            in->read();
+            received++;
+            busy++;
+        } else {
+            starved++;
+        }
+    }
+};
+
+// Emits an output stencil for every input stencil that completes a
+// full window, i.e. once pos + in_size >= out_size in all dimensions.
+struct LineBuffer : public Node {
+    Fifo *in, *out;
+    std::vector<int> in_size, out_size;
+    Counter counter;
+    long total, consumed;
+    bool pending;
+
+    static std::vector<int> last_pos(const std::vector<int> &store, const std::vector<int> &in_size) {
+        std::vector<int> m(store.size());
+        for (size_t i = 0; i < store.size(); i++) m[i] = store[i] - in_size[i];
+        return m;
+    }
+
+    LineBuffer(const char *n, Fifo *in, Fifo *out, const std::vector<int> &store,
+               const std::vector<int> &in_size, const std::vector<int> &out_size)
+        : Node(n), in(in), out(out), in_size(in_size), out_size(out_size),
+          counter(last_pos(store, in_size), in_size), total(counter.count()),
+          consumed(0), pending(false) {}
+
+    void step() {
+        bool moved = false;
+        if (pending) {
+            if (!out->can_write()) {
+                blocked++;
+                return;
+            }
+            out->write();
+            pending = false;
+            moved = true;
+        }
+        if (consumed < total && in->can_read()) {
+            in->read();
+            consumed++;
+            pending = true;
+            for (size_t i = 0; i < in_size.size(); i++) {
+                if (counter.pos[i] + in_size[i] < out_size[i]) pending = false;
+            }
+            counter.next();
+            moved = true;
+        }
+        if (moved) {
+            busy++;
+        } else if (consumed < total) {
+            starved++;
+        }
+    }
+};
+
+// Sends each input stencil to the consumers whose window contains it.
+// The input is held until every such consumer can accept it.
+struct Dispatch : public Node {
+    Fifo *in;
+    std::vector<Fifo *> outs;
+    std::vector<int> sizes;
+    std::vector<std::vector<int> > offsets, extents;
+    Counter counter;
+    long total, consumed;
+
+    static std::vector<int> last_pos(const std::vector<int> &store, const std::vector<int> &sizes) {
+        std::vector<int> m(store.size());
+        for (size_t i = 0; i < store.size(); i++) m[i] = store[i] - sizes[i];
+        return m;
+    }
+
+    Dispatch(const char *n, Fifo *in, const std::vector<Fifo *> &outs,
+             const std::vector<int> &store, const std::vector<int> &sizes, const std::vector<int> &steps,
+             const std::vector<std::vector<int> > &offsets, const std::vector<std::vector<int> > &extents)
+        : Node(n), in(in), outs(outs), sizes(sizes), offsets(offsets), extents(extents),
+          counter(last_pos(store, sizes), steps), total(counter.count()), consumed(0) {}
+
+    void step() {
+        if (consumed == total) return;
+        if (!in->can_read()) {
+            starved++;
+            return;
+        }
+        std::vector<Fifo *> targets;
+        for (size_t c = 0; c < outs.size(); c++) {
+            bool inside = true;
+            for (size_t i = 0; i < sizes.size(); i++) {
+                int p = counter.pos[i];
+                if (p < offsets[c][i] || p > offsets[c][i] + extents[c][i] - sizes[i]) inside = false;
+            }
+            if (inside) targets.push_back(outs[c]);
+        }
+        if (!all_writable(targets)) {
+            blocked++;
+            return;
+        }
+        in->read();
+        for (Fifo *f : targets) f->write();
+        consumed++;
+        counter.next();
+        busy++;
+    }
+};
+
+// Stores a tile of stencils in one of two banks while the consumer
+// reads the other. A stencil of ELEMS elements takes as many cycles
+// on the write port of a bank. Once a bank is full, its consumer is
+// sent a token per iteration; the bank is released when the tokens
+// are drained.
+struct PingPong : public Node {
+    Fifo *in, *token;
+    long per_tile, tokens, written, sent, next_write;
+    int elems;
+    bool full[2];
+    int wr_bank, rd_bank;
+
+    PingPong(const char *n, Fifo *in, Fifo *token, long per_tile, long tokens, int elems)
+        : Node(n), in(in), token(token), per_tile(per_tile), tokens(tokens),
+          written(0), sent(0), next_write(0), elems(elems < 1 ? 1 : elems), wr_bank(0), rd_bank(0) {
+        full[0] = full[1] = false;
+    }
+
+    void step() {
+        bool moved = false, is_blocked = false;
+        if (cycle < next_write) {
+            moved = true;
+        } else if (!full[wr_bank] && in->can_read()) {
+            in->read();
+            next_write = cycle + elems;
+            if (++written == per_tile) {
+                full[wr_bank] = true;
+                wr_bank ^= 1;
+                written = 0;
+            }
+            moved = true;
+        } else if (full[wr_bank]) {
+            is_blocked = true;
+        }
+        if (full[rd_bank]) {
+            if (sent < tokens) {
+                if (token->can_write()) {
+                    token->write();
+                    sent++;
+                    moved = true;
+                }
+            } else if (!token->can_read() && token->level == 0) {
+                full[rd_bank] = false;
+                rd_bank ^= 1;
+                sent = 0;
+            }
+        }
+        if (moved) {
+            busy++;
+        } else if (is_blocked) {
+            blocked++;
+        } else {
+            starved++;
+        }
+    }
+};
+
+// A loop nest that reads one stencil from every input stream and
+// writes one to every output stream per iteration. Iterations leave
+// the datapath DEPTH cycles after they start, and a new one starts
+// every II cycles (the stencil loops that are not unrolled).
+struct ForBlock : public Node {
+    std::vector<Fifo *> ins, outs;
+    long total, issued, next_issue;
+    int depth, ii;
+    std::deque<long> in_flight; // cycle at which each iteration completes
+
+    ForBlock(const char *n, const std::vector<Fifo *> &ins, const std::vector<Fifo *> &outs,
+             long total, int depth, int ii)
+        : Node(n), ins(ins), outs(outs), total(total), issued(0), next_issue(0),
+          depth(depth < 1 ? 1 : depth), ii(ii < 1 ? 1 : ii) {}
+
+    void step() {
+        bool moved = false, is_blocked = false;
+        if (!in_flight.empty() && in_flight.front() <= cycle) {
+            if (all_writable(outs)) {
+                for (Fifo *f : outs) f->write();
+                in_flight.pop_front();
+                moved = true;
+            } else {
+                is_blocked = true;
+            }
+        }
+        bool waiting = false;
+        if (issued < total && cycle < next_issue) {
+            moved = true;
+        } else if (issued < total && (int)in_flight.size() < depth) {
+            if (all_readable(ins)) {
+                for (Fifo *f : ins) f->read();
+                in_flight.push_back(cycle + depth + ii - 1);
+                next_issue = cycle + ii;
+                issued++;
+                moved = true;
+            } else {
+                waiting = true;
+            }
+        }
+        if (moved) {
+            busy++;
+        } else if (is_blocked) {
+            blocked++;
+        } else if (waiting) {
+            starved++;
+        }
+    }
+};
+
+int run(const char *design, const std::vector<Node *> &nodes, const std::vector<Fifo *> &fifos,
+        const std::vector<OutputIO *> &outputs, long max_cycles) {
+    const long deadlock_cycles = 10000;
+    long last_progress = 0;
+    bool finished = false;
+    while (cycle < max_cycles) {
+        finished = true;
+        for (OutputIO *o : outputs) finished = finished && o->done();
+        if (finished || cycle - last_progress > deadlock_cycles) break;
+
+        long busy = 0;
+        for (Node *n : nodes) busy -= n->busy;
+        for (Node *n : nodes) n->step();
+        for (Node *n : nodes) busy += n->busy;
+        bool moved = busy > 0;
+        for (Fifo *f : fifos) {
+            f->tick();
+            moved = moved || f->moved;
+        }
+        if (moved) last_progress = cycle;
+        cycle++;
+    }
+
+    printf("%s: %ld cycles", design, cycle);
+    if (!finished) {
+        printf(cycle < max_cycles ? " (deadlock)" : " (cycle limit reached)");
+    }
+    printf("\n\n");
+    for (OutputIO *o : outputs) {
+        long pixels = o->received * o->pixels_per_token;
+        printf("%s: %ld/%ld stencils, %ld pixels, %.3f pixels/cycle\n", o->name.c_str(),
+               o->received, o->total, pixels, cycle ? (double)pixels / cycle : 0.0);
+    }
+    printf("\n%-40s %10s %10s %10s\n", "component", "busy", "starved", "blocked");
+    for (Node *n : nodes) {
+        printf("%-40s %10ld %10ld %10ld\n", n->name.c_str(), n->busy, n->starved, n->blocked);
+    }
+    printf("\nFIFO occupancy (cycles at each level, including the output register):\n");
+    for (Fifo *f : fifos) {
+        printf("%s (depth %d):", f->name.c_str(), f->depth);
+        for (size_t i = 0; i < f->histogram.size(); i++) {
+            printf(" %zu:%ld", i, f->histogram[i]);
+        }
+        printf("\n");
+    }
+    return finished ? 0 : 1;
+}
+
+}  // namespace
+
+)INLINE_CODE";
+
+}
+
+string CodeGen_FIRRTL_SimModel::source_fifo(const string &port) {
+    internal_assert(connections.count(port)) << "Stream port " << port << " is not connected.\n";
+    string src = connections[port];
+    while (starts_with(src, "wire_") && connections.count(src)) {
+        src = connections[src];
+    }
+    internal_assert(ends_with(src, ".data_out"))
+        << "Stream port " << port << " is not driven by a FIFO (" << src << ").\n";
+    return src.substr(0, src.size() - string(".data_out").size());
+}
+
+string CodeGen_FIRRTL_SimModel::sink_fifo(const string &port) {
+    for (auto &c : connections) {
+        if (c.second == port && ends_with(c.first, ".data_in")) {
+            return c.first.substr(0, c.first.size() - string(".data_in").size());
+        }
+    }
+    internal_error << "Stream port " << port << " does not feed a FIFO.\n";
+    return "";
+}
+
+string CodeGen_FIRRTL_SimModel::print_vector(const vector<int> &v) {
+    ostringstream oss;
+    oss << "{";
+    for (size_t i = 0; i < v.size(); i++) {
+        oss << (i ? ", " : "") << v[i];
+    }
+    oss << "}";
+    return oss.str();
+}
+
+string CodeGen_FIRRTL_SimModel::print_stencil_extents(const FIRRTL_Type &t, size_t dims) {
+    vector<int> extents;
+    for (size_t i = 0; i < dims; i++) {
+        const int64_t *e = i < t.bounds.size() ? as_const_int(t.bounds[i].extent) : nullptr;
+        extents.push_back(e ? (int)*e : 1);
+    }
+    return print_vector(extents);
+}
+
+int CodeGen_FIRRTL_SimModel::stencil_size(const FIRRTL_Type &t) {
+    int size = 1;
+    for (const auto &range : t.bounds) {
+        const int64_t *e = as_const_int(range.extent);
+        internal_assert(e) << "Stencil extents must be constant.\n";
+        size *= *e;
+    }
+    return size;
+}
+
+long CodeGen_FIRRTL_SimModel::tokens_per_frame(const vector<int> &store, const FIRRTL_Type &t) {
+    long total = 1;
+    for (size_t d = 0; d < store.size(); d++) {
+        const int64_t *e = d < t.bounds.size() ? as_const_int(t.bounds[d].extent) : nullptr;
+        total *= store[d] / (e ? *e : 1);
+    }
+    return total;
+}
+
+void CodeGen_FIRRTL_SimModel::print(TopLevel *top) {
+    connections = top->getConnects();
+    fifo_vars.clear();
+    token_vars.clear();
+
+    stream << "// Cycle-level model of " << top->getInstanceName() << " generated by Halide.\n";
+    stream << "// Usage: <model> [max_cycles]\n";
+    stream << sim_kernel;
+    stream << "int main(int argc, char **argv) {\n";
+    stream << "    long max_cycles = argc > 1 ? atol(argv[1]) : 1000000000L;\n\n";
+
+    // FIFOs become the channels of the model.
+    map<string, string> instances = top->getInstances();
+    vector<string> fifo_list;
+    for (auto &i : instances) {
+        Component *c = top->getComponent(i.second);
+        if (c->getType() == ComponentType::Fifo) {
+            string var = "fifo" + std::to_string(fifo_vars.size());
+            fifo_vars[i.first] = var;
+            fifo_list.push_back(var);
+            stream << "    Fifo *" << var << " = new Fifo(\"" << i.first << "\", "
+                   << static_cast<FIFO *>(c)->getDepth() << ");\n";
+        } else if (c->getType() == ComponentType::Pingpong) {
+            PingPong *pp = static_cast<PingPong *>(c);
+            internal_assert(pp->getOutputs().size() == 1);
+            string token = pp->getOutputs().begin()->first;
+            string var = "fifo" + std::to_string(fifo_vars.size());
+            fifo_vars[i.first + "." + token] = var;
+            token_vars[pp->getConsumerBlock() + "." + token] = var;
+            fifo_list.push_back(var);
+            stream << "    Fifo *" << var << " = new Fifo(\"" << i.first << "." << token << "\", 1);\n";
+        }
+    }
+    stream << "\n";
+
+    vector<string> node_list, output_list;
+    for (auto &i : instances) {
+        const string &inst = i.first;
+        Component *c = top->getComponent(i.second);
+        string var = "node" + std::to_string(node_list.size());
+        switch (c->getType()) {
+        case ComponentType::Input: {
+            IO *io = static_cast<IO *>(c);
+            internal_assert(io->getOutputs().size() == 1);
+            auto out = *io->getOutputs().begin();
+            long total = tokens_per_frame(io->getStoreExtents(), out.second);
+            stream << "    InputIO *" << var << " = new InputIO(\"" << inst << "\", "
+                   << fifo_vars[sink_fifo(inst + "." + out.first)] << ", " << total << ");\n";
+            break;
+        }
+        case ComponentType::Output: {
+            IO *io = static_cast<IO *>(c);
+            internal_assert(io->getInputs().size() == 1);
+            auto in = *io->getInputs().begin();
+            // The output counts stencils, not pixels.
+            long total = tokens_per_frame(io->getStoreExtents(), in.second);
+            stream << "    OutputIO *" << var << " = new OutputIO(\"" << inst << "\", "
+                   << fifo_vars[source_fifo(inst + "." + in.first)] << ", " << total << ", "
+                   << stencil_size(in.second) << ");\n";
+            output_list.push_back(var);
+            break;
+        }
+        case ComponentType::Linebuffer: {
+            LineBuffer *lb = static_cast<LineBuffer *>(c);
+            auto in = *lb->getInputs().begin();
+            auto out = *lb->getOutputs().begin();
+            vector<int> store = lb->getStoreExtents();
+            stream << "    LineBuffer *" << var << " = new LineBuffer(\"" << inst << "\", "
+                   << fifo_vars[source_fifo(inst + "." + in.first)] << ", "
+                   << fifo_vars[sink_fifo(inst + "." + out.first)] << ", "
+                   << print_vector(store) << ", "
+                   << print_stencil_extents(in.second, store.size()) << ", "
+                   << print_stencil_extents(out.second, store.size()) << ");\n";
+            break;
+        }
+        case ComponentType::Dispatcher: {
+            Dispatch *dp = static_cast<Dispatch *>(c);
+            auto in = *dp->getInputs().begin();
+            vector<string> outs;
+            for (const string &s : dp->getConsumerStreams()) {
+                outs.push_back(fifo_vars[sink_fifo(inst + "." + s)]);
+            }
+            stream << "    Dispatch *" << var << " = new Dispatch(\"" << inst << "\", "
+                   << fifo_vars[source_fifo(inst + "." + in.first)] << ", {";
+            for (size_t k = 0; k < outs.size(); k++) {
+                stream << (k ? ", " : "") << outs[k];
+            }
+            stream << "}, " << print_vector(dp->getStoreExtents())
+                   << ", " << print_vector(dp->getStencilSizes())
+                   << ", " << print_vector(dp->getStencilSteps()) << ", {";
+            vector<vector<int> > offsets = dp->getConsumerOffsets();
+            vector<vector<int> > extents = dp->getConsumerExtents();
+            for (size_t k = 0; k < offsets.size(); k++) {
+                stream << (k ? ", " : "") << print_vector(offsets[k]);
+            }
+            stream << "}, {";
+            for (size_t k = 0; k < extents.size(); k++) {
+                stream << (k ? ", " : "") << print_vector(extents[k]);
+            }
+            stream << "});\n";
+            break;
+        }
+        case ComponentType::Forblock: {
+            ForBlock *fb = static_cast<ForBlock *>(c);
+            long total = 1;
+            for (int m : fb->getMaxs()) {
+                total *= m + 1;
+            }
+            // Unrolled (or vectorized) stencil loops are replicated in
+            // space; the remaining ones are iterated one per step, and
+            // a step takes the initiation interval of the ForBlock.
+            int ii = fb->getInitiationInterval();
+            vector<int> stencil_mins = fb->getStencilMins();
+            vector<int> stencil_maxs = fb->getStencilMaxs();
+            for (size_t k = 0; k < stencil_maxs.size(); k++) {
+                ii *= stencil_maxs[k] - stencil_mins[k] + 1;
+            }
+            vector<string> ins, outs;
+            for (auto &p : fb->getInputs()) {
+                string port = inst + "." + p.first;
+                ins.push_back(token_vars.count(port) ? token_vars[port] : fifo_vars[source_fifo(port)]);
+            }
+            for (auto &p : fb->getOutputs()) {
+                outs.push_back(fifo_vars[sink_fifo(inst + "." + p.first)]);
+            }
+            stream << "    ForBlock *" << var << " = new ForBlock(\"" << inst << "\", {";
+            for (size_t k = 0; k < ins.size(); k++) {
+                stream << (k ? ", " : "") << ins[k];
+            }
+            stream << "}, {";
+            for (size_t k = 0; k < outs.size(); k++) {
+                stream << (k ? ", " : "") << outs[k];
+            }
+            stream << "}, " << total << ", " << fb->getPipelineDepth() * fb->getInitiationInterval()
+                   << ", " << ii << ");\n";
+            break;
+        }
+        case ComponentType::Pingpong: {
+            PingPong *pp = static_cast<PingPong *>(c);
+            auto in = *pp->getInputs().begin();
+            string token = pp->getOutputs().begin()->first;
+            vector<int> store = pp->getStoreExtents();
+            vector<int> steps = pp->getStencilSteps();
+            long per_tile = 1;
+            int elems = 1;
+            for (size_t d = 0; d < store.size(); d++) {
+                per_tile *= (store[d] + steps[d] - 1) / steps[d];
+                elems *= steps[d];
+            }
+            // The consumer takes a token on each of its iterations.
+            long tokens = 1;
+            Component *consumer = top->getComponent(instances[pp->getConsumerBlock()]);
+            internal_assert(consumer && consumer->getType() == ComponentType::Forblock);
+            for (int m : static_cast<ForBlock *>(consumer)->getMaxs()) {
+                tokens *= m + 1;
+            }
+            stream << "    PingPong *" << var << " = new PingPong(\"" << inst << "\", "
+                   << fifo_vars[source_fifo(inst + "." + in.first)] << ", "
+                   << fifo_vars[inst + "." + token] << ", " << per_tile << ", " << tokens << ", " << elems << ");\n";
+            break;
+        }
+        default:
+            // SlaveIf and FIFOs do not take part in the data flow.
+            continue;
+        }
+        node_list.push_back(var);
+    }
+
+    stream << "\n    std::vector<Fifo *> fifos = {";
+    for (size_t k = 0; k < fifo_list.size(); k++) {
+        stream << (k ? ", " : "") << fifo_list[k];
+    }
+    stream << "};\n";
+    stream << "    std::vector<Node *> nodes = {";
+    for (size_t k = 0; k < node_list.size(); k++) {
+        stream << (k ? ", " : "") << node_list[k];
+    }
+    stream << "};\n";
+    stream << "    std::vector<OutputIO *> outputs = {";
+    for (size_t k = 0; k < output_list.size(); k++) {
+        stream << (k ? ", " : "") << output_list[k];
+    }
+    stream << "};\n\n";
+    stream << "    return run(\"" << top->getInstanceName() << "\", nodes, fifos, outputs, max_cycles);\n";
+    stream << "}\n";
+}
+
+}
+}
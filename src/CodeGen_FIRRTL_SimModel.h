@@ -0,0 +1,65 @@
+#ifndef HALIDE_CODEGEN_FIRRTL_SIMMODEL_H
+#define HALIDE_CODEGEN_FIRRTL_SIMMODEL_H
+
+/** \file
+ *
+ * Defines the code-generator for producing a cycle-level C++ model
+ * of the FIRRTL component graph
+ */
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Component.h"
+
+namespace Halide {
+
+namespace Internal {
+
+/** This class emits a standalone C++ program that simulates the
+ * component graph built by CodeGen_FIRRTL_Target. Stencils move
+ * between IO, LineBuffer, Dispatch, PingPong and ForBlock components through
+ * FIFOs that follow the registered ready/valid protocol of
+ * print_fifo(). Running the program reports stall cycles per
+ * component, FIFO occupancy histograms and pixels/cycle, which is a
+ * quick estimate of throughput without a FIRRTL simulation flow.
+ */
+class CodeGen_FIRRTL_SimModel {
+public:
+    CodeGen_FIRRTL_SimModel(std::ostream &s) : stream(s) {}
+
+    /** Emit the model of the design rooted at TOP. */
+    void print(TopLevel *top);
+
+protected:
+    std::ostream &stream;
+
+    /** Connections of the top level, <lhs, rhs>. */
+    std::map<std::string, std::string> connections;
+
+    /** Model variable names of FIFO instances, <instance, variable>. */
+    std::map<std::string, std::string> fifo_vars;
+
+    /** Model variable names of the bank tokens of ping-pong buffers,
+     * <consumer port, variable>. The token has no FIFO in hardware, so
+     * the model adds one. */
+    std::map<std::string, std::string> token_vars;
+
+    /** Returns the FIFO instance driving PORT of a component, following
+     * the wires of the top level. */
+    std::string source_fifo(const std::string &port);
+
+    /** Returns the FIFO instance fed by PORT of a component. */
+    std::string sink_fifo(const std::string &port);
+
+    std::string print_vector(const std::vector<int> &v);
+    std::string print_stencil_extents(const FIRRTL_Type &t, size_t dims);
+    int stencil_size(const FIRRTL_Type &t);
+    /** The number of stencils of type t in a frame with the given store extents. */
+    long tokens_per_frame(const std::vector<int> &store, const FIRRTL_Type &t);
+};
+
+}
+}
+
+#endif
@@ -3,8 +3,11 @@
 #include <fstream>
 #include <limits>
 #include <algorithm>
+#include <cstring>
 
 #include "CodeGen_FIRRTL_Target.h"
+#include "CodeGen_FIRRTL_SimModel.h"
+#include "CodeGen_FIRRTL_Report.h"
 #include "CodeGen_Internal.h"
 #include "Substitute.h"
 #include "IRMutator.h"
@@ -13,6 +16,7 @@
 #include "Var.h"
 #include "Lerp.h"
 #include "Simplify.h"
+#include "Float16.h"
 
 namespace Halide {
 namespace Internal {
@@ -106,6 +110,54 @@ bool contain_realize(Stmt s) {
     return cfl.found;
 }
 
+// Finds the options of an accelerator, set by the fixed_point() and
+// stage_delay() calls at the start of its body.
+class FindHWOptions : public IRVisitor {
+    using IRVisitor::visit;
+    void visit(const Call *op) {
+        if(op->name == "fixed_point") {
+            internal_assert(op->args.size() == 1);
+            const int64_t *frac = as_const_int(op->args[0]);
+            internal_assert(frac && *frac > 0);
+            frac_bits = (int)*frac;
+        } else if(op->name == "stage_delay") {
+            internal_assert(op->args.size() == 1);
+            const double *ns = as_const_float(op->args[0]);
+            internal_assert(ns && *ns > 0);
+            stage_delay = *ns;
+        }
+        return;
+    }
+
+public:
+    int frac_bits;
+    double stage_delay;
+
+    FindHWOptions() : frac_bits(0), stage_delay(0) {}
+};
+
+// Counts the accesses of each ping-pong buffer in a loop nest.
+class CountPingPongReads : public IRVisitor {
+    using IRVisitor::visit;
+    void visit(const Call *op) {
+        if (ends_with(op->name, ".pingpong")) {
+            reads[op->name]++;
+        }
+        IRVisitor::visit(op);
+    }
+
+public:
+    map<string, int> reads;
+
+    int max_reads() const {
+        int n = 0;
+        for (const auto &p : reads) {
+            n = std::max(n, p.second);
+        }
+        return n;
+    }
+};
+
 }
 
 // Extract Params and tap.stencils used in the For loop to make port of them.
@@ -125,10 +177,11 @@ protected:
 
 void FIRRTL_For_Closure::visit(const Call *op)
 {
-    // Ignore read_stream and write_stream because they're taken care of 
-    // by CodeGen_FIRRTL_Target::visit(Call).
+    // Ignore read_stream, write_stream and read_pingpong because they're
+    // taken care of by CodeGen_FIRRTL_Target::visit(Call).
     if((op->name != "read_stream") &&
-       (op->name != "write_stream")) {
+       (op->name != "write_stream") &&
+       (op->name != "read_pingpong")) {
         Closure::visit(op);
     }
 }
@@ -150,9 +203,14 @@ vector<string> FIRRTL_For_Closure::arguments(void) {
     return res;
 }
 
-CodeGen_FIRRTL_Target::CodeGen_FIRRTL_Target(std::ostream &s, Target t, const std::string &ip_name)
-    : IRPrinter(s), id("$$ BAD ID $$"), target(t), target_name(ip_name) {
+CodeGen_FIRRTL_Target::CodeGen_FIRRTL_Target(std::ostream &s, Target t, const std::string &ip_name,
+                                             std::ostream *model_stream, std::ostream *report_stream)
+    : IRPrinter(s), id("$$ BAD ID $$"), target(t), target_name(ip_name), model_stream(model_stream),
+      report_stream(report_stream) {
     indent = 0;
+    fixed_frac_bits = 0;
+    stage_delay_budget = 0;
+    initiation_interval = 1;
     // initialize the source file
     stream << ";Generated FIRRTL\n";
     stream << ";Target name: " << target_name << "\n";
@@ -270,31 +328,322 @@ string CodeGen_FIRRTL_Target::print_stencil_type(FIRRTL_Type stencil_type) {
     return oss.str();
 }
 
-string CodeGen_FIRRTL_Target::print_assignment(Type t, const std::string &rhs) {
+namespace {
 
-    map<string, string>::iterator cached = cache.find(rhs);
+// Replaces each $k of RHS with OPERANDS[k].
+string instantiate(const string &rhs, const vector<string> &operands) {
+    string r;
+    for (size_t i = 0; i < rhs.size(); i++) {
+        if (rhs[i] == '$') {
+            size_t j = i + 1;
+            while (j < rhs.size() && isdigit(rhs[j])) j++;
+            size_t k = std::stoul(rhs.substr(i + 1, j - i - 1));
+            internal_assert(k < operands.size()) << "No operand " << k << " for " << rhs << "\n";
+            r += operands[k];
+            i = j - 1;
+        } else {
+            r += rhs[i];
+        }
+    }
+    return r;
+}
+
+}
+
+// RHS refers to the values it reads as $0, $1, ..., which are the
+// names in OPERANDS.
+string CodeGen_FIRRTL_Target::print_assignment(Type t, const std::string &rhs, const vector<string> &operands) {
+
+    string expr = instantiate(rhs, operands);
+    map<string, string>::iterator cached = cache.find(expr);
 
     id = unique_name('_');
 
     if (cached == cache.end()) {
         if (current_fb!=nullptr) { // Inside ForBlock, print to ForBlock oss_body directly.
-            current_fb->print("node " + id + " = " + rhs + "\n");
+            int stage;
+            double arrival;
+            string aligned = retime(rhs, operands, t, stage, arrival);
+            current_fb->print("node " + id + " = " + aligned + "\n");
+            stages[id] = stage;
+            arrivals[id] = arrival;
+            stage_types[id] = {FIRRTL_Type::StencilContainerType::Scalar,t,Region(),0,{}};
+            if (stage_delay_budget > 0 && arrival > stage_delay_budget) {
+                // A single operator slower than the budget gets extra
+                // registers after it, for synthesis to retime into it.
+                int extra = (int)std::ceil(arrival / stage_delay_budget) - 1;
+                id = delay_value(id, stage + extra);
+            }
         } else {
             FIRRTL_Type wire_type = {FIRRTL_Type::StencilContainerType::Scalar,t,Region(),0,{}};
             top->addWire(id, wire_type);
-            top->addConnect(id, rhs);
+            top->addConnect(id, expr);
         }
-        cache[rhs] = id;
+        cache[expr] = id;
     } else {
         id = cached->second;
     }
     return id;
 }
 
+double CodeGen_FIRRTL_Target::arrival_of(const string &id) {
+    auto it = arrivals.find(id);
+    return it == arrivals.end() ? 0 : it->second;
+}
+
+int CodeGen_FIRRTL_Target::stage_of(const string &id) {
+    auto it = stages.find(id);
+    return it == stages.end() ? 0 : it->second;
+}
+
+// Returns the name of a register chain carrying ID to STAGE.
+string CodeGen_FIRRTL_Target::delay_value(const string &id, int stage) {
+    internal_assert(current_fb);
+    int from = stage_of(id);
+    if (from < 0 || from >= stage) {
+        return id;
+    }
+
+    FIRRTL_Type type;
+    if (stage_types.count(id)) {
+        type = stage_types[id];
+    } else if (current_fb->getWires().count(id)) {
+        type = current_fb->getWire(id);
+    } else if (current_fb->getRegs().count(id)) {
+        type = current_fb->getReg(id);
+    } else { // loop variables
+        type = {FIRRTL_Type::StencilContainerType::Scalar,Int(32),Region(),0,{}};
+    }
+
+    string prev = id;
+    for (int s = from + 1; s <= stage; s++) {
+        string name = id + "_s" + std::to_string(s);
+        if (!stages.count(name)) {
+            // The body is printed under 'when run_step', so the delay
+            // registers only advance together with the pipeline.
+            current_fb->addReg(name, type);
+            print_update(name + " <= " + prev + "\n");
+            stages[name] = s;
+            stage_types[name] = type;
+        }
+        prev = name;
+    }
+    return prev;
+}
+
+int CodeGen_FIRRTL_Target::align_stages(vector<string> &ids) {
+    int stage = -1;
+    for (const string &i : ids) {
+        stage = std::max(stage, stage_of(i));
+    }
+    for (string &i : ids) {
+        i = delay_value(i, stage);
+    }
+    return stage;
+}
+
+// Delays the OPERANDS of RHS to the stage of the latest one, and returns
+// RHS reading the delayed values. The primitive operations of RHS
+// are the names it applies to arguments or widths, as it names no
+// values itself.
+string CodeGen_FIRRTL_Target::retime(const string &rhs, const vector<string> &operands, Type t, int &stage, double &arrival) {
+    vector<string> ops;
+    for (size_t i = 0; i < rhs.size();) {
+        size_t j = i;
+        if (isalpha(rhs[i]) || rhs[i] == '_') {
+            while (j < rhs.size() && (isalnum(rhs[j]) || rhs[j] == '_')) j++;
+            if (j < rhs.size() && (rhs[j] == '(' || rhs[j] == '<')) {
+                ops.push_back(rhs.substr(i, j - i));
+            }
+        } else {
+            j++;
+        }
+        i = j;
+    }
+
+    vector<string> ids = operands;
+    stage = align_stages(ids);
+
+    // Nested primitive operations form a chain. Compares are as slow
+    // as their operands are wide.
+    int bits = t.bits();
+    for (const string &o : ids) {
+        if (stage_types.count(o)) {
+            bits = std::max(bits, stage_types[o].elemType.bits());
+        }
+    }
+    double delay = 0;
+    for (const string &o : ops) {
+        double d = firrtl_op_delay(o, bits);
+        if (d > 0) {
+            current_fb->addOperation(o, bits);
+        }
+        delay += d;
+    }
+
+    // Operands computed combinationally in this stage arrive late. If
+    // the new operation would exceed the delay budget, the operands
+    // are registered and the operation starts the next stage.
+    double start = 0;
+    for (const string &o : ids) {
+        start = std::max(start, arrival_of(o));
+    }
+    if (stage_delay_budget > 0 && start > 0 && start + delay > stage_delay_budget) {
+        stage++;
+        for (string &o : ids) {
+            o = delay_value(o, stage);
+        }
+        start = 0;
+    }
+    arrival = start + delay;
+
+    return instantiate(rhs, ids);
+}
+
+void CodeGen_FIRRTL_Target::finish_forblock() {
+    internal_assert(current_fb);
+
+    // All output stencil elements are written at the stage of the
+    // latest one, and the output register adds one more stage.
+    int stage = 0;
+    for (const Pending_Provide &p : pending_provides) {
+        stage = std::max(stage, stage_of(p.value));
+    }
+    for (const Pending_Provide &p : pending_provides) {
+        ostringstream oss;
+        oss << p.name;
+        for (size_t i = 0; i < p.indices.size(); i++) {
+            if (p.index_is_var[i]) {
+                oss << "[asUInt(" << delay_value(p.indices[i], stage) << ")]";
+            } else {
+                oss << "[" << p.indices[i] << "]";
+            }
+        }
+        string value = delay_value(p.value, stage);
+        print_update(oss.str() + " <= " + value + "\n");
+    }
+    current_fb->setPipelineDepth(stage + 1);
+
+    // Operators slower than the budget are retimed over the registers
+    // print_assignment() adds after them.
+    double critical_path = 0;
+    for (const auto &a : arrivals) {
+        double d = a.second;
+        if (stage_delay_budget > 0 && d > stage_delay_budget) {
+            d /= std::ceil(d / stage_delay_budget);
+        }
+        critical_path = std::max(critical_path, d);
+    }
+    current_fb->setCriticalPath(critical_path);
+
+    pending_provides.clear();
+    shared_ops.clear();
+    stages.clear();
+    arrivals.clear();
+    stage_types.clear();
+    fixed_formats.clear();
+}
+
+void CodeGen_FIRRTL_Target::print_update(const string &s) {
+    internal_assert(current_fb);
+    if (current_fb->getInitiationInterval() > 1) {
+        current_fb->print("when ii_last :\n");
+        current_fb->open_scope();
+        current_fb->print(s);
+        current_fb->close_scope("");
+    } else {
+        current_fb->print(s);
+    }
+}
+
+string CodeGen_FIRRTL_Target::print_shared_op(const string &op, Type t, Expr a, Expr b) {
+    internal_assert(current_fb);
+    int ii = current_fb->getInitiationInterval();
+    vector<string> ids = {print_expr(a), print_expr(b)};
+
+    string key = op + "(" + ids[0] + ", " + ids[1] + ")";
+    auto cached = cache.find(key);
+    if (cached != cache.end()) {
+        id = cached->second;
+        return id;
+    }
+
+    // The operands come from registers of the previous stage or from
+    // the input stencils, so they stay put for the whole interval.
+    int stage = std::max(align_stages(ids), 0);
+    FIRRTL_Type type = {FIRRTL_Type::StencilContainerType::Scalar,t,Region(),0,{}};
+
+    string kind = op + (t.is_int() ? "_s" : "_u") + std::to_string(t.bits());
+    int k = shared_ops[kind]++;
+    int phase = k % ii;
+    string unit = "shared_" + kind + "_" + std::to_string(k / ii);
+    if (phase == 0) {
+        current_fb->addWire(unit + "_a", type);
+        current_fb->addWire(unit + "_b", type);
+        current_fb->addWire(unit + "_z", type);
+        ostringstream oss;
+        if (t.is_int()) {
+            oss << "asSInt(";
+        }
+        if (op == "mul") {
+            oss << "bits(mul(" << unit << "_a, " << unit << "_b), " << t.bits()-1 << ", 0)";
+        } else {
+            oss << "tail(" << op << "(" << unit << "_a, " << unit << "_b), 1)";
+        }
+        if (t.is_int()) {
+            oss << ")";
+        }
+        current_fb->addConnect(unit + "_z", oss.str());
+        current_fb->addOperation(op, t.bits());
+    } else {
+        current_fb->addOperation("mux", t.bits()); // operand select
+        current_fb->addOperation("mux", t.bits());
+    }
+
+    // The result of the last phase is registered directly, the others
+    // are held while the unit serves the following phases.
+    id = unique_name('_');
+    string held = unit + "_z";
+    current_fb->print("when eq(ii_phase, UInt(" + std::to_string(phase) + ")) :\n");
+    current_fb->open_scope();
+    current_fb->print(unit + "_a <= " + ids[0] + "\n");
+    current_fb->print(unit + "_b <= " + ids[1] + "\n");
+    if (phase < ii - 1) {
+        held = id + "_h";
+        current_fb->addReg(held, type);
+        current_fb->print(held + " <= " + unit + "_z\n");
+    }
+    current_fb->close_scope("");
+    current_fb->addReg(id, type);
+    print_update(id + " <= " + held + "\n");
+
+    stages[id] = stage + 1;
+    arrivals[id] = 0;
+    stage_types[id] = type;
+    cache[key] = id;
+    return id;
+}
+
 void CodeGen_FIRRTL_Target::add_kernel(Stmt stmt,
                                        const vector<FIRRTL_Argument> &args) {
-    // Create Top module
-    top = new TopLevel("hls_target");
+    FindHWOptions options;
+    stmt.accept(&options);
+    fixed_frac_bits = options.frac_bits;
+    stage_delay_budget = options.stage_delay;
+
+    // The host sends and receives IEEE-754 bits, so the IO of a
+    // fixed-point accelerator must not be floating point.
+    for (size_t i = 0; i < args.size(); i++) {
+        user_assert(fixed_frac_bits == 0 || !args[i].stencil_type.elemType.is_float())
+            << "The accelerator " << target_name << " carries floating-point values in fixed point, "
+            << "but its input, output or parameter " << args[i].name << " is floating point. "
+            << "Use an integer type for it and cast inside the accelerated pipeline.\n";
+    }
+
+    // Create Top module. Components are shared by module name within
+    // a circuit only, so forget those of any earlier accelerator.
+    Component::clearComponents();
+    top = new TopLevel(target_name);
     sif = new SlaveIf("SlaveIf");
     top->addInstance(static_cast<Component*>(sif));
     top->addConnect(sif->getInstanceName() + ".clock", "clock");
@@ -449,6 +798,7 @@ void CodeGen_FIRRTL_Target::add_kernel(Stmt stmt,
 
     // initialize
     current_fb = nullptr;
+    pingpongs.clear();
 
     // Visit body to collect components.
     print(stmt);
@@ -489,12 +839,26 @@ void CodeGen_FIRRTL_Target::add_kernel(Stmt stmt,
         stream << "; Dispatch instance " << c->getInstanceName() << "\n";
         print_dispatch(static_cast<Dispatch*>(c));
     }
+    for(auto &c : top->getComponents(ComponentType::Pingpong)) {
+        do_indent();
+        stream << "; PingPong instance " << c->getInstanceName() << "\n";
+        print_pingpong(static_cast<PingPong*>(c));
+    }
     for(auto &c : top->getComponents(ComponentType::Forblock)) {
         do_indent();
         stream << "; ForBlock instance " << c->getInstanceName() << "\n";
         print_forblock(static_cast<ForBlock*>(c));
     }
 
+    if (model_stream) {
+        CodeGen_FIRRTL_SimModel model(*model_stream);
+        model.print(top);
+    }
+
+    if (report_stream) {
+        CodeGen_FIRRTL_Report report(*report_stream);
+        report.print(top);
+    }
 }
 
 void CodeGen_FIRRTL_Target::print_module(Component *c)
@@ -587,14 +951,18 @@ void CodeGen_FIRRTL_Target::print_slaveif(SlaveIf *c)
     }
     stream << "\n";
 
-    // Offset address assignment
-    int offset = 0x40; // Base of config registers
+    // Offset address assignment. Stencil elements are packed into the
+    // 32-bit words of the register, the first element in the LSBs.
+    const int base = 0x40; // Base of config registers
+    int offset = base;
     std::map<int, string> complete_address_map; // Just for Register Map table printing.
     std::map<string, Reg_Type> address_map; // map of vector (name, size)
     for(auto &p : c->getRegs()) {
         FIRRTL_Type s = p.second;
         Reg_Type r;
-        if (s.type == FIRRTL_Type::StencilContainerType::Stencil) { // TODO: pack it in 32-bit word
+        r.bitwidth = s.elemType.bits();
+        r.lane = SlaveIf::laneBits(r.bitwidth);
+        if (s.type == FIRRTL_Type::StencilContainerType::Stencil) {
             internal_assert(s.bounds.size() <= 4);
             internal_assert(s.bounds.size() >= 1);
             r.extents.push_back(1);
@@ -609,11 +977,11 @@ void CodeGen_FIRRTL_Target::print_slaveif(SlaveIf *c)
                 r.range *= e->value;
             }
             r.is_stencil = true;
-            r.bitwidth = 32; //s.elemType.bits(); // TODO for packing
-            //TODO for packing... r.range *= r.bitwidth;
-            r.range *= 4; // range in byte
+            const int lanes = 32 / r.lane;
+            r.range = (r.range + lanes - 1) / lanes * 4; // range in byte
             r.offset = offset;
             address_map[p.first] = r;
+            int elem = 0;
             string regidx0, regidx1, regidx2, regidx3;
             for(int i3 = 0; i3 < r.extents[3]; i3++) {
                 regidx3 = "_" + std::to_string(i3);
@@ -625,15 +993,22 @@ void CodeGen_FIRRTL_Target::print_slaveif(SlaveIf *c)
                             regidx0 = "_" + std::to_string(i0);
                             string n = p.first;
                             n.replace(0,2,""); // remove "r_"
-                            complete_address_map[offset] = n+regidx3+regidx2+regidx1+regidx0; // reverse-order
-                            offset += 4; // TODO: packing
+                            string &entry = complete_address_map[r.offset + elem / lanes * 4];
+                            if (!entry.empty()) entry += ", ";
+                            entry += n+regidx3+regidx2+regidx1+regidx0; // reverse-order
+                            if (lanes > 1) {
+                                int lo = elem % lanes * r.lane;
+                                int hi = lo + std::min(r.bitwidth, r.lane) - 1;
+                                entry += " [" + std::to_string(hi) + ":" + std::to_string(lo) + "]";
+                            }
+                            elem++;
                         }
                     }
                 }
             }
+            offset += r.range;
         } else {
             r.is_stencil = false;
-            r.bitwidth = 32;//s.elemType.bits(); // TODO for packing
             r.range = 4; // range in byte
             r.offset = offset;
             string n = p.first;
@@ -643,12 +1018,16 @@ void CodeGen_FIRRTL_Target::print_slaveif(SlaveIf *c)
             offset += 4;
         }
     }
+    // The shadow bank mirrors the whole register window.
+    const int shadow_words = (offset - base) / 4;
 
     // Body
     do_indent(); stream << ";------------------ Start of Register Map -----------------\n";
     do_indent(); stream << "; 0x00000000 : CTRL\n";
     do_indent(); stream << ";              [0]: Start (Write 1 to start, auto cleared)\n";
     do_indent(); stream << ";              [1]: Done (Set to 1 when all block are done. Write 1 to clear)\n";
+    do_indent(); stream << ";              [2]: Commit (Write 1 to copy the shadow bank to the config registers, auto cleared when copied)\n";
+    do_indent(); stream << ";              [3]: Commit at start (Write 1 to commit the shadow bank at the next Start, before the frame starts)\n";
     do_indent(); stream << "; 0x00000004 : STATUS (Read-Only)\n";
     do_indent(); stream << ";              [0]: Run (1 indicates running).\n";
     do_indent(); stream << "; 0x00000008 : Interrupt Enable // TODO\n";
@@ -661,6 +1040,10 @@ void CodeGen_FIRRTL_Target::print_slaveif(SlaveIf *c)
     do_indent(); stream << "; 0x00000024 : Info5 (Read-Only)\n";
     do_indent(); stream << "; 0x00000028 : Info6 (Read-Only)\n";
     do_indent(); stream << "; 0x0000002C : Info7 (Read-Only)\n";
+    do_indent(); stream << "; 0x00000030 : SHADOW_ADDR (Word index into the shadow bank for SHADOW_DATA writes)\n";
+    do_indent(); stream << "; 0x00000034 : SHADOW_DATA (Write-Only, writes a word of the shadow bank and increments SHADOW_ADDR)\n";
+    do_indent(); stream << ";              The shadow bank has one word per config register word from 0x40, in order.\n";
+    do_indent(); stream << ";              Direct writes to config registers also update the shadow bank.\n";
     for(auto &p : complete_address_map) { // sort by address
         do_indent();
         stream << "; 0x" << std::hex << std::setw(8) << std::setfill('0') << p.first << " : " << p.second << "\n";
@@ -700,6 +1083,20 @@ void CodeGen_FIRRTL_Target::print_slaveif(SlaveIf *c)
     do_indent(); stream << "reg  r_start : UInt<1>, clock with : (reset => (reset, UInt<1>(0)))\n";
     do_indent(); stream << "reg  r_run :   UInt<1>, clock with : (reset => (reset, UInt<1>(0)))\n";
     do_indent(); stream << "reg  r_done :  UInt<1>, clock with : (reset => (reset, UInt<1>(0)))\n";
+    do_indent(); stream << "reg  r_commit_busy : UInt<1>, clock with : (reset => (reset, UInt<1>(0)))\n";
+    do_indent(); stream << "reg  r_commit_pending : UInt<1>, clock with : (reset => (reset, UInt<1>(0)))\n";
+    do_indent(); stream << "reg  r_start_deferred : UInt<1>, clock with : (reset => (reset, UInt<1>(0)))\n";
+    do_indent(); stream << "wire w_commit_at_start : UInt<1>\n";
+    do_indent(); stream << "wire w_ready : UInt<1>\n";
+    do_indent(); stream << "wire aw_wr : UInt<1>\n";
+    do_indent(); stream << "wire w_cfg_wr_en : UInt<1>\n";
+    do_indent(); stream << "wire w_cfg_wr_addr : UInt<32>\n";
+    do_indent(); stream << "wire w_cfg_wr_data : UInt<32>\n";
+    if (shadow_words > 0) {
+        do_indent(); stream << "cmem shadow : UInt<32>[" << shadow_words << "]\n";
+        do_indent(); stream << "reg  r_shadow_ptr : UInt<32>, clock with : (reset => (reset, UInt<32>(0)))\n";
+        do_indent(); stream << "reg  r_commit_idx : UInt<32>, clock with : (reset => (reset, UInt<32>(0)))\n";
+    }
     vector<string> done_ports;
     for(auto &p : c->getInPorts()) {
         if (ends_with(p.first, "_done")) {// collecting done signals
@@ -717,7 +1114,7 @@ void CodeGen_FIRRTL_Target::print_slaveif(SlaveIf *c)
             stream << " with : (reset => (reset, " << print_type(s.elemType) << "(0)))\n";
         } else {
             do_indent();
-            stream << "cmem " << p.first << " : {value : " << print_type(s.elemType) << "}[" << (r.range>>2) << "]\n"; // >>2 to word count.
+            stream << "cmem " << p.first << " : UInt<32>[" << (r.range>>2) << "]\n"; // >>2 to word count.
             do_indent(); stream << "wire w_" << p.first << "_rd_idx : UInt<32>\n";
             do_indent(); stream << "wire w_" << p.first << "_wr_idx : UInt<32>\n";
         }
@@ -730,7 +1127,7 @@ void CodeGen_FIRRTL_Target::print_slaveif(SlaveIf *c)
     do_indent(); stream << "  when AWVALID :\n";
     do_indent(); stream << "    w_aw_ns_fsm <= ST_AW_ADDR\n";
     do_indent(); stream << "else when eq(r_aw_cs_fsm, ST_AW_ADDR) :\n";
-    do_indent(); stream << "  when WVALID :\n";
+    do_indent(); stream << "  when aw_wr :\n";
     do_indent(); stream << "    w_aw_ns_fsm <= ST_AW_DATA\n";
     do_indent(); stream << "else when eq(r_aw_cs_fsm, ST_AW_DATA) :\n";
     do_indent(); stream << "  when BREADY :\n";
@@ -741,7 +1138,10 @@ void CodeGen_FIRRTL_Target::print_slaveif(SlaveIf *c)
     do_indent(); stream << "  r_aw_addr <= AWADDR\n";
     stream << "\n";
     do_indent(); stream << "AWREADY <= eq(r_aw_cs_fsm, ST_AW_IDLE)\n";
-    do_indent(); stream << "WREADY <= eq(r_aw_cs_fsm, ST_AW_ADDR)\n";
+    // Writes wait while the shadow bank is being committed.
+    do_indent(); stream << "w_ready <= and(eq(r_aw_cs_fsm, ST_AW_ADDR), not(r_commit_busy))\n";
+    do_indent(); stream << "aw_wr <= and(WVALID, w_ready)\n";
+    do_indent(); stream << "WREADY <= w_ready\n";
     do_indent(); stream << "BVALID <= eq(r_aw_cs_fsm, ST_AW_DATA)\n";
     do_indent(); stream << "BRESP  <= UInt<1>(0)\n";
     stream << "\n";
@@ -766,7 +1166,7 @@ void CodeGen_FIRRTL_Target::print_slaveif(SlaveIf *c)
             do_indent();
             stream << "w_" << p.first << "_rd_idx" << " <= shr(asUInt(sub(r_ar_addr, UInt(\"h" << std::hex << r.offset << "\"))), 2)\n";
             do_indent();
-            stream << "w_" << p.first << "_wr_idx" << " <= shr(asUInt(sub(r_aw_addr, UInt(\"h" << std::hex << r.offset << "\"))), 2)\n";
+            stream << "w_" << p.first << "_wr_idx" << " <= shr(asUInt(sub(w_cfg_wr_addr, UInt(\"h" << std::hex << r.offset << "\"))), 2)\n";
             stream << std::dec;
         }
     }
@@ -777,9 +1177,13 @@ void CodeGen_FIRRTL_Target::print_slaveif(SlaveIf *c)
     stream << "\n";
     do_indent(); stream << "when eq(r_ar_cs_fsm, ST_AR_ADDR) :\n";
     do_indent(); stream << "  when eq(r_ar_addr, ADDR_CTRL) :\n";
-    do_indent(); stream << "    r_rd_data <= or(shl(r_done, 1), r_start)\n";
+    do_indent(); stream << "    r_rd_data <= or(or(shl(r_commit_pending, 3), shl(r_commit_busy, 2)), or(shl(r_done, 1), r_start))\n";
     do_indent(); stream << "  else when eq(r_ar_addr, ADDR_STATUS) :\n";
     do_indent(); stream << "    r_rd_data <= r_run\n";
+    if (shadow_words > 0) {
+        do_indent(); stream << "  else when eq(r_ar_addr, UInt<32>(\"h30\")) :\n";
+        do_indent(); stream << "    r_rd_data <= r_shadow_ptr\n";
+    }
     for(auto &p : address_map) {
         Reg_Type r = p.second;
         if (r.is_stencil) {
@@ -790,7 +1194,7 @@ void CodeGen_FIRRTL_Target::print_slaveif(SlaveIf *c)
             do_indent();
             stream << "    infer mport " << p.first << "_rd = " << p.first << "[w_" << p.first << "_rd_idx], clock\n";
             do_indent();
-            stream << "    r_rd_data <= asUInt(" << p.first << "_rd.value)\n";
+            stream << "    r_rd_data <= " << p.first << "_rd\n";
         } else {
             do_indent();
             stream << "  else when eq(r_ar_addr, UInt<32>(\"h" << std::hex << r.offset << "\")) :\n";
@@ -803,8 +1207,12 @@ void CodeGen_FIRRTL_Target::print_slaveif(SlaveIf *c)
 
     do_indent(); stream << "RDATA <= r_rd_data\n";
 
-    do_indent(); stream << "when and(eq(r_aw_cs_fsm, ST_AW_ADDR), eq(r_aw_addr, ADDR_CTRL)) :\n";
+    // A start with a commit at start pending is deferred until the
+    // shadow bank is copied, so each frame sees one set of parameters.
+    do_indent(); stream << "when and(and(aw_wr, eq(r_aw_addr, ADDR_CTRL)), not(w_commit_at_start)) :\n";
     do_indent(); stream << "  r_start <= WDATA ; bit 0 only\n";
+    do_indent(); stream << "else when and(r_start_deferred, not(r_commit_busy)) :\n";
+    do_indent(); stream << "  r_start <= UInt<1>(1)\n";
     do_indent(); stream << "else :\n";
     do_indent(); stream << "  r_start <= UInt<1>(0)\n";
     stream << "\n";
@@ -819,14 +1227,14 @@ void CodeGen_FIRRTL_Target::print_slaveif(SlaveIf *c)
     stream << "\n";
 
     for(auto &p : done_ports) {
-        do_indent(); stream << "when and(eq(r_aw_cs_fsm, ST_AW_ADDR), and(eq(r_aw_addr, ADDR_CTRL), eq(and(WDATA,UInt<32>(2)), UInt<32>(2)))) :\n";
+        do_indent(); stream << "when and(aw_wr, and(eq(r_aw_addr, ADDR_CTRL), eq(and(WDATA,UInt<32>(2)), UInt<32>(2)))) :\n";
         do_indent(); stream << "    r_" << p << " <= UInt<1>(0)\n";
         do_indent(); stream << "else when " << p << " :\n";
         do_indent(); stream << "    r_" << p << " <= UInt<1>(1)\n";
         stream << "\n";
     }
 
-    do_indent(); stream << "when and(eq(r_aw_cs_fsm, ST_AW_ADDR), and(eq(r_aw_addr, ADDR_CTRL), eq(and(WDATA,UInt<32>(2)), UInt<32>(2)))) :\n";
+    do_indent(); stream << "when and(aw_wr, and(eq(r_aw_addr, ADDR_CTRL), eq(and(WDATA,UInt<32>(2)), UInt<32>(2)))) :\n";
     do_indent(); stream << "  r_done <= UInt<1>(0)\n";
     do_indent(); stream << "else when";
     int done_ports_size = done_ports.size();
@@ -841,19 +1249,66 @@ void CodeGen_FIRRTL_Target::print_slaveif(SlaveIf *c)
     do_indent(); stream << "  r_done <= UInt<1>(1)\n";
     stream << "\n";
 
+    // Config registers are written by the host directly, or word by word
+    // from the shadow bank on a commit.
+    if (shadow_words > 0) {
+        do_indent(); stream << "when aw_wr :\n";
+        do_indent(); stream << "  when eq(r_aw_addr, UInt<32>(\"h30\")) :\n";
+        do_indent(); stream << "    r_shadow_ptr <= WDATA\n";
+        do_indent(); stream << "  else when eq(r_aw_addr, UInt<32>(\"h34\")) :\n";
+        do_indent(); stream << "    infer mport shadow_bw = shadow[r_shadow_ptr], clock\n";
+        do_indent(); stream << "    shadow_bw <= WDATA\n";
+        do_indent(); stream << "    r_shadow_ptr <= tail(add(r_shadow_ptr, UInt<32>(1)), 1)\n";
+        do_indent(); stream << "  else when and(geq(r_aw_addr, UInt<32>(\"h" << std::hex << base << "\")), ";
+        stream << "lt(r_aw_addr, UInt<32>(\"h" << offset << "\"))) :\n";
+        do_indent(); stream << "    infer mport shadow_dw = shadow[shr(asUInt(sub(r_aw_addr, UInt(\"h" << base << "\"))), 2)], clock\n";
+        stream << std::dec;
+        do_indent(); stream << "    shadow_dw <= WDATA\n";
+        stream << "\n";
+        do_indent(); stream << "w_commit_at_start <= and(and(aw_wr, eq(r_aw_addr, ADDR_CTRL)), "
+                            << "and(eq(and(WDATA,UInt<32>(1)), UInt<32>(1)), or(r_commit_pending, eq(and(WDATA,UInt<32>(8)), UInt<32>(8)))))\n";
+        do_indent(); stream << "when w_commit_at_start :\n";
+        do_indent(); stream << "  r_commit_pending <= UInt<1>(0)\n";
+        do_indent(); stream << "  r_start_deferred <= UInt<1>(1)\n";
+        do_indent(); stream << "else when and(aw_wr, and(eq(r_aw_addr, ADDR_CTRL), eq(and(WDATA,UInt<32>(8)), UInt<32>(8)))) :\n";
+        do_indent(); stream << "  r_commit_pending <= UInt<1>(1)\n";
+        do_indent(); stream << "else when and(r_start_deferred, not(r_commit_busy)) :\n";
+        do_indent(); stream << "  r_start_deferred <= UInt<1>(0)\n";
+        stream << "\n";
+        do_indent(); stream << "when or(w_commit_at_start, and(aw_wr, and(eq(r_aw_addr, ADDR_CTRL), eq(and(WDATA,UInt<32>(4)), UInt<32>(4))))) :\n";
+        do_indent(); stream << "  r_commit_busy <= UInt<1>(1)\n";
+        do_indent(); stream << "  r_commit_idx <= UInt<32>(0)\n";
+        do_indent(); stream << "else when r_commit_busy :\n";
+        do_indent(); stream << "  r_commit_idx <= tail(add(r_commit_idx, UInt<32>(1)), 1)\n";
+        do_indent(); stream << "  when eq(r_commit_idx, UInt<32>(" << shadow_words - 1 << ")) :\n";
+        do_indent(); stream << "    r_commit_busy <= UInt<1>(0)\n";
+        do_indent(); stream << "infer mport shadow_cm = shadow[r_commit_idx], clock\n";
+        stream << "\n";
+        do_indent(); stream << "w_cfg_wr_en <= or(aw_wr, r_commit_busy)\n";
+        do_indent(); stream << "w_cfg_wr_addr <= mux(r_commit_busy, tail(add(UInt<32>(\"h" << std::hex << base << std::dec
+                            << "\"), shl(bits(r_commit_idx, 29, 0), 2)), 1), r_aw_addr)\n";
+        do_indent(); stream << "w_cfg_wr_data <= mux(r_commit_busy, shadow_cm, WDATA)\n";
+    } else {
+        do_indent(); stream << "w_commit_at_start <= UInt<1>(0)\n";
+        do_indent(); stream << "w_cfg_wr_en <= aw_wr\n";
+        do_indent(); stream << "w_cfg_wr_addr <= r_aw_addr\n";
+        do_indent(); stream << "w_cfg_wr_data <= WDATA\n";
+    }
+    stream << "\n";
+
     for(auto &p : address_map) {
         Reg_Type r = p.second;
         FIRRTL_Type s = c->getReg(p.first);
         if (r.is_stencil) {
-            do_indent(); stream << "when eq(r_aw_cs_fsm, ST_AW_ADDR) :\n";
-            do_indent(); stream << "  when and(geq(r_aw_addr, UInt<32>(\"h" << std::hex << r.offset << "\")), ";
-            stream << "lt(r_aw_addr, UInt<32>(\"h" << std::hex << (r.offset + r.range) << "\"))) :\n";
+            do_indent(); stream << "when w_cfg_wr_en :\n";
+            do_indent(); stream << "  when and(geq(w_cfg_wr_addr, UInt<32>(\"h" << std::hex << r.offset << "\")), ";
+            stream << "lt(w_cfg_wr_addr, UInt<32>(\"h" << std::hex << (r.offset + r.range) << "\"))) :\n";
             do_indent(); stream << "    infer mport " << p.first << "_wr = " << p.first << "[w_" << p.first << "_wr_idx], clock\n";
-            do_indent(); stream << "    " << p.first << "_wr.value <= as" << print_base_type(s.elemType) << "(WDATA)\n";
+            do_indent(); stream << "    " << p.first << "_wr <= w_cfg_wr_data\n";
         } else {
-            do_indent(); stream << "when eq(r_aw_cs_fsm, ST_AW_ADDR) :\n";
-            do_indent(); stream << "  when eq(r_aw_addr, UInt<32>(\"h" << std::hex << r.offset << "\")) :\n";
-            do_indent(); stream << "    " << p.first << " <= as" << print_base_type(s.elemType) << "(WDATA)\n";
+            do_indent(); stream << "when w_cfg_wr_en :\n";
+            do_indent(); stream << "  when eq(w_cfg_wr_addr, UInt<32>(\"h" << std::hex << r.offset << "\")) :\n";
+            do_indent(); stream << "    " << p.first << " <= as" << print_base_type(s.elemType) << "(w_cfg_wr_data)\n";
         }
         stream << "\n";
     }
@@ -898,10 +1353,28 @@ void CodeGen_FIRRTL_Target::print_slaveif(SlaveIf *c)
                         do_indent();
                         stream << "node " << o.first << "_idx = " << o.first << "_idx0\n";
                     }
+                    // Select the lane of the element from its packed word.
+                    int lane_shift = 0, lanes_shift = 0;
+                    while ((1 << lane_shift) < r.lane) lane_shift++;
+                    while ((1 << lanes_shift) < 32 / r.lane) lanes_shift++;
+                    string elem = o.first + "_rd";
+                    if (lanes_shift > 0) {
+                        do_indent();
+                        stream << "node " << o.first << "_word = shr(" << o.first << "_idx, " << lanes_shift << ")\n";
+                        do_indent();
+                        stream << "node " << o.first << "_lane = bits(" << o.first << "_idx, " << lanes_shift - 1 << ", 0)\n";
+                        do_indent();
+                        stream << "infer mport " << o.first << "_rd = " << p.first << "[" << o.first << "_word], clock\n";
+                        elem = "dshr(" + elem + ", shl(" + o.first + "_lane, " + std::to_string(lane_shift) + "))";
+                    } else {
+                        do_indent();
+                        stream << "infer mport " << o.first << "_rd = " << p.first << "[" << o.first << "_idx], clock\n";
+                    }
+                    if (r.bitwidth < 32) {
+                        elem = "bits(" + elem + ", " + std::to_string(r.bitwidth - 1) + ", 0)";
+                    }
                     do_indent();
-                    stream << "infer mport " << o.first << "_rd = " << p.first << "[" << o.first << "_idx], clock\n";
-                    do_indent();
-                    stream << o.first << ".value <= " << o.first << "_rd.value\n";
+                    stream << o.first << ".value <= as" << print_base_type(p.second.elemType) << "(" << elem << ")\n";
                 }
             }
         } else {
@@ -1440,9 +1913,14 @@ void CodeGen_FIRRTL_Target::print_linebuffer1D(string name, int L[4], Type t, in
         do_indent(); stream << "io.out.bits.value <= io.in.bits.value\n";
         do_indent(); stream << "io.in.ready <= io.out.ready\n";
         do_indent(); stream << "io.out.valid <= io.in.valid\n";
-    } else {// TODO: } else if (isOutDimDivisibleByIn(0)) {
-        int ratio = outEl[0]/inEl[0];
+    } else {
+        // The window is the last outEl[0] elements of the buffered words
+        // followed by the incoming word. With an N-wide input (a vectorized
+        // consumer), outEl[0] is K+N-1 for a K-wide stencil, which need not
+        // be a multiple of N; the leading 'skew' elements are dropped then.
+        int ratio = (outEl[0] + inEl[0] - 1)/inEl[0];
         int bufL0 = std::max(0,ratio - 1);
+        int skew = ratio*inEl[0] - outEl[0];
         int imgL0 = L[0]/inEl[0];
         int nBit_imgL0 = (int)std::ceil(std::log2((float)imgL0));
 
@@ -1471,11 +1949,14 @@ void CodeGen_FIRRTL_Target::print_linebuffer1D(string name, int L[4], Type t, in
         do_indent(); stream << "when io.in.valid :\n";
         do_indent(); stream << "  when geq(col, UInt<" << nBit_imgL0 << ">(" << bufL0 << ")) :\n";
         for (int bi=0; bi<bufL0; bi++) {
-            int inSliceL0 =  bi * inEl[0];
+            int inSliceL0 =  bi * inEl[0] - skew;
             for (int i3=0; i3<inEl[3]; i3++) {
             for (int i2=0; i2<inEl[2]; i2++) {
             for (int i1=0; i1<inEl[1]; i1++) {
             for (int i0=0; i0<inEl[0]; i0++) {
+                if (inSliceL0 + i0 < 0) {
+                    continue;
+                }
                 do_indent();
                 stream << "    outStencil.value[" << i3 << "][" << i2 << "][" << i1 << "][" << inSliceL0 + i0 << "]"
                           " <= buffer[" << bi << "].value[" << i3 << "][" << i2 << "][" << i1 << "][" << i0 << "]\n";
@@ -1488,8 +1969,11 @@ void CodeGen_FIRRTL_Target::print_linebuffer1D(string name, int L[4], Type t, in
         for (int i2=0; i2<inEl[2]; i2++) {
         for (int i1=0; i1<inEl[1]; i1++) {
         for (int i0=0; i0<inEl[0]; i0++) {
+            if (bufL0*inEl[0] - skew + i0 < 0) {
+                continue;
+            }
             do_indent();
-            stream << "    outStencil.value[" << i3 << "][" << i2 << "][" << i1 << "][" << bufL0*inEl[0] + i0 << "]"
+            stream << "    outStencil.value[" << i3 << "][" << i2 << "][" << i1 << "][" << bufL0*inEl[0] - skew + i0 << "]"
                       " <= io.in.bits.value[" << i3 << "][" << i2 << "][" << i1 << "][" << i0 << "]\n";
         }
         }
@@ -1525,7 +2009,7 @@ void CodeGen_FIRRTL_Target::print_linebuffer1D(string name, int L[4], Type t, in
         for (int i3=0; i3<inEl[3]; i3++) {
         for (int i2=0; i2<inEl[2]; i2++) {
         for (int i1=0; i1<inEl[1]; i1++) {
-        for (int i0=0; i0<inEl[0]; i0++) {
+        for (int i0=0; i0<inEl[0] && bufL0>0; i0++) {
             do_indent();
             stream << "    buffer[" << bufL0-1 << "].value[" << i3 << "][" << i2 << "][" << i1 << "][" << i0 << "]"
                       " <= io.in.bits.value[" << i3 << "][" << i2 << "][" << i1 << "][" << i0 << "]\n";
@@ -1591,7 +2075,11 @@ void CodeGen_FIRRTL_Target::print_linebuffer2D(string name, int L[4], Type t, in
         do_indent(); stream << "io.out.valid <= io.in.valid\n";
     } else { //} else if(isOutDimDivisibleByIn(0) && isOutDimDivisibleByIn(1)) {
         // TODO: require(L0 > inEl.dim(0) && L0 > outEl.dim(0))
-        // TODO: require(L0 % inEl.dim(0) == 0)
+        // Rows are buffered as inEl[0]-wide words, so an N-wide input
+        // stream stores L0/N words per row and print_linebuffer1D()
+        // assembles the outEl[0]-wide window from them.
+        internal_assert(L[0] % inEl[0] == 0)
+            << "Linebuffer row " << L[0] << " is not a multiple of the input word " << inEl[0] << "\n";
 
         int ratio1 = outEl[1]/inEl[1];
         int bufL0 = L[0]/inEl[0];
@@ -1607,8 +2095,14 @@ void CodeGen_FIRRTL_Target::print_linebuffer2D(string name, int L[4], Type t, in
         do_indent(); stream << "io.in.ready <= UInt<1>(0)\n";
         do_indent(); stream << "reg col : UInt<" << nBit_imgL0 << ">, clock with : (reset => (reset, UInt<" << nBit_imgL0 << ">(0)))\n";
         do_indent(); stream << "reg row : UInt<" << nBit_imgL1 << ">, clock with : (reset => (reset, UInt<" << nBit_imgL1 << ">(0)))\n";
+        // Each buffered row is a bank of its own, written at the
+        // column of the incoming word and read at the same column by
+        // the following rows, which is one read and one write per bank
+        // and cycle. The banks are synchronous-read memories, so that
+        // they map to block RAM; the read address is the column of the
+        // next input, one cycle ahead.
         for(int i=0; i<bufL1; i++) {
-            do_indent(); stream << "cmem buffer" << i << " : {value : " << inS << "}[" << bufL0 << "]\n";
+            do_indent(); stream << "smem buffer" << i << " : {value : " << inS << "}[" << bufL0 << "]\n";
         }
         if (bufL1!=0) {
             do_indent(); stream << "reg writeIdx1 : UInt<" << nBit_bufL1 << ">, clock with : (reset => (reset, UInt<" << nBit_bufL1 << ">(0)))\n";
@@ -1631,11 +2125,23 @@ void CodeGen_FIRRTL_Target::print_linebuffer2D(string name, int L[4], Type t, in
         }
         }
         }
+        if (bufL1!=0) {
+            do_indent(); stream << "wire col_next : UInt<" << nBit_imgL0 << ">\n";
+            do_indent(); stream << "col_next <= col\n";
+            do_indent(); stream << "when and(io.in.valid, " << name << "_1D.io.in.ready) :\n";
+            do_indent(); stream << "  col_next <= tail(add(col, UInt<1>(1)), 1)\n";
+            do_indent(); stream << "  when eq(col, UInt<" << nBit_imgL0 << ">(" << imgL0-1 << ")) :\n";
+            do_indent(); stream << "    col_next <= UInt<" << nBit_imgL0 << ">(0)\n";
+            do_indent(); stream << "    skip\n";
+            do_indent(); stream << "  skip\n";
+        }
+        for(int l1=0; l1<bufL1; l1++) {
+            do_indent(); stream << "read mport buffer" << l1 << "_rd = buffer" << l1 << "[col_next], clock\n";
+        }
         do_indent(); stream << "io.in.ready <= UInt<1>(1)\n";
         do_indent(); stream << "when io.in.valid :\n";
         do_indent(); stream << "  when geq(row, UInt<" << nBit_imgL1 << ">(" << bufL1 << ")) :\n";
         for(int l1=0; l1<bufL1; l1++) {
-            do_indent(); stream << "    infer mport buffer" << l1 << "_rd = buffer" << l1 << "[col], clock\n";
             do_indent(); stream << "    node inSliceL1s_buffer" << l1 << " = tail(asUInt(sub(UInt<" << nBit_bufL1+1 << ">(" << bufL1+l1 << "), writeIdx1)), 1)\n";
             do_indent(); stream << "    wire inSliceL1_buffer" << l1 << " : UInt<" << nBit_outEl1 << ">\n";
             do_indent(); stream << "    inSliceL1_buffer" << l1 << " is invalid\n";
@@ -1714,7 +2220,7 @@ void CodeGen_FIRRTL_Target::print_linebuffer2D(string name, int L[4], Type t, in
 
         for(int l1=0; l1<bufL1; l1++) {
             do_indent(); stream << "    when eq(UInt<" << nBit_bufL1 << ">(" << l1 << "), writeIdx1) :\n";
-            do_indent(); stream << "      infer mport buffer" << l1 << "_wr = buffer" << l1 << "[col], clock\n";
+            do_indent(); stream << "      write mport buffer" << l1 << "_wr = buffer" << l1 << "[col], clock\n";
             for (int i3=0; i3<inEl[3]; i3++) {
             for (int i2=0; i2<inEl[2]; i2++) {
             for (int i1=0; i1<inEl[1]; i1++) {
@@ -1976,6 +2482,9 @@ void CodeGen_FIRRTL_Target::print_forblock(ForBlock *c)
     }
     stream << "\n";
 
+    do_indent(); stream << ";  pipeline depth=" << c->getPipelineDepth() << "\n";
+    do_indent(); stream << ";  initiation interval=" << c->getInitiationInterval() << "\n";
+
     stream << "\n";
 
     // Body of ForBlock
@@ -2002,7 +2511,7 @@ void CodeGen_FIRRTL_Target::print_forblock(ForBlock *c)
         // Use +1 bit to prevent becoming minus value when typed cased.
     }
 
-    int ppdepth = c->getPipelineDepth(); // Always 1 for now
+    int ppdepth = c->getPipelineDepth(); // Stages of the datapath plus the output register
     for(unsigned i = 0 ; i < vars.size() ; i++) {
         do_indent();
         // Let's use 32-bit integer so that its behavior is matching with HLS C.
@@ -2038,6 +2547,12 @@ void CodeGen_FIRRTL_Target::print_forblock(ForBlock *c)
     do_indent(); stream << "reg state : UInt<2>, clock with : (reset => (reset, UInt<2>(0)))\n";
     do_indent(); stream << "reg is_last_stencil : UInt<1>, clock with : (reset => (reset, UInt<1>(0)))\n";
     do_indent(); stream << "wire run_step : UInt<1>\n";
+    int ii = c->getInitiationInterval();
+    int ii_nBits = std::max((int)std::ceil(std::log2((float)ii)), 1);
+    if (ii > 1) {
+        do_indent(); stream << "reg ii_phase : UInt<" << ii_nBits << ">, clock with : (reset => (reset, UInt<" << ii_nBits << ">(0)))\n";
+        do_indent(); stream << "node ii_last = eq(ii_phase, UInt<" << ii_nBits << ">(" << ii-1 << "))\n";
+    }
 
     do_indent(); stream << out_stream << ".value is invalid\n";
     do_indent(); stream << out_stream << ".valid is invalid\n";
@@ -2055,6 +2570,11 @@ void CodeGen_FIRRTL_Target::print_forblock(ForBlock *c)
     do_indent(); stream << "done_out is invalid\n";
     do_indent(); stream << "run_step is invalid\n";
 
+    // Shared operators.
+    for(auto &p : c->getConnectKeys()) {
+        do_indent(); stream << p << " <= " << c->getConnects()[p] << "\n";
+    }
+
     for(auto &p : c->getInputs()) {
         do_indent();
         stream << p.first << ".ready <= UInt<1>(0)\n";
@@ -2087,6 +2607,9 @@ void CodeGen_FIRRTL_Target::print_forblock(ForBlock *c)
         do_indent(); stream << "is_last_stencil_d" << (j+1) << " <= UInt<1>(0)\n";
     }
     do_indent(); stream << "state <= UInt<2>(0)\n";
+    if (ii > 1) {
+        do_indent(); stream << "ii_phase <= UInt<" << ii_nBits << ">(0)\n";
+    }
     close_scope("");
     do_indent(); stream << "else when done_out :\n";
     open_scope();
@@ -2100,6 +2623,28 @@ void CodeGen_FIRRTL_Target::print_forblock(ForBlock *c)
     stream << "when " << out_stream << ".ready :\n";
     open_scope();
 
+    if (ii > 1) {
+        // The FSM and the pipeline advance in the last phase of each
+        // interval. The phases only count while the FSM is able to
+        // advance, so that the operands of the shared operators are
+        // valid in every phase.
+        string inputs_valid = "UInt<1>(1)";
+        for(auto &p : c->getInputs()) {
+            inputs_valid = "and(" + inputs_valid + ", " + p.first + ".valid)";
+        }
+        do_indent(); stream << "node ii_go = or(neq(state, UInt<2>(0)), " << inputs_valid << ")\n";
+        do_indent(); stream << "when ii_go :\n";
+        open_scope();
+        do_indent(); stream << "run_step <= UInt<1>(1)\n";
+        do_indent(); stream << "ii_phase <= tail(add(ii_phase, UInt(1)), 1)\n";
+        do_indent(); stream << "when ii_last :\n";
+        do_indent(); stream << "  ii_phase <= UInt<" << ii_nBits << ">(0)\n";
+        do_indent(); stream << "  skip\n";
+        close_scope("ii_go");
+        do_indent(); stream << "when ii_last :\n";
+        open_scope();
+    }
+
     // Print FSM
     // Case 1, When there is no Stencil Var.
     //    S0 -> S0 -> ... -> S2
@@ -2214,9 +2759,11 @@ void CodeGen_FIRRTL_Target::print_forblock(ForBlock *c)
 
     // forwarding through pipeline
     for(unsigned i = 0 ; i < stencil_vars.size() ; i++) {
-        for(int j = 0 ; j < ppdepth ; j++) {
+        do_indent();
+        stream << stencil_vars[i] << "_d1 <= " << stencil_vars[i] << "\n";
+        for(int j = 1 ; j < ppdepth ; j++) {
             do_indent();
-            stream << stencil_vars[i] << "_d" << (j+1) << " <= " << stencil_vars[i] << "\n";
+            stream << stencil_vars[i] << "_d" << (j+1) << " <= " << stencil_vars[i] << "_d" << j << "\n";
         }
     }
     do_indent(); stream << "is_last_stencil_d1 <= is_last_stencil\n";
@@ -2244,6 +2791,10 @@ void CodeGen_FIRRTL_Target::print_forblock(ForBlock *c)
         }
     }
 
+    if (ii > 1) {
+        close_scope("ii_last");
+    }
+
     close_scope(out_stream + ".ready");
 
     close_scope("started");
@@ -2365,6 +2916,15 @@ void CodeGen_FIRRTL_Target::print_dispatch(Dispatch *c)
     vector<vector<int> > consumer_extents = c->getConsumerExtents();
     int num_of_consumers = consumer_fifo_depths.size();
 
+    // Each consumer receives its window of the input stencil.
+    map<string, int> consumer_index;
+    vector<string> consumer_streams = c->getConsumerStreams();
+    for (size_t i = 0; i < consumer_streams.size(); i++) {
+        consumer_index[consumer_streams[i]] = i;
+    }
+    vector<vector<int> > window_offsets = c->getConsumerWindowOffsets();
+    vector<vector<int> > window_sizes = c->getConsumerWindowSizes();
+
     do_indent(); stream << "clock is invalid\n";
     do_indent(); stream << "reset is invalid\n";
     do_indent();
@@ -2379,10 +2939,12 @@ void CodeGen_FIRRTL_Target::print_dispatch(Dispatch *c)
         stream << "reg counter" << i << " : UInt<" << store_nBits[i] << ">, clock with : (reset => (reset, UInt<" << store_nBits[i] << ">(0)))\n";
     }
     for(auto &p : c->getOutputs()) {
+        FIRRTL_Type out_stencil = p.second;
+        out_stencil.type = FIRRTL_Type::StencilContainerType::Stencil;
         do_indent();
         stream << p.first << ".valid <= UInt<1>(0)\n";
         do_indent();
-        stream << "wire " << p.first << "_inv : " << print_stencil_type(in_stencil) << "\n";
+        stream << "wire " << p.first << "_inv : " << print_stencil_type(out_stencil) << "\n";
         do_indent();
         stream << p.first << "_inv is invalid\n";
         do_indent();
@@ -2432,7 +2994,37 @@ void CodeGen_FIRRTL_Target::print_dispatch(Dispatch *c)
         do_indent(); stream << "when c" << i << "r :\n";
         open_scope();
         do_indent(); stream << consumer_names[i] << ".valid <= UInt<1>(1)\n";
-        do_indent(); stream << consumer_names[i] << ".value <= " << in_name << ".value\n";
+        int k = consumer_index.count(consumer_names[i]) ? consumer_index[consumer_names[i]] : -1;
+        bool whole_window = true;
+        for (int j = 0; k >= 0 && j < num_of_dimensions; j++) {
+            whole_window &= window_sizes[k][j] == stencil_sizes[j];
+        }
+        if (whole_window) {
+            do_indent(); stream << consumer_names[i] << ".value <= " << in_name << ".value\n";
+        } else {
+            // e.g. c.value[0][0] <= in.value[1][1], the last dimension first
+            vector<int> idx(num_of_dimensions, 0);
+            bool done = false;
+            while (!done) {
+                do_indent(); stream << consumer_names[i] << ".value";
+                for (int j = num_of_dimensions - 1; j >= 0; j--) {
+                    stream << "[" << idx[j] << "]";
+                }
+                stream << " <= " << in_name << ".value";
+                for (int j = num_of_dimensions - 1; j >= 0; j--) {
+                    stream << "[" << idx[j] + window_offsets[k][j] << "]";
+                }
+                stream << "\n";
+                done = true;
+                for (int j = 0; j < num_of_dimensions && done; j++) {
+                    if (++idx[j] < window_sizes[k][j]) {
+                        done = false;
+                    } else {
+                        idx[j] = 0;
+                    }
+                }
+            }
+        }
         close_scope("");
     }
 
@@ -2443,7 +3035,9 @@ void CodeGen_FIRRTL_Target::print_dispatch(Dispatch *c)
         }
         int max = store_extents[i] - stencil_sizes[i];
         int step = stencil_steps[i];
-        do_indent(); stream << "node counter" << i << "_is_max = eq(counter" << i << ", UInt(" << max << "))\n";
+        // An N-wide stream steps the counter by N, so the last stencil
+        // is the one within a step of max.
+        do_indent(); stream << "node counter" << i << "_is_max = geq(counter" << i << ", UInt(" << std::max(max - step + 1, 0) << "))\n";
         do_indent(); stream << "node counter" << i << "_inc_c = add(counter" << i << ", UInt(" << step << "))\n";
         do_indent(); stream << "node counter" << i << "_inc = tail(counter" << i << "_inc_c, 1)\n";
         do_indent(); stream << "counter" << i << " <= counter" << i << "_inc\n";
@@ -2473,6 +3067,201 @@ void CodeGen_FIRRTL_Target::print_dispatch(Dispatch *c)
     stream << "\n";
 }
 
+void CodeGen_FIRRTL_Target::print_pingpong(PingPong *c)
+{
+    do_indent();
+    stream << "module " << c->getModuleName() << " :\n";
+    open_scope();
+
+    // Print ports.
+    do_indent();
+    stream << "input clock : Clock\n";
+    do_indent();
+    stream << "input reset : UInt<1>\n";
+
+    for(auto &p : c->getInPorts()) {
+        do_indent();
+        stream << "input " << p.first << " : " << print_stencil_type(p.second) << "\n";
+    }
+    for(auto &p : c->getOutPorts()) {
+        do_indent();
+        stream << "output " << p.first << " : " << print_stencil_type(p.second) << "\n";
+    }
+    stream << "\n";
+
+    string in_stream;
+    FIRRTL_Type s;
+    for(auto &p : c->getInputs()) { // only one input
+        in_stream = p.first;
+        s = p.second;
+        break;
+    }
+    string token;
+    for(auto &p : c->getOutputs()) { // only one token output
+        token = p.first;
+        break;
+    }
+    vector<int> steps = c->getStencilSteps();
+    vector<int> extents = c->getStoreExtents();
+    size_t dims = extents.size();
+    int depth = 1;
+    vector<int> strides(dims);
+    for (size_t i = 0; i < dims; i++) {
+        strides[i] = depth;
+        depth *= extents[i];
+    }
+
+    do_indent(); stream << "; Parameters:\n";
+    do_indent(); stream << ";  Type=" << s.elemType << "\n";
+    do_indent(); stream << ";  Store extents=";
+    for(auto &e : extents) {
+        stream << "[" << e << "]";
+    }
+    stream << "\n";
+    do_indent(); stream << ";  Stencil steps=";
+    for(auto &e : steps) {
+        stream << "[" << e << "]";
+    }
+    stream << "\n";
+    do_indent(); stream << ";  Depth=2x" << depth << "\n";
+    do_indent(); stream << ";  Consumer=" << c->getConsumerBlock() << "\n";
+    stream << "\n";
+
+    // The producer fills the write bank stencil by stencil while the
+    // consumer reads the other one at random. A bank is handed over
+    // when it is full, and handed back when the consumer is done.
+    // The banks are synchronous-read memories with a write port and a
+    // read port each, so that they map to simple dual-port block RAM.
+    // The elements of a stencil are written one per cycle, and the
+    // input is accepted with the last one.
+    string elem_type = print_type(s.elemType);
+    int elems = 1;
+    for (int e : steps) {
+        elems *= e;
+    }
+    do_indent(); stream << "smem  bank0 : " << elem_type << "[" << depth << "]\n";
+    do_indent(); stream << "smem  bank1 : " << elem_type << "[" << depth << "]\n";
+    do_indent(); stream << "reg  r_wr_bank : UInt<1>, clock with : (reset => (reset, UInt<1>(0)))\n";
+    do_indent(); stream << "reg  r_rd_bank : UInt<1>, clock with : (reset => (reset, UInt<1>(0)))\n";
+    do_indent(); stream << "reg  r_rd_sel : UInt<1>, clock with : (reset => (reset, UInt<1>(0)))\n";
+    do_indent(); stream << "reg  r_full0 : UInt<1>, clock with : (reset => (reset, UInt<1>(0)))\n";
+    do_indent(); stream << "reg  r_full1 : UInt<1>, clock with : (reset => (reset, UInt<1>(0)))\n";
+    do_indent(); stream << "reg  r_elem : UInt<32>, clock with : (reset => (reset, UInt<32>(0)))\n";
+    for (size_t i = 0; i < dims; i++) {
+        do_indent(); stream << "reg  r_pos" << i << " : UInt<32>, clock with : (reset => (reset, UInt<32>(0)))\n";
+    }
+    do_indent(); stream << "wire w_write : UInt<1>\n";
+    do_indent(); stream << "wire w_data : " << elem_type << "\n";
+    do_indent(); stream << "wire w_offset : UInt<32>\n";
+    stream << "\n";
+
+    do_indent(); stream << "node wr_full = mux(r_wr_bank, r_full1, r_full0)\n";
+    do_indent(); stream << "node rd_full = mux(r_rd_bank, r_full1, r_full0)\n";
+    do_indent(); stream << "node last_elem = eq(r_elem, UInt<32>(" << elems-1 << "))\n";
+    do_indent(); stream << "w_write <= and(" << in_stream << ".valid, not(wr_full))\n";
+    do_indent(); stream << in_stream << ".ready <= and(not(wr_full), last_elem)\n";
+    do_indent(); stream << token << ".value[0] <= UInt<1>(0)\n";
+    do_indent(); stream << token << ".valid <= rd_full\n";
+    stream << "\n";
+
+    // Select the element of the incoming stencil written this cycle,
+    // and its offset in the tile.
+    do_indent(); stream << "w_data is invalid\n";
+    do_indent(); stream << "w_offset is invalid\n";
+    vector<int> idx(dims, 0);
+    int n = 0;
+    bool done = false;
+    while (!done) {
+        int offset = 0;
+        string elem = in_stream + ".value";
+        for (int j = dims - 1; j >= 0; j--) {
+            offset += idx[j] * strides[j];
+            elem += "[" + std::to_string(idx[j]) + "]";
+        }
+        do_indent(); stream << "when eq(r_elem, UInt<32>(" << n << ")) :\n";
+        do_indent(); stream << "  w_data <= " << elem << "\n";
+        do_indent(); stream << "  w_offset <= UInt<32>(" << offset << ")\n";
+        n++;
+        done = true;
+        for (size_t j = 0; j < dims && done; j++) {
+            if (++idx[j] < steps[j]) {
+                done = false;
+            } else {
+                idx[j] = 0;
+            }
+        }
+    }
+    stream << "\n";
+
+    // Store the element at its position in the tile.
+    do_indent(); stream << "when w_write :\n";
+    string base = "UInt<32>(0)";
+    for (size_t i = 0; i < dims; i++) {
+        base = "add(" + base + ", mul(r_pos" + std::to_string(i) + ", UInt<32>(" + std::to_string(steps[i]*strides[i]) + ")))";
+    }
+    do_indent(); stream << "  node wr_idx = add(" << base << ", w_offset)\n";
+    do_indent(); stream << "  when r_wr_bank :\n";
+    do_indent(); stream << "    write mport bank1_wr = bank1[wr_idx], clock\n";
+    do_indent(); stream << "    bank1_wr <= w_data\n";
+    do_indent(); stream << "  else :\n";
+    do_indent(); stream << "    write mport bank0_wr = bank0[wr_idx], clock\n";
+    do_indent(); stream << "    bank0_wr <= w_data\n";
+    do_indent(); stream << "  r_elem <= tail(add(r_elem, UInt<32>(1)), 1)\n";
+    do_indent(); stream << "  when last_elem :\n";
+    do_indent(); stream << "    r_elem <= UInt<32>(0)\n";
+
+    // Advance the position, and hand the bank over after the last stencil.
+    string indent = "    ";
+    for (size_t i = 0; i < dims; i++) {
+        string pos = "r_pos" + std::to_string(i);
+        int last = (extents[i] + steps[i] - 1) / steps[i] - 1;
+        do_indent(); stream << indent << pos << " <= tail(add(" << pos << ", UInt<32>(1)), 1)\n";
+        do_indent(); stream << indent << "when eq(" << pos << ", UInt<32>(" << last << ")) :\n";
+        indent += "  ";
+        do_indent(); stream << indent << pos << " <= UInt<32>(0)\n";
+    }
+    do_indent(); stream << indent << "r_wr_bank <= not(r_wr_bank)\n";
+    do_indent(); stream << indent << "when r_wr_bank :\n";
+    do_indent(); stream << indent << "  r_full1 <= UInt<1>(1)\n";
+    do_indent(); stream << indent << "else :\n";
+    do_indent(); stream << indent << "  r_full0 <= UInt<1>(1)\n";
+    stream << "\n";
+
+    do_indent(); stream << "when release_in :\n";
+    do_indent(); stream << "  r_rd_bank <= not(r_rd_bank)\n";
+    do_indent(); stream << "  when r_rd_bank :\n";
+    do_indent(); stream << "    r_full1 <= UInt<1>(0)\n";
+    do_indent(); stream << "  else :\n";
+    do_indent(); stream << "    r_full0 <= UInt<1>(0)\n";
+    stream << "\n";
+
+    // The accesses of the consumer take turns on the read port (see
+    // visit(Call)). The read data is selected by the bank the address
+    // was issued to.
+    if (c->getNumOfReads() > 0) {
+        string o = c->getReadPort();
+        string idx_expr = "UInt<32>(0)";
+        for (size_t i = 0; i < dims; i++) {
+            idx_expr = "add(" + idx_expr + ", mul(" + o + ".addr[" + std::to_string(i) + "], UInt<32>(" + std::to_string(strides[i]) + ")))";
+        }
+        do_indent(); stream << "node " << o << "_idx = " << idx_expr << "\n";
+        do_indent(); stream << "wire " << o << "_rd0 : " << elem_type << "\n";
+        do_indent(); stream << "wire " << o << "_rd1 : " << elem_type << "\n";
+        do_indent(); stream << o << "_rd0 is invalid\n";
+        do_indent(); stream << o << "_rd1 is invalid\n";
+        do_indent(); stream << "when " << o << "_en :\n";
+        do_indent(); stream << "  r_rd_sel <= r_rd_bank\n";
+        do_indent(); stream << "  read mport bank0_rd = bank0[" << o << "_idx], clock\n";
+        do_indent(); stream << "  read mport bank1_rd = bank1[" << o << "_idx], clock\n";
+        do_indent(); stream << "  " << o << "_rd0 <= bank0_rd\n";
+        do_indent(); stream << "  " << o << "_rd1 <= bank1_rd\n";
+        do_indent(); stream << o << ".value <= mux(r_rd_sel, " << o << "_rd1, " << o << "_rd0)\n";
+    }
+
+    close_scope(" end of " + c->getModuleName());
+    stream << "\n";
+}
+
 void CodeGen_FIRRTL_Target::open_scope()
 {
     //cache.clear();
@@ -2486,12 +3275,157 @@ void CodeGen_FIRRTL_Target::close_scope(const std::string &comment)
     indent -= 2;
 }
 
+namespace {
+
+// Number of bits of the smallest signed integer holding v.
+int signed_bits(int64_t v) {
+    int n = 1;
+    while (n < 64 && (v < -(int64_t(1) << (n-1)) || v >= (int64_t(1) << (n-1)))) {
+        n++;
+    }
+    return n;
+}
+
+}
+
+string CodeGen_FIRRTL_Target::print_fixed_assignment(const string &rhs, Fixed_Format fmt,
+                                                     const vector<string> &operands) {
+    string r = print_assignment(Int(fmt.bits), rhs, operands);
+    fixed_formats[r] = fmt;
+    return r;
+}
+
+// Prints E as a fixed-point value. Integers have no fraction bits, and
+// float values without a known format come from stencils or parameters.
+string CodeGen_FIRRTL_Target::print_fixed(Expr e, Fixed_Format &fmt) {
+    string v = print_expr(e);
+    Type t = e.type();
+    if (t.is_float()) {
+        auto it = fixed_formats.find(v);
+        if (it != fixed_formats.end()) {
+            fmt = it->second;
+        } else {
+            fmt = {t.bits(), fixed_frac_bits};
+        }
+        return v;
+    } else if (t.is_uint()) {
+        fmt = {t.bits() + 1, 0};
+        return print_fixed_assignment("cvt($0)", fmt, {v});
+    } else {
+        fmt = {t.bits(), 0};
+        return v;
+    }
+}
+
+// Changes the number of fraction bits of ID to FRAC. Dropped fraction
+// bits are rounded to nearest.
+string CodeGen_FIRRTL_Target::fixed_align(const string &id, Fixed_Format &fmt, int frac) {
+    if (frac == fmt.frac) {
+        return id;
+    } else if (frac > fmt.frac) {
+        int n = frac - fmt.frac;
+        fmt = {fmt.bits + n, frac};
+        return print_fixed_assignment("shl($0, " + std::to_string(n) + ")", fmt, {id});
+    }
+    int n = fmt.frac - frac;
+    string half = "SInt<" + std::to_string(n + 1) + ">(" + std::to_string(int64_t(1) << (n - 1)) + ")";
+    Fixed_Format sum = {std::max(fmt.bits, n + 1) + 1, fmt.frac};
+    string r = print_fixed_assignment("add($0, " + half + ")", sum, {id});
+    fmt = {std::max(sum.bits - n, 1), frac};
+    return print_fixed_assignment("shr($0, " + std::to_string(n) + ")", fmt, {r});
+}
+
+// Clamps the integer ID to the range of T and converts it to T.
+string CodeGen_FIRRTL_Target::fixed_saturate(const string &id, Fixed_Format fmt, Type t) {
+    int n = t.bits();
+    string r = id;
+    if (n < 64) {
+        int64_t hi = t.is_uint() ? (int64_t(1) << n) - 1 : (int64_t(1) << (n - 1)) - 1;
+        int64_t lo = t.is_uint() ? 0 : -(int64_t(1) << (n - 1));
+        string k = "SInt<" + std::to_string(n + 1) + ">";
+        string shi = k + "(" + std::to_string(hi) + ")";
+        string slo = k + "(" + std::to_string(lo) + ")";
+        r = print_assignment(Int(std::max(fmt.bits, n + 1)),
+                             "mux(gt($0, " + shi + "), " + shi + ", mux(lt($0, " + slo + "), " + slo + ", $0))", {r});
+    }
+    string low = "bits(pad($0, " + std::to_string(n) + "), " + std::to_string(n - 1) + ", 0)";
+    return print_assignment(t, t.is_uint() ? low : "asSInt(" + low + ")", {r});
+}
+
+// Float to integer casts round toward zero, as in C.
+string CodeGen_FIRRTL_Target::fixed_to_int(const string &id, Fixed_Format fmt, Type t) {
+    string r = id;
+    if (fmt.frac > 0) {
+        string f = std::to_string(fmt.frac);
+        Fixed_Format ifmt = {std::max(fmt.bits - fmt.frac + 2, 1), 0};
+        r = print_fixed_assignment("mux(lt($0, SInt<1>(0)), neg(shr(neg($0), " + f + ")), shr($0, " + f + "))", ifmt, {id});
+        fmt = ifmt;
+    }
+    return fixed_saturate(r, fmt, t);
+}
+
+// Converts ID to the format float stencils are stored in.
+string CodeGen_FIRRTL_Target::fixed_to_storage(const string &id, Fixed_Format fmt, Type t) {
+    string r = fixed_align(id, fmt, fixed_frac_bits);
+    return fixed_saturate(r, fmt, Int(t.bits()));
+}
+
+void CodeGen_FIRRTL_Target::visit_fixed_binop(Type t, Expr a, Expr b, const char *op) {
+    Fixed_Format fa, fb;
+    string sa = print_fixed(a, fa);
+    string sb = print_fixed(b, fb);
+    int frac = std::max(fa.frac, fb.frac);
+    sa = fixed_align(sa, fa, frac);
+    sb = fixed_align(sb, fb, frac);
+    string rhs = string(op) + "($0, $1)";
+    if (t.is_float()) { // add, sub
+        print_fixed_assignment(rhs, {std::max(fa.bits, fb.bits) + 1, frac}, {sa, sb});
+    } else { // comparisons
+        print_assignment(t, rhs, {sa, sb});
+    }
+}
+
+// There are no floating-point cores for the FIRRTL backend to bind
+// float operations to, so the accelerator must carry float values in
+// fixed point instead.
+string CodeGen_FIRRTL_Target::print_float_op(const string &op, const vector<Expr> &args, Type result) {
+    user_error << "The FIRRTL backend has no floating-point " << op << " operator. "
+               << "Schedule the accelerator with Func::fixed_point() to compute it in fixed point.\n";
+    return "";
+}
+
 void CodeGen_FIRRTL_Target::visit(const Variable *op) {
     id = print_name(op->name);
 }
 
 void CodeGen_FIRRTL_Target::visit(const Cast *op)
 {
+    if (op->type.is_float() || op->value.type().is_float()) {
+        Type from = op->value.type();
+        if (fixed_frac_bits > 0) {
+            Fixed_Format fmt;
+            string v = print_fixed(op->value, fmt);
+            if (op->type.is_float()) { // float and integer values share the format
+                fixed_formats[v] = fmt;
+                id = v;
+            } else {
+                fixed_to_int(v, fmt, op->type);
+            }
+        } else if (from.is_float() && op->type.is_float()) {
+            if (from.bits() == op->type.bits()) {
+                id = print_expr(op->value);
+            } else {
+                print_float_op(op->type.bits() == 16 ? "to_f16" : "to_f32", {op->value}, op->type);
+            }
+        } else if (op->type.is_float()) {
+            print_float_op("from_i32", {cast(Int(32), op->value)}, op->type);
+        } else {
+            string v = print_float_op("to_i32", {op->value}, Int(32));
+            print_expr(cast(op->type, Variable::make(Int(32), v)));
+        }
+        return;
+    }
+
     // Solution to match with C type conversion rule:
     //   Perform Bit-width extension/shrink before type conversion.
 
@@ -2500,19 +3434,19 @@ void CodeGen_FIRRTL_Target::visit(const Cast *op)
 
     if (lhs_bits==rhs_bits) { // simplification
         if ((op->type).is_int()) {
-            print_assignment(op->type, "asSInt(" + print_expr(op->value) + ")");
+            print_assignment(op->type, "asSInt($0)", {print_expr(op->value)});
         } else {
-            print_assignment(op->type, "asUInt(" + print_expr(op->value) + ")");
+            print_assignment(op->type, "asUInt($0)", {print_expr(op->value)});
         }
     } else if (lhs_bits>rhs_bits) { // narrow to wider
         string b = std::to_string(lhs_bits); // pad() doesn't change type.
-        print_assignment(op->type, "pad(" + print_expr(op->value) + ", " + b + ")");
+        print_assignment(op->type, "pad($0, " + b + ")", {print_expr(op->value)});
     } else {
         string b = std::to_string(lhs_bits-1); // wide to narrower
         if ((op->type).is_int()) { // bits() result is always unsigned.
-            print_assignment(op->type, "asSInt(bits(" + print_expr(op->value) + ", " + b + ", 0))");
+            print_assignment(op->type, "asSInt(bits($0, " + b + ", 0))", {print_expr(op->value)});
         } else {
-            print_assignment(op->type, "bits(" + print_expr(op->value) + ", " + b + ", 0)");
+            print_assignment(op->type, "bits($0, " + b + ", 0)", {print_expr(op->value)});
         }
     }
 }
@@ -2520,61 +3454,148 @@ void CodeGen_FIRRTL_Target::visit(const Cast *op)
 void CodeGen_FIRRTL_Target::visit_uniop(Type t, Expr a, const char * op) {
     string sa = print_expr(a);
     string sop(op);
-    print_assignment(t, sop + "(" + sa + ")");
+    print_assignment(t, sop + "($0)", {sa});
 }
 
 void CodeGen_FIRRTL_Target::visit_binop(Type t, Expr a, Expr b, const char * op) {
+    if (a.type().is_float()) { // comparisons
+        string sop(op);
+        if (fixed_frac_bits > 0) {
+            visit_fixed_binop(t, a, b, op);
+        } else if (sop == "lt") {
+            print_float_op("lt", {a, b}, t);
+        } else if (sop == "gt") {
+            print_float_op("lt", {b, a}, t);
+        } else if (sop == "leq") {
+            print_float_op("le", {a, b}, t);
+        } else if (sop == "geq") {
+            print_float_op("le", {b, a}, t);
+        } else if (sop == "eq") {
+            print_float_op("eq", {a, b}, t);
+        } else if (sop == "neq") {
+            string e = print_float_op("eq", {a, b}, t);
+            print_assignment(t, "not($0)", {e});
+        } else {
+            user_error << "Floating-point " << sop << " is not supported by the FIRRTL backend.\n";
+        }
+        return;
+    }
     string sa = print_expr(a);
     string sb = print_expr(b);
     string sop(op);
-    print_assignment(t, sop + "(" + sa + ", " + sb + ")");
+    print_assignment(t, sop + "($0, $1)", {sa, sb});
 }
 
 void CodeGen_FIRRTL_Target::visit(const Add *op) {
+    if (op->type.is_float()) {
+        if (fixed_frac_bits > 0) {
+            visit_fixed_binop(op->type, op->a, op->b, "add");
+        } else {
+            print_float_op("add", {op->a, op->b}, op->type);
+        }
+        return;
+    }
+    if (current_fb && current_fb->getInitiationInterval() > 1) {
+        print_shared_op("add", op->type, op->a, op->b);
+        return;
+    }
     ostringstream oss;
     if ((op->type).is_int()) {
         oss << "asSInt("; // tail() makes everything unsigned. convert back.
     }
-    oss << "tail(add(" << print_expr(op->a) << ", " << print_expr(op->b) << "), 1)";
+    string sa = print_expr(op->a);
+    string sb = print_expr(op->b);
+    oss << "tail(add($0, $1), 1)";
     if ((op->type).is_int()) {
         oss << ")";
     }
-    print_assignment(op->type, oss.str());
+    print_assignment(op->type, oss.str(), {sa, sb});
 }
 
 void CodeGen_FIRRTL_Target::visit(const Sub *op) {
+    if (op->type.is_float()) {
+        if (fixed_frac_bits > 0) {
+            visit_fixed_binop(op->type, op->a, op->b, "sub");
+        } else {
+            print_float_op("sub", {op->a, op->b}, op->type);
+        }
+        return;
+    }
+    if (current_fb && current_fb->getInitiationInterval() > 1) {
+        print_shared_op("sub", op->type, op->a, op->b);
+        return;
+    }
     //visit_binop(op->type, op->a, op->b, "sub");
     ostringstream oss;
     if ((op->type).is_int()) { // tail() makes everything unsigned. convert back.
         oss << "asSInt(";
     }
-    oss << "tail(sub(" << print_expr(op->a) << ", " << print_expr(op->b) << "), 1)";
+    string sa = print_expr(op->a);
+    string sb = print_expr(op->b);
+    oss << "tail(sub($0, $1), 1)";
     if ((op->type).is_int()) {
         oss << ")";
     }
-    print_assignment(op->type, oss.str());
+    print_assignment(op->type, oss.str(), {sa, sb});
 }
 
 void CodeGen_FIRRTL_Target::visit(const Mul *op) {
+    if (op->type.is_float()) {
+        if (fixed_frac_bits > 0) {
+            // Round the product back to the working precision.
+            Fixed_Format fa, fb;
+            string sa = print_fixed(op->a, fa);
+            string sb = print_fixed(op->b, fb);
+            Fixed_Format fmt = {fa.bits + fb.bits, fa.frac + fb.frac};
+            string r = print_fixed_assignment("mul($0, $1)", fmt, {sa, sb});
+            if (fmt.frac > fixed_frac_bits) {
+                r = fixed_align(r, fmt, fixed_frac_bits);
+            }
+            id = r;
+        } else {
+            print_float_op("mul", {op->a, op->b}, op->type);
+        }
+        return;
+    }
+    if (current_fb && current_fb->getInitiationInterval() > 1) {
+        print_shared_op("mul", op->type, op->a, op->b);
+        return;
+    }
     ostringstream oss;
     //visit_binop(op->type, op->a, op->b, "mul");
     int bits = op->type.bits();
     if ((op->type).is_int()) { // bits() makes everything unsigned. convert back.
         oss << "asSInt(";
     }
-    oss << "bits(mul(" << print_expr(op->a) << ", " << print_expr(op->b) << "), " << bits-1 << ", 0)";
+    string sa = print_expr(op->a);
+    string sb = print_expr(op->b);
+    oss << "bits(mul($0, $1), " << bits-1 << ", 0)";
     if ((op->type).is_int()) {
         oss << ")";
     }
-    print_assignment(op->type, oss.str());
+    print_assignment(op->type, oss.str(), {sa, sb});
 }
 
 void CodeGen_FIRRTL_Target::visit(const Div *op) {
+    if (op->type.is_float()) {
+        if (fixed_frac_bits > 0) {
+            // Pre-scale the dividend so that the quotient has the
+            // working number of fraction bits.
+            Fixed_Format fa, fb;
+            string sa = print_fixed(op->a, fa);
+            string sb = print_fixed(op->b, fb);
+            sa = fixed_align(sa, fa, fixed_frac_bits + fb.frac);
+            print_fixed_assignment("div($0, $1)", {fa.bits + 1, fixed_frac_bits}, {sa, sb});
+        } else {
+            print_float_op("div", {op->a, op->b}, op->type);
+        }
+        return;
+    }
     int bits;
     if (is_const_power_of_two_integer(op->b, &bits)) {
         ostringstream oss;
-        oss << "shr(" << print_expr(op->a) << ", " << bits << ")";
-        print_assignment(op->type, oss.str());
+        oss << "shr($0, " << bits << ")";
+        print_assignment(op->type, oss.str(), {print_expr(op->a)});
     } else if (op->type.is_int()) {
         print_expr(lower_euclidean_div(op->a, op->b));
     } else {
@@ -2583,17 +3604,19 @@ void CodeGen_FIRRTL_Target::visit(const Div *op) {
 }
 
 void CodeGen_FIRRTL_Target::visit(const Mod *op) {
+    user_assert(!op->type.is_float()) << "Floating-point mod is not supported by the FIRRTL backend.\n";
     int bits;
     if (is_const_power_of_two_integer(op->b, &bits)) {
         ostringstream oss;
         if ((op->type).is_int()) {
             oss << "asSInt(";
         }
-        oss << "and(" << print_expr(op->a) << ", UInt<" << (op->type).bits() << ">(" << ((1 << bits)-1) << "))";
+        string sa = print_expr(op->a);
+        oss << "and($0, UInt<" << (op->type).bits() << ">(" << ((1 << bits)-1) << "))";
         if ((op->type).is_int()) {
             oss << ")";
         }
-        print_assignment(op->type, oss.str());
+        print_assignment(op->type, oss.str(), {sa});
     } else if (op->type.is_int()) {
         print_expr(lower_euclidean_mod(op->a, op->b));
     } else {
@@ -2663,7 +3686,7 @@ void CodeGen_FIRRTL_Target::visit(const Or *op)
 
 void CodeGen_FIRRTL_Target::visit(const Not *op)
 {
-    print_assignment(op->type, "not(" + print_expr(op->a) + ")");
+    print_assignment(op->type, "not($0)", {print_expr(op->a)});
 }
 
 void CodeGen_FIRRTL_Target::visit(const IntImm *op) {
@@ -2697,7 +3720,23 @@ static bool isinf(T x)
 
 void CodeGen_FIRRTL_Target::visit(const FloatImm *op)
 {
-    internal_assert(true) << "Not support floating yet..\n";
+    user_assert(!isnan(op->value) && !isinf(op->value))
+        << "The FIRRTL backend doesn't support NaN or infinity constants.\n";
+    if (fixed_frac_bits > 0) {
+        int64_t q = (int64_t)std::llround(op->value * (double)(int64_t(1) << fixed_frac_bits));
+        Fixed_Format fmt = {signed_bits(q), fixed_frac_bits};
+        print_fixed_assignment("SInt<" + std::to_string(fmt.bits) + ">(" + std::to_string(q) + ")", fmt);
+    } else if (op->type.bits() == 32) {
+        float f = (float)op->value;
+        uint32_t b;
+        memcpy(&b, &f, sizeof(b));
+        print_assignment(op->type, "asSInt(UInt<32>(" + std::to_string(b) + "))");
+    } else if (op->type.bits() == 16) {
+        uint16_t b = float16_t(op->value).to_bits();
+        print_assignment(op->type, "asSInt(UInt<16>(" + std::to_string(b) + "))");
+    } else {
+        user_error << "The FIRRTL backend supports float16 and float32 only.\n";
+    }
 }
 
 void CodeGen_FIRRTL_Target::visit(const Call *op)
@@ -2732,8 +3771,7 @@ void CodeGen_FIRRTL_Target::visit(const Call *op)
         internal_assert(op->args.size() == 1);
         Expr a = op->args[0];
         Expr cast_a = cast(op->type, a);
-        rhs << print_expr(cast_a);
-        print_assignment(op->type, rhs.str());
+        print_assignment(op->type, "$0", {print_expr(cast_a)});
     } else if (op->is_intrinsic(Call::shift_left)) {
         internal_assert(op->args.size() == 2);
         Expr a = op->args[0];
@@ -2741,8 +3779,8 @@ void CodeGen_FIRRTL_Target::visit(const Call *op)
         const UIntImm *b_imm = b.as<UIntImm>();
         if (b_imm) { // Constant shift, use shl
             ostringstream rhs;
-            rhs << "shl(" << print_expr(a) << ", " << b_imm->value << ")";
-            print_assignment(op->type, rhs.str());
+            rhs << "shl($0, " << b_imm->value << ")";
+            print_assignment(op->type, rhs.str(), {print_expr(a)});
         } else {
             Type t = UInt(8); // Workaround for the limit: dshl(e, n), n should be 19(or 20) bit or less. 8 might be enough.
             Expr cast_b = cast(t, b);
@@ -2755,8 +3793,8 @@ void CodeGen_FIRRTL_Target::visit(const Call *op)
         const UIntImm *b_imm = b.as<UIntImm>();
         if (b_imm) { // Constant shift, use shr
             ostringstream rhs;
-            rhs << "shr(" << print_expr(a) << ", " << std::to_string(b_imm->value) << ")";
-            print_assignment(op->type, rhs.str());
+            rhs << "shr($0, " << std::to_string(b_imm->value) << ")";
+            print_assignment(op->type, rhs.str(), {print_expr(a)});
         } else {
             Type t = UInt(op->type.bits());
             Expr cast_b = cast(t, b);
@@ -2770,15 +3808,14 @@ void CodeGen_FIRRTL_Target::visit(const Call *op)
         Expr a = op->args[0];
         Expr b = op->args[1];
         Expr e = select(a < b, b - a, a - b);
-        rhs << print_expr(e);
-        print_assignment(op->type, rhs.str());
+        print_assignment(op->type, "$0", {print_expr(e)});
     } else if (op->is_intrinsic(Call::abs)) {
         ostringstream rhs;
         internal_assert(op->args.size() == 1);
         Expr a0 = op->args[0];
-        rhs << print_expr(cast(op->type, select(a0 > 0, a0, -a0)));
+        string abs = print_expr(cast(op->type, select(a0 > 0, a0, -a0)));
         Type t = UInt((op->type).bits());
-        print_assignment(t, rhs.str());
+        print_assignment(t, "$0", {abs});
     } else if (op->is_intrinsic(Call::div_round_to_zero)) {
         Expr a = op->args[0];
         Expr b = op->args[1];
@@ -2787,6 +3824,10 @@ void CodeGen_FIRRTL_Target::visit(const Call *op)
         Expr a = op->args[0];
         Expr b = op->args[1];
         visit_binop(op->type, a, b, "rem");
+    } else if (op->call_type == Call::PureExtern &&
+               (op->name == "sqrt_f32" || op->name == "sqrt_f16")) {
+        user_assert(fixed_frac_bits == 0) << "sqrt is not supported in fixed-point mode.\n";
+        print_float_op("sqrt", {op->args[0]}, op->type);
     } else if(op->name == "linebuffer") {
         const Variable *input = op->args[0].as<Variable>();
         const Variable *output = op->args[1].as<Variable>();
@@ -2976,24 +4017,180 @@ void CodeGen_FIRRTL_Target::visit(const Call *op)
             for(size_t i = 0; i < op->args.size(); i++) {
                 current_fb->print(rhs.str()+".addr["+std::to_string(i)+"] <= asUInt("+print_expr(op->args[i])+")\n");
             }
-            print_assignment(op->type, rhs.str()+".value");
+            print_assignment(op->type, "$0.value", {rhs.str()});
         } else {
             // IR: out.stencil_update(0, 0, 0)
             // FIRRTL: out_stencil_update[0][0][0]
-            rhs << print_name(op->name) << "[";
+            vector<string> operands = {print_name(op->name)};
+            rhs << "$0[";
             for(int i = op->args.size()-1; i >= 0; i--) {
                 const IntImm *a  = op->args[i].as<IntImm>();
                 if (a) {
                     rhs << std::to_string(a->value);
                 } else {
-                    rhs << "asUInt(" + print_expr(op->args[i]) + ")";
+                    rhs << "asUInt($" << operands.size() << ")";
+                    operands.push_back(print_expr(op->args[i]));
                 }
                 if (i != 0)
                     rhs << "][";
             }
             rhs << "]";
-            print_assignment(op->type, rhs.str());
+            print_assignment(op->type, rhs.str(), operands);
+        }
+    } else if (ends_with(op->name, ".pingpong")) {
+        internal_assert(current_fb);
+        // The accesses share one read port of the ping-pong buffer,
+        // which has a cycle of read latency. Access k drives the
+        // address in phase k of the interval and its data is held from
+        // phase k+1, like the results of a shared operator. The port
+        // only reads while the pipeline steps, so the data survives a
+        // stall between the two phases.
+        // IR: blury.pingpong(x, y, z)
+        // FIRRTL: blury_pingpong_rd : {value : UInt<16>, flip addr : UInt<32>[4]}
+        // when eq(ii_phase, UInt(0)) :
+        //   blury_pingpong_rd.addr[0] <= asUInt(x)
+        //   blury_pingpong_rd.addr[1] <= asUInt(y)
+        //   blury_pingpong_rd.addr[2] <= asUInt(z)
+        // when eq(ii_phase, UInt(1)) :
+        //   _1_h <= blury_pingpong_rd.value
+        // when ii_last :
+        //   _1 <= _1_h
+        string pingpong_name = print_name(op->name);
+        internal_assert(pingpongs.count(pingpong_name));
+        PingPong *pp = pingpongs[pingpong_name];
+        string port = pingpong_name + "_rd";
+        FIRRTL_Type stype = {FIRRTL_Type::StencilContainerType::MemRd,op->type,Region(),0,{}};
+        if (pp->getNumOfReads() == 0) {
+            top->addWire("wire_" + port, stype);
+            top->addConnect("wire_" + port, pp->getInstanceName() + "." + port);
+            top->addConnect(current_fb->getInstanceName() + "." + port, "wire_" + port);
+            current_fb->addInPort(port, stype);
+            pp->addOutPort(port, stype);
+            pp->setReadPort(port);
+
+            current_fb->addOutPort(port + "_en", wire_1bit);
+            current_fb->addConnect(port + "_en", "run_step");
+            pp->addInPort(port + "_en", wire_1bit);
+            top->addConnect(pp->getInstanceName() + "." + port + "_en", current_fb->getInstanceName() + "." + port + "_en");
+        }
+        int ii = current_fb->getInitiationInterval();
+        int phase = pp->addRead();
+        internal_assert(phase + 1 < ii)
+            << "Access " << phase << " of " << pingpong_name << " does not fit in the interval of "
+            << current_fb->getInstanceName() << "\n";
+
+        vector<string> ids(op->args.size());
+        for(size_t i = 0; i < op->args.size(); i++) {
+            ids[i] = print_expr(op->args[i]);
+        }
+        int stage = std::max(align_stages(ids), 0);
+        current_fb->print("when eq(ii_phase, UInt(" + std::to_string(phase) + ")) :\n");
+        current_fb->open_scope();
+        for(size_t i = 0; i < ids.size(); i++) {
+            current_fb->print(port+".addr["+std::to_string(i)+"] <= asUInt("+ids[i]+")\n");
         }
+        current_fb->close_scope("");
+        current_fb->addOperation("mux", 32); // address select
+
+        FIRRTL_Type type = {FIRRTL_Type::StencilContainerType::Scalar,op->type,Region(),0,{}};
+        id = unique_name('_');
+        string held = port + ".value";
+        if (phase + 1 < ii - 1) {
+            held = id + "_h";
+            current_fb->addReg(held, type);
+            current_fb->print("when eq(ii_phase, UInt(" + std::to_string(phase + 1) + ")) :\n");
+            current_fb->open_scope();
+            current_fb->print(held + " <= " + port + ".value\n");
+            current_fb->close_scope("");
+        }
+        current_fb->addReg(id, type);
+        print_update(id + " <= " + held + "\n");
+
+        stages[id] = stage + 1;
+        arrivals[id] = 0;
+        stage_types[id] = type;
+    } else if (op->name == "pingpong_buffer") {
+        // syntax:
+        //   pingpong_buffer(update_stream_name, pingpong_name, consumer_name,
+        //                   stencil_step_dim_0, store_extent_dim_0,
+        //                   [stencil_step_dim_1, store_extent_dim_1, ...])
+        internal_assert(op->args.size() >= 5 && op->args.size() % 2 == 1);
+        const Variable *stream_name_var = op->args[0].as<Variable>();
+        const Variable *pingpong_var = op->args[1].as<Variable>();
+        const StringImm *consumer_imm = op->args[2].as<StringImm>();
+        internal_assert(stream_name_var && pingpong_var && consumer_imm);
+        string inputname = print_name(stream_name_var->name);
+        string pingpong_name = print_name(pingpong_var->name);
+        string token_name = pingpong_name + "_to_" + print_name(consumer_imm->value);
+        size_t num_of_demensions = (op->args.size() - 3) / 2;
+        vector<int> stencil_steps(num_of_demensions);
+        vector<int> store_extents(num_of_demensions);
+        for (size_t i = 0; i < num_of_demensions; i++) {
+            stencil_steps[i] = *as_const_int(op->args[i*2 + 3]);
+            store_extents[i] = *as_const_int(op->args[i*2 + 4]);
+        }
+        FIRRTL_Type in_stype = top->getWire("wire_" + inputname); // get stencil type
+
+        // Create PingPong component
+        PingPong *pp = new PingPong("PP_" + pingpong_name);
+        pp->addInput(inputname, in_stype);
+        pp->setStencilSteps(stencil_steps);
+        pp->setStoreExtents(store_extents);
+        pingpongs[pingpong_name] = pp;
+
+        // The consumer takes a token stream, valid while the bank it
+        // reads is full, and releases the bank when its run is done.
+        FIRRTL_Type token_type = {FIRRTL_Type::StencilContainerType::Stream,UInt(1),{Range(0, 1)},1,{1}};
+        pp->addOutput(token_name, token_type);
+        pp->addInPort("release_in", wire_1bit);
+
+        // Add to top
+        top->addInstance(static_cast<Component*>(pp));
+
+        // Connect clock/reset
+        top->addConnect(pp->getInstanceName() + ".clock", "clock");
+        top->addConnect(pp->getInstanceName() + ".reset", "reset");
+
+        // Connect PingPong input port
+        top->addConnect(pp->getInstanceName() + "." + inputname, "wire_" + inputname);     // PP.data_in <= wire
+
+        // Connect PingPong token port. There is no FIFO in between,
+        // since the consumer pops the token every iteration.
+        top->addWire("wire_" + token_name, token_type);
+        top->addConnect("wire_" + token_name, pp->getInstanceName() + "." + token_name);
+
+        id = "0";
+    } else if (op->name == "read_pingpong") {
+        internal_assert(op->args.size() == 2);
+        internal_assert(current_fb); // Inside ForBlock
+        // IR: read_pingpong(blury.pingpong, consumer_name)
+        const Variable *pingpong_var = op->args[0].as<Variable>();
+        const StringImm *consumer_imm = op->args[1].as<StringImm>();
+        internal_assert(pingpong_var && consumer_imm);
+        string pingpong_name = print_name(pingpong_var->name);
+        string token_name = pingpong_name + "_to_" + print_name(consumer_imm->value);
+        internal_assert(pingpongs.count(pingpong_name));
+        PingPong *pp = pingpongs[pingpong_name];
+
+        FIRRTL_Type stype = top->getWire("wire_" + token_name);
+        current_fb->addInput(token_name, stype);
+        top->addConnect(current_fb->getInstanceName() + "." + token_name, "wire_" + token_name);
+
+        // Release the bank once the consumer has drained its pipeline
+        top->addConnect(pp->getInstanceName() + ".release_in", current_fb->getInstanceName() + ".done_out");
+        pp->setConsumerBlock(current_fb->getInstanceName());
+        id = "0";
+    } else if (op->name == "fixed_point" || op->name == "stage_delay") {
+        // IR: fixed_point(frac_bits) and stage_delay(ns), read by add_kernel().
+        id = "0";
+    } else if (op->name == "initiation_interval") {
+        // IR: initiation_interval(ii), ahead of the scan loops.
+        // Applies to the ForBlock created for them.
+        internal_assert(op->args.size() == 1);
+        const int64_t *ii = as_const_int(op->args[0]);
+        internal_assert(ii && *ii > 0);
+        initiation_interval = (int)*ii;
+        id = "0";
     } else if (op->name == "dispatch_stream") {
         // emits the calling arguments in comment
         vector<string> args(op->args.size());
@@ -3008,6 +4205,8 @@ void CodeGen_FIRRTL_Target::visit(const Call *op)
         //                   consumer_0_name, fifo_0_depth,
         //                   consumer_0_offset_dim_0, consumer_0_extent_dim_0,
         //                   [consumer_0_offset_dim_1, consumer_0_extent_dim_1, ...]
+        //                   consumer_0_window_offset_dim_0, consumer_0_window_size_dim_0,
+        //                   [consumer_0_window_offset_dim_1, consumer_0_window_size_dim_1, ...]
         //                   [consumer_1_name, ...])
 
         // recover the structed data from op->args
@@ -3033,23 +4232,31 @@ void CodeGen_FIRRTL_Target::visit(const Call *op)
         vector<int> consumer_fifo_depth(num_of_consumers);
         vector<vector<int> > consumer_offsets(num_of_consumers);
         vector<vector<int> > consumer_extents(num_of_consumers);
+        vector<vector<int> > window_offsets(num_of_consumers);
+        vector<vector<int> > window_sizes(num_of_consumers);
 
-        internal_assert(op->args.size() >= num_of_demensions*3 + 3 + num_of_consumers*(2 + 2*num_of_demensions));
+        internal_assert(op->args.size() >= num_of_demensions*3 + 3 + num_of_consumers*(2 + 4*num_of_demensions));
         for (size_t i = 0; i < num_of_consumers; i++) {
-            const StringImm *string_imm = op->args[num_of_demensions*3 + 3 + (2 + 2*num_of_demensions)*i].as<StringImm>();
+            const StringImm *string_imm = op->args[num_of_demensions*3 + 3 + (2 + 4*num_of_demensions)*i].as<StringImm>();
             internal_assert(string_imm);
             consumer_names[i] = string_imm->value;
-            const IntImm *int_imm = op->args[num_of_demensions*3 + 4 + (2 + 2*num_of_demensions)*i].as<IntImm>();
+            const IntImm *int_imm = op->args[num_of_demensions*3 + 4 + (2 + 4*num_of_demensions)*i].as<IntImm>();
             internal_assert(int_imm);
-            consumer_fifo_depth[i] = int_imm->value; // TODO: We will calculate this automatically.
+            consumer_fifo_depth[i] = int_imm->value; // sized by size_fifo_depths() unless scheduled
             vector<int> offsets(num_of_demensions);
             vector<int > extents(num_of_demensions);
+            vector<int> win_offsets(num_of_demensions);
+            vector<int> win_sizes(num_of_demensions);
             for (size_t j = 0; j < num_of_demensions; j++) {
-                offsets[j] = *as_const_int(op->args[num_of_demensions*3 + 5 + (2 + 2*num_of_demensions)*i + 2*j]);
-                extents[j] = *as_const_int(op->args[num_of_demensions*3 + 6 + (2 + 2*num_of_demensions)*i + 2*j]);
+                offsets[j] = *as_const_int(op->args[num_of_demensions*3 + 5 + (2 + 4*num_of_demensions)*i + 2*j]);
+                extents[j] = *as_const_int(op->args[num_of_demensions*3 + 6 + (2 + 4*num_of_demensions)*i + 2*j]);
+                win_offsets[j] = *as_const_int(op->args[num_of_demensions*5 + 5 + (2 + 4*num_of_demensions)*i + 2*j]);
+                win_sizes[j] = *as_const_int(op->args[num_of_demensions*5 + 6 + (2 + 4*num_of_demensions)*i + 2*j]);
             }
             consumer_offsets[i] = offsets;
             consumer_extents[i] = extents;
+            window_offsets[i] = win_offsets;
+            window_sizes[i] = win_sizes;
         }
 
         // emits declarations of streams for each consumer
@@ -3072,7 +4279,7 @@ void CodeGen_FIRRTL_Target::visit(const Call *op)
         }
 
         for (size_t i = 0; i < num_of_consumers; i++) {
-            consumer_fifo_depth[i] = std::max(consumer_fifo_depth[i], 1);// set minimum. TODO: We will calculate this automatically.
+            consumer_fifo_depth[i] = std::max(consumer_fifo_depth[i], 1);// set minimum.
         }
         // Create Dispatch component
         Dispatch *dp = new Dispatch("DP_" + stream_name);
@@ -3083,6 +4290,8 @@ void CodeGen_FIRRTL_Target::visit(const Call *op)
         dp->setConsumerFifoDepths(consumer_fifo_depth);
         dp->setConsumerOffsets(consumer_offsets);
         dp->setConsumerExtents(consumer_extents);
+        dp->setConsumerWindowOffsets(window_offsets);
+        dp->setConsumerWindowSizes(window_sizes);
 
         // Add to top
         top->addInstance(static_cast<Component*>(dp));
@@ -3102,16 +4311,22 @@ void CodeGen_FIRRTL_Target::visit(const Call *op)
         top->addConnect(dp->getInstanceName() + ".start_in", sif->getInstanceName() + ".start");   // DP.start_in <= SIF.start
         top->addConnect(sif->getInstanceName() + "." + done, dp->getInstanceName() + ".done_out"); // SIF.done <= DP.done_out
 
+        vector<string> consumer_streams;
         for (size_t i = 0; i < num_of_consumers; i++) {
             string consumer_stream_name = stream_name + "_to_" + print_name(consumer_names[i]);
-            dp->addOutput(consumer_stream_name, stream_type);
+            // The consumer only receives its window of the stencil.
+            FIRRTL_Type consumer_stream_type = stream_type;
+            for (size_t j = 0; j < num_of_demensions; j++) {
+                consumer_stream_type.bounds[j] = Range(0, window_sizes[i][j]);
+            }
+            dp->addOutput(consumer_stream_name, consumer_stream_type);
+            consumer_streams.push_back(consumer_stream_name);
 
             // Create FIFO following Dispatch for each output.
             FIFO *fifo = new FIFO("FIFO_" + consumer_stream_name);
-            fifo->addInput("data_in", stream_type);
-            fifo->addOutput("data_out", stream_type);
-            //fifo->setDepth("$$"); // Mark to be back-annotated later TODO
-            fifo->setDepth(std::to_string(consumer_fifo_depth[i])); // FIXME later
+            fifo->addInput("data_in", consumer_stream_type);
+            fifo->addOutput("data_out", consumer_stream_type);
+            fifo->setDepth(std::to_string(consumer_fifo_depth[i]));
 
             // Add to top
             top->addInstance(static_cast<Component*>(fifo));
@@ -3124,9 +4339,10 @@ void CodeGen_FIRRTL_Target::visit(const Call *op)
             top->addConnect(fifo->getInstanceName() + ".data_in",  dp->getInstanceName() + "." + consumer_stream_name);
 
             // Connect FIFO output port
-            top->addWire("wire_" + consumer_stream_name, stream_type);
+            top->addWire("wire_" + consumer_stream_name, consumer_stream_type);
             top->addConnect("wire_" + consumer_stream_name, fifo->getInstanceName() + ".data_out");
         }
+        dp->setConsumerStreams(consumer_streams);
 
         id = "0";
     }
@@ -3139,10 +4355,9 @@ void CodeGen_FIRRTL_Target::visit(const Load *op)
     string name = print_name(op->name);
 
     string id_index = print_expr(op->index);
-    rhs << name;
-    rhs << "[asUInt(" << id_index << ")]";
+    rhs << "$0[asUInt($1)]";
 
-    print_assignment(t, rhs.str());
+    print_assignment(t, rhs.str(), {name, id_index});
 }
 
 void CodeGen_FIRRTL_Target::visit(const Store *op)
@@ -3154,7 +4369,7 @@ void CodeGen_FIRRTL_Target::visit(const Store *op)
     string name = print_name(op->name);
 
     internal_assert(current_fb); // for now Allocate/Store/Load is supported only inside of for-loop body.
-    current_fb->print(name + "[asUInt(" + id_index + ")] <= " + id_value + "\n");
+    print_update(name + "[asUInt(" + id_index + ")] <= " + id_value + "\n");
 
     cache.clear();
 }
@@ -3169,6 +4384,18 @@ void CodeGen_FIRRTL_Target::visit(const Let *op)
 
 void CodeGen_FIRRTL_Target::visit(const Select *op)
 {
+    if (fixed_frac_bits > 0 && op->type.is_float()) {
+        string cond = print_expr(op->condition);
+        Fixed_Format ft, ff;
+        string st = print_fixed(op->true_value, ft);
+        string sf = print_fixed(op->false_value, ff);
+        int frac = std::max(ft.frac, ff.frac);
+        st = fixed_align(st, ft, frac);
+        sf = fixed_align(sf, ff, frac);
+        print_fixed_assignment("mux($0, $1, $2)", {std::max(ft.bits, ff.bits), frac}, {cond, st, sf});
+        return;
+    }
+
     ostringstream rhs;
     string type;
     string true_val = print_expr(op->true_value);
@@ -3180,10 +4407,10 @@ void CodeGen_FIRRTL_Target::visit(const Select *op)
     } else {
         type = "asSInt(";
     }
-    rhs << type << "mux(" << cond
-        << ", " << type << true_val << ")"
-        << ", " << type << false_val << ")))";
-    print_assignment(op->type, rhs.str());
+    rhs << type << "mux($0"
+        << ", " << type << "$1)"
+        << ", " << type << "$2)))";
+    print_assignment(op->type, rhs.str(), {cond, true_val, false_val});
 }
 
 void CodeGen_FIRRTL_Target::visit(const LetStmt *op)
@@ -3225,6 +4452,14 @@ void CodeGen_FIRRTL_Target::visit(const For *op)
 
         // Create ForBlock component
         ForBlock *fb = new ForBlock("FB_" + print_name(producename));
+        // The accesses of a ping-pong buffer take turns on the read
+        // port of its banks, one per phase, and the data of the last
+        // one arrives a phase later.
+        CountPingPongReads pingpong_reads;
+        op->accept(&pingpong_reads);
+        int reads = pingpong_reads.max_reads();
+        fb->setInitiationInterval(reads > 0 ? std::max(initiation_interval, reads + 1) : initiation_interval);
+        initiation_interval = 1;
         current_fb = fb;
 
         // Add to top
@@ -3258,6 +4493,7 @@ void CodeGen_FIRRTL_Target::visit(const For *op)
                     FIRRTL_Type stype = top->getWire("wire_" + a);
                     fb->addInPort(a, stype);
                     top->addConnect(fb->getInstanceName() + "." + a, "wire_" + a);
+                    stages[a] = -1; // parameters don't change during a run
                 }
             }
         }
@@ -3286,6 +4522,7 @@ void CodeGen_FIRRTL_Target::visit(const For *op)
     for_scanvar_list.pop_back();
 
     if (for_scanvar_list.empty()) {
+        finish_forblock();
         cache.clear();
         current_fb = nullptr;
     }
@@ -3295,39 +4532,38 @@ void CodeGen_FIRRTL_Target::visit(const Provide *op)
 {
     if (ends_with(op->name, ".stencil") ||
         ends_with(op->name, ".stencil_update")) {
-        ostringstream oss;
         // IR: buffered.stencil_update(1, 2, 3) =
         // FIRRTL: buffered_stencil_update[1][2][3] =
-        //vector<string> args_indices(op->args.size());
-        vector<string> args_indices(op->args.size());
-        for(size_t i = 0; i < op->args.size(); i++) {
+        Pending_Provide provide;
+        provide.name = print_name(op->name);
+        for(int i = op->args.size()-1; i >= 0; i--) { // reverse order in FIRRTL
             const IntImm *e = op->args[i].as<IntImm>();
             if (e) {
-                args_indices[i] = std::to_string(e->value);
+                provide.indices.push_back(std::to_string(e->value));
+                provide.index_is_var.push_back(false);
             } else {
                 const Variable *v = op->args[i].as<Variable>();
                 internal_assert(v);
-                args_indices[i] = "asUInt(" + print_name(v->name) + ")";
+                provide.indices.push_back(print_name(v->name));
+                provide.index_is_var.push_back(true);
             }
         }
 
         internal_assert(op->values.size() == 1);
-        string id_value = print_expr(op->values[0]);
-
-        oss << print_name(op->name) << "[";
-
-        for(int i = op->args.size()-1; i >= 0; i--) { // reverse order in FIRRTL
-            oss << args_indices[i];
-            if (i != 0)
-                oss << "][";
+        if (fixed_frac_bits > 0 && op->values[0].type().is_float()) {
+            Fixed_Format fmt;
+            string id_value = print_fixed(op->values[0], fmt);
+            provide.value = fixed_to_storage(id_value, fmt, op->values[0].type());
+        } else {
+            provide.value = print_expr(op->values[0]);
         }
-        oss << "]";
+
         if (current_fb!=nullptr) {
-          // Inside ForBlock, print to ForBlock oss_body directly.
-          current_fb->print(oss.str() + " <= " + id_value + "\n");
+          // Inside ForBlock, emitted by finish_forblock() once the
+          // pipeline depth is known.
+          pending_provides.push_back(provide);
         } else { // TODO Do we need this?
             internal_assert(false) << "Provide at outside of ForBlock\n";
-            top->addConnect(oss.str(), id_value);
         }
 
         cache.clear();
@@ -3441,6 +4677,11 @@ void CodeGen_FIRRTL_Target::visit(const Realize *op)
 
         op->body.accept(this);
 
+    } else if (ends_with(op->name, ".pingpong")) {
+        // The memory lives in the PingPong component created by
+        // pingpong_buffer().
+        op->body.accept(this);
+
     } else {
         visit(op);
     }
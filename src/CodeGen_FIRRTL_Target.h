@@ -29,7 +29,12 @@ struct FIRRTL_Argument {
  */
 class CodeGen_FIRRTL_Target : public IRPrinter {
 public:
-    CodeGen_FIRRTL_Target(std::ostream &s, Target t, const std::string &ip_name);
+    /** If model_stream is not null, a cycle-level C++ model of the
+     * design is written to it as well, and if report_stream is not
+     * null, a JSON report of the estimated resources and timing. */
+    CodeGen_FIRRTL_Target(std::ostream &s, Target t, const std::string &ip_name,
+                          std::ostream *model_stream = nullptr,
+                          std::ostream *report_stream = nullptr);
 
     void add_kernel(Stmt stmt,
                     const std::vector<FIRRTL_Argument> &args);
@@ -45,6 +50,12 @@ protected:
     /** A name for the FIRRTL target */
     std::string target_name;
 
+    /** Where the cycle-level model is emitted, if requested */
+    std::ostream *model_stream;
+
+    /** Where the resource and timing report is emitted, if requested */
+    std::ostream *report_stream;
+
     void open_scope();
 
     void close_scope(const std::string &);
@@ -57,6 +68,7 @@ protected:
     void print_linebuffer2D(std::string name, int L[4], Type, int inEl[4], int outEl[4]);
     void print_linebuffer3D(std::string name, int L[4], Type, int inEl[4], int outEl[4]);
     void print_dispatch(Dispatch*);
+    void print_pingpong(PingPong*);
     void print_forblock(ForBlock*);
     void print_slaveif(SlaveIf*);
     void generate_firrtl_fifo(int, int);
@@ -64,8 +76,9 @@ protected:
     struct Reg_Type {
         std::string name;
         bool is_stencil; // scalar or stencil (array)
-        int bitwidth; // TODO for packing.
-        int range; // bitwidth * extents[0] * extents[1] * ... *extents[3] / 8
+        int bitwidth; // element width
+        int lane; // bits of a 32-bit word each element occupies
+        int range; // words * 4, elements packed into 32-bit words
         int offset; // address offset in byte
         std::vector<int> extents;
     };
@@ -78,13 +91,18 @@ protected:
     TopLevel * top;
     SlaveIf * sif;
 
+    /** The ping-pong buffers of the kernel, by printed name, so that
+     * the consumer can connect to the banks it reads. */
+    std::map<std::string, PingPong*> pingpongs;
+
     /** A cache of generated values in scope */
     std::map<std::string, std::string> cache;
 
     std::string rootName(const std::string &name);
     std::string print_name(const std::string &name);
     std::string print_expr(Expr);
-    std::string print_assignment(Type t, const std::string &rhs);
+    std::string print_assignment(Type t, const std::string &rhs,
+                                 const std::vector<std::string> &operands = {});
     void print_stmt(Stmt);
     std::string print_base_type(Type);
     std::string print_type(Type);
@@ -94,6 +112,87 @@ protected:
     int pipeline_depth;
     ForBlock *current_fb;
 
+    /** Every ssa value computed inside a ForBlock is valid at a
+     * pipeline stage, counted in run_step cycles after the input
+     * stencils are read. Operands valid at different stages are
+     * aligned with delay registers. Values not listed in stages are
+     * valid at stage 0; constants and parameters are at stage -1. */
+    // @{
+    std::map<std::string, int> stages;
+    std::map<std::string, FIRRTL_Type> stage_types;
+    int stage_of(const std::string &id);
+    std::string delay_value(const std::string &id, int stage);
+    int align_stages(std::vector<std::string> &ids);
+    // @}
+
+    /** Operations are scheduled as soon as possible, but a stage ends
+     * where the combinational delay since the last register would
+     * exceed stage_delay_budget (in ns, set by Func::stage_delay();
+     * 0, the default, disables the scheduling). arrivals holds that delay
+     * for each ssa value, recorded where print_assignment() defines
+     * it. retime() aligns the operands of RHS and returns it with the
+     * delayed operand names. */
+    // @{
+    double stage_delay_budget;
+    std::map<std::string, double> arrivals;
+    double arrival_of(const std::string &id);
+    std::string retime(const std::string &rhs, const std::vector<std::string> &operands,
+                       Type t, int &stage, double &arrival);
+    // @}
+
+    /** With an initiation interval ii > 1 (set by the
+     * initiation_interval() call ahead of the scan loops), a ForBlock
+     * advances its pipeline once every ii cycles, counted by ii_phase.
+     * Integer multipliers and adders are then time-multiplexed: the
+     * k-th operation of a kind is issued to shared unit k / ii in
+     * phase k % ii, held until the end of the interval and registered
+     * into the next stage. Register updates of the body are done by
+     * print_update(), only when the pipeline advances. */
+    // @{
+    int initiation_interval;
+    std::map<std::string, int> shared_ops;  // operations issued per kind
+    std::string print_shared_op(const std::string &op, Type t, Expr a, Expr b);
+    void print_update(const std::string &s);
+    // @}
+
+    /** Provides inside the current ForBlock. They are emitted by
+     * finish_forblock() once the stage of the output stencil, and with
+     * it the pipeline depth of the ForBlock, is known. */
+    struct Pending_Provide {
+        std::string name;
+        std::vector<std::string> indices; // in FIRRTL order
+        std::vector<bool> index_is_var;
+        std::string value;
+    };
+    std::vector<Pending_Provide> pending_provides;
+    void finish_forblock();
+
+    /** Number of fraction bits of the fixed-point format carrying
+     * floating-point values, set by Func::fixed_point(). When it is 0,
+     * floating-point operations are rejected. */
+    int fixed_frac_bits;
+
+    /** A signed fixed-point value of 'bits' bits, 'frac' of which are
+     * fraction bits. Float stencils are stored with the width of
+     * their type and fixed_frac_bits fraction bits. */
+    struct Fixed_Format {
+        int bits;
+        int frac;
+    };
+    std::map<std::string, Fixed_Format> fixed_formats;
+    std::string print_fixed(Expr e, Fixed_Format &fmt);
+    std::string print_fixed_assignment(const std::string &rhs, Fixed_Format fmt,
+                                       const std::vector<std::string> &operands = {});
+    std::string fixed_align(const std::string &id, Fixed_Format &fmt, int frac);
+    std::string fixed_saturate(const std::string &id, Fixed_Format fmt, Type t);
+    std::string fixed_to_int(const std::string &id, Fixed_Format fmt, Type t);
+    std::string fixed_to_storage(const std::string &id, Fixed_Format fmt, Type t);
+    void visit_fixed_binop(Type t, Expr a, Expr b, const char *op);
+
+    /** Rejects the floating-point operation OP, which has no core to
+     * be mapped to. */
+    std::string print_float_op(const std::string &op, const std::vector<Expr> &args, Type result);
+
     using IRPrinter::visit;
 
     void visit(const Variable *);
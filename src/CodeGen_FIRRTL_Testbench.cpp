@@ -1,9 +1,11 @@
+#include <fstream>
 #include <iostream>
 #include <limits>
 
 #include "CodeGen_FIRRTL_Base.h"
 #include "CodeGen_FIRRTL_Testbench.h"
 #include "CodeGen_Internal.h"
+#include "ExtractHWKernelDAG.h"
 #include "Substitute.h"
 #include "IROperator.h"
 #include "Param.h"
@@ -159,10 +161,20 @@ const string tb_verilog1 =
     "    .stop_sim(stop)\n"
     ");\n"
     "\n";
+
+// AXI-lite signals of the config bus in DUT port order, <name, width>.
+const vector<pair<string, string>> axi_lite_wires = {
+    {"ARADDR", "[31:0] "}, {"ARVALID", ""}, {"AWADDR", "[31:0] "}, {"AWVALID", ""},
+    {"BREADY", ""}, {"RREADY", ""}, {"WDATA", "[31:0] "}, {"WSTRB", "[3:0] "},
+    {"WVALID", ""}, {"ARREADY", ""}, {"AWREADY", ""}, {"BRESP", "[1:0] "},
+    {"BVALID", ""}, {"RDATA", "[31:0] "}, {"RRESP", "[1:0] "}, {"RVALID", ""},
+    {"WREADY", ""}};
 }
 
-CodeGen_FIRRTL_Testbench::CodeGen_FIRRTL_Testbench(ostream &tb_stream, Target target, ostream &firrtl_stream, const string &ip_name)
-    : IRPrinter(tb_stream), cg_target(firrtl_stream, target, ip_name) {
+CodeGen_FIRRTL_Testbench::CodeGen_FIRRTL_Testbench(ostream &tb_stream, Target target, ostream &firrtl_stream, const string &ip_name,
+                                                   ostream *model_stream, ostream *report_stream)
+    : IRPrinter(tb_stream), cg_target(firrtl_stream, target, ip_name, model_stream, report_stream),
+      target(target), emit_model(model_stream != nullptr), emit_report(report_stream != nullptr) {
 
     stream << tb_verilog1;
 }
@@ -213,6 +225,12 @@ string CodeGen_FIRRTL_Testbench::print_name(const string &name) {
 
 void CodeGen_FIRRTL_Testbench::visit(const ProducerConsumer *op) {
     if (op->is_producer && starts_with(op->name, "_hls_target.")) {
+        if (hwacc_indices.count(op->name)) {
+            // The DUT of a repeated accelerator is already instantiated.
+            debug(1) << "skip the repeated hardware pipeline " << op->name << '\n';
+            return;
+        }
+        int index = hw_accelerator_index(hwacc_indices, op->name);
         Stmt hw_body = op->body;
 
         debug(1) << "compute the closure for hardware pipeline "
@@ -221,9 +239,46 @@ void CodeGen_FIRRTL_Testbench::visit(const ProducerConsumer *op) {
         vector<FIRRTL_Argument> args = c.arguments(stencils);
 
         // generate FIRRTL target code using the child code generator
-        cg_target.add_kernel(hw_body, args);
+        string ip_name = hw_accelerator_name(index);
+        string axi_prefix = "";
+        if (index == 0) {
+            cg_target.add_kernel(hw_body, args);
+        } else {
+            std::ofstream firrtl_file(ip_name + ".fir");
+            std::ofstream model_file, report_file;
+            if (emit_model) {
+                model_file.open(ip_name + "_model.cpp");
+            }
+            if (emit_report) {
+                report_file.open(ip_name + "_report.json");
+            }
+            CodeGen_FIRRTL_Target cg(firrtl_file, target, ip_name,
+                                     emit_model ? &model_file : nullptr,
+                                     emit_report ? &report_file : nullptr);
+            cg.add_kernel(hw_body, args);
+
+            // The config bus of the first accelerator is declared in
+            // tb_verilog1; each further one gets its own bus and master.
+            axi_prefix = ip_name + "_";
+            for (const auto &w : axi_lite_wires) {
+                stream << "wire " << w.second << axi_prefix << w.first << ";\n";
+            }
+            stream << "wire " << axi_prefix << "config_done;\n";
+            stream << "axi_config #(.FILENAME(\"" << axi_prefix << "param_addr.dat\"))\n";
+            stream << axi_prefix << "axi_config (\n";
+            stream << "    .clk     (clk),\n";
+            stream << "    .reset   (reset),\n";
+            for (const auto &w : axi_lite_wires) {
+                stream << "    ." << w.first << "(" << axi_prefix << w.first << "),\n";
+            }
+            stream << "    .start   (start_config),\n";
+            stream << "    .done    (" << axi_prefix << "config_done),\n";
+            stream << "    .stop_sim()\n";
+            stream << ");\n";
+            stream << "\n";
+        }
 
-        stream << "hls_target DUT(\n";
+        stream << ip_name << " DUT" << (axi_prefix.empty() ? "" : "_" + ip_name) << "(\n";
         stream << "    .clock   (clk),\n";
         stream << "    .reset   (reset),\n";
         // for each inputs/outputs
@@ -271,23 +326,11 @@ void CodeGen_FIRRTL_Testbench::visit(const ProducerConsumer *op) {
             }
         }
         // AXI Slave If
-        stream << "    .ARADDR  (ARADDR),\n";
-        stream << "    .ARVALID (ARVALID),\n";
-        stream << "    .AWADDR  (AWADDR),\n";
-        stream << "    .AWVALID (AWVALID),\n";
-        stream << "    .BREADY  (BREADY),\n";
-        stream << "    .RREADY  (RREADY),\n";
-        stream << "    .WDATA   (WDATA),\n";
-        stream << "    .WSTRB   (WSTRB),\n";
-        stream << "    .WVALID  (WVALID),\n";
-        stream << "    .ARREADY (ARREADY),\n";
-        stream << "    .AWREADY (AWREADY),\n";
-        stream << "    .BRESP   (BRESP),\n";
-        stream << "    .BVALID  (BVALID),\n";
-        stream << "    .RDATA   (RDATA),\n";
-        stream << "    .RRESP   (RRESP),\n";
-        stream << "    .RVALID  (RVALID),\n";
-        stream << "    .WREADY  (WREADY)\n";
+        for (size_t i = 0; i < axi_lite_wires.size(); i++) {
+            const string &w = axi_lite_wires[i].first;
+            stream << "    ." << w << string(8 - w.size(), ' ') << "(" << axi_prefix << w << ")"
+                   << (i + 1 < axi_lite_wires.size() ? ",\n" : "\n");
+        }
         stream << ");\n";
         stream << "\n";
     } else {
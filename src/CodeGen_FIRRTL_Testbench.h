@@ -5,6 +5,7 @@
  *
  * Defines the code-generator for producing FIRRTL testbench code
  */
+#include <map>
 #include <sstream>
 
 #include "IRPrinter.h"
@@ -19,7 +20,9 @@ namespace Internal {
 
 class CodeGen_FIRRTL_Testbench : public IRPrinter {
 public:
-    CodeGen_FIRRTL_Testbench(ostream &tb_stream, Target target, std::ostream &firrtl_stream, const string &ip_name);
+    CodeGen_FIRRTL_Testbench(ostream &tb_stream, Target target, std::ostream &firrtl_stream, const string &ip_name,
+                             std::ostream *model_stream = nullptr,
+                             std::ostream *report_stream = nullptr);
     ~CodeGen_FIRRTL_Testbench();
     /** Emit the declarations contained in the module as Verilog code. */
     /** The verilog code is standalone. TODO: C/Verilog co-simulation */
@@ -85,6 +88,14 @@ protected:
     void visit(const Prefetch *);
 
     CodeGen_FIRRTL_Target cg_target;
+
+    /** Further accelerators get FIRRTL files of their own, next to the
+     * first one, and a model/report when the first has them. */
+    Target target;
+    bool emit_model, emit_report;
+    /** The indices of the accelerator IPs emitted so far, by the name
+     * of their producer (see hw_accelerator_index()). */
+    std::map<std::string, int> hwacc_indices;
 };
 
 }
@@ -199,6 +199,103 @@ void CodeGen_HLS_Base::visit(const Call *op) {
         rhs << ")";
 
         print_assignment(op->type, rhs.str());
+    } else if (ends_with(op->name, ".pingpong")) {
+        // IR: blury.pingpong(x, y, z)
+        // C: _blury_pingpong[z][y][x]
+        vector<string> args_indices(op->args.size());
+        for(size_t i = 0; i < op->args.size(); i++)
+            args_indices[i] = print_expr(op->args[i]);
+
+        ostringstream rhs;
+        rhs << print_name(op->name);
+        for(int i = op->args.size() - 1; i >= 0; i--) {
+            rhs << "[" << args_indices[i] << "]";
+        }
+
+        print_assignment(op->type, rhs.str());
+    } else if (op->name == "read_pingpong") {
+        // the consumer reads the ping-pong buffer in place. The HLS
+        // tool synchronizes the banks between the dataflow processes.
+        internal_assert(op->args.size() == 2);
+        const Variable *pingpong_var = op->args[0].as<Variable>();
+        const StringImm *consumer_imm = op->args[1].as<StringImm>();
+        internal_assert(pingpong_var && consumer_imm);
+        do_indent();
+        stream << "// " << consumer_imm->value << " reads " << print_name(pingpong_var->name) << "\n";
+        id = "0"; // skip evaluation
+    } else if (op->name == "pingpong_buffer") {
+        // syntax:
+        //   pingpong_buffer(update_stream_name, pingpong_name, consumer_name,
+        //                   stencil_step_dim_0, store_extent_dim_0,
+        //                   [stencil_step_dim_1, store_extent_dim_1, ...])
+        // C: for (int _dim_1 = 0; _dim_1 <= 8 - 1; _dim_1 += 1)
+        //    for (int _dim_0 = 0; _dim_0 <= 16 - 2; _dim_0 += 2)
+        //    {
+        //    #pragma HLS PIPELINE II=1
+        //     PackedStencil<uint16_t, 2, 1> tmp_stencil = _blury_stencil_update_stream.read();
+        //     _blury_pingpong[_dim_1 + 0][_dim_0 + 0] = tmp_stencil(0, 0);
+        //     _blury_pingpong[_dim_1 + 0][_dim_0 + 1] = tmp_stencil(1, 0);
+        //    }
+        internal_assert(op->args.size() >= 5 && op->args.size() % 2 == 1);
+        const Variable *stream_name_var = op->args[0].as<Variable>();
+        const Variable *pingpong_var = op->args[1].as<Variable>();
+        internal_assert(stream_name_var && pingpong_var);
+        string stream_name = stream_name_var->name;
+        string pingpong_name = pingpong_var->name;
+        size_t num_of_demensions = (op->args.size() - 3) / 2;
+        vector<int> stencil_steps(num_of_demensions);
+        vector<int> store_extents(num_of_demensions);
+        for (size_t i = 0; i < num_of_demensions; i++) {
+            stencil_steps[i] = *as_const_int(op->args[i*2 + 3]);
+            store_extents[i] = *as_const_int(op->args[i*2 + 4]);
+        }
+
+        internal_assert(stencils.contains(stream_name));
+        Stencil_Type stencil_type = stencils.get(stream_name);
+        stencil_type.type = Stencil_Type::StencilContainerType::Stencil;
+
+        // emits a loop for each dimensions (larger dimension number, outer the loop)
+        for (int i = num_of_demensions - 1; i >= 0; i--) {
+            string dim_name = "_dim_" + to_string(i);
+            do_indent();
+            stream << "for (int " << dim_name <<" = 0; "
+                   << dim_name << " <= " << store_extents[i] - stencil_steps[i] << "; "
+                   << dim_name << " += " << stencil_steps[i] << ")\n";
+        }
+        open_scope();
+        stream << "#pragma HLS PIPELINE II=1\n";
+        string stencil_name = "tmp_stencil";
+        do_indent();
+        stream << "Packed" << print_stencil_type(stencil_type) << ' '
+               << print_name(stencil_name) << " = "
+               << print_name(stream_name) << ".read();\n";
+
+        // store each element of the stencil to the bank being written
+        vector<int> idx(num_of_demensions, 0);
+        bool done = false;
+        while (!done) {
+            do_indent();
+            stream << print_name(pingpong_name);
+            for (int j = num_of_demensions - 1; j >= 0; j--) {
+                stream << "[_dim_" << j << " + " << idx[j] << "]";
+            }
+            stream << " = " << print_name(stencil_name) << "(";
+            for (size_t j = 0; j < num_of_demensions; j++) {
+                stream << (j ? ", " : "") << idx[j];
+            }
+            stream << ");\n";
+            done = true;
+            for (size_t j = 0; j < num_of_demensions && done; j++) {
+                if (++idx[j] < stencil_steps[j]) {
+                    done = false;
+                } else {
+                    idx[j] = 0;
+                }
+            }
+        }
+        close_scope("");
+
+        id = "0"; // skip evaluation
     } else if (op->name == "dispatch_stream") {
         // emits the calling arguments in comment
         vector<string> args(op->args.size());
@@ -222,6 +319,8 @@ void CodeGen_HLS_Base::visit(const Call *op) {
         //                   consumer_0_name, fifo_0_depth,
         //                   consumer_0_offset_dim_0, consumer_0_extent_dim_0,
         //                   [consumer_0_offset_dim_1, consumer_0_extent_dim_1, ...]
+        //                   consumer_0_window_offset_dim_0, consumer_0_window_size_dim_0,
+        //                   [consumer_0_window_offset_dim_1, consumer_0_window_size_dim_1, ...]
         //                   [consumer_1_name, ...])
 
         // recover the structed data from op->args
@@ -247,23 +346,31 @@ void CodeGen_HLS_Base::visit(const Call *op) {
         vector<int> consumer_fifo_depth(num_of_consumers);
         vector<vector<int> > consumer_offsets(num_of_consumers);
         vector<vector<int> > consumer_extents(num_of_consumers);
+        vector<vector<int> > window_offsets(num_of_consumers);
+        vector<vector<int> > window_sizes(num_of_consumers);
 
-        internal_assert(op->args.size() >= num_of_demensions*3 + 3 + num_of_consumers*(2 + 2*num_of_demensions));
+        internal_assert(op->args.size() >= num_of_demensions*3 + 3 + num_of_consumers*(2 + 4*num_of_demensions));
         for (size_t i = 0; i < num_of_consumers; i++) {
-            const StringImm *string_imm = op->args[num_of_demensions*3 + 3 + (2 + 2*num_of_demensions)*i].as<StringImm>();
+            const StringImm *string_imm = op->args[num_of_demensions*3 + 3 + (2 + 4*num_of_demensions)*i].as<StringImm>();
             internal_assert(string_imm);
             consumer_names[i] = string_imm->value;
-            const IntImm *int_imm = op->args[num_of_demensions*3 + 4 + (2 + 2*num_of_demensions)*i].as<IntImm>();
+            const IntImm *int_imm = op->args[num_of_demensions*3 + 4 + (2 + 4*num_of_demensions)*i].as<IntImm>();
             internal_assert(int_imm);
             consumer_fifo_depth[i] = int_imm->value;
             vector<int> offsets(num_of_demensions);
             vector<int > extents(num_of_demensions);
+            vector<int> win_offsets(num_of_demensions);
+            vector<int> win_sizes(num_of_demensions);
             for (size_t j = 0; j < num_of_demensions; j++) {
-                offsets[j] = *as_const_int(op->args[num_of_demensions*3 + 5 + (2 + 2*num_of_demensions)*i + 2*j]);
-                extents[j] = *as_const_int(op->args[num_of_demensions*3 + 6 + (2 + 2*num_of_demensions)*i + 2*j]);
+                offsets[j] = *as_const_int(op->args[num_of_demensions*3 + 5 + (2 + 4*num_of_demensions)*i + 2*j]);
+                extents[j] = *as_const_int(op->args[num_of_demensions*3 + 6 + (2 + 4*num_of_demensions)*i + 2*j]);
+                win_offsets[j] = *as_const_int(op->args[num_of_demensions*5 + 5 + (2 + 4*num_of_demensions)*i + 2*j]);
+                win_sizes[j] = *as_const_int(op->args[num_of_demensions*5 + 6 + (2 + 4*num_of_demensions)*i + 2*j]);
             }
             consumer_offsets[i] = offsets;
             consumer_extents[i] = extents;
+            window_offsets[i] = win_offsets;
+            window_sizes[i] = win_sizes;
         }
 
         // emits declarations of streams for each consumer
@@ -285,6 +392,9 @@ void CodeGen_HLS_Base::visit(const Call *op) {
         for (size_t i = 0; i < num_of_consumers; i++) {
             string consumer_stream_name = stream_name + ".to." + consumer_names[i];
             Stencil_Type consumer_stream_type = stream_type;
+            for (size_t j = 0; j < num_of_demensions; j++) {
+                consumer_stream_type.bounds[j] = Range(0, window_sizes[i][j]);
+            }
             consumer_stream_type.depth = std::max(consumer_fifo_depth[i], 1); // HLS tool doesn't support zero-depth FIFO yet
             do_indent();
             stream << print_stencil_type(consumer_stream_type) << ' '
@@ -335,14 +445,67 @@ void CodeGen_HLS_Base::visit(const Call *op) {
 
             // emits the write call in the if body
             open_scope();
-            do_indent();
-            stream << print_name(consumer_stream_name) << ".write("
-                   << print_name(stencil_name) << ");\n";
+            bool whole_window = true;
+            for (size_t j = 0; j < num_of_demensions; j++) {
+                whole_window &= window_sizes[i][j] == stencil_sizes[j];
+            }
+            if (whole_window) {
+                do_indent();
+                stream << print_name(consumer_stream_name) << ".write("
+                       << print_name(stencil_name) << ");\n";
+            } else {
+                // HLS C: PackedStencil<uint16_t, 1, 1> tmp_stencil_to_consumer;
+                //        tmp_stencil_to_consumer(0, 0) = tmp_stencil(1, 1);
+                //        ...
+                Stencil_Type window_type = stencil_type;
+                for (size_t j = 0; j < num_of_demensions; j++) {
+                    window_type.bounds[j] = Range(0, window_sizes[i][j]);
+                }
+                string window_name = stencil_name + "_to_" + print_name(consumer_names[i]);
+                do_indent();
+                stream << "Packed" << print_stencil_type(window_type) << ' '
+                       << window_name << ";\n";
+                vector<int> idx(num_of_demensions, 0);
+                bool done = false;
+                while (!done) {
+                    do_indent();
+                    stream << window_name << "(";
+                    for (size_t j = 0; j < num_of_demensions; j++) {
+                        stream << (j ? ", " : "") << idx[j];
+                    }
+                    stream << ") = " << print_name(stencil_name) << "(";
+                    for (size_t j = 0; j < num_of_demensions; j++) {
+                        stream << (j ? ", " : "") << idx[j] + window_offsets[i][j];
+                    }
+                    stream << ");\n";
+                    done = true;
+                    for (size_t j = 0; j < num_of_demensions && done; j++) {
+                        if (++idx[j] < window_sizes[i][j]) {
+                            done = false;
+                        } else {
+                            idx[j] = 0;
+                        }
+                    }
+                }
+                do_indent();
+                stream << print_name(consumer_stream_name) << ".write("
+                       << window_name << ");\n";
+            }
             close_scope("");
         }
 
         close_scope("");
 
+        id = "0"; // skip evaluation
+    } else if (op->name == "fixed_point" || op->name == "stage_delay") {
+        // IR: fixed_point(frac_bits) and stage_delay(ns), FIRRTL only.
+        id = "0"; // skip evaluation
+    } else if (op->name == "initiation_interval") {
+        // IR: initiation_interval(ii), ahead of the scan loops of a kernel
+        internal_assert(op->args.size() == 1);
+        const int64_t *ii = as_const_int(op->args[0]);
+        internal_assert(ii);
+        pipeline_ii = (int)*ii;
         id = "0"; // skip evaluation
     } else {
         CodeGen_C::visit(op);
@@ -370,6 +533,26 @@ void CodeGen_HLS_Base::visit(const Realize *op) {
         allocations.pop(op->name);
         stencils.pop(op->name);
 
+    } else if (ends_with(op->name, ".pingpong")) {
+        // create a ping-pong buffered memory over the store region
+        internal_assert(op->types.size() == 1);
+        allocations.push(op->name, {op->types[0]});
+        Stencil_Type stype({Stencil_Type::StencilContainerType::PingPong, op->types[0], op->bounds, 2});
+        stencils.push(op->name, stype);
+
+        do_indent();
+        // uint16_t _blury_pingpong[8][16][16];
+        stream << print_type(op->types[0]) << ' ' << print_name(op->name);
+        for (int i = op->bounds.size() - 1; i >= 0; i--) {
+            stream << "[" << print_expr(op->bounds[i].extent) << "]";
+        }
+        stream << ";\n";
+        stream << print_stencil_pragma(op->name);
+
+        op->body.accept(this);
+
+        allocations.pop(op->name);
+        stencils.pop(op->name);
     } else if (ends_with(op->name, ".stencil") ||
                ends_with(op->name, ".stencil_update")) {
         // create a stencil type
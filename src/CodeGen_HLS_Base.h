@@ -24,10 +24,10 @@ public:
                      Target target,
                      OutputKind output_kind,
                      const std::string &include_guard = "")
-        : CodeGen_C(dest, target, output_kind, include_guard) {}
+        : CodeGen_C(dest, target, output_kind, include_guard), pipeline_ii(1) {}
 
     struct Stencil_Type {
-        typedef enum {Stencil, Stream, AxiStream} StencilContainerType;
+        typedef enum {Stencil, Stream, AxiStream, PingPong} StencilContainerType;
         StencilContainerType type;
         Type elemType;  // type of the element
         Region bounds;  // extent of each dimension
@@ -36,6 +36,7 @@ public:
 
 protected:
     Scope<Stencil_Type> stencils;  // scope of stencils and streams of stencils
+    int pipeline_ii;  // initiation interval of the kernel being emitted
 
     virtual std::string print_stencil_type(Stencil_Type s);
     virtual std::string print_name(const std::string &name);
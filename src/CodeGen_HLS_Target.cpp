@@ -129,6 +129,10 @@ string CodeGen_HLS_Target::CodeGen_HLS_C::print_stencil_pragma(const string &nam
         }
     } else if (stype.type == Stencil_Type::StencilContainerType::Stencil) {
         oss << "#pragma HLS ARRAY_PARTITION variable=" << print_name(name) << ".value complete dim=0\n\n";
+    } else if (stype.type == Stencil_Type::StencilContainerType::PingPong) {
+        // the memory is written and read by two dataflow processes, so
+        // the tool double-buffers it as a ping-pong channel
+        oss << "#pragma HLS RESOURCE variable=" << print_name(name) << " core=RAM_2P_BRAM\n\n";
     } else {
         internal_error;
     }
@@ -194,7 +198,10 @@ void CodeGen_HLS_Target::CodeGen_HLS_C::add_kernel(Stmt stmt,
         }
         stream << "\n";
 
-        // create alias (references) of the arguments using the names in the IR
+        // create alias (references) of the arguments using the names in the IR.
+        // Config arguments are copied instead, so they are latched when the
+        // kernel starts and the host can write the values of the next frame
+        // while this one is running.
         do_indent();
         stream << "// alias the arguments\n";
         for (size_t i = 0; i < args.size(); i++) {
@@ -202,10 +209,17 @@ void CodeGen_HLS_Target::CodeGen_HLS_C::add_kernel(Stmt stmt,
             do_indent();
             if (args[i].is_stencil) {
                 CodeGen_HLS_Base::Stencil_Type stype = args[i].stencil_type;
-                stream << print_stencil_type(args[i].stencil_type) << " &"
-                       << print_name(args[i].name) << " = " << arg_name << ";\n";
+                if (ends_with(args[i].name, ".stream")) {
+                    stream << print_stencil_type(args[i].stencil_type) << " &"
+                           << print_name(args[i].name) << " = " << arg_name << ";\n";
+                } else {
+                    stream << print_stencil_type(args[i].stencil_type) << " "
+                           << print_name(args[i].name) << " = " << arg_name << ";\n";
+                    stream << "#pragma HLS ARRAY_PARTITION "
+                           << "variable=" << print_name(args[i].name) << ".value complete dim=0\n";
+                }
             } else {
-                stream << print_type(args[i].scalar_type) << " &"
+                stream << print_type(args[i].scalar_type) << " "
                        << print_name(args[i].name) << " = " << arg_name << ";\n";
             }
         }
@@ -253,7 +267,7 @@ void CodeGen_HLS_Target::CodeGen_HLS_C::visit(const For *op) {
     if (!contain_for_loop(op->body)) {
         //stream << "#pragma HLS DEPENDENCE array inter false\n"
         //       << "#pragma HLS LOOP_FLATTEN off\n";
-        stream << "#pragma HLS PIPELINE II=1\n";
+        stream << "#pragma HLS PIPELINE II=" << pipeline_ii << "\n";
     }
     op->body.accept(this);
     close_scope("for " + print_name(op->name));
@@ -3,6 +3,7 @@
 
 #include "CodeGen_HLS_Testbench.h"
 #include "CodeGen_Internal.h"
+#include "ExtractHWKernelDAG.h"
 #include "Substitute.h"
 #include "IROperator.h"
 #include "Param.h"
@@ -88,9 +89,13 @@ void CodeGen_HLS_Testbench::visit(const ProducerConsumer *op) {
         HLS_Closure c(hw_body);
         vector<HLS_Argument> args = c.arguments(stencils);
 
-        // generate HLS target code using the child code generator
-        string ip_name = unique_name("hls_target");
-        cg_target.add_kernel(hw_body, ip_name, args);
+        // generate HLS target code using the child code generator,
+        // once for an accelerator that appears more than once
+        bool is_new = !hwacc_indices.count(op->name);
+        string ip_name = hw_accelerator_name(hw_accelerator_index(hwacc_indices, op->name));
+        if (is_new) {
+            cg_target.add_kernel(hw_body, ip_name, args);
+        }
 
         // Instrument to capture all paramter inputs.
         if (target.has_feature(Target::DumpIO)) {
@@ -5,6 +5,7 @@
  *
  * Defines the code-generator for producing HLS testbench code
  */
+#include <map>
 #include <sstream>
 
 #include "CodeGen_HLS_Base.h"
@@ -35,6 +36,9 @@ protected:
 
 private:
     CodeGen_HLS_Target cg_target;
+    /** The indices of the accelerator IPs emitted so far, by the name
+     * of their producer (see hw_accelerator_index()). */
+    std::map<std::string, int> hwacc_indices;
 };
 
 }
@@ -3,6 +3,8 @@
 
 #include "CodeGen_Zynq_C.h"
 #include "CodeGen_Internal.h"
+#include "ExtractHWKernelDAG.h"
+#include "InjectZynqIntrinsics.h"
 #include "IROperator.h"
 #include "Simplify.h"
 
@@ -17,6 +19,30 @@ using std::pair;
 using std::ostringstream;
 using std::to_string;
 
+namespace {
+
+// Finds the name of the first accelerator producer in a Stmt.
+class FindHWTarget : public IRVisitor {
+    using IRVisitor::visit;
+    void visit(const ProducerConsumer *op) {
+        if (name.empty() && op->is_producer && starts_with(op->name, "_hls_target.")) {
+            name = op->name;
+        }
+        IRVisitor::visit(op);
+    }
+
+public:
+    string name;
+};
+
+string hw_target_name(Stmt s) {
+    FindHWTarget f;
+    s.accept(&f);
+    return f.name;
+}
+
+}
+
 class Zynq_Closure : public Closure {
 public:
     Zynq_Closure(Stmt s)  {
@@ -72,24 +98,89 @@ const string zynq_runtime =
     "  unsigned int mmap_offset;\n"
     "} cma_buffer_t;\n"
     "#endif\n"
+    "#ifndef CMA_SG_BUFFER_T_DEFINED\n"
+    "#define CMA_SG_BUFFER_T_DEFINED\n"
+    "#define CMA_SG_MAX_BLOCKS 64\n"
+    "typedef struct cma_block_t {\n"
+    "  unsigned int phys_addr; // Bus address of the first row\n"
+    "  unsigned int width; // Bytes per row\n"
+    "  unsigned int stride; // Bytes between rows\n"
+    "  unsigned int height; // Number of rows\n"
+    "} cma_block_t;\n"
+    "typedef struct cma_sg_buffer_t {\n"
+    "  unsigned int num_blocks;\n"
+    "  cma_block_t blocks[CMA_SG_MAX_BLOCKS];\n"
+    "} cma_sg_buffer_t;\n"
+    "#endif\n"
+    "#ifndef REGISTER_T_DEFINED\n"
+    "#define REGISTER_T_DEFINED\n"
+    "typedef struct hwacc_reg_t {\n"
+    "    unsigned int offset;\n"
+    "    unsigned int value;\n"
+    "} hwacc_reg_t;\n"
+    "#endif\n"
     "// Zynq runtime API\n"
     "int halide_zynq_init();\n"
     "void halide_zynq_free(void *user_context, void *ptr);\n"
     "int halide_zynq_cma_alloc(struct halide_buffer_t *buf);\n"
     "int halide_zynq_cma_free(struct halide_buffer_t *buf);\n"
+    "const struct halide_device_interface_t *halide_zynq_device_interface();\n"
     "int halide_zynq_subimage(const struct halide_buffer_t* image, struct cma_buffer_t* subimage, void *address_of_subimage_origin, int width, int height);\n"
     "int halide_zynq_hwacc_launch(struct cma_buffer_t bufs[]);\n"
     "int halide_zynq_hwacc_sync(int task_id);\n"
+    "int halide_zynq_set_hwacc_depth(int depth);\n"
+    "int halide_zynq_hwacc_launch_pipelined(struct cma_buffer_t bufs[]);\n"
+    "int halide_zynq_hwacc_sync_all();\n"
+    "int halide_zynq_stage_reg(unsigned int offset, unsigned int value);\n"
+    "int halide_zynq_hwacc_launch_on(int device, struct cma_buffer_t bufs[]);\n"
+    "int halide_zynq_hwacc_sync_on(int device, int task_id);\n"
+    "int halide_zynq_hwacc_launch_pipelined_on(int device, struct cma_buffer_t bufs[]);\n"
+    "int halide_zynq_hwacc_sync_all_on(int device);\n"
+    "int halide_zynq_stage_reg_on(int device, unsigned int offset, unsigned int value);\n"
+    "int halide_zynq_subimage_nd(const struct halide_buffer_t* image, struct cma_sg_buffer_t* subimage, void *address_of_subimage_origin, int dimensions, const int *strides, const int *extents);\n"
+    "int halide_zynq_hwacc_launch_sg_on(int device, struct cma_sg_buffer_t bufs[]);\n"
+    "int halide_zynq_hwacc_launch_pipelined_sg_on(int device, struct cma_sg_buffer_t bufs[]);\n"
     "#include \"halide_zynq_api_setreg.h\"\n";
 }
 
 CodeGen_Zynq_C::CodeGen_Zynq_C(ostream &dest,
                                Target target,
                                OutputKind output_kind)
-    : CodeGen_C(dest, target, output_kind) {
+    : CodeGen_C(dest, target, output_kind), tap_device(0), parallel_depth(0), use_sg_dma(false) {
     stream  << zynq_runtime;
 }
 
+void CodeGen_Zynq_C::compile(const LoweredFunc &f) {
+    output_buffers.clear();
+    for (const LoweredArgument &arg : f.args) {
+        if (arg.is_output()) {
+            output_buffers.push_back(arg.name);
+        }
+    }
+    unsynced_hwacc.clear();
+    CodeGen_C::compile(f);
+}
+
+void CodeGen_Zynq_C::sync_hwacc(const std::set<int> &devices) {
+    for (int device : devices) {
+        do_indent();
+        if (device == 0) {
+            stream << "halide_zynq_hwacc_sync_all();\n";
+        } else {
+            stream << "halide_zynq_hwacc_sync_all_on(" << device << ");\n";
+        }
+    }
+}
+
+void CodeGen_Zynq_C::sync_all_hwacc() {
+    std::set<int> devices;
+    for (const auto &p : unsynced_hwacc) {
+        devices.insert(p.second.begin(), p.second.end());
+    }
+    sync_hwacc(devices);
+    unsynced_hwacc.clear();
+}
+
 // Follow name coversion rule of HLS CodeGen for compatibility.
 string CodeGen_Zynq_C::print_name(const string &name) {
     ostringstream oss;
@@ -114,14 +205,25 @@ void CodeGen_Zynq_C::visit(const Realize *op) {
     if (ends_with(op->name, ".stream")) {
         open_scope();
         string slice_name = op->name;
+        if (buffer_slices.empty()) {
+            // The slices of a run are realized around each other, so
+            // the outermost one sees all of them.
+            use_sg_dma = target.has_feature(Target::ZynqSG) &&
+                uses_nd_stream_subimage(op->body);
+        }
         buffer_slices.push_back(slice_name);
 
         do_indent();
-        stream << "cma_buffer_t " << print_name(slice_name) << ";\n";
+        stream << (use_sg_dma ? "cma_sg_buffer_t " : "cma_buffer_t ")
+               << print_name(slice_name) << ";\n";
         // Recurse
         print_stmt(op->body);
         close_scope(slice_name);
     } else {
+        // The tap belongs to the accelerator launched inside.
+        string target_name = hw_target_name(op->body);
+        internal_assert(!target_name.empty()) << "Tap " << op->name << " outside of an accelerator.\n";
+        tap_device = hw_accelerator_index(hwacc_indices, target_name);
         print_stmt(op->body);
     }
 }
@@ -134,13 +236,17 @@ void CodeGen_Zynq_C::visit(const ProducerConsumer *op) {
            kbufs[0] = kbuf_in0;
            kbufs[1] = kbuf_in1;
            kbufs[2] = kbuf_out;
-           int process_id halide_zynq_hwacc_launch(kbufs);
-           halide_pend_processed(process_id);
+           halide_zynq_hwacc_launch_pipelined(kbufs);
         */
+        // The launch returns while up to hwacc_depth runs are still
+        // in flight, so the host can move on to the next tile. They
+        // are drained with halide_zynq_hwacc_sync_all() where the
+        // enclosing producer's Func is consumed.
         // TODO check the order of buffer slices is consistent with
         // the order of DMA ports in the driver
 
         Stmt hw_body = op->body;
+        int device = hw_accelerator_index(hwacc_indices, op->name);
 
         debug(1) << "compute the closure for hardware pipeline "
                  << op->name << '\n';
@@ -150,26 +256,83 @@ void CodeGen_Zynq_C::visit(const ProducerConsumer *op) {
         // emits the register setting api function call
         for(size_t i = 0; i < args.size(); i++) {
             do_indent();
-            stream << "halide_zynq_set_" << print_name(args[i]) << "(" << print_name(args[i]) << ");\n";
+            stream << hw_register_setter_name(device, print_name(args[i]))
+                   << "(" << print_name(args[i]) << ");\n";
         }
 
         do_indent();
-        stream << "cma_buffer_t _cma_bufs[" << buffer_slices.size() << "];\n";
+        stream << (use_sg_dma ? "cma_sg_buffer_t" : "cma_buffer_t")
+               << " _cma_bufs[" << buffer_slices.size() << "];\n";
         for (size_t i = 0; i < buffer_slices.size(); i++) {
             do_indent();
             stream << "_cma_bufs[" << i << "] = " << print_name(buffer_slices[i]) << ";\n";
         }
         do_indent();
-        stream << "int _process_id = halide_zynq_hwacc_launch(_cma_bufs);\n";
-        do_indent();
-        stream << "halide_zynq_hwacc_sync(_process_id);\n";
+        if (use_sg_dma) {
+            // There are only device variants of the scatter-gather launches.
+            if (parallel_depth > 0) {
+                stream << "halide_zynq_hwacc_sync_on(" << device << ", "
+                       << "halide_zynq_hwacc_launch_sg_on(" << device << ", _cma_bufs));\n";
+            } else {
+                stream << "halide_zynq_hwacc_launch_pipelined_sg_on(" << device << ", _cma_bufs);\n";
+                launched_hwacc.insert(device);
+            }
+        } else if (parallel_depth > 0) {
+            if (device == 0) {
+                stream << "halide_zynq_hwacc_sync(halide_zynq_hwacc_launch(_cma_bufs));\n";
+            } else {
+                stream << "halide_zynq_hwacc_sync_on(" << device << ", "
+                       << "halide_zynq_hwacc_launch_on(" << device << ", _cma_bufs));\n";
+            }
+        } else {
+            if (device == 0) {
+                stream << "halide_zynq_hwacc_launch_pipelined(_cma_bufs);\n";
+            } else {
+                stream << "halide_zynq_hwacc_launch_pipelined_on(" << device << ", _cma_bufs);\n";
+            }
+            launched_hwacc.insert(device);
+        }
 
         buffer_slices.clear();
+    } else if (op->is_producer) {
+        std::set<int> old_launched_hwacc;
+        old_launched_hwacc.swap(launched_hwacc);
+        CodeGen_C::visit(op);
+        bool is_output = false;
+        for (const string &b : output_buffers) {
+            is_output |= (b == op->name || starts_with(b, op->name + "."));
+        }
+        if (is_output) {
+            // Nothing consumes an output within the pipeline, so wait
+            // for its runs before the function returns.
+            sync_hwacc(launched_hwacc);
+        } else if (!launched_hwacc.empty()) {
+            unsynced_hwacc[op->name] = launched_hwacc;
+        }
+        launched_hwacc.swap(old_launched_hwacc);
     } else {
+        // Consumers may read the Func as soon as its runs finish.
+        auto it = unsynced_hwacc.find(op->name);
+        if (it != unsynced_hwacc.end()) {
+            sync_hwacc(it->second);
+            unsynced_hwacc.erase(it);
+        }
         CodeGen_C::visit(op);
     }
 }
 
+void CodeGen_Zynq_C::visit(const For *op) {
+    parallel_depth += op->is_parallel();
+    CodeGen_C::visit(op);
+    parallel_depth -= op->is_parallel();
+}
+
+void CodeGen_Zynq_C::visit(const Free *op) {
+    // A run still in flight may access any buffer.
+    sync_all_hwacc();
+    CodeGen_C::visit(op);
+}
+
 void CodeGen_Zynq_C::visit(const Call *op) {
     ostringstream rhs;
     if (op->is_intrinsic("halide_zynq_cma_alloc")) {
@@ -180,6 +343,7 @@ void CodeGen_Zynq_C::visit(const Call *op) {
     } else if (op->is_intrinsic("halide_zynq_cma_free")) {
         internal_assert(op->args.size() == 1);
         string buffer = print_expr(op->args[0]);
+        sync_all_hwacc();
         do_indent();
         stream << "halide_zynq_cma_free(" << buffer << ");\n";
     } else if (op->is_intrinsic("stream_subimage")) {
@@ -198,6 +362,38 @@ void CodeGen_Zynq_C::visit(const Call *op) {
         string slice_name = print_expr(op->args[2]);
         string address_of_subimage_origin = print_expr(op->args[3]);
 
+        if (use_sg_dma) {
+            /* C code:
+               {
+                   int _strides[] = {dim_0_stride, ...};
+                   int _extents[] = {dim_0_extent, ...};
+                   halide_zynq_subimage_nd(&buffer_var, &stream_var, address_of_subimage_origin,
+                                           dims, _strides, _extents);
+               }
+            */
+            size_t dims = (op->args.size() - 4) / 2;
+            vector<string> strides, extents;
+            for (size_t i = 0; i < dims; i++) {
+                strides.push_back(print_expr(op->args[4 + 2*i]));
+                extents.push_back(print_expr(op->args[5 + 2*i]));
+            }
+            do_indent();
+            stream << "{\n";
+            indent += 2;
+            do_indent();
+            stream << "int _strides[] = {" << with_commas(strides) << "};\n";
+            do_indent();
+            stream << "int _extents[] = {" << with_commas(extents) << "};\n";
+            do_indent();
+            stream << "halide_zynq_subimage_nd("
+                   << print_name(buffer_name) << ", &" << print_name(slice_name) << ", "
+                   << address_of_subimage_origin << ", " << dims << ", _strides, _extents);\n";
+            indent -= 2;
+            do_indent();
+            stream << "}\n";
+            return;
+        }
+
         string width, height;
         // TODO check the lower demesion matches the buffer depth
         // TODO static check that the slice is within the bounds of kernel buffer
@@ -227,7 +423,7 @@ void CodeGen_Zynq_C::visit(const Call *op) {
         string a0 = print_expr(op->args[0]);
         string a1 = print_expr(op->args[1]);
         do_indent();
-        stream << "halide_zynq_set_" << a1 << "(_halide_buffer_get_host(" << a0 << "));\n";
+        stream << hw_register_setter_name(tap_device, a1) << "(_halide_buffer_get_host(" << a0 << "));\n";
         id = "0"; // skip evaluation
     } else {
         CodeGen_C::visit(op);
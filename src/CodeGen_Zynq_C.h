@@ -5,6 +5,9 @@
  *
  * Defines an class of Zynq C code-generator
  */
+#include <map>
+#include <set>
+
 #include "CodeGen_C.h"
 #include "Module.h"
 #include "Scope.h"
@@ -28,12 +31,52 @@ public:
 protected:
     std::vector<std::string> buffer_slices;
 
+    /** A pipeline may contain several accelerators, numbered by the
+     * name of their producer (see hw_accelerator_index()); accelerator
+     * k runs on device k. */
+    std::map<std::string, int> hwacc_indices;
+
+    /** The device of the accelerator whose tap stencils are being set. */
+    int tap_device;
+
+    /** The devices launched inside the producer currently being
+     * printed. */
+    std::set<int> launched_hwacc;
+
+    /** The devices launched inside the producer of a Func that are
+     * not synced yet. They are synced where the Func is consumed, so
+     * that accelerators with no data dependency on each other run
+     * concurrently. Producers of the outputs are synced at their
+     * end. */
+    std::map<std::string, std::set<int>> unsynced_hwacc;
+
+    /** The names of the output buffers of the function being compiled. */
+    std::vector<std::string> output_buffers;
+
+    /** The number of enclosing parallel loops. Tiles of a parallel
+     * loop launch their own runs and wait for them by task id, since
+     * syncing all pending runs would also wait for the other threads. */
+    int parallel_depth;
+
+    /** Whether the slices of the run being printed are streamed with
+     * scatter-gather descriptors, because one of them has more than
+     * two dimensions (see uses_nd_stream_subimage()). */
+    bool use_sg_dma;
+
+    void sync_hwacc(const std::set<int> &devices);
+    void sync_all_hwacc();
+
+    using CodeGen_C::compile;
     using CodeGen_C::visit;
 
+    void compile(const LoweredFunc &f);
+
     virtual std::string print_name(const std::string &name);
     void visit(const Realize *);
     void visit(const ProducerConsumer *op);
     void visit(const Call *);
+    void visit(const Free *);
+    void visit(const For *);
 };
 
 }
@@ -3,21 +3,67 @@
 
 #include "CodeGen_Zynq_LLVM.h"
 #include "CodeGen_Internal.h"
+#include "CoScheduleHWTiles.h"
+#include "ExtractHWKernelDAG.h"
+#include "InjectZynqIntrinsics.h"
 #include "IROperator.h"
 #include <sys/mman.h>
 
 namespace Halide {
 namespace Internal {
 
+using std::string;
 using std::vector;
 using llvm::Value;
 
 CodeGen_Zynq_LLVM::CodeGen_Zynq_LLVM(Target t)
-    : CodeGen_ARM(t) { }
+    : CodeGen_ARM(t), parallel_depth(0), use_sg_dma(false) { }
+
+void CodeGen_Zynq_LLVM::compile_func(const LoweredFunc &f, const std::string &simple_name,
+                                     const std::string &extern_name) {
+    output_buffers.clear();
+    for (const LoweredArgument &arg : f.args) {
+        if (arg.is_output()) {
+            output_buffers.push_back(arg.name);
+        }
+    }
+    unsynced_hwacc.clear();
+    // Overlap the host stages with the accelerator on the thread pool.
+    LoweredFunc co_scheduled = f;
+    co_scheduled.body = co_schedule_hw_tiles(f.body);
+    CodeGen_ARM::compile_func(co_scheduled, simple_name, extern_name);
+}
+
+void CodeGen_Zynq_LLVM::sync_hwacc(const std::set<int> &devices) {
+    for (int device : devices) {
+        if (device == 0) {
+            llvm::Function *sync_fn = module->getFunction("halide_zynq_hwacc_sync_all");
+            internal_assert(sync_fn);
+            builder->CreateCall(sync_fn, {});
+        } else {
+            llvm::Function *sync_fn = module->getFunction("halide_zynq_hwacc_sync_all_on");
+            internal_assert(sync_fn);
+            builder->CreateCall(sync_fn, {llvm::ConstantInt::get(i32_t, device)});
+        }
+    }
+}
+
+void CodeGen_Zynq_LLVM::sync_all_hwacc() {
+    std::set<int> devices;
+    for (const auto &p : unsynced_hwacc) {
+        devices.insert(p.second.begin(), p.second.end());
+    }
+    sync_hwacc(devices);
+    unsynced_hwacc.clear();
+}
 
 void CodeGen_Zynq_LLVM::visit(const Realize *op) {
     internal_assert(ends_with(op->name, ".stream"));
-    llvm::StructType *kbuf_type = module->getTypeByName("struct.cma_buffer_t");
+    if (buffer_slices.empty()) {
+        use_sg_dma = target.has_feature(Target::ZynqSG) &&
+            uses_nd_stream_subimage(op->body);
+    }
+    llvm::StructType *kbuf_type = module->getTypeByName(use_sg_dma ? "struct.cma_sg_buffer_t" : "struct.cma_buffer_t");
     internal_assert(kbuf_type);
     llvm::Constant *one = llvm::ConstantInt::get(i32_t, 1);
     Value *slice_ptr = builder->CreateAlloca(kbuf_type, one, op->name);
@@ -37,12 +83,13 @@ void CodeGen_Zynq_LLVM::visit(const ProducerConsumer *op) {
            kbufs[0] = kbuf_in0;
            kbufs[1] = kbuf_in1;
            kbufs[2] = kbuf_out;
-           int process_id halide_zynq_hwacc_launch(kbufs);
-           halide_pend_processed(process_id);
+           halide_zynq_hwacc_launch_pipelined(kbufs);
         */
+        // Up to hwacc_depth runs stay in flight after the launch; they
+        // are drained where the enclosing producer's Func is consumed.
         // TODO check the order of buffer slices is consistent with
         // the order of DMA ports in the driver
-        llvm::StructType *kbuf_type = module->getTypeByName("struct.cma_buffer_t");
+        llvm::StructType *kbuf_type = module->getTypeByName(use_sg_dma ? "struct.cma_sg_buffer_t" : "struct.cma_buffer_t");
         internal_assert(kbuf_type);
         Value *set_size = llvm::ConstantInt::get(i32_t, buffer_slices.size());
         Value *slice_set = builder->CreateAlloca(kbuf_type, set_size);
@@ -59,22 +106,71 @@ void CodeGen_Zynq_LLVM::visit(const ProducerConsumer *op) {
             builder->CreateMemCpy(elem_ptr, slice_ptr, size_of_kbuf, 0);
         }
 
+        int device = hw_accelerator_index(hwacc_indices, op->name);
         vector<Value *> process_args({slice_set});
-        llvm::Function *process_fn = module->getFunction("halide_zynq_hwacc_launch");
+        string launch_name = parallel_depth > 0 ? "halide_zynq_hwacc_launch" : "halide_zynq_hwacc_launch_pipelined";
+        if (use_sg_dma) {
+            launch_name += "_sg_on";
+            process_args.insert(process_args.begin(), llvm::ConstantInt::get(i32_t, device));
+        } else if (device > 0) {
+            launch_name += "_on";
+            process_args.insert(process_args.begin(), llvm::ConstantInt::get(i32_t, device));
+        }
+        llvm::Function *process_fn = module->getFunction(launch_name);
         internal_assert(process_fn);
-        Value *process_id = builder->CreateCall(process_fn, process_args);
-
-        vector<Value *> pend_args({process_id});
-        llvm::Function *pend_fn = module->getFunction("halide_zynq_hwacc_sync");
-        internal_assert(pend_fn);
-        builder->CreateCall(pend_fn, pend_args);
+        Value *task_id = builder->CreateCall(process_fn, process_args);
+
+        if (parallel_depth > 0) {
+            // Wait for this tile's own run.
+            vector<Value *> sync_args({task_id});
+            string sync_name = "halide_zynq_hwacc_sync";
+            if (device > 0 || use_sg_dma) {
+                sync_name += "_on";
+                sync_args.insert(sync_args.begin(), llvm::ConstantInt::get(i32_t, device));
+            }
+            llvm::Function *sync_fn = module->getFunction(sync_name);
+            internal_assert(sync_fn);
+            builder->CreateCall(sync_fn, sync_args);
+        } else {
+            launched_hwacc.insert(device);
+        }
 
         buffer_slices.clear();
+    } else if (op->is_producer) {
+        std::set<int> old_launched_hwacc;
+        old_launched_hwacc.swap(launched_hwacc);
+        CodeGen_ARM::visit(op);
+        bool is_output = false;
+        for (const string &b : output_buffers) {
+            is_output |= (b == op->name || starts_with(b, op->name + "."));
+        }
+        if (is_output) {
+            sync_hwacc(launched_hwacc);
+        } else if (!launched_hwacc.empty()) {
+            unsynced_hwacc[op->name] = launched_hwacc;
+        }
+        launched_hwacc.swap(old_launched_hwacc);
     } else {
+        auto it = unsynced_hwacc.find(op->name);
+        if (it != unsynced_hwacc.end()) {
+            sync_hwacc(it->second);
+            unsynced_hwacc.erase(it);
+        }
         CodeGen_ARM::visit(op);
     }
 }
 
+void CodeGen_Zynq_LLVM::visit(const For *op) {
+    parallel_depth += op->is_parallel();
+    CodeGen_ARM::visit(op);
+    parallel_depth -= op->is_parallel();
+}
+
+void CodeGen_Zynq_LLVM::visit(const Free *op) {
+    sync_all_hwacc();
+    CodeGen_ARM::visit(op);
+}
+
 void CodeGen_Zynq_LLVM::visit(const Call *op) {
     if (op->is_intrinsic("halide_zynq_cma_alloc")) {
         internal_assert(op->args.size() == 1);
@@ -85,6 +181,7 @@ void CodeGen_Zynq_LLVM::visit(const Call *op) {
     } else if (op->is_intrinsic("halide_zynq_cma_free")) {
         internal_assert(op->args.size() == 1);
         Value *buffer = codegen(op->args[0]);
+        sync_all_hwacc();
         llvm::Function *fn = module->getFunction("halide_zynq_cma_free");
         internal_assert(fn);
         value = builder->CreateCall(fn, {buffer});
@@ -106,6 +203,26 @@ void CodeGen_Zynq_LLVM::visit(const Call *op) {
           builder->CreatePointerCast(address_of_subimage_origin,
                                      llvm::PointerType::get(i8_t, 0));
 
+        if (use_sg_dma) {
+            // halide_zynq_subimage_nd(&buffer_var, &stream_var, address_of_subimage_origin,
+            //                         dims, strides, extents);
+            int dims = (op->args.size() - 4) / 2;
+            Value *dims_value = llvm::ConstantInt::get(i32_t, dims);
+            Value *strides = builder->CreateAlloca(i32_t, dims_value);
+            Value *extents = builder->CreateAlloca(i32_t, dims_value);
+            for (int i = 0; i < dims; i++) {
+                builder->CreateStore(codegen(op->args[4 + 2*i]),
+                                     builder->CreateConstInBoundsGEP1_32(i32_t, strides, i));
+                builder->CreateStore(codegen(op->args[5 + 2*i]),
+                                     builder->CreateConstInBoundsGEP1_32(i32_t, extents, i));
+            }
+            llvm::Function *fn = module->getFunction("halide_zynq_subimage_nd");
+            internal_assert(fn);
+            value = builder->CreateCall(fn, {buffer_ptr, slice_ptr, address_of_subimage_origin,
+                                             dims_value, strides, extents});
+            return;
+        }
+
         // TODO check the lower demesion matches the buffer depth
         // TODO static check that the slice is within the bounds of kernel buffer
         size_t arg_length = op->args.size();
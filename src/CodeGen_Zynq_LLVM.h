@@ -5,6 +5,9 @@
  *
  * Defines an class of Zynq LLVM code-generator
  */
+#include <map>
+#include <set>
+
 #include "CodeGen_ARM.h"
 #include "Module.h"
 
@@ -23,11 +26,40 @@ public:
 protected:
     std::vector<llvm::Value *> buffer_slices;
 
+    /** Accelerator k of the pipeline runs on device k, numbered by
+     * the name of its producer as in CodeGen_Zynq_C. */
+    std::map<std::string, int> hwacc_indices;
+
+    /** The devices launched inside the producer currently being
+     * compiled. */
+    std::set<int> launched_hwacc;
+
+    /** The devices launched inside the producer of a Func that are
+     * not synced yet. They are synced where the Func is consumed. */
+    std::map<std::string, std::set<int>> unsynced_hwacc;
+
+    /** The names of the output buffers of the function being compiled. */
+    std::vector<std::string> output_buffers;
+
+    /** The number of enclosing parallel loops, in which runs are
+     * waited for by task id (see CodeGen_Zynq_C). */
+    int parallel_depth;
+
+    /** Whether the slices of the run being compiled are streamed
+     * with scatter-gather descriptors (see CodeGen_Zynq_C). */
+    bool use_sg_dma;
+
+    void sync_hwacc(const std::set<int> &devices);
+    void sync_all_hwacc();
+
     using CodeGen_ARM::visit;
 
+    void compile_func(const LoweredFunc &f, const std::string &simple_name, const std::string &extern_name);
     void visit(const Realize *);
     void visit(const ProducerConsumer *op);
     void visit(const Call *);
+    void visit(const Free *);
+    void visit(const For *);
 };
 
 }
@@ -23,6 +23,7 @@ enum ComponentType
     Dispatcher,
     Forblock,
     Slaveif,
+    Pingpong,
     All
 };
 
@@ -72,6 +73,7 @@ public:
     // Instance
     void addInstance(Component * c);
     map<string, string> getInstances(void) {return instances;}
+    static void clearComponents(void) {components.clear();}
 
     string print_type(Type);
     string print_stencil_type(FIRRTL_Type);
@@ -128,12 +130,18 @@ public:
     void setConsumerFifoDepths(vector<int> e) { consumer_fifodepths = e;}
     void setConsumerOffsets(vector<vector<int> > e) { consumer_offsets = e;}
     void setConsumerExtents(vector<vector<int> > e) { consumer_extents = e;}
+    void setConsumerStreams(vector<string> e) { consumer_streams = e;}
+    void setConsumerWindowOffsets(vector<vector<int> > e) { consumer_window_offsets = e;}
+    void setConsumerWindowSizes(vector<vector<int> > e) { consumer_window_sizes = e;}
     vector<int> getStencilSizes(void) { return stencil_sizes;}
     vector<int> getStencilSteps(void) { return stencil_steps;}
     vector<int> getStoreExtents(void) { return store_extents;}
     vector<int> getConsumerFifoDepths(void) { return consumer_fifodepths;}
     vector<vector<int> > getConsumerOffsets(void) { return consumer_offsets;}
     vector<vector<int> > getConsumerExtents(void) { return consumer_extents;}
+    vector<string> getConsumerStreams(void) { return consumer_streams;}
+    vector<vector<int> > getConsumerWindowOffsets(void) { return consumer_window_offsets;}
+    vector<vector<int> > getConsumerWindowSizes(void) { return consumer_window_sizes;}
     int getNumOfConsumer(void) { return consumer_extents.size();}
 
 protected:
@@ -145,6 +153,33 @@ protected:
     vector<int         > consumer_fifodepths;
     vector<vector<int> > consumer_offsets;
     vector<vector<int> > consumer_extents;
+    vector<string      > consumer_streams; // output port names, in the order of consumers
+    vector<vector<int> > consumer_window_offsets; // part of the stencil sent to each consumer
+    vector<vector<int> > consumer_window_sizes;
+};
+
+class PingPong : public Component
+{
+public:
+    PingPong(const string &name) : Component(name) {type = ComponentType::Pingpong; num_reads = 0;}
+
+    void setStoreExtents(vector<int> e) { store_extents = e;}
+    void setStencilSteps(vector<int> e) { stencil_steps = e;}
+    void setConsumerBlock(string s) { consumer_block = s;}
+    void setReadPort(string p) { read_port = p;}
+    int addRead(void) { return num_reads++;}
+    vector<int> getStoreExtents(void) { return store_extents;}
+    vector<int> getStencilSteps(void) { return stencil_steps;}
+    string getConsumerBlock(void) { return consumer_block;}
+    string getReadPort(void) { return read_port;}
+    int getNumOfReads(void) { return num_reads;}
+
+protected:
+    vector<int > store_extents;
+    vector<int > stencil_steps;
+    string consumer_block;      // instance name of the ForBlock reading the banks
+    string read_port;           // the read port shared by the accesses of the consumer
+    int num_reads;              // accesses of the consumer, one per phase of its interval
 };
 
 class SlaveIf : public Component
@@ -152,6 +187,15 @@ class SlaveIf : public Component
 public:
     SlaveIf(const string &name) : Component(name) {type = ComponentType::Slaveif;}
 
+    // Config registers are 32-bit words. Stencil elements narrower than a
+    // word are packed into it, each in a lane of a power-of-two width.
+    static int laneBits(int bits) {
+        int lane = 1;
+        while (lane < bits && lane < 32) lane *= 2;
+        return lane;
+    }
+    static int lanesPerWord(int bits) { return 32 / laneBits(bits); }
+
 protected:
 };
 
@@ -179,13 +223,13 @@ public:
     string getDepth() {return depth;}
 
 protected:
-    string depth; // String type used to indicate to be back-annotated if depth is "$$"
+    string depth; // String type so that it can be used in the module name
 };
 
 class ForBlock : public Component
 {
 public:
-    ForBlock(const string &name) : Component(name) {type = ComponentType::Forblock; indent = 0; pipeline_depth = 1;}
+    ForBlock(const string &name) : Component(name) {type = ComponentType::Forblock; indent = 0; pipeline_depth = 1; initiation_interval = 1; critical_path = 0;}
 
     ForBlock() {type = ComponentType::Forblock;}
     void addVar(string p) {scan_vars.push_back(p);}
@@ -195,6 +239,11 @@ public:
     void addStencilMax(int p) {stencil_maxs.push_back(p);}
     void addStencilMin(int p) {stencil_mins.push_back(p);}
     void setPipelineDepth(int p) {pipeline_depth = p;}
+    void setInitiationInterval(int p) {initiation_interval = p;}
+    void addOperation(string op, int bits) {operations[op][bits]++;}
+    map<string, map<int, int> > getOperations(void) {return operations;}
+    void setCriticalPath(double ns) {critical_path = ns;}
+    double getCriticalPath(void) {return critical_path;}
     vector<string> getVars() {return scan_vars;}
     vector<int>    getMins(void) {return mins;}
     vector<int>    getMaxs(void) {return maxs;}
@@ -202,6 +251,7 @@ public:
     vector<int> getStencilMaxs() {return stencil_maxs;}
     vector<int> getStencilMins() {return stencil_mins;}
     int getPipelineDepth() {return pipeline_depth;}
+    int getInitiationInterval() {return initiation_interval;}
     void print(string s);
     vector<string> print_body();
     void open_scope();
@@ -216,6 +266,9 @@ protected:
     vector<int> stencil_maxs;
     int indent;
     int pipeline_depth;
+    int initiation_interval; // cycles per pipeline step
+    map<string, map<int, int> > operations; // datapath operations, <op, <bits, count>>
+    double critical_path; // longest combinational delay between registers in ns
     ostringstream oss_body;
 };
 
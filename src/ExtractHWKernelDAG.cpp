@@ -239,6 +239,12 @@ ostream &operator<<(ostream &out, const HWKernel &k) {
     if(k.is_inlined) {
         out << "[inlined]\n";
     }
+    if (k.is_ping_pong) {
+        out << "[ping-pong]\n";
+    }
+    if (k.initiation_interval > 1) {
+        out << "[II=" << k.initiation_interval << "]\n";
+    }
     for (size_t i = 0; i < k.dims.size(); i++)
         out << "  dim " << k.func.args()[i] << ": " << k.dims[i] << '\n';
 
@@ -247,6 +253,11 @@ ostream &operator<<(ostream &out, const HWKernel &k) {
             out << "consumer " << p.first << '\n';
             for (size_t i = 0; i < p.second.size(); i++)
                 out << "  dim " << k.func.args()[i] << ": " << p.second[i] << '\n';
+            const auto it = k.consumer_windows.find(p.first);
+            if (it != k.consumer_windows.end()) {
+                out << "  window offsets " << it->second.offsets
+                    << ", sizes " << it->second.sizes << '\n';
+            }
         }
     }
     return out;
@@ -302,7 +313,8 @@ extract_stencil_specs(Box box, const set<string> &scan_loops,
 // TODO review the implementation of this function
 // FIXME there is bug if the merged store bounds of input kerenel is larger than SW implementation allocates
 vector<StencilDimSpecs>
-merge_consumer_stencils(map<string, vector<StencilDimSpecs> > &consumer_stencils) {
+merge_consumer_stencils(map<string, vector<StencilDimSpecs> > &consumer_stencils,
+                        map<string, StencilWindow> &consumer_windows) {
     vector<StencilDimSpecs> res;
     internal_assert(consumer_stencils.size() > 0);
     const vector<StencilDimSpecs> &first_stencil = consumer_stencils.begin()->second;
@@ -338,10 +350,15 @@ merge_consumer_stencils(map<string, vector<StencilDimSpecs> > &consumer_stencils
     }
 
     // Second pass, update the min_pos and store_bounds of each consumer stencil
-    // if the size of stencil windows is different
+    // if the size of stencil windows is different. The original window
+    // of the consumer is kept as its part of the enlarged one.
     for (auto& p : consumer_stencils) {
+        StencilWindow &window = consumer_windows[p.first];
+        window.offsets = vector<int>(num_of_dims, 0);
+        window.sizes = vector<int>(num_of_dims);
         for (size_t i = 0; i < num_of_dims; i++) {
             StencilDimSpecs &consumer_dim = p.second[i];
+            window.sizes[i] = consumer_dim.size;
             if (consumer_dim.size != res[i].size) {
                 int size_difference = res[i].size - consumer_dim.size;
                 internal_assert(is_const(simplify(consumer_dim.min_pos - res[i].min_pos)));
@@ -354,6 +371,8 @@ merge_consumer_stencils(map<string, vector<StencilDimSpecs> > &consumer_stencils
                 int left_shift_amount = pos_difference < size_difference ? pos_difference : size_difference;
                 int right_enlarged_amount = size_difference - left_shift_amount;
 
+                window.offsets[i] = left_shift_amount;
+
                 // Shift min_pos and store_bound.min
                 consumer_dim.min_pos = simplify(consumer_dim.min_pos - left_shift_amount);
                 consumer_dim.store_bound.min = simplify(consumer_dim.store_bound.min - left_shift_amount);
@@ -399,6 +418,24 @@ void calculate_input_streams(HWKernelDAG &dag) {
     }
 }
 
+// A ping-pong buffered kernel hands a whole tile to its consumer, so it
+// has to sit between two streamed kernels of the DAG.
+void check_ping_pong_kernels(const HWKernelDAG &dag) {
+    for (const auto &p : dag.kernels) {
+        const HWKernel &kernel = p.second;
+        if (!kernel.is_ping_pong) {
+            continue;
+        }
+        user_assert(!kernel.is_output && !dag.input_kernels.count(kernel.name))
+            << "Function " << kernel.name << " is scheduled to be ping-pong buffered, "
+            << "but it is an input or the output of the accelerated pipeline " << dag.name << ".\n";
+        user_assert(kernel.consumer_stencils.size() == 1)
+            << "Function " << kernel.name << " is scheduled to be ping-pong buffered, "
+            << "but it has " << kernel.consumer_stencils.size() << " consumers in the "
+            << "accelerated pipeline " << dag.name << ". It must have exactly one.\n";
+    }
+}
+
 class BuildDAGForFunction : public IRVisitor {
     Function func;
     const map<string, Function> &env;
@@ -547,6 +584,8 @@ class BuildDAGForFunction : public IRVisitor {
                         cur_kernel.is_inlined = true;
                         debug(3) << "[inlined]\n";
                     }
+                    cur_kernel.initiation_interval = cur_func.schedule().initiation_interval();
+                    cur_kernel.is_ping_pong = !cur_kernel.is_inlined && cur_func.schedule().is_ping_pong();
 
                     // merge the bounds of consumers if they are inlined into the same buffered kernel
                     map<string, Box> consumer_boxes;
@@ -607,7 +646,8 @@ class BuildDAGForFunction : public IRVisitor {
                     }
 
                     // calculate the stencil specs of the cur_kernel
-                    cur_kernel.dims = merge_consumer_stencils(cur_kernel.consumer_stencils);
+                    cur_kernel.dims = merge_consumer_stencils(cur_kernel.consumer_stencils,
+                                                              cur_kernel.consumer_windows);
 
                     if (!cur_kernel.is_inlined) {
                         // check consistency between min_pos and store_bounds.min
@@ -679,7 +719,10 @@ public:
         dag.input_kernels = func.schedule().accelerate_inputs(); // TODO we don't use it later
         dag.compute_level = compute_level;
         dag.store_level = store_level;
+        dag.fixed_point_frac_bits = func.schedule().fixed_point_frac_bits();
+        dag.stage_delay = func.schedule().stage_delay();
         calculate_input_streams(dag);
+        check_ping_pong_kernels(dag);
         /*
         debug(0) << "after building producer pointers:" << "\n";
         for (const auto &p : dag.kernels)
@@ -710,5 +753,24 @@ Stmt extract_hw_kernel_dag(Stmt s, const map<string, Function> &env,
     return s;
 }
 
+string hw_accelerator_name(int index) {
+    internal_assert(index >= 0);
+    return index == 0 ? "hls_target" : "hls_target" + std::to_string(index);
+}
+
+int hw_accelerator_index(map<string, int> &indices, const string &name) {
+    auto it = indices.find(name);
+    if (it != indices.end()) {
+        return it->second;
+    }
+    int index = (int)indices.size();
+    indices[name] = index;
+    return index;
+}
+
+string hw_register_setter_name(int index, const string &reg) {
+    return "halide_zynq_set_" + (index == 0 ? "" : hw_accelerator_name(index)) + reg;
+}
+
 }
 }
@@ -35,19 +35,33 @@ struct StencilDimSpecs {
     Interval store_bound;
 };
 
+/** The part of the merged stencil window of a kernel that one of its
+ * consumers reads: the offset inside the window and the size, in every
+ * dimension. The line buffer of the kernel keeps the merged window, and
+ * the dispatcher sends each consumer only its own part of it.
+ */
+struct StencilWindow {
+    std::vector<int> offsets;
+    std::vector<int> sizes;
+};
+
 struct HWKernel {
     Function func;
     std::string name;
     bool is_inlined;
     bool is_output;
+    bool is_ping_pong;  // stored in a ping-pong buffered memory instead of a line buffer
     std::vector<StencilDimSpecs> dims;
     std::vector<std::string> input_streams;  // used when inserting read_stream calls
     std::map<std::string, std::vector<StencilDimSpecs> > consumer_stencils; // used for transforming call nodes and inserting dispatch calls
     std::map<std::string, int> consumer_fifo_depths;
+    std::map<std::string, StencilWindow> consumer_windows; // the window each consumer reads from the merged stencil
+    int initiation_interval;  // cycles between two stencils of the datapath
 
-    HWKernel() : is_inlined(false), is_output(false) {}
+    HWKernel() : is_inlined(false), is_output(false), is_ping_pong(false), initiation_interval(1) {}
     HWKernel(Function f, const std::string &s)
-        : func(f), name(s), is_inlined(false), is_output(false) {}
+        : func(f), name(s), is_inlined(false), is_output(false), is_ping_pong(false),
+          initiation_interval(1) {}
 };
 
 struct HWTap {
@@ -65,6 +79,10 @@ struct HWKernelDAG {
     std::set<std::string> input_kernels;
     std::set<std::string> loop_vars;   // FIXME we use loop_vars name to figure out the location to start Stream transformation. Need better way.
     LoopLevel compute_level, store_level;
+    int fixed_point_frac_bits;  // 0 keeps floating point
+    float stage_delay;          // in ns, 0 leaves stages unscheduled
+
+    HWKernelDAG() : fixed_point_frac_bits(0), stage_delay(0) {}
 };
 
 std::ostream &operator<<(std::ostream &out, const HWKernel &k);
@@ -76,6 +94,30 @@ Stmt extract_hw_kernel_dag(Stmt s, const std::map<std::string, Function> &env,
                            const std::vector<BoundsInference_Stage> &inlined_stages,
                            std::vector<HWKernelDAG> &dags);
 
+/** Name of the accelerator IP built from the INDEX-th hardware kernel
+ * DAG of a pipeline (see hw_accelerator_index()). The first IP keeps
+ * the name "hls_target" and the driver device /dev/hwacc0; the IP with
+ * index k is "hls_target<k>" on /dev/hwacc<k>.
+ */
+std::string hw_accelerator_name(int index);
+
+/** The index of the accelerator built from the "_hls_target." producer
+ * NAME. The distinct producers of a pipeline are numbered in the order
+ * they first appear in the lowered code, recorded in INDICES, so a
+ * producer that appears more than once (e.g. in both branches of a
+ * specialization) keeps its accelerator.
+ */
+int hw_accelerator_index(std::map<std::string, int> &indices, const std::string &name);
+
+/** The name of the function that sets the register REG (the name of a
+ * parameter or tap as printed by the Zynq C code generator) of the
+ * accelerator with index INDEX: halide_zynq_set_<REG> on the first
+ * accelerator and halide_zynq_set_hls_target<k><REG> on accelerator k.
+ * apps/hls_examples/hls_support/gen_reg_api.py defines the functions
+ * by the same rule.
+ */
+std::string hw_register_setter_name(int index, const std::string &reg);
+
 }
 }
 
@@ -2670,6 +2670,13 @@ Func &Func::linebuffer() {
     return *this;
 }
 
+Func &Func::ping_pong() {
+    invalidate_cache();
+    func.schedule().is_linebuffered() = true;
+    func.schedule().is_ping_pong() = true;
+    return *this;
+}
+
 Func &Func::fifo_depth(Func consumer, int depth) {
     invalidate_cache();
     user_assert(depth > 0) << "Fifo depth must be greater than zero.\n";
@@ -2681,6 +2688,31 @@ Func &Func::fifo_depth(Func consumer, int depth) {
     return *this;
 }
 
+Func &Func::initiation_interval(int ii) {
+    invalidate_cache();
+    user_assert(ii > 0) << "Initiation interval must be greater than zero.\n";
+    func.schedule().initiation_interval() = ii;
+    return *this;
+}
+
+Func &Func::fixed_point(int frac_bits) {
+    invalidate_cache();
+    user_assert(func.schedule().is_accelerated())
+        << "Func " << name() << " must be scheduled with accelerate() before fixed_point().\n";
+    user_assert(frac_bits > 0) << "The number of fraction bits must be greater than zero.\n";
+    func.schedule().fixed_point_frac_bits() = frac_bits;
+    return *this;
+}
+
+Func &Func::stage_delay(float ns) {
+    invalidate_cache();
+    user_assert(func.schedule().is_accelerated())
+        << "Func " << name() << " must be scheduled with accelerate() before stage_delay().\n";
+    user_assert(ns > 0) << "Stage delay must be greater than zero.\n";
+    func.schedule().stage_delay() = ns;
+    return *this;
+}
+
 Func &Func::compute_inline() {
     return compute_at(LoopLevel::inlined());
 }
@@ -1944,6 +1944,9 @@ public:
      * In addition, compute_var and store_var, specify
      * the compute and store levels of all linebuffered
      * functions in the pipeline w.r.t this function.
+     * Vectorizing the innermost dimension of this function by N
+     * replicates the hardware datapath N-wide, so that N pixels
+     * are produced per cycle.
      */
     EXPORT Func &accelerate(std::vector<Func> inputs,
                             Var compute_var, Var store_var,
@@ -1953,10 +1956,64 @@ public:
      */
     EXPORT Func &linebuffer();
 
-    /** Set the depth of the fifo from this function to consumer
+    /** Store this function in an on-chip memory with two banks in
+     * hardware, instead of streaming it through a line buffer. The
+     * function writes a whole tile (its store region) into one bank
+     * while its consumer reads the previous tile from the other, at
+     * any position. This suits stages that read their input at
+     * data-dependent positions, e.g. the lookup of a histogram or a
+     * grid, which would otherwise need the whole tile as a stencil
+     * window in registers. The consumer starts once the tile is
+     * complete, so the function must have a single consumer, and it
+     * cannot be an input or the output of the accelerated pipeline.
+     * In FIRRTL, each bank has one read and one write port: the
+     * elements of a stencil are written one per cycle, and a consumer
+     * that reads the function N times starts an iteration every N+1
+     * cycles at best.
+     */
+    EXPORT Func &ping_pong();
+
+    /** Set the depth of the fifo from this function to consumer.
+     * Without it, the depth is computed from the latency difference
+     * of the paths that reach the consumer (see size_fifo_depths()).
+     * That estimate counts a fixed latency of 4 cycles per kernel, not
+     * the depth of its datapath, so a consumer whose other input
+     * comes through kernels with deep datapaths (e.g. stages split by
+     * stage_delay()) may need a deeper
+     * fifo, set with this.
      */
     EXPORT Func &fifo_depth(Func consumer, int depth);
 
+    /** Let the hardware datapath of this function start a new stencil
+     * only every ii cycles. Multipliers and adders of the datapath are
+     * then shared by up to ii operations, which trades throughput for
+     * area in stages that do not need to run at full rate.
+     */
+    EXPORT Func &initiation_interval(int ii);
+
+    /** Carry the floating-point values of the hardware accelerator
+     * pipeline ending at this function as signed fixed point with
+     * frac_bits fraction bits. Only the FIRRTL backend supports it,
+     * and it has no floating-point cores, so its accelerators must
+     * use this to compute in floating point. The
+     * inputs, output and parameters of the pipeline must not be
+     * floating point, as the host sends and receives IEEE-754 bits;
+     * cast them inside the pipeline instead. The function must be
+     * scheduled with accelerate() first.
+     */
+    EXPORT Func &fixed_point(int frac_bits);
+
+    /** Split the datapath of the hardware accelerator pipeline ending
+     * at this function into pipeline stages whose estimated
+     * combinational delay stays within ns nanoseconds, registering
+     * the operands of an operation where it would exceed that. This
+     * raises the clock rate the design can run at, at the cost of
+     * registers and latency. Without it, the datapath is not
+     * retimed. Only the FIRRTL backend supports it. The function must
+     * be scheduled with accelerate() first.
+     */
+    EXPORT Func &stage_delay(float ns);
+
     /** Aggressively inline all uses of this function. This is the
      * default schedule, so you're unlikely to need to call this. For
      * a Func with an update definition, that means it gets computed
@@ -1,6 +1,7 @@
 #include "InjectZynqIntrinsics.h"
 #include "IRMutator.h"
 #include "IROperator.h"
+#include "IRVisitor.h"
 
 namespace Halide {
 namespace Internal {
@@ -9,7 +10,175 @@ using std::string;
 using std::vector;
 using std::map;
 
-/*
+namespace {
+
+// If F is a plain copy of an input image, f(x, y, ...) = in(x, y, ...),
+// returns the call to the image.
+const Call *copied_input(const Function &f) {
+    if (!f.is_pure() || f.values().size() != 1) {
+        return nullptr;
+    }
+    const Call *call = f.values()[0].as<Call>();
+    if (!call || call->call_type != Call::Image ||
+        call->type != f.values()[0].type() ||
+        call->args.size() != f.args().size()) {
+        return nullptr;
+    }
+    for (size_t i = 0; i < call->args.size(); i++) {
+        const Variable *v = call->args[i].as<Variable>();
+        if (!v || v->name != f.args()[i]) {
+            return nullptr;
+        }
+    }
+    return call;
+}
+
+// Counts the loads of a buffer outside of its producer, apart from
+// the address_of() taken by stream_subimage.
+class CountLoads : public IRVisitor {
+    const string &name;
+
+    using IRVisitor::visit;
+
+    void visit(const ProducerConsumer *op) {
+        if (!(op->is_producer && op->name == name)) {
+            IRVisitor::visit(op);
+        }
+    }
+
+    void visit(const Load *op) {
+        count += (op->name == name);
+        IRVisitor::visit(op);
+    }
+
+    void visit(const Call *op) {
+        if (op->is_intrinsic("stream_subimage")) {
+            for (size_t i = 0; i < op->args.size(); i++) {
+                if (i != 3) {
+                    op->args[i].accept(this);
+                }
+            }
+        } else {
+            IRVisitor::visit(op);
+        }
+    }
+
+public:
+    int count;
+    CountLoads(const string &n) : name(n), count(0) {}
+};
+
+// Streams an input image to the accelerator in place of a kernel buffer
+// holding a copy of it, and drops the producer of the copy.
+class AliasKernelBuffer : public IRMutator {
+    const string &name;
+    const Call *input;
+    int dims;
+
+    using IRMutator::visit;
+
+    Expr input_var(const string &field, int d) {
+        return Variable::make(Int(32), input->name + "." + field + "." + std::to_string(d),
+                              input->image, input->param, ReductionDomain());
+    }
+
+    // Recover the coordinates from an index flattened by storage
+    // flattening: (c0 - min.0)*stride.0 + (c1 - min.1)*stride.1 + ...
+    bool unflatten(Expr idx, vector<Expr> &coords) {
+        coords = vector<Expr>(dims);
+        while (const Add *add = idx.as<Add>()) {
+            const Mul *mul = add->b.as<Mul>();
+            const Sub *sub = mul ? mul->a.as<Sub>() : nullptr;
+            const Variable *min = sub ? sub->b.as<Variable>() : nullptr;
+            const Variable *stride = mul ? mul->b.as<Variable>() : nullptr;
+            if (!min || !stride) {
+                return false;
+            }
+            bool found = false;
+            for (int d = 0; d < dims; d++) {
+                string dim = std::to_string(d);
+                if (min->name == name + ".min." + dim &&
+                    stride->name == name + ".stride." + dim) {
+                    coords[d] = sub->a;
+                    found = true;
+                }
+            }
+            if (!found) {
+                return false;
+            }
+            idx = add->a;
+        }
+        for (Expr c : coords) {
+            if (!c.defined()) {
+                return false;
+            }
+        }
+        return is_zero(idx);
+    }
+
+    void visit(const ProducerConsumer *op) {
+        if (op->is_producer && op->name == name) {
+            stmt = ProducerConsumer::make(op->name, true, Evaluate::make(0));
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+
+    void visit(const Call *op) {
+        const Variable *buffer_var = op->is_intrinsic("stream_subimage") ?
+            op->args[1].as<Variable>() : nullptr;
+        if (!buffer_var || buffer_var->name != name + ".buffer") {
+            IRMutator::visit(op);
+            return;
+        }
+
+        // stream_subimage(direction, buffer_var, stream_var, address_of_subimage_origin,
+        //                 dim_0_stride, dim_0_extent, ...)
+        vector<Expr> args = op->args;
+        const Call *address_of = args[3].as<Call>();
+        const Load *origin = address_of ? address_of->args[0].as<Load>() : nullptr;
+        vector<Expr> coords;
+        if (!origin || !unflatten(origin->index, coords)) {
+            failed = true;
+            expr = op;
+            return;
+        }
+        Expr idx = 0;
+        for (int d = 0; d < dims; d++) {
+            idx += (coords[d] - input_var("min", d)) * input_var("stride", d);
+        }
+        Expr load = Load::make(input->type, input->name, idx, input->image, input->param,
+                               const_true());
+        args[1] = Variable::make(type_of<struct halide_buffer_t *>(), input->name + ".buffer",
+                                 input->image, input->param, ReductionDomain());
+        args[3] = Call::make(Handle(), "address_of", {load}, Call::Intrinsic);
+        for (int d = 0; d < dims && 4 + 2 * d < (int)args.size(); d++) {
+            args[4 + 2 * d] = input_var("stride", d);
+        }
+        expr = Call::make(op->type, op->name, args, op->call_type);
+    }
+
+public:
+    bool failed;
+    AliasKernelBuffer(const string &n, const Call *in)
+        : name(n), input(in), dims(in->args.size()), failed(false) {}
+};
+
+// Drops the host pointer of a buffer_init call.
+class NullBufferHost : public IRMutator {
+    using IRMutator::visit;
+
+    void visit(const Call *op) {
+        if (op->is_intrinsic(Call::buffer_init)) {
+            vector<Expr> args = op->args;
+            args[2] = make_zero(type_of<void *>());
+            expr = Call::make(op->type, op->name, args, op->call_type);
+        } else {
+            IRMutator::visit(op);
+        }
+    }
+};
+
 class InjectCmaIntrinsics : public IRMutator {
     const map<string, Function> &env;
 
@@ -20,69 +189,100 @@ class InjectCmaIntrinsics : public IRMutator {
 
         // If it's not in the environment it's some anonymous
         // realization that we should skip (e.g. an inlined reduction)
-        if (iter == env.end()) {
+        if (iter == env.end() || !iter->second.schedule().is_kernel_buffer()) {
             IRMutator::visit(op);
             return;
         }
 
-        if (iter->second.schedule().is_kernel_buffer()) {
-            debug(3) << "find a kernel buffer " << op->name << "\n";
-            // function (accessed by the accelerator pipeline) are scheduled to store in kernel buffer
-            // we want to use cma (contiguous memory allocator)
-            // The IR is like:
-            //
-            //  let buffer_name.zerocopy_buffer = create_buffer_t(null_handle(), ...)
-            //  let zynq_cma_alloc_result = halide_zynq_cma_alloc(buffer_name.zerocopy_buffer)
-            //  assert((zynq_cma_alloc_result == 0), zynq_cma_alloc_result)
-            //  allocate buffer_name[...]custom_new{buffer_name.zerocopy_buffer.host}custom_delete{ halide_zynq_free(); }
-            // get the args from a previously inserted create_buffer_t call
-            // and pop the call out from the body
-            const LetStmt *lets = op->body.as<LetStmt>();
-            internal_assert(lets);
-            const Call *buf = lets->value.as<Call>();
-            internal_assert(buf && buf->name == Call::create_buffer_t);
-            Stmt new_body = mutate(lets->body);
-
-            // allocate node
-            string zerocopy_buffer_name = op->name + ".buffer";
-            Expr zerocopy_buffer = Variable::make(type_of<struct buffer_t *>(), zerocopy_buffer_name);
-            Expr new_expr = Call::make(Handle(), Call::extract_buffer_host, {zerocopy_buffer}, Call::Intrinsic);
-            string free_function = "halide_zynq_free";
-
-            Stmt free = Evaluate::make(Call::make(Int(32), "halide_zynq_cma_free", {zerocopy_buffer}, Call::Intrinsic));
-            stmt = Allocate::make(op->name, op->type, op->extents, op->condition, Block::make(new_body, free), new_expr, free_function);
-
-            // call to halide_zynq_cma_alloc and assertion
-            string call_result_name = unique_name("zynq_cma_alloc_result");
-            Expr call_result_var = Variable::make(Int(32), call_result_name);
-            Expr call = Call::make(Int(32), "halide_zynq_cma_alloc", {zerocopy_buffer}, Call::Intrinsic);
-            stmt = Block::make(LetStmt::make(call_result_name, call, AssertStmt::make(call_result_var == 0, call_result_var)), stmt);
-
-            // create the new buffer_t
-            vector<Expr> args = buf->args;
-            args[0] = Call::make(Handle(), Call::null_handle, {}, Call::PureIntrinsic);
-            Expr zerocopy_buf = Call::make(type_of<struct buffer_t *>(),
-                                           Call::create_buffer_t,
-                                           args, Call::Intrinsic);
-            stmt = LetStmt::make(zerocopy_buffer_name,  zerocopy_buf, stmt);
+        debug(3) << "find a kernel buffer " << op->name << "\n";
+        // function (accessed by the accelerator pipeline) are scheduled to store in kernel buffer
+        // we want to use cma (contiguous memory allocator)
+        // The IR is like:
+        //
+        //  let buffer_name.buffer = _halide_buffer_init(..., null, ...)
+        //  let zynq_cma_alloc_result = halide_zynq_cma_alloc(buffer_name.buffer)
+        //  assert((zynq_cma_alloc_result == 0), zynq_cma_alloc_result)
+        //  allocate buffer_name[...] custom_new{_halide_buffer_get_host(buffer_name.buffer)} custom_delete{ halide_zynq_free(); } {
+        //    ...
+        //    halide_zynq_cma_free(buffer_name.buffer)
+        //  }
+        const LetStmt *let = op->body.as<LetStmt>();
+        internal_assert(let && let->name == op->name + ".buffer");
+        Stmt new_body = mutate(let->body);
 
+        Expr buffer = Variable::make(type_of<struct halide_buffer_t *>(), let->name);
+        Expr host = Call::make(Handle(), Call::buffer_get_host, {buffer}, Call::Extern);
+        Stmt free = Evaluate::make(Call::make(Int(32), "halide_zynq_cma_free", {buffer}, Call::Intrinsic));
+        Stmt cma = Allocate::make(op->name, op->type, op->extents, op->condition,
+                                  Block::make(new_body, free), host, "halide_zynq_free");
 
-        } else {
-            IRMutator::visit(op);
+        string result_name = unique_name("zynq_cma_alloc_result");
+        Expr result = Variable::make(Int(32), result_name);
+        Expr alloc = Call::make(Int(32), "halide_zynq_cma_alloc", {buffer}, Call::Intrinsic);
+        cma = LetStmt::make(result_name, alloc, Block::make(AssertStmt::make(result == 0, result), cma));
+        cma = LetStmt::make(let->name, NullBufferHost().mutate(let->value), cma);
+
+        // An accelerator input that only copies an input image already
+        // in DMA-able memory (see halide_zynq_cma_wrap()) is streamed
+        // from the image itself, without the allocation and the copy.
+        // Buffers of other devices have a device handle too, so the
+        // image must carry the device interface of the Zynq runtime.
+        const Call *input = copied_input(iter->second);
+        CountLoads loads(op->name);
+        new_body.accept(&loads);
+        if (input && loads.count == 0) {
+            AliasKernelBuffer alias(op->name, input);
+            Stmt alias_body = alias.mutate(new_body);
+            if (!alias.failed) {
+                debug(3) << "stream " << input->name << " in place of " << op->name
+                         << " when it is device-resident\n";
+                Expr input_buffer = Variable::make(type_of<struct halide_buffer_t *>(), input->name + ".buffer",
+                                                   input->image, input->param, ReductionDomain());
+                Type interface_type = type_of<const struct halide_device_interface_t *>();
+                Expr interface = Call::make(interface_type, Call::buffer_get_device_interface,
+                                            {input_buffer}, Call::Extern);
+                Expr zynq_interface = Call::make(interface_type, "halide_zynq_device_interface",
+                                                 {}, Call::Extern);
+                stmt = IfThenElse::make(interface == zynq_interface, alias_body, cma);
+                return;
+            }
         }
+        stmt = cma;
     }
 
 public:
     InjectCmaIntrinsics(const map<string, Function> &e)
         : env(e) {}
 };
-*/
+
+class FindNDSubimage : public IRVisitor {
+    using IRVisitor::visit;
+
+    void visit(const Call *op) {
+        // stream_subimage(direction, buffer_var, stream_var, address_of_subimage_origin,
+        //                 dim_0_stride, dim_0_extent, ...)
+        if (op->is_intrinsic("stream_subimage") && (op->args.size() - 4) / 2 > 2) {
+            found = true;
+        }
+        IRVisitor::visit(op);
+    }
+
+public:
+    bool found;
+    FindNDSubimage() : found(false) {}
+};
+
+}
 
 Stmt inject_zynq_intrinsics(Stmt s,
                             const map<string, Function> &env) {
-    // TODO(jingpu) check it we still need this after implementing device_interface
-    //return InjectCmaIntrinsics(env).mutate(s);
-    return s;
+    return InjectCmaIntrinsics(env).mutate(s);
+}
+
+bool uses_nd_stream_subimage(Stmt s) {
+    FindNDSubimage f;
+    s.accept(&f);
+    return f.found;
 }
 
 }
@@ -13,9 +13,19 @@ namespace Halide {
 namespace Internal {
 
 /** Inject Zynq platform specific allocation call for buffers shared
- * between FPGA and CPU. */
+ * between FPGA and CPU. A kernel buffer that is a plain copy of an
+ * input image is not allocated nor computed when the image is already
+ * device-resident; the image is streamed to the accelerator instead. */
 Stmt inject_zynq_intrinsics(Stmt s,
                             const std::map<std::string, Function> &env);
+
+/** Returns true if a stream_subimage in S slices more than two
+ * dimensions. With Target::ZynqSG, such slices are streamed with
+ * scatter-gather DMA descriptors (see halide_zynq_subimage_nd()), and
+ * so are the other slices of the same accelerator run. Without it,
+ * the dimensions below the last two are folded into the pixel depth
+ * by halide_zynq_subimage(), which needs them packed in memory. */
+bool uses_nd_stream_subimage(Stmt s);
 }
 }
 
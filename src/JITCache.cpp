@@ -0,0 +1,307 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <sys/utime.h>
+#define utime _utime
+#else
+#include <utime.h>
+#endif
+
+#include "JITCache.h"
+#include "LLVM_Headers.h"
+#include <llvm/Support/SHA1.h>
+#include "Debug.h"
+#include "Error.h"
+
+namespace Halide {
+namespace Internal {
+
+using std::string;
+using std::vector;
+
+namespace {
+
+// Change this when the layout of the files changes.
+const char cache_magic[8] = {'H', 'L', 'J', 'I', 'T', 'O', '2', 0};
+
+const size_t digest_size = 20;
+
+struct CacheFileHeader {
+    char magic[8];
+    // The key of the module the object was compiled from; a file name
+    // is only its hex form, so a load checks the key as well.
+    uint8_t key[digest_size];
+    // The digest of the object code that follows the header.
+    uint8_t checksum[digest_size];
+    uint64_t size;
+};
+
+int64_t default_cache_size() {
+    string size = get_env_variable("HL_JIT_CACHE_SIZE");
+    return size.empty() ? (256 << 20) : strtoll(size.c_str(), nullptr, 10);
+}
+
+// The SHA-1 digest of DATA, as DIGEST_SIZE raw bytes.
+string sha1(llvm::StringRef data) {
+    llvm::SHA1 hash;
+    hash.update(data);
+    string digest = hash.result().str();
+    internal_assert(digest.size() == digest_size);
+    return digest;
+}
+
+string hex(const string &digest) {
+    std::ostringstream oss;
+    for (char c : digest) {
+        oss << std::hex << std::setw(2) << std::setfill('0') << (int)(uint8_t)c;
+    }
+    return oss.str();
+}
+
+// The key of a module: the digest of its IR and of the version of
+// LLVM, whose backend makes the object code. The IR holds the target
+// triple, the data layout and the target options.
+string module_key(const llvm::Module &m) {
+    string ir;
+    llvm::raw_string_ostream os(ir);
+    m.print(os, nullptr);
+    os << "llvm " << LLVM_VERSION;
+    os.flush();
+    return sha1(ir);
+}
+
+struct CacheFile {
+    string path;
+    int64_t size;
+    int64_t mtime;
+};
+
+class DiskObjectCache : public llvm::ObjectCache {
+    std::mutex mutex;
+    string dir;
+    int64_t max_size;
+    JITCacheStats stats;
+
+    // MCJIT runs the backend on a module between getObject() and
+    // notifyObjectCompiled(), which changes its IR, so the key is
+    // computed by the former and kept here for the latter.
+    std::map<const llvm::Module *, string> pending_keys;
+
+    string path_of(const string &key) {
+        return dir + "/" + hex(key) + ".o";
+    }
+
+    vector<CacheFile> list_files(const string &suffix) {
+        vector<CacheFile> files;
+        std::error_code ec;
+        for (llvm::sys::fs::directory_iterator it(dir, ec), end; it != end && !ec; it.increment(ec)) {
+            string path = it->path();
+            struct stat s;
+            if (ends_with(path, suffix) && ::stat(path.c_str(), &s) == 0) {
+                files.push_back({path, (int64_t)s.st_size, (int64_t)s.st_mtime});
+            }
+        }
+        return files;
+    }
+
+    // Deletes the least recently used objects until the cache fits.
+    // Called with the lock held.
+    void prune() {
+        vector<CacheFile> files = list_files(".o");
+        int64_t total = 0;
+        for (const CacheFile &f : files) {
+            total += f.size;
+        }
+        if (total <= max_size) {
+            return;
+        }
+        std::sort(files.begin(), files.end(),
+                  [](const CacheFile &a, const CacheFile &b) { return a.mtime < b.mtime; });
+        for (size_t i = 0; i < files.size() && total > max_size; i++) {
+            if (!llvm::sys::fs::remove(files[i].path)) {
+                debug(2) << "Evicted " << files[i].path << " from the JIT cache\n";
+                total -= files[i].size;
+                stats.evictions++;
+            }
+        }
+    }
+
+public:
+    DiskObjectCache() : max_size(default_cache_size()) {
+        stats = JITCacheStats{0, 0, 0, 0};
+        set_directory(get_env_variable("HL_JIT_CACHE_DIR"));
+    }
+
+    void set_directory(const string &d) {
+        std::lock_guard<std::mutex> lock(mutex);
+        dir = d;
+        if (!dir.empty()) {
+            std::error_code ec = llvm::sys::fs::create_directories(dir);
+            user_assert(!ec) << "Could not create the JIT cache directory " << dir << ": " << ec.message() << "\n";
+        }
+    }
+
+    void set_size(int64_t size) {
+        std::lock_guard<std::mutex> lock(mutex);
+        max_size = size;
+        if (!dir.empty()) {
+            prune();
+        }
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!dir.empty()) {
+            for (const CacheFile &f : list_files(".o")) {
+                llvm::sys::fs::remove(f.path);
+            }
+        }
+    }
+
+    bool enabled() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return !dir.empty();
+    }
+
+    JITCacheStats get_stats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+    std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *m) override {
+        string key = module_key(*m);
+        string path;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (dir.empty()) {
+                return nullptr;
+            }
+            pending_keys[m] = key;
+            path = path_of(key);
+        }
+
+        auto file = llvm::MemoryBuffer::getFile(path, -1, false);
+        if (!file) {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.misses++;
+            return nullptr;
+        }
+
+        // Drop a truncated or corrupt file, e.g. from a process that
+        // died while writing it, or one of another module, and compile
+        // the module again.
+        const char *data = (*file)->getBufferStart();
+        size_t size = (*file)->getBufferSize();
+        CacheFileHeader header;
+        bool valid = size >= sizeof(header);
+        if (valid) {
+            memcpy(&header, data, sizeof(header));
+            valid = (memcmp(header.magic, cache_magic, sizeof(cache_magic)) == 0 &&
+                     memcmp(header.key, key.data(), digest_size) == 0 &&
+                     header.size == size - sizeof(header) &&
+                     sha1(llvm::StringRef(data + sizeof(header), header.size)) ==
+                     string((const char *)header.checksum, digest_size));
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!valid) {
+            debug(1) << "Dropping invalid JIT cache file " << path << "\n";
+            llvm::sys::fs::remove(path);
+            stats.misses++;
+            return nullptr;
+        }
+
+        // The modification time of an object is when it was last used.
+        utime(path.c_str(), nullptr);
+        pending_keys.erase(m);
+        stats.hits++;
+        debug(1) << "Loaded the object code of " << m->getModuleIdentifier()
+                 << " from the JIT cache " << path << "\n";
+        return llvm::MemoryBuffer::getMemBufferCopy(llvm::StringRef(data + sizeof(header), header.size), path);
+    }
+
+    void notifyObjectCompiled(const llvm::Module *m, llvm::MemoryBufferRef obj) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = pending_keys.find(m);
+        if (it == pending_keys.end()) {
+            return;
+        }
+        string key = it->second;
+        pending_keys.erase(it);
+        if (dir.empty()) {
+            return;
+        }
+
+        // Write to a temporary file and rename it, so that other
+        // processes never read a partial object.
+        CacheFileHeader header;
+        memcpy(header.magic, cache_magic, sizeof(cache_magic));
+        memcpy(header.key, key.data(), digest_size);
+        memcpy(header.checksum, sha1(obj.getBuffer()).data(), digest_size);
+        header.size = obj.getBufferSize();
+
+        int fd;
+        llvm::SmallString<256> tmp_path;
+        if (llvm::sys::fs::createUniqueFile(dir + "/%%%%%%%%.tmp", fd, tmp_path)) {
+            debug(1) << "Could not create a file in the JIT cache " << dir << "\n";
+            return;
+        }
+        bool written;
+        {
+            llvm::raw_fd_ostream out(fd, true);
+            out.write((const char *)&header, sizeof(header));
+            out.write(obj.getBufferStart(), obj.getBufferSize());
+            out.close();
+            written = !out.has_error();
+            out.clear_error();
+        }
+        if (!written || llvm::sys::fs::rename(tmp_path, path_of(key))) {
+            llvm::sys::fs::remove(tmp_path);
+            return;
+        }
+        stats.stores++;
+        debug(1) << "Stored the object code of " << m->getModuleIdentifier()
+                 << " in the JIT cache " << path_of(key) << "\n";
+        prune();
+    }
+};
+
+DiskObjectCache &disk_object_cache() {
+    static DiskObjectCache cache;
+    return cache;
+}
+
+}
+
+void jit_cache_set_directory(const string &dir) {
+    disk_object_cache().set_directory(dir);
+}
+
+void jit_cache_set_size(int64_t size) {
+    disk_object_cache().set_size(size > 0 ? size : default_cache_size());
+}
+
+void jit_cache_clear() {
+    disk_object_cache().clear();
+}
+
+JITCacheStats jit_cache_get_stats() {
+    return disk_object_cache().get_stats();
+}
+
+llvm::ObjectCache *get_jit_object_cache() {
+    DiskObjectCache &cache = disk_object_cache();
+    return cache.enabled() ? &cache : nullptr;
+}
+
+}
+}
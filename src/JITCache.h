@@ -0,0 +1,53 @@
+#ifndef HALIDE_JIT_CACHE_H
+#define HALIDE_JIT_CACHE_H
+
+/** \file
+ * Defines the persistent on-disk cache of JIT compiled object code
+ */
+
+#include <stdint.h>
+#include <string>
+
+#include "Util.h"
+
+namespace llvm {
+class ObjectCache;
+}
+
+namespace Halide {
+namespace Internal {
+
+/** Counters of the JIT object cache since the start of the process. */
+struct JITCacheStats {
+    int64_t hits, misses, stores, evictions;
+};
+
+/** Store the object code of the modules compiled by the JIT in the
+ * directory DIR, so that later processes load it instead of running
+ * the LLVM backend again. An object is keyed on the SHA-1 digest of
+ * the LLVM IR of its module, which covers the lowered pipeline and
+ * the target, and of the version of LLVM. The digest is stored with
+ * the object and checked when it is loaded. An empty string disables the cache.
+ * The directory is initially the value of the environment variable
+ * HL_JIT_CACHE_DIR, and the cache is disabled if it is not set. */
+EXPORT void jit_cache_set_directory(const std::string &dir);
+
+/** Set the maximum number of bytes of object code in the cache
+ * directory. When a store goes over it, the least recently used
+ * objects are deleted. Zero restores the default, which is the value
+ * of the environment variable HL_JIT_CACHE_SIZE, or 256MB. */
+EXPORT void jit_cache_set_size(int64_t size);
+
+/** Delete all the objects of the cache directory. */
+EXPORT void jit_cache_clear();
+
+EXPORT JITCacheStats jit_cache_get_stats();
+
+/** The cache to give to the MCJIT execution engines, or null if it
+ * is disabled. */
+llvm::ObjectCache *get_jit_object_cache();
+
+}
+}
+
+#endif
@@ -8,6 +8,7 @@
 #endif
 
 #include "CodeGen_Internal.h"
+#include "JITCache.h"
 #include "JITModule.h"
 #include "LLVM_Headers.h"
 #include "LLVM_Runtime_Linker.h"
@@ -301,6 +302,13 @@ void JITModule::compile_module(std::unique_ptr<llvm::Module> m, const string &fu
     if (!ee) std::cerr << error_string << "\n";
     internal_assert(ee) << "Couldn't create execution engine\n";
 
+    // Load the object code of an identical module compiled by an
+    // earlier process instead of running the backend, if the cache
+    // is enabled.
+    if (llvm::ObjectCache *cache = get_jit_object_cache()) {
+        ee->setObjectCache(cache);
+    }
+
     // Do any target-specific initialization
     std::vector<llvm::JITEventListener *> listeners;
 
@@ -457,6 +465,14 @@ void JITModule::memoization_cache_set_size(int64_t size) const {
     }
 }
 
+void JITModule::memoization_cache_get_stats(halide_memoization_cache_stats_t *stats) const {
+    std::map<std::string, Symbol>::const_iterator f =
+        exports().find("halide_memoization_cache_get_stats");
+    if (f != exports().end()) {
+        (reinterpret_bits<void (*)(halide_memoization_cache_stats_t *)>(f->second.address))(stats);
+    }
+}
+
 bool JITModule::compiled() const {
   return jit_module->execution_engine != nullptr;
 }
@@ -862,5 +878,12 @@ void JITSharedRuntime::memoization_cache_set_size(int64_t size) {
     }
 }
 
+void JITSharedRuntime::memoization_cache_get_stats(halide_memoization_cache_stats_t *stats) {
+    std::lock_guard<std::mutex> lock(shared_runtimes_mutex);
+
+    memset(stats, 0, sizeof(*stats));
+    shared_runtimes(MainShared).memoization_cache_get_stats(stats);
+}
+
 }
 }
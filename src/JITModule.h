@@ -115,6 +115,7 @@ struct JITModule {
 
     /** Encapsulate device (GPU) and buffer interactions. */
     EXPORT void memoization_cache_set_size(int64_t size) const;
+    EXPORT void memoization_cache_get_stats(halide_memoization_cache_stats_t *stats) const;
 
     /** Return true if compile_module has been called on this module. */
     EXPORT bool compiled() const;
@@ -153,6 +154,12 @@ public:
      */
     EXPORT static void memoization_cache_set_size(int64_t size);
 
+    /** Read the hit, miss and eviction counters of the memoization
+     * cache. If you are compiling statically, call
+     * halide_memoization_cache_get_stats() instead.
+     */
+    EXPORT static void memoization_cache_get_stats(halide_memoization_cache_stats_t *stats);
+
     EXPORT static void release_all();
 };
 
@@ -8,6 +8,7 @@
 #include "AddImageChecks.h"
 #include "AddParameterChecks.h"
 #include "AllocationBoundsInference.h"
+#include "AnalyzeDataflow.h"
 #include "Bounds.h"
 #include "BoundsInference.h"
 #include "CSE.h"
@@ -51,6 +52,7 @@
 #include "SlidingWindow.h"
 #include "Simplify.h"
 #include "SimplifySpecializations.h"
+#include "SizeFIFODepths.h"
 #include "SplitTuples.h"
 #include "StorageFlattening.h"
 #include "StorageFolding.h"
@@ -185,9 +187,14 @@ Module lower(const vector<Function> &output_funcs, const string &pipeline_name,
         vector<HWKernelDAG> dags;
         s = extract_hw_kernel_dag(s, env, inlined_stages, dags);
 
+        for(HWKernelDAG &dag : dags) {
+            size_fifo_depths(dag);
+        }
+
         for(const HWKernelDAG &dag : dags) {
             s = stream_opt(s, dag);
             //s = replace_image_param(s, dag);
+            analyze_dataflow(dag);
         }
 
         debug(2) << "Lowering after HLS optimization:\n" << s << '\n';
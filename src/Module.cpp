@@ -1,8 +1,11 @@
 #include "Module.h"
 
 #include <array>
+#include <atomic>
 #include <fstream>
+#include <functional>
 #include <future>
+#include <map>
 
 #include "CodeGen_C.h"
 #include "CodeGen_FIRRTL_Testbench.h"
@@ -10,11 +13,13 @@
 #include "CodeGen_Internal.h"
 #include "CodeGen_Zynq_C.h"
 #include "Debug.h"
+#include "ExtractHWKernelDAG.h"
 #include "HexagonOffload.h"
 #include "LLVM_Headers.h"
 #include "LLVM_Output.h"
 #include "LLVM_Runtime_Linker.h"
 #include "IROperator.h"
+#include "IRVisitor.h"
 #include "Outputs.h"
 #include "StmtToHtml.h"
 #include "WrapExternStages.h"
@@ -107,6 +112,156 @@ uint64_t target_feature_mask(const Target &target) {
     return feature_mask;
 }
 
+// The number of tasks running on compile thread pools.
+std::atomic<int> active_compile_tasks(0);
+
+// Marks a task of a compile thread pool as running.
+class CompileTask {
+public:
+    CompileTask() { active_compile_tasks++; }
+    ~CompileTask() { active_compile_tasks--; }
+};
+
+// The number of threads to compile independent parts on. If we are
+// running with HL_DEBUG_CODEGEN=1, use one, so that debug output won't
+// be utterly incomprehensible. HL_NUM_COMPILE_THREADS overrides the
+// number of cores. The threads are shared by the compilations of the
+// process: while a pool is running, e.g. the one compiling the
+// sub-targets of compile_multitarget, other modules, including those
+// compiled on it, are compiled on the calling thread.
+size_t num_compile_threads() {
+    if (debug::debug_level() > 0 || active_compile_tasks > 0) {
+        return 1;
+    }
+    std::string threads = get_env_variable("HL_NUM_COMPILE_THREADS");
+    if (!threads.empty()) {
+        return (size_t)std::max(atoi(threads.c_str()), 1);
+    }
+    return ThreadPool<void>::num_processors_online();
+}
+
+// Finds the functions of a module that a statement calls.
+class FindCalledFunctions : public IRVisitor {
+    const std::map<std::string, size_t> &index;
+
+    using IRVisitor::visit;
+
+    void visit(const Call *op) {
+        IRVisitor::visit(op);
+        auto it = index.find(op->name);
+        if (it != index.end()) {
+            called.push_back(it->second);
+        }
+    }
+
+public:
+    std::vector<size_t> called;
+
+    FindCalledFunctions(const std::map<std::string, size_t> &index) : index(index) {}
+};
+
+// Split a module into modules of one function each, which can be
+// compiled in parallel. Functions with internal linkage, e.g. the
+// wrappers of extern stages, are only visible in their own part, so they
+// go in the part of the functions that call them. As in
+// compile_multitarget, the functions are compiled without the runtime,
+// and the runtime (if any) is a part of its own. Returns no parts if the
+// module is better compiled in one piece: if it has a single part of
+// functions, or buffers, which may hold state shared by all of its
+// functions.
+std::vector<Module> split_module_by_function(const Module &m) {
+    std::vector<Module> parts;
+    if (m.functions().size() < 2 ||
+        !m.buffers().empty() ||
+        m.target().has_feature(Target::JIT) ||
+        num_compile_threads() < 2) {
+        return parts;
+    }
+
+    const std::vector<LoweredFunc> &functions = m.functions();
+    std::map<std::string, size_t> index;
+    for (size_t i = 0; i < functions.size(); i++) {
+        index[functions[i].name] = i;
+    }
+
+    // Group each function with the internal functions it calls, and
+    // each internal function with the functions it calls.
+    std::vector<size_t> group(functions.size());
+    for (size_t i = 0; i < functions.size(); i++) {
+        group[i] = i;
+    }
+    std::function<size_t(size_t)> find_group = [&](size_t i) {
+        if (group[i] != i) {
+            group[i] = find_group(group[i]);
+        }
+        return group[i];
+    };
+    for (size_t i = 0; i < functions.size(); i++) {
+        FindCalledFunctions calls(index);
+        functions[i].body.accept(&calls);
+        for (size_t j : calls.called) {
+            if (functions[i].linkage == LoweredFunc::Internal ||
+                functions[j].linkage == LoweredFunc::Internal) {
+                group[find_group(j)] = find_group(i);
+            }
+        }
+    }
+
+    const Target part_target = m.target().with_feature(Target::NoRuntime);
+    std::map<size_t, size_t> part_of_group;
+    for (size_t i = 0; i < functions.size(); i++) {
+        size_t g = find_group(i);
+        if (!part_of_group.count(g)) {
+            part_of_group[g] = parts.size();
+            parts.push_back(Module(m.name(), part_target));
+        }
+        parts[part_of_group[g]].append(functions[i]);
+    }
+    if (parts.size() < 2) {
+        return std::vector<Module>();
+    }
+    // External code must be linked in only once.
+    for (const auto &ec : m.external_code()) {
+        parts[0].append(ec);
+    }
+    if (!m.target().has_feature(Target::NoRuntime)) {
+        parts.push_back(Module(m.name(), m.target()));
+    }
+    return parts;
+}
+
+// Compile the parts of a module in parallel and link them into one llvm
+// module. An llvm context must only be used by one thread at a time, so
+// each part is compiled on a context of its own, and comes back as
+// bitcode.
+std::unique_ptr<llvm::Module> compile_parts_to_llvm_module(const Module &m,
+                                                           const std::vector<Module> &parts,
+                                                           llvm::LLVMContext &context) {
+    std::vector<std::future<std::vector<uint8_t>>> bitcodes;
+    ThreadPool<std::vector<uint8_t>> pool(std::min(num_compile_threads(), parts.size()));
+    for (const Module &part : parts) {
+        bitcodes.emplace_back(pool.async([](Module p) {
+            CompileTask task;
+            debug(1) << "Module.compile(): compiling part " << p.name() << " with "
+                     << p.functions().size() << " function(s)\n";
+            llvm::LLVMContext part_context;
+            std::unique_ptr<llvm::Module> llvm_part(compile_module_to_llvm_module(p, part_context));
+            llvm::SmallVector<char, 4096> bitcode;
+            llvm::raw_svector_ostream bitcode_stream(bitcode);
+            compile_llvm_module_to_llvm_bitcode(*llvm_part, bitcode_stream);
+            return std::vector<uint8_t>(bitcode.begin(), bitcode.end());
+        }, part));
+    }
+
+    // The linker takes the triple and data layout from the first part.
+    std::unique_ptr<llvm::Module> llvm_module(new llvm::Module(m.name(), context));
+    for (size_t i = 0; i < bitcodes.size(); i++) {
+        add_bitcode_to_module(&context, *llvm_module, bitcodes[i].get(),
+                              m.name() + "_part" + std::to_string(i));
+    }
+    return llvm_module;
+}
+
 }  // namespace
 
 struct ModuleContents {
@@ -315,11 +470,42 @@ void Module::compile(const Outputs &output_files) const {
         return;
     }
 
-    if (!output_files.object_name.empty() || !output_files.assembly_name.empty() ||
-        !output_files.bitcode_name.empty() || !output_files.llvm_assembly_name.empty() ||
-        !output_files.static_library_name.empty()) {
+    const bool llvm_outputs =
+        !output_files.object_name.empty() || !output_files.assembly_name.empty() ||
+        !output_files.bitcode_name.empty() || !output_files.llvm_assembly_name.empty();
+    std::vector<Module> parts;
+    if (llvm_outputs || !output_files.static_library_name.empty()) {
+        parts = split_module_by_function(*this);
+    }
+
+    if (!llvm_outputs && !output_files.static_library_name.empty() && !parts.empty()) {
+        // Nothing needs the parts in one llvm module, so give each part
+        // an object of its own, which also runs the backends in parallel.
+        TemporaryObjectFileDir temp_dir;
+        {
+            ThreadPool<void> pool(std::min(num_compile_threads(), parts.size()));
+            std::vector<std::future<void>> futures;
+            for (size_t i = 0; i < parts.size(); i++) {
+                Outputs part_out = Outputs().object(
+                    temp_dir.add_temp_object_file(output_files.static_library_name, "_" + std::to_string(i), target()));
+                futures.emplace_back(pool.async([](Module m, Outputs o) {
+                    CompileTask task;
+                    debug(1) << "Module.compile(): part object_name " << o.object_name << "\n";
+                    m.compile(o);
+                }, parts[i], part_out));
+            }
+            for (auto &f : futures) {
+                f.wait();
+            }
+        }
+        debug(1) << "Module.compile(): static_library_name " << output_files.static_library_name << "\n";
+        Target base_target(target().os, target().arch, target().bits);
+        create_static_library(temp_dir.files(), base_target, output_files.static_library_name);
+    } else if (llvm_outputs || !output_files.static_library_name.empty()) {
         llvm::LLVMContext context;
-        std::unique_ptr<llvm::Module> llvm_module(compile_module_to_llvm_module(*this, context));
+        std::unique_ptr<llvm::Module> llvm_module(parts.empty() ?
+                                                  compile_module_to_llvm_module(*this, context) :
+                                                  compile_parts_to_llvm_module(*this, parts, context));
 
         if (!output_files.object_name.empty()) {
             debug(1) << "Module.compile(): object_name " << output_files.object_name << "\n";
@@ -393,10 +579,23 @@ void Module::compile(const Outputs &output_files) const {
     if (!output_files.firrtl_source_name.empty()) {
         debug(1) << "Module.compile(): firrtl_source_name " << output_files.firrtl_source_name << "\n";
         std::ofstream file(output_files.firrtl_source_name);
-        std::string ip_name = "hls_target"; // TODO user-given DUT name
+        // Further accelerators of the pipeline are written next to it.
+        std::string ip_name = Internal::hw_accelerator_name(0);
         std::ofstream firrtl_file(ip_name+".fir");
+        std::ofstream model_file;
+        if (!output_files.firrtl_model_name.empty()) {
+            debug(1) << "Module.compile(): firrtl_model_name " << output_files.firrtl_model_name << "\n";
+            model_file.open(output_files.firrtl_model_name);
+        }
+        std::ofstream report_file;
+        if (!output_files.firrtl_report_name.empty()) {
+            debug(1) << "Module.compile(): firrtl_report_name " << output_files.firrtl_report_name << "\n";
+            report_file.open(output_files.firrtl_report_name);
+        }
         // TODO: Testbench is independent. No C/Verilog co-simulation yet.
-        CodeGen_FIRRTL_Testbench cg(file, target(), firrtl_file, ip_name);
+        CodeGen_FIRRTL_Testbench cg(file, target(), firrtl_file, ip_name,
+                                    model_file.is_open() ? &model_file : nullptr,
+                                    report_file.is_open() ? &report_file : nullptr);
         cg.compile(*this);
     }
     if (!output_files.stmt_name.empty()) {
@@ -453,11 +652,11 @@ void compile_multitarget(const std::string &fn_name,
         return;
     }
 
+    // The sub-targets are lowered one at a time, as the producer may
+    // share state between its calls (e.g. a Pipeline), and each is
+    // compiled on the pool while the next one is lowered.
     std::vector<std::future<void>> futures;
-    // If we are running with HL_DEBUG_CODEGEN=1, use threads=1 to enforce
-    // sequential execution, so that debug output won't be utterly incomprehensible
-    const size_t num_threads = (debug::debug_level() > 0) ? 1 : Internal::ThreadPool<void>::num_processors_online();
-    Internal::ThreadPool<void> pool(num_threads);
+    Internal::ThreadPool<void> pool(num_compile_threads());
 
     // For safety, the runtime must be built only with features common to all
     // of the targets; given an unusual ordering like
@@ -522,6 +721,7 @@ void compile_multitarget(const std::string &fn_name,
         internal_assert(sub_out.object_name.empty());
         sub_out.object_name = temp_dir.add_temp_object_file(output_files.static_library_name, suffix, target);
         futures.emplace_back(pool.async([](Module m, Outputs o) {
+            CompileTask task;
             debug(1) << "compile_multitarget: compile_sub_target " << o.object_name << "\n";
             m.compile(o);
         }, std::move(sub_module), std::move(sub_out)));
@@ -556,6 +756,7 @@ void compile_multitarget(const std::string &fn_name,
         Outputs runtime_out = Outputs().object(
             temp_dir.add_temp_object_file(output_files.static_library_name, "_runtime", runtime_target));
         futures.emplace_back(pool.async([](Target t, Outputs o) {
+            CompileTask task;
             debug(1) << "compile_multitarget: compile_standalone_runtime " << o.static_library_name << "\n";
             compile_standalone_runtime(o, t);
         }, std::move(runtime_target), std::move(runtime_out)));
@@ -597,6 +798,7 @@ void compile_multitarget(const std::string &fn_name,
         Outputs wrapper_out = Outputs().object(
             temp_dir.add_temp_object_file(output_files.static_library_name, "_wrapper", base_target, /* in_front*/ true));
         futures.emplace_back(pool.async([](Module m, Outputs o) {
+            CompileTask task;
             debug(1) << "compile_multitarget: wrapper " << o.object_name << "\n";
             m.compile(o);
         }, std::move(wrapper_module), std::move(wrapper_out)));
@@ -607,6 +809,7 @@ void compile_multitarget(const std::string &fn_name,
         header_module.append(LoweredFunc(fn_name, base_target_args, {}, LoweredFunc::ExternalPlusMetadata));
         Outputs header_out = Outputs().c_header(output_files.c_header_name);
         futures.emplace_back(pool.async([](Module m, Outputs o) {
+            CompileTask task;
             debug(1) << "compile_multitarget: c_header_name " << o.c_header_name << "\n";
             m.compile(o);
         }, std::move(header_module), std::move(header_out)));
@@ -46,6 +46,15 @@ struct Outputs {
      * output is desired. */
     std::string firrtl_source_name;
 
+    /** The name of the emitted cycle-level C++ model of the FIRRTL
+     * design. Only produced along with firrtl_source_name. */
+    std::string firrtl_model_name;
+
+    /** The name of the emitted JSON report of the estimated resources
+     * and timing of the FIRRTL design. Only produced along with
+     * firrtl_source_name. */
+    std::string firrtl_report_name;
+
     /** The name of the emitted Zynq C source file. Empty if no C source file
      * output is desired. */
     std::string zynq_c_source_name;
@@ -118,6 +127,24 @@ struct Outputs {
         return updated;
     }
 
+    /** Make a new Outputs struct that emits everything this one does
+     * and also a cycle-level C++ model of the FIRRTL design with the
+     * given name. */
+    Outputs firrtl_model(const std::string &firrtl_model_name) const {
+        Outputs updated = *this;
+        updated.firrtl_model_name = firrtl_model_name;
+        return updated;
+    }
+
+    /** Make a new Outputs struct that emits everything this one does
+     * and also a JSON report of the estimated resources and timing of
+     * the FIRRTL design with the given name. */
+    Outputs firrtl_report(const std::string &firrtl_report_name) const {
+        Outputs updated = *this;
+        updated.firrtl_report_name = firrtl_report_name;
+        return updated;
+    }
+
     /** Make a new Outputs struct that emits everything this one does
      * and also a stmt file with the given name. */
     Outputs stmt(const std::string &stmt_name) const {
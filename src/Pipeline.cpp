@@ -29,6 +29,20 @@ std::string output_name(const string &filename, const Module &m, const char* ext
     return output_name(filename, m.name(), ext);
 }
 
+// The name of an output written next to FILENAME, which replaces its
+// extension with SUFFIX.
+std::string sibling_output_name(const string &filename, const Module &m, const char* suffix) {
+    if (filename.empty()) {
+        return m.name() + suffix;
+    }
+    size_t dot = filename.rfind('.');
+    size_t slash = filename.find_last_of("/\\");
+    if (dot == string::npos || (slash != string::npos && dot < slash)) {
+        return filename + suffix;
+    }
+    return filename.substr(0, dot) + suffix;
+}
+
 Outputs static_library_outputs(const string &filename_prefix, const Target &target) {
     Outputs outputs = Outputs().c_header(filename_prefix + ".h");
     if (target.os == Target::Windows && !target.has_feature(Target::MinGW)) {
@@ -221,7 +235,9 @@ void Pipeline::compile_to_firrtl(const string &filename,
                                  const string &fn_name,
                                  const Target &target) {
     Module m = compile_to_module(args, fn_name, target);
-    m.compile(Outputs().firrtl_source(output_name(filename, m, ".fir")));
+    m.compile(Outputs().firrtl_source(output_name(filename, m, ".fir"))
+                       .firrtl_model(sibling_output_name(filename, m, "_model.cpp"))
+                       .firrtl_report(sibling_output_name(filename, m, "_report.json")));
 }
 
 
@@ -154,6 +154,13 @@ public:
                                const std::string &fn_name = "",
                                const Target &target = get_target_from_environment());
 
+    /** Statically compile a pipeline to FIRRTL. Besides the FIRRTL
+     * design and its testbench (written to filename), a cycle-level
+     * C++ model of the design is written to <name>_model.cpp, where
+     * <name> is filename without its extension; build and run it to
+     * get a quick estimate of stalls, FIFO occupancy and pixels/cycle.
+     * <name>_report.json has the estimated LUT/FF/DSP/BRAM counts
+     * and critical path of each component and of the whole design. */
     EXPORT void compile_to_firrtl(const std::string &filename,
                                const std::vector<Argument> &,
                                const std::string &fn_name = "",
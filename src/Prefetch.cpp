@@ -95,7 +95,8 @@ private:
         //----- HLS Modification Begins -----//
         if (ends_with(op->name, ".stencil") ||
             ends_with(op->name, ".stencil_update") ||
-            ends_with(op->name, ".stream")) {
+            ends_with(op->name, ".stream") ||
+            ends_with(op->name, ".pingpong")) {
             stmt = op;
             return;
         }
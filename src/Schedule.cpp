@@ -135,10 +135,14 @@ struct FuncScheduleContents {
     bool is_hw_kernel;   // TODO equivalent to !accelerate_exit.empty()
     bool is_accelerated;  // TODO equivalent to !accelerate_input.empty()
     bool is_linebuffered;
+    bool is_ping_pong;
     std::set<std::string> accelerate_inputs;
     std::string accelerate_exit;
     LoopLevel accelerate_compute_level, accelerate_store_level;
     std::map<std::string, int> fifo_depths;   // key is the name of the consumer
+    int initiation_interval;
+    int fixed_point_frac_bits;
+    float stage_delay;
     bool is_kernel_buffer;
     bool is_kernel_buffer_slice;
     std::map<std::string, Function> tap_funcs;
@@ -150,7 +154,7 @@ struct FuncScheduleContents {
           compute_level(LoopLevel::inlined()), memoized(false),
           //----- HLS Modification Begins -----//
           is_hw_kernel(false), is_accelerated(false), is_linebuffered(false),
-          is_kernel_buffer(false), is_kernel_buffer_slice(false){};
+          is_ping_pong(false), initiation_interval(1), fixed_point_frac_bits(0), stage_delay(0), is_kernel_buffer(false), is_kernel_buffer_slice(false){};
           //----- HLS Modification Ends -------//
 
     // Pass an IRMutator through to all Exprs referenced in the FuncScheduleContents
@@ -249,11 +253,15 @@ FuncSchedule FuncSchedule::deep_copy(
     copy.contents->is_hw_kernel = contents->is_hw_kernel;
     copy.contents->is_accelerated = contents->is_accelerated;
     copy.contents->is_linebuffered = contents->is_linebuffered;
+    copy.contents->is_ping_pong = contents->is_ping_pong;
     copy.contents->accelerate_inputs = contents->accelerate_inputs;
     copy.contents->accelerate_exit = contents->accelerate_exit;
     copy.contents->accelerate_compute_level = contents->accelerate_compute_level;
     copy.contents->accelerate_store_level = contents->accelerate_store_level;
     copy.contents->fifo_depths = contents->fifo_depths;
+    copy.contents->initiation_interval = contents->initiation_interval;
+    copy.contents->fixed_point_frac_bits = contents->fixed_point_frac_bits;
+    copy.contents->stage_delay = contents->stage_delay;
     copy.contents->is_kernel_buffer = contents->is_kernel_buffer;
     copy.contents->is_kernel_buffer_slice = contents->is_kernel_buffer_slice;
     copy.contents->tap_funcs = contents->tap_funcs;
@@ -440,6 +448,14 @@ bool &FuncSchedule::is_linebuffered() {
     return contents->is_linebuffered;
 }
 
+bool FuncSchedule::is_ping_pong() const {
+    return contents->is_ping_pong;
+}
+
+bool &FuncSchedule::is_ping_pong() {
+    return contents->is_ping_pong;
+}
+
 bool FuncSchedule::is_kernel_buffer() const {
     return contents->is_kernel_buffer;
 }
@@ -488,6 +504,30 @@ std::map<std::string, int> &FuncSchedule::fifo_depths() {
     return contents->fifo_depths;
 }
 
+int FuncSchedule::initiation_interval() const {
+    return contents->initiation_interval;
+}
+
+int &FuncSchedule::initiation_interval() {
+    return contents->initiation_interval;
+}
+
+int FuncSchedule::fixed_point_frac_bits() const {
+    return contents->fixed_point_frac_bits;
+}
+
+int &FuncSchedule::fixed_point_frac_bits() {
+    return contents->fixed_point_frac_bits;
+}
+
+float FuncSchedule::stage_delay() const {
+    return contents->stage_delay;
+}
+
+float &FuncSchedule::stage_delay() {
+    return contents->stage_delay;
+}
+
 const std::string &FuncSchedule::accelerate_exit() const{
     return contents->accelerate_exit;
 }
@@ -321,6 +321,13 @@ public:
     bool &is_linebuffered();
     // @}
 
+    /** Is the function stored in a ping-pong buffered memory in
+     * hardware, instead of streamed through a line buffer? */
+    // @{
+    bool is_ping_pong() const;
+    bool &is_ping_pong();
+    // @}
+
     /** Is accelerated using hardware? */
     // @{
     bool is_accelerated() const;
@@ -354,6 +361,29 @@ public:
     std::map<std::string, int> &fifo_depths();
     // @}
 
+    /** The number of cycles between two stencils computed by the
+     * function in hardware. */
+    // @{
+    int initiation_interval() const;
+    int &initiation_interval();
+    // @}
+
+    /** The number of fraction bits of the fixed-point format that
+     * carries floating-point values in the hardware accelerator
+     * pipeline ending at this function. 0 keeps floating point. */
+    // @{
+    int fixed_point_frac_bits() const;
+    int &fixed_point_frac_bits();
+    // @}
+
+    /** The combinational delay budget, in ns, of a pipeline stage of
+     * the hardware accelerator pipeline ending at this function. 0
+     * leaves the operations of a stage unscheduled. */
+    // @{
+    float stage_delay() const;
+    float &stage_delay();
+    // @}
+
     /** The output functions of the hardware accelerator pipeline. */
     // @{
     const std::string &accelerate_exit() const;
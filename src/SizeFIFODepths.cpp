@@ -0,0 +1,219 @@
+#include "SizeFIFODepths.h"
+#include "IROperator.h"
+#include "Simplify.h"
+#include "Debug.h"
+
+#include <algorithm>
+
+namespace Halide {
+namespace Internal {
+
+using std::map;
+using std::set;
+using std::string;
+using std::vector;
+
+namespace {
+
+// Cycles a stencil needs to get from the output of a producer to the
+// output of its consumer when nothing stalls: the FIFO after the
+// dispatcher (two registers, see print_fifo() of the FIRRTL backend),
+// the line buffer output register and the ForBlock pipeline register.
+const int kernel_latency = 4;
+
+int const_value(Expr e, int fallback) {
+    const int64_t *v = as_const_int(simplify(e));
+    return v ? (int)*v : fallback;
+}
+
+class FIFODepthSizer {
+    const HWKernelDAG &dag;
+    map<string, int> start_time;  // cycle at which a kernel produces its first stencil
+    set<string> visiting;
+
+    // The number of producer stencils that stream by before the consumer
+    // has its first full window: the offset of the consumer region inside
+    // the producer store region plus the lines the line buffer has to fill.
+    int fill_delay(const HWKernel &producer, const vector<StencilDimSpecs> &consumer_stencil) {
+        int delay = 0;
+        int stride = 1;
+        for (size_t i = 0; i < producer.dims.size() && i < consumer_stencil.size(); i++) {
+            const StencilDimSpecs &p = producer.dims[i];
+            const StencilDimSpecs &c = consumer_stencil[i];
+            int step = std::max(p.step, 1);
+            int offset = std::max(const_value(c.store_bound.min - p.store_bound.min, 0), 0);
+            int windows = (c.size + step - 1) / step;
+            delay += (offset / step + windows - 1) * stride;
+            int extent = const_value(p.store_bound.max - p.store_bound.min + 1, step);
+            stride *= std::max(extent / step, 1);
+        }
+        return delay;
+    }
+
+    // The number of stencils a kernel writes over its store region.
+    int tile_delay(const HWKernel &producer) {
+        int stencils = 1;
+        for (const StencilDimSpecs &p : producer.dims) {
+            int step = std::max(p.step, 1);
+            int extent = const_value(p.store_bound.max - p.store_bound.min + 1, step);
+            stencils *= std::max(extent / step, 1);
+        }
+        return stencils;
+    }
+
+    int edge_delay(const string &producer, const string &consumer) {
+        const HWKernel &p = dag.kernels.at(producer);
+        internal_assert(p.consumer_stencils.count(consumer));
+        // A ping-pong buffered producer hands over its whole tile at
+        // once, otherwise the consumer waits for its first window.
+        int delay = p.is_ping_pong ? tile_delay(p) :
+            fill_delay(p, p.consumer_stencils.find(consumer)->second);
+        // the producer emits a stencil every initiation_interval cycles
+        return delay * p.initiation_interval + kernel_latency;
+    }
+
+public:
+    FIFODepthSizer(const HWKernelDAG &d) : dag(d) {}
+
+    int get_start_time(const string &name) {
+        if (start_time.count(name)) {
+            return start_time[name];
+        }
+        internal_assert(!visiting.count(name)) << "HW kernel DAG has a cycle through " << name << "\n";
+        visiting.insert(name);
+        int t = 0;
+        auto it = dag.kernels.find(name);
+        vector<string> inputs;
+        if (it != dag.kernels.end()) {
+            inputs = it->second.input_streams;
+        }
+        for (const string &input : inputs) {
+            if (input != name) {
+                t = std::max(t, get_start_time(input) + edge_delay(input, name));
+            }
+        }
+        visiting.erase(name);
+        start_time[name] = t;
+        return t;
+    }
+
+    int required_depth(const string &producer, const string &consumer) {
+        // Stencils from this producer arrive edge_delay cycles before the
+        // consumer can use them, but the consumer only starts when its
+        // slowest input is ready. The stencils produced in the
+        // difference have to be buffered.
+        int slack = get_start_time(consumer) - get_start_time(producer)
+            - edge_delay(producer, consumer);
+        int ii = dag.kernels.at(producer).initiation_interval;
+        return std::max((slack + ii - 1) / ii, 0);
+    }
+};
+
+}
+
+void size_fifo_depths(HWKernelDAG &dag) {
+    FIFODepthSizer sizer(dag);
+    for (auto &p : dag.kernels) {
+        HWKernel &producer = p.second;
+        if (producer.is_inlined) {
+            // inlined kernels are not streamed, so they have no FIFOs
+            continue;
+        }
+        const map<string, int> &scheduled = producer.func.schedule().fifo_depths();
+        for (const auto &c : producer.consumer_stencils) {
+            const string &consumer = c.first;
+            if (consumer == producer.name || !dag.kernels.count(consumer)) {
+                continue;
+            }
+            if (producer.is_ping_pong) {
+                // the consumer reads the ping-pong buffer, not a FIFO
+                continue;
+            }
+            if (scheduled.count(consumer)) {
+                debug(3) << "FIFO " << producer.name << " -> " << consumer
+                         << " keeps the scheduled depth " << scheduled.find(consumer)->second << "\n";
+                continue;
+            }
+            producer.consumer_fifo_depths[consumer] = sizer.required_depth(producer.name, consumer);
+            debug(3) << "FIFO " << producer.name << " -> " << consumer
+                     << " sized to depth " << producer.consumer_fifo_depths[consumer] << "\n";
+        }
+    }
+}
+
+int hw_kernel_start_time(const HWKernelDAG &dag, const string &kernel) {
+    return FIFODepthSizer(dag).get_start_time(kernel);
+}
+
+int required_fifo_depth(const HWKernelDAG &dag, const string &producer, const string &consumer) {
+    return FIFODepthSizer(dag).required_depth(producer, consumer);
+}
+
+namespace {
+
+// The window of SIZE x SIZE stencils shifted by one over an EXTENT x
+// EXTENT tile.
+vector<StencilDimSpecs> test_window(int size, int extent) {
+    StencilDimSpecs d;
+    d.size = size;
+    d.step = 1;
+    d.min_pos = 0;
+    d.store_bound = Interval(0, extent - 1);
+    return {d, d};
+}
+
+HWKernel test_kernel(const string &name, const vector<string> &inputs) {
+    HWKernel k(Function(name), name);
+    k.dims = test_window(1, 64);
+    k.input_streams = inputs;
+    return k;
+}
+
+}
+
+void size_fifo_depths_test() {
+    // A reconvergent DAG: blur reads a 3x3 window of in, and out reads
+    // both in and blur.
+    HWKernelDAG dag;
+    dag.name = "out";
+    HWKernel in = test_kernel("in", {});
+    in.consumer_stencils["blur"] = test_window(3, 64);
+    in.consumer_stencils["out"] = test_window(1, 64);
+    HWKernel blur = test_kernel("blur", {"in"});
+    blur.consumer_stencils["out"] = test_window(1, 64);
+    HWKernel out = test_kernel("out", {"in", "blur"});
+    out.is_output = true;
+    dag.kernels["in"] = in;
+    dag.kernels["blur"] = blur;
+    dag.kernels["out"] = out;
+
+    // blur has its first window after two rows and two pixels of in.
+    const int fill = 2 * 64 + 2;
+    internal_assert(hw_kernel_start_time(dag, "in") == 0);
+    internal_assert(hw_kernel_start_time(dag, "blur") == fill + kernel_latency);
+    internal_assert(hw_kernel_start_time(dag, "out") == fill + 2 * kernel_latency);
+
+    // The short path from in to out buffers what in streams while blur
+    // fills its window.
+    size_fifo_depths(dag);
+    internal_assert(dag.kernels["in"].consumer_fifo_depths["out"] == fill + kernel_latency);
+    internal_assert(dag.kernels["in"].consumer_fifo_depths["blur"] == 0);
+    internal_assert(dag.kernels["blur"].consumer_fifo_depths["out"] == 0);
+
+    // If in streams a stencil every 2 cycles, blur waits twice as
+    // long, but the FIFO to out also fills at half the rate.
+    dag.kernels["in"].initiation_interval = 2;
+    internal_assert(required_fifo_depth(dag, "in", "out") == (2 * fill + kernel_latency + 1) / 2);
+
+    // Depths set with Func::fifo_depth() are kept.
+    dag.kernels["in"].initiation_interval = 1;
+    dag.kernels["in"].func.schedule().fifo_depths()["out"] = 1000;
+    dag.kernels["in"].consumer_fifo_depths["out"] = 1000;
+    size_fifo_depths(dag);
+    internal_assert(dag.kernels["in"].consumer_fifo_depths["out"] == 1000);
+
+    debug(0) << "size_fifo_depths test passed\n";
+}
+
+}
+}
@@ -0,0 +1,45 @@
+#ifndef HALIDE_SIZE_FIFO_DEPTHS_H
+#define HALIDE_SIZE_FIFO_DEPTHS_H
+
+/** \file
+ *
+ * Defines the analysis pass that sizes the FIFOs between HW kernels
+ */
+
+#include "ExtractHWKernelDAG.h"
+
+namespace Halide {
+namespace Internal {
+
+/** Compute the depth of every producer-to-consumer FIFO in the DAG
+ * from the latency of the paths reaching each kernel. A kernel cannot
+ * start until the data on its slowest input path arrives, so the
+ * stencils arriving earlier on the other paths have to wait in the
+ * FIFO. The depth is this difference in latency, which is the minimum
+ * that keeps reconvergent paths from stalling or deadlocking. Depths
+ * given with Func::fifo_depth() are left untouched.
+ *
+ * The latency of a kernel is modelled as a constant 4 cycles: the
+ * FIFO, the line buffer output register and one pipeline register.
+ * The depth of the datapath of a kernel is only known once the
+ * FIRRTL backend schedules it into stages, after this pass, so
+ * kernels with deeper datapaths make the depths computed here too
+ * shallow by the extra stages on the slower path.
+ */
+void size_fifo_depths(HWKernelDAG &dag);
+
+/** The cycle at which KERNEL produces its first stencil when nothing
+ * stalls, counted from the start of the DAG. */
+int hw_kernel_start_time(const HWKernelDAG &dag, const std::string &kernel);
+
+/** The depth, in stencils, that the FIFO from PRODUCER to CONSUMER
+ * needs according to the latency model of size_fifo_depths(). */
+int required_fifo_depth(const HWKernelDAG &dag, const std::string &producer,
+                        const std::string &consumer);
+
+EXPORT void size_fifo_depths_test();
+
+}
+}
+
+#endif
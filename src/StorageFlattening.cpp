@@ -98,7 +98,8 @@ private:
         // if it is a op node of a stream or a stencil, skip it
         if (ends_with(op->name, ".stencil") ||
             ends_with(op->name, ".stencil_update") ||
-            ends_with(op->name, ".stream")) {
+            ends_with(op->name, ".stream") ||
+            ends_with(op->name, ".pingpong")) {
             Stmt body = mutate(op->body);
 
             debug(3) << "Not attempting to flatten " << op->name << " because it is a stream or a stencil.\n";
@@ -292,7 +292,8 @@ class StorageFolding : public IRMutator {
         // if it is a realize node of a stream or a stencil, skip it
         if (ends_with(op->name, ".stencil") ||
             ends_with(op->name, ".stencil_update") ||
-            ends_with(op->name, ".stream")) {
+            ends_with(op->name, ".stream") ||
+            ends_with(op->name, ".pingpong")) {
             debug(3) << "Not attempting to fold " << op->name << " because it is a stream or a stencil.\n";
             if (body.same_as(op->body)) {
                 stmt = op;
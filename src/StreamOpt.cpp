@@ -49,6 +49,21 @@ Expr expand_expr(Expr e, const Scope<Expr> &scope) {
     return result;
 }
 
+// The part of the stencil window of PRODUCER that CONSUMER reads. It is
+// the whole window if the consumer stencils were not merged.
+StencilWindow consumer_window(const HWKernel &producer, const string &consumer) {
+    const auto it = producer.consumer_windows.find(consumer);
+    if (it != producer.consumer_windows.end()) {
+        return it->second;
+    }
+    StencilWindow window;
+    for (const StencilDimSpecs &dim : producer.dims) {
+        window.offsets.push_back(0);
+        window.sizes.push_back(dim.size);
+    }
+    return window;
+}
+
 
 }
 
@@ -150,8 +165,10 @@ class ReplaceReferencesWithStencil : public IRMutator {
             const HWKernel &stencil_kernel = it->second;
             internal_assert(op->args.size() == stencil_kernel.func.args().size());
 
-            // Replace the call node of func with call node of func.stencil
-            string stencil_name = stencil_kernel.name + ".stencil";
+            // Replace the call node of func with call node of func.stencil,
+            // or of func.pingpong if the input is ping-pong buffered
+            bool is_ping_pong = stencil_kernel.is_ping_pong && stencil_kernel.name != kernel.name;
+            string stencil_name = stencil_kernel.name + (is_ping_pong ? ".pingpong" : ".stencil");
             vector<Expr> new_args(op->args.size());
 
             // Mutate the arguments.
@@ -163,12 +180,17 @@ class ReplaceReferencesWithStencil : public IRMutator {
                 if (stencil_kernel.name == kernel.name) {
                     // The call is in an update definition of the kernel itself
                     offset = stencil_kernel.dims[i].min_pos;
+                } else if (is_ping_pong) {
+                    // The ping-pong buffer holds the whole store region
+                    offset = stencil_kernel.dims[i].store_bound.min;
                 } else {
                     // This is call to input stencil
-                    // we use the min_pos stored in in_kernel.consumer_stencils
+                    // we use the min_pos stored in in_kernel.consumer_stencils,
+                    // shifted to the window the kernel receives
                     const auto it = stencil_kernel.consumer_stencils.find(kernel.name);
                     internal_assert(it != kernel.consumer_stencils.end());
-                    offset = it->second[i].min_pos;
+                    offset = it->second[i].min_pos +
+                        consumer_window(stencil_kernel, kernel.name).offsets[i];
                 }
 
                 Expr new_arg = old_arg - offset;
@@ -263,7 +285,12 @@ Stmt create_dispatch_call(const HWKernel& kernel, int min_fifo_depth = 0) {
     //                   consumer_0_name, fifo_0_depth,
     //                   consumer_0_offset_dim_0, consumer_0_extent_dim_0,
     //                   [consumer_0_offset_dim_1, consumer_0_extent_dim_1, ...]
+    //                   consumer_0_window_offset_dim_0, consumer_0_window_size_dim_0,
+    //                   [consumer_0_window_offset_dim_1, consumer_0_window_size_dim_1, ...]
     //                   [consumer_1_name, ...])
+    // Every consumer receives the part of the stencil given by its
+    // window, so the consumers share the line buffer of the kernel, and
+    // their FIFOs only hold what they read.
     Expr stream_var = Variable::make(Handle(), kernel.name + ".stencil.stream");
     vector<Expr> dispatch_args({stream_var, (int)kernel.dims.size()});
     for (size_t i = 0; i < kernel.dims.size(); i++) {
@@ -290,13 +317,33 @@ Stmt create_dispatch_call(const HWKernel& kernel, int min_fifo_depth = 0) {
             dispatch_args.push_back((int)*as_const_int(store_offset));
             dispatch_args.push_back((int)*as_const_int(store_extent));
         }
+        StencilWindow window = consumer_window(kernel, p.first);
+        for (size_t i = 0; i < kernel.dims.size(); i++) {
+            dispatch_args.push_back(window.offsets[i]);
+            dispatch_args.push_back(window.sizes[i]);
+        }
     }
     return Evaluate::make(Call::make(Handle(), "dispatch_stream", dispatch_args, Call::Intrinsic));
 }
 
 
+// Add a read_pingpong call ahead of IR s. The kernel reads the
+// ping-pong buffer of the input directly, so there is no stencil to
+// realize, but every iteration waits for a complete bank.
+Stmt add_input_pingpong(Stmt s, const HWKernel &kernel, const HWKernel &input) {
+    // syntax for read_pingpong()
+    // read_pingpong(src_pingpong, consumer_name)
+    Expr pingpong_var = Variable::make(Handle(), input.name + ".pingpong");
+    vector<Expr> args({pingpong_var, kernel.name});
+    Stmt read_call = Evaluate::make(Call::make(Handle(), "read_pingpong", args, Call::Intrinsic));
+    return Block::make(read_call, s);
+}
+
 // Add realize and read_stream calls arround IR s
 Stmt add_input_stencil(Stmt s, const HWKernel &kernel, const HWKernel &input) {
+    if (input.is_ping_pong && input.name != kernel.name) {
+        return add_input_pingpong(s, kernel, input);
+    }
     string stencil_name = input.name + ".stencil";
     string stream_name = stencil_name + ".stream";
     Expr stream_var = Variable::make(Handle(), stream_name);
@@ -313,15 +360,88 @@ Stmt add_input_stencil(Stmt s, const HWKernel &kernel, const HWKernel &input) {
     Stmt pc = Block::make(ProducerConsumer::make(stencil_name, true, read_call),
                           ProducerConsumer::make(stencil_name, false, s));
 
-    // create a realizeation of the stencil image
+    // create a realizeation of the stencil image, of the size of the
+    // window the kernel receives
     Region bounds;
-    for (StencilDimSpecs dim: input.dims) {
-        bounds.push_back(Range(0, dim.size));
+    if (input.name != kernel.name) {
+        for (int size : consumer_window(input, kernel.name).sizes) {
+            bounds.push_back(Range(0, size));
+        }
+    } else {
+        for (StencilDimSpecs dim: input.dims) {
+            bounds.push_back(Range(0, dim.size));
+        }
     }
     s = Realize::make(stencil_name, input.func.output_types(), bounds, const_true(), pc);
     return s;
 }
 
+// Put the initiation interval of KERNEL ahead of its scan loops, so
+// that code generators know the rate the loop nest is pipelined at.
+// syntax: initiation_interval(ii)
+Stmt add_initiation_interval(Stmt s, const HWKernel &kernel) {
+    Expr ii = make_const(Int(32), kernel.initiation_interval);
+    Stmt ii_call = Evaluate::make(Call::make(Handle(), "initiation_interval", {ii}, Call::Intrinsic));
+    return Block::make(ii_call, s);
+}
+
+// Put the fixed-point format and the stage delay of DAG, if set, at
+// the start of its accelerator body for the code generators.
+// syntax: fixed_point(frac_bits)
+//         stage_delay(ns)
+Stmt add_hw_options(Stmt s, const HWKernelDAG &dag) {
+    if (dag.stage_delay > 0) {
+        Expr ns = FloatImm::make(Float(32), dag.stage_delay);
+        Stmt ns_call = Evaluate::make(Call::make(Handle(), "stage_delay", {ns}, Call::Intrinsic));
+        s = Block::make(ns_call, s);
+    }
+    if (dag.fixed_point_frac_bits > 0) {
+        Expr frac = make_const(Int(32), dag.fixed_point_frac_bits);
+        Stmt frac_call = Evaluate::make(Call::make(Handle(), "fixed_point", {frac}, Call::Intrinsic));
+        s = Block::make(frac_call, s);
+    }
+    return s;
+}
+
+// IR for ping-pong buffers
+// A ping-pong buffer is instantiated to store the stencil_update.stream
+// of the kernel over its whole store region. The kernel writes a tile
+// into one bank while the consumer reads the previous one from the
+// other bank.
+Stmt add_pingpong_buffer(Stmt s, const HWKernel &kernel) {
+    // Before mutation:
+    //       stmt...
+    //
+    // After mutation:
+    //       realize func.pingpong {
+    //         pingpong_buffer(...)
+    //         stmt...
+    //       }
+    //
+    // syntax:
+    //   pingpong_buffer(update_stream_name, pingpong_name, consumer_name,
+    //                   stencil_step_dim_0, store_extent_dim_0,
+    //                   [stencil_step_dim_1, store_extent_dim_1, ...])
+    internal_assert(kernel.consumer_stencils.size() == 1);
+    string name = kernel.name + ".pingpong";
+    Expr update_stream_var = Variable::make(Handle(), kernel.name + ".stencil_update.stream");
+    Expr pingpong_var = Variable::make(Handle(), name);
+    vector<Expr> args({update_stream_var, pingpong_var, kernel.consumer_stencils.begin()->first});
+
+    // create a realization of the memory of the store-size
+    Region store_bounds;
+    for (const StencilDimSpecs &dim : kernel.dims) {
+        Expr store_extent = simplify(dim.store_bound.max - dim.store_bound.min + 1);
+        internal_assert(is_const(store_extent));
+        args.push_back(dim.step);
+        args.push_back(store_extent);
+        store_bounds.push_back(Range(0, store_extent));
+    }
+    Stmt pingpong_call = Evaluate::make(Call::make(Handle(), "pingpong_buffer", args, Call::Intrinsic));
+    return Realize::make(name, kernel.func.output_types(), store_bounds, const_true(),
+                         Block::make(pingpong_call, s));
+}
+
 bool need_linebuffer(const HWKernel &kernel) {
     // check if we need a line buffer
     bool ret = false;
@@ -441,8 +561,10 @@ Stmt transform_kernel(Stmt s, const HWKernelDAG &dag, const Scope<Expr> &scope)
         //         consume func.stencil.stream
         //       }
         //     }
+        // A ping-pong buffered kernel gets a ping-pong buffer in place
+        // of the line buffer and the dispatcher.
         string stencil_name = kernel.name + ".stencil";
-        string stream_name = need_linebuffer(kernel) ?
+        string stream_name = need_linebuffer(kernel) || kernel.is_ping_pong ?
             kernel.name + ".stencil_update.stream" : kernel.name + ".stencil.stream";
         Expr stencil_var = Variable::make(Handle(), stencil_name);
         Expr stream_var = Variable::make(Handle(), stream_name);
@@ -508,10 +630,12 @@ Stmt transform_kernel(Stmt s, const HWKernelDAG &dag, const Scope<Expr> &scope)
         Stmt stream_consume = transform_kernel(consume->body, dag, scope);
 
         // Add line buffer and dispatcher
-        Stmt stream_realize = add_linebuffer(stream_consume, kernel);
+        Stmt stream_realize = kernel.is_ping_pong ?
+            add_pingpong_buffer(stream_consume, kernel) : add_linebuffer(stream_consume, kernel);
 
         // create the PC node for update stream
-        Stmt stream_pc = Block::make(ProducerConsumer::make(stream_name, true, scan_loops),
+        Stmt stream_pc = Block::make(ProducerConsumer::make(stream_name, true,
+                                                             add_initiation_interval(scan_loops, kernel)),
                                      ProducerConsumer::make(stream_name, false, stream_realize));
 
         // create a realizeation of the stencil stream
@@ -601,13 +725,37 @@ Stmt transform_kernel(Stmt s, const HWKernelDAG &dag, const Scope<Expr> &scope)
             scan_loops = For::make(loop_var_name, 0, loop_extent, ForType::Serial, DeviceAPI::Host, scan_loops);
         }
 
-        ret = Block::make(ProducerConsumer::make(stream_name, true, scan_loops),
+        ret = Block::make(ProducerConsumer::make(stream_name, true,
+                                                 add_initiation_interval(scan_loops, kernel)),
                           ProducerConsumer::make(stream_name, false, Evaluate::make(0)));
     }
     return ret;
 }
 
 
+// The hardware has no vector unit, so a vectorized loop inside the
+// accelerated pipeline means the datapath is replicated: each lane
+// becomes its own copy of the loop body, and the stencil step grows
+// to the vector width.
+class UnrollVectorizedLoops : public IRMutator {
+    using IRMutator::visit;
+
+    void visit(const For *op) {
+        Stmt body = mutate(op->body);
+        if (op->for_type == ForType::Vectorized) {
+            user_assert(is_const(op->extent))
+                << "Vectorized loop " << op->name
+                << " in the hardware pipeline must have a constant extent\n";
+            debug(3) << "replicating the datapath of vectorized loop " << op->name << '\n';
+            stmt = For::make(op->name, op->min, op->extent, ForType::Unrolled, op->device_api, body);
+        } else if (body.same_as(op->body)) {
+            stmt = op;
+        } else {
+            stmt = For::make(op->name, op->min, op->extent, op->for_type, op->device_api, body);
+        }
+    }
+};
+
 class TransformTapStencils : public IRMutator {
     const map<string, HWTap> &taps;
 
@@ -698,6 +846,8 @@ class StreamOpt : public IRMutator {
             }
 
             Stmt new_body = mutate(body);
+            new_body = UnrollVectorizedLoops().mutate(new_body);
+            new_body = add_hw_options(new_body, dag);
 
             //stmt = For::make(dag.name + ".accelerator", 0, 1, ForType::Serial, DeviceAPI::Host, body);
             const string target_name = "_hls_target." + dag.name;
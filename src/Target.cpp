@@ -272,6 +272,7 @@ const std::map<std::string, Target::Feature> feature_name_map = {
     {"no_perfect_nested_loop", Target::NoPerfectNestedLoop},
     //----- Dump IO for RTL Simulation, used with compile_to_hls()-----//
     {"dump_io", Target::DumpIO},
+    {"zynq_sg", Target::ZynqSG},
 };
 
 bool lookup_feature(const std::string &tok, Target::Feature &result) {
@@ -92,6 +92,7 @@ struct Target {
         NoPerfectNestedLoop = halide_target_feature_no_perfect_nested_loop,
         //----- Dump IO for RTL Simulation -----//
         DumpIO = halide_target_feature_dump_io,
+        ZynqSG = halide_target_feature_zynq_sg,
         FeatureEnd = halide_target_feature_end
     };
     Target() : os(OSUnknown), arch(ArchUnknown), bits(0) {}
@@ -168,7 +168,7 @@ extern void halide_join_thread(struct halide_thread *);
  * n < 0  : error condition
  * n == 0 : use a reasonable system default (typically, number of cpus online).
  * n == 1 : use exactly one thread; this will always enforce serial execution
- * n > 1  : use a pool of exactly n threads.
+ * n > 1  : use a pool of exactly n threads, up to 1024.
  *
  * Note that the default iOS and OSX behavior will treat n > 1 like n == 0;
  * that is, any positive value other than 1 will use a system-determined number
@@ -180,6 +180,35 @@ extern void halide_join_thread(struct halide_thread *);
  */
 extern int halide_set_num_threads(int n);
 
+/** Where the worker threads of Halide's thread pool run. Workers are
+ * counted from zero, and the NUMA nodes are those of the host that
+ * have cpus. */
+typedef enum halide_thread_affinity_t {
+    halide_thread_affinity_none = 0, //!< Threads are not pinned, the OS places them
+    halide_thread_affinity_compact,  //!< Worker i runs on cpu i, filling a node before the next one
+    halide_thread_affinity_scatter,  //!< Workers take the nodes in turn, one cpu each
+    halide_thread_affinity_numa      //!< Workers take the nodes in turn, and run on any cpu of their node
+} halide_thread_affinity_t;
+
+/** Set the affinity of the worker threads of Halide's thread
+ * pool. Returns the old mode. The default is read from the
+ * environment variable HL_THREAD_AFFINITY (none, compact, scatter or
+ * numa), and is none if it is not set. Running threads move at their
+ * next wake up.
+ *
+ * Unless the mode is none, an idle thread steals work from the
+ * threads on its own node before the other ones, so the tiles of a
+ * parallel loop launched by a thread tend to stay on its node.
+ *
+ * On Windows, the cpus of all the processor groups are numbered in
+ * turn, and a worker only runs on the cpus of one group.
+ *
+ * (As for halide_set_num_threads(), this is only guaranteed when
+ * using the default implementations of halide_do_par_for(), and
+ * only has an effect on Linux and Windows.)
+ */
+extern int halide_set_thread_affinity(int mode);
+
 /** Halide calls these functions to allocate and free memory. To
  * replace in AOT code, use the halide_set_custom_malloc and
  * halide_set_custom_free, or (on platforms that support weak
@@ -642,6 +671,21 @@ extern void halide_memoization_cache_release(void *user_context, void *host);
  */
 extern void halide_memoization_cache_cleanup();
 
+/** Counters of the default memoization cache, since it was last
+ * cleaned up. */
+struct halide_memoization_cache_stats_t {
+    uint64_t hits, misses;   //!< Lookups that found an entry, and that did not
+    uint64_t evictions;      //!< Entries evicted to make room
+    int64_t entries;         //!< Entries in the cache
+    int64_t current_size;    //!< Bytes of data held by the entries
+    int64_t max_size;        //!< See halide_memoization_cache_set_size()
+};
+
+/** Read the counters of the default memoization cache. Each shard of
+ * the cache is read in turn, so the counters of a cache in use by
+ * other threads are not quite a snapshot. */
+extern void halide_memoization_cache_get_stats(struct halide_memoization_cache_stats_t *stats);
+
 /** Create a unique file with a name of the form prefixXXXXXsuffix in an arbitrary
  * (but writable) directory; this is typically $TMP or /tmp, but the specific
  * location is not guaranteed. (Note that the exact form of the file name
@@ -949,7 +993,8 @@ typedef enum halide_target_feature_t {
     //----- HLS Modification Ends -------//
     halide_target_feature_no_perfect_nested_loop = 51, ///< Disable Perfect Nested Loop
     halide_target_feature_dump_io = 52, ///< Dump IO for RTL Simulation used with compile_to_hls()
-    halide_target_feature_end = 53 ///< A sentinel. Every target is considered to have this feature, and setting this feature does nothing.
+    halide_target_feature_zynq_sg = 53, ///< Stream N-D sub-images to Zynq accelerators with scatter-gather DMA. Needs a hwacc driver that implements PROCESS_IMAGE_SG.
+    halide_target_feature_end = 54 ///< A sentinel. Every target is considered to have this feature, and setting this feature does nothing.
 } halide_target_feature_t;
 
 /** This function is called internally by Halide in some situations to determine
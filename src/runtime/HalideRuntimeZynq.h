@@ -35,6 +35,33 @@ typedef struct cma_buffer_t {
 } cma_buffer_t;
 #endif
 
+#ifndef CMA_SG_BUFFER_T_DEFINED
+#define CMA_SG_BUFFER_T_DEFINED
+/** A scatter-gather DMA descriptor of an N-D sub-image, as a list of
+ * 2-D blocks streamed in order. Each block is HEIGHT rows of WIDTH
+ * contiguous bytes, STRIDE bytes apart. */
+#define CMA_SG_MAX_BLOCKS 64
+typedef struct cma_block_t {
+  unsigned int phys_addr; // Bus address of the first row
+  unsigned int width; // Bytes per row
+  unsigned int stride; // Bytes between rows
+  unsigned int height; // Number of rows
+} cma_block_t;
+typedef struct cma_sg_buffer_t {
+  unsigned int num_blocks;
+  cma_block_t blocks[CMA_SG_MAX_BLOCKS];
+} cma_sg_buffer_t;
+#endif
+
+#ifndef REGISTER_T_DEFINED
+#define REGISTER_T_DEFINED
+/** A configuration register write, passed to the hwacc driver. */
+typedef struct hwacc_reg_t {
+    unsigned int offset;
+    unsigned int value;
+} hwacc_reg_t;
+#endif
+
 /** Initialize Zynq runtime environment and must be called
     before any other function from the runtime API. */
 extern int halide_zynq_init();
@@ -52,6 +79,56 @@ extern int halide_zynq_cma_alloc(struct halide_buffer_t *buf);
 extern int halide_zynq_cma_free(struct halide_buffer_t *buf);
 // @}
 
+/** Returned by calls that the installed drivers don't implement. */
+#define HALIDE_ZYNQ_UNSUPPORTED (-4)
+
+/** The device interface of buffers allocated or wrapped by the Zynq
+ * runtime. Generated code streams an input in place only when it
+ * carries this interface. */
+extern const struct halide_device_interface_t *halide_zynq_device_interface();
+
+/** Make an existing DMA-able region the device allocation of BUF, so
+ * that frames already in such memory (e.g. from a camera driver) are
+ * streamed to the accelerator without a copy. BUF->host must point at
+ * a mapping of the region, with the layout given by the buffer's
+ * dimensions; the pixels of a row must be packed, rows may be padded.
+ * halide_zynq_cma_wrap() takes the bus address of the region, and
+ * halide_zynq_dmabuf_wrap() imports a dma-buf file descriptor through
+ * the CMA driver to find it. halide_zynq_cma_unwrap() (or
+ * halide_zynq_cma_free()) releases the wrapper, not the memory.
+ * halide_zynq_dmabuf_wrap() returns HALIDE_ZYNQ_UNSUPPORTED, leaving
+ * BUF untouched, when the CMA driver can't import dma-bufs; callers
+ * can then copy the frame into a buffer from halide_zynq_cma_alloc().
+ * Pipelines read accelerator inputs that are plain copies of a
+ * device-resident input buffer directly from it. */
+// @{
+extern int halide_zynq_cma_wrap(struct halide_buffer_t *buf, unsigned int phys_addr);
+extern int halide_zynq_dmabuf_wrap(struct halide_buffer_t *buf, int dmabuf_fd);
+extern int halide_zynq_cma_unwrap(struct halide_buffer_t *buf);
+// @}
+
+/** CMA buffers released by halide_zynq_cma_free() stay mapped in a
+ * pool, and halide_zynq_cma_alloc() hands them out again when a later
+ * request fits, so steady-state frames make no allocation syscalls.
+ * halide_zynq_cma_pool_trim() releases unused buffers until at most
+ * MAX_CACHED_BYTES remain cached; passing 0 empties the pool.
+ *
+ * Setting HL_ZYNQ_FAKE_CMA=1 before halide_zynq_init() backs buffers
+ * with anonymous memory instead of /dev/cmabuffer0, so the allocator
+ * can be tested on a machine without the Zynq drivers. */
+// @{
+struct halide_zynq_cma_pool_stats_t {
+    uint64_t hits;           // allocations served from the pool
+    uint64_t misses;         // allocations that went to the driver
+    int buffers_in_use;
+    int buffers_cached;
+    uint64_t bytes_in_use;
+    uint64_t bytes_cached;
+};
+extern int halide_zynq_cma_pool_trim(size_t max_cached_bytes);
+extern int halide_zynq_cma_pool_get_stats(struct halide_zynq_cma_pool_stats_t *stats);
+// @}
+
 /** Create a new cma_buffer_t representing a sub-image tile of IMAGE
  * buffer. The sub-image tile starts at the user space address
  * ADDRESS_OF_SUBIMAGE_ORIGIN, and is WIDTH wide and HEIGHT tall.
@@ -60,10 +137,22 @@ extern int halide_zynq_cma_free(struct halide_buffer_t *buf);
  */
 extern int halide_zynq_subimage(const struct halide_buffer_t* image, struct cma_buffer_t* subimage, void *address_of_subimage_origin, int width, int height);
 
+/** Describe an N-D sub-image of IMAGE, starting at
+ * ADDRESS_OF_SUBIMAGE_ORIGIN with the given EXTENTS and STRIDES (in
+ * elements) of its DIMENSIONS, as a scatter-gather list. The elements
+ * are streamed with dimension 0 innermost. Dimensions that are
+ * contiguous in memory are merged, the next one gives the rows of a
+ * block, and the remaining ones enumerate the blocks, so e.g. a tile
+ * of a planar RGB image becomes one block per plane. Slices that
+ * would need more than CMA_SG_MAX_BLOCKS blocks are rejected. */
+extern int halide_zynq_subimage_nd(const struct halide_buffer_t* image, struct cma_sg_buffer_t* subimage, void *address_of_subimage_origin, int dimensions, const int *strides, const int *extents);
+
 /** Launch a hardware accelerator run. BUFS stores the inputs and
  * output (sub-)image tiles used by DMAs.
  * The function returns immediately (non-blocking) with a task_id,
  * which can be used in other synchronization (blocking) functions.
+ * Runs may be launched from several threads, e.g. by the tiles of a
+ * parallel loop; they are queued to the accelerator in turn.
  */
 extern int halide_zynq_hwacc_launch(struct cma_buffer_t bufs[]);
 
@@ -71,6 +160,52 @@ extern int halide_zynq_hwacc_launch(struct cma_buffer_t bufs[]);
  * TASK_ID finishes. */
 extern int halide_zynq_hwacc_sync(int task_id);
 
+/** Set how many accelerator runs may still be in flight when
+ * halide_zynq_hwacc_launch_pipelined() returns. A depth of 0 (the
+ * default) makes each launch wait for its own run; a depth of 1
+ * double-buffers, letting the host prepare tile N+1 while the fabric
+ * processes tile N. The initial value can also be set with the
+ * HL_ZYNQ_HWACC_DEPTH environment variable. */
+extern int halide_zynq_set_hwacc_depth(int depth);
+
+/** Launch an accelerator run and record its task_id as pending.
+ * Before returning, the oldest pending runs are synced until no more
+ * than the configured depth remain in flight. */
+extern int halide_zynq_hwacc_launch_pipelined(struct cma_buffer_t bufs[]);
+
+/** Block until every pending run from halide_zynq_hwacc_launch_pipelined()
+ * finishes. */
+extern int halide_zynq_hwacc_sync_all();
+
+/** Stage a write of VALUE to the configuration register at byte
+ * OFFSET. Staged writes are applied right before the next launch, once
+ * at most one earlier run is still in flight. The accelerator latches
+ * its configuration when a run starts, so new parameters can be staged
+ * while the current frame runs, without draining the pipeline. The
+ * halide_zynq_set_* functions generated by gen_reg_api.py stage their
+ * writes through this function. */
+extern int halide_zynq_stage_reg(unsigned int offset, unsigned int value);
+
+/** A pipeline may contain several accelerator IPs. The IP named
+ * hls_target is driven through /dev/hwacc0, and the functions above
+ * act on it; the IP named hls_targetN is driven through /dev/hwaccN.
+ * These variants act on the given DEVICE number. Runs pending on
+ * different devices proceed concurrently. */
+// @{
+extern int halide_zynq_hwacc_launch_on(int device, struct cma_buffer_t bufs[]);
+extern int halide_zynq_hwacc_sync_on(int device, int task_id);
+extern int halide_zynq_hwacc_launch_pipelined_on(int device, struct cma_buffer_t bufs[]);
+extern int halide_zynq_hwacc_sync_all_on(int device);
+extern int halide_zynq_stage_reg_on(int device, unsigned int offset, unsigned int value);
+// @}
+
+/** Launch variants taking scatter-gather descriptors filled by
+ * halide_zynq_subimage_nd(). */
+// @{
+extern int halide_zynq_hwacc_launch_sg_on(int device, struct cma_sg_buffer_t bufs[]);
+extern int halide_zynq_hwacc_launch_pipelined_sg_on(int device, struct cma_sg_buffer_t bufs[]);
+// @}
+
 #ifdef __cplusplus
 } // End extern "C"
 #endif
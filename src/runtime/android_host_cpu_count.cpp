@@ -1,4 +1,5 @@
 #include "HalideRuntime.h"
+#include "runtime_internal.h"
 
 extern "C" {
 
@@ -9,4 +10,12 @@ WEAK int halide_host_cpu_count() {
     return sysconf(97);
 }
 
+WEAK int halide_host_numa_nodes(int *node_of_cpu, int num_cpus) {
+    // Android devices have a single memory node.
+    for (int i = 0; i < num_cpus; i++) {
+        node_of_cpu[i] = 0;
+    }
+    return 1;
+}
+
 }
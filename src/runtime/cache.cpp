@@ -3,12 +3,12 @@
 #include "printer.h"
 #include "scoped_mutex_lock.h"
 
-// This is temporary code. In particular, the hash table is stupid and
-// currently thread safety is accomplished via large granularity spin
-// locks. It is mainly intended to prove the programming model and
-// runtime interface for memoization. We'll improve the implementation
-// later. In the meantime, on some platforms it can be replaced by a
-// platform specific LRU cache such as libcache from Apple.
+// The cache is split into shards by the hash of the key, each with its
+// own lock, hash table and CLOCK approximation of LRU eviction, so that
+// threads using different entries rarely contend. A hit only sets the
+// referenced bit of its entry instead of reordering a global recency
+// list. On some platforms it can be replaced by a platform specific
+// LRU cache such as libcache from Apple.
 
 namespace Halide { namespace Runtime { namespace Internal {
 
@@ -82,8 +82,11 @@ const size_t extra_bytes_host_bytes = 16;
 
 struct CacheEntry {
     CacheEntry *next;
-    CacheEntry *more_recent;
-    CacheEntry *less_recent;
+    // The ring of the entries of the shard swept by its clock hand.
+    CacheEntry *clock_next;
+    CacheEntry *clock_prev;
+    // Set when the entry is used, cleared when the hand passes it.
+    bool referenced;
     uint8_t *metadata_storage;
     size_t key_size;
     uint8_t *key;
@@ -118,8 +121,9 @@ WEAK bool CacheEntry::init(const uint8_t *cache_key, size_t cache_key_size,
                            uint32_t key_hash, const halide_buffer_t *computed_bounds_buf,
                            int32_t tuples, halide_buffer_t **tuple_buffers) {
     next = NULL;
-    more_recent = NULL;
-    less_recent = NULL;
+    clock_next = NULL;
+    clock_prev = NULL;
+    referenced = false;
     key_size = cache_key_size;
     hash = key_hash;
     in_use_count = 0;
@@ -181,134 +185,228 @@ WEAK void CacheEntry::destroy() {
     halide_free(NULL, metadata_storage);
 }
 
-WEAK uint32_t djb_hash(const uint8_t *key, size_t key_size)  {
-    uint32_t h = 5381;
-    for (size_t i = 0; i < key_size; i++) {
-      h = (h << 5) + h + key[i];
+// Hashes the key 32 bytes at a time with four independent lanes of
+// 64-bit multiply-xorshift, which pipeline (or vectorize) instead of
+// chaining a dependency through every byte of the key.
+WEAK uint32_t hash_key(const uint8_t *key, size_t key_size) {
+    const uint64_t prime = 0x9E3779B97F4A7C15ULL;
+    uint64_t lanes[4] = {prime, prime * 3, prime * 5, prime * 7};
+    size_t i = 0;
+    for (; i + 32 <= key_size; i += 32) {
+        for (int l = 0; l < 4; l++) {
+            uint64_t v;
+            memcpy(&v, key + i + 8 * l, 8);
+            lanes[l] = (lanes[l] ^ v) * prime;
+            lanes[l] ^= lanes[l] >> 32;
+        }
     }
-    return h;
+    uint64_t h = key_size;
+    for (int l = 0; l < 4; l++) {
+        h = (h ^ lanes[l]) * prime;
+    }
+    for (; i + 8 <= key_size; i += 8) {
+        uint64_t v;
+        memcpy(&v, key + i, 8);
+        h = (h ^ v) * prime;
+        h ^= h >> 32;
+    }
+    for (; i < key_size; i++) {
+        h = (h ^ key[i]) * prime;
+    }
+    // Finish with the avalanche of MurmurHash3.
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return (uint32_t)h;
 }
 
-WEAK halide_mutex memoization_lock;
+const size_t kCacheShards = 16;
+const size_t kBucketsPerShard = 64;
+
+struct CacheShard {
+    halide_mutex lock;
+    CacheEntry *buckets[kBucketsPerShard];
 
-const size_t kHashTableSize = 256;
+    // The next entry the clock hand looks at, and the number of
+    // entries in the ring.
+    CacheEntry *hand;
+    int64_t entry_count;
 
-WEAK CacheEntry *cache_entries[kHashTableSize];
+    // The bytes of data held by the entries of the shard.
+    int64_t size;
+
+    uint64_t hits, misses, evictions;
+};
 
-WEAK CacheEntry *most_recently_used = NULL;
-WEAK CacheEntry *least_recently_used = NULL;
+WEAK CacheShard cache_shards[kCacheShards];
+
+// The shard is picked by the top bits of the hash, and the bucket by
+// the bottom ones.
+WEAK CacheShard &shard_of(uint32_t hash) {
+    return cache_shards[hash >> 28];
+}
+
+WEAK CacheEntry *&bucket_of(CacheShard &shard, uint32_t hash) {
+    return shard.buckets[hash % kBucketsPerShard];
+}
 
 const uint64_t kDefaultCacheSize = 1 << 20;
 WEAK int64_t max_cache_size = kDefaultCacheSize;
-WEAK int64_t current_cache_size = 0;
+
+// The size of all the shards. It is read without their locks, which
+// is good enough for a soft limit.
+WEAK int64_t current_cache_size() {
+    int64_t size = 0;
+    for (size_t i = 0; i < kCacheShards; i++) {
+        size += cache_shards[i].size;
+    }
+    return size;
+}
 
 #if CACHE_DEBUGGING
-WEAK void validate_cache() {
-    print(NULL) << "validating cache, "
-                << "current size " << current_cache_size
-                << " of maximum " << max_cache_size << "\n";
+WEAK void validate_shard(CacheShard &shard) {
     int entries_in_hash_table = 0;
-    for (size_t i = 0; i < kHashTableSize; i++) {
-        CacheEntry *entry = cache_entries[i];
-        while (entry != NULL) {
+    for (size_t i = 0; i < kBucketsPerShard; i++) {
+        for (CacheEntry *entry = shard.buckets[i]; entry != NULL; entry = entry->next) {
             entries_in_hash_table++;
-            if (entry->more_recent == NULL && entry != most_recently_used) {
+            if (entry->clock_next->clock_prev != entry ||
+                entry->clock_prev->clock_next != entry) {
                 halide_print(NULL, "cache invalid case 1\n");
                 __builtin_trap();
             }
-            if (entry->less_recent == NULL && entry != least_recently_used) {
-                halide_print(NULL, "cache invalid case 2\n");
-                __builtin_trap();
-            }
-            entry = entry->next;
         }
     }
-    int entries_from_mru = 0;
-    CacheEntry *mru_chain = most_recently_used;
-    while (mru_chain != NULL) {
-        entries_from_mru++;
-        mru_chain = mru_chain->less_recent;
-    }
-    int entries_from_lru = 0;
-    CacheEntry *lru_chain = least_recently_used;
-    while (lru_chain != NULL) {
-        entries_from_lru++;
-        lru_chain = lru_chain->more_recent;
-    }
-    print(NULL) << "hash entries " << entries_in_hash_table
-                << ", mru entries " << entries_from_mru
-                << ", lru entries " << entries_from_lru << "\n";
-    if (entries_in_hash_table != entries_from_mru) {
-        halide_print(NULL, "cache invalid case 3\n");
+    int entries_in_ring = 0;
+    if (shard.hand != NULL) {
+        CacheEntry *entry = shard.hand;
+        do {
+            entries_in_ring++;
+            entry = entry->clock_next;
+        } while (entry != shard.hand);
+    }
+    if (entries_in_hash_table != entries_in_ring ||
+        entries_in_ring != shard.entry_count) {
+        print(NULL) << "hash entries " << entries_in_hash_table
+                    << ", ring entries " << entries_in_ring
+                    << ", count " << shard.entry_count << "\n";
+        halide_print(NULL, "cache invalid case 2\n");
         __builtin_trap();
     }
-    if (entries_in_hash_table != entries_from_lru) {
-        halide_print(NULL, "cache invalid case 4\n");
-        __builtin_trap();
-    }
-    if (current_cache_size < 0) {
+    if (shard.size < 0) {
         halide_print(NULL, "cache size is negative\n");
         __builtin_trap();
     }
 }
 #endif
 
-WEAK void prune_cache() {
-#if CACHE_DEBUGGING
-    validate_cache();
-#endif
-    CacheEntry *prune_candidate = least_recently_used;
-    while (current_cache_size > max_cache_size &&
-           prune_candidate != NULL) {
-        CacheEntry *more_recent = prune_candidate->more_recent;
-
-        if (prune_candidate->in_use_count == 0) {
-            uint32_t h = prune_candidate->hash;
-            uint32_t index = h % kHashTableSize;
-
-            // Remove from hash table
-            CacheEntry *prev_hash_entry = cache_entries[index];
-            if (prev_hash_entry == prune_candidate) {
-                cache_entries[index] = prune_candidate->next;
-            } else {
-                while (prev_hash_entry != NULL && prev_hash_entry->next != prune_candidate) {
-                    prev_hash_entry = prev_hash_entry->next;
-                }
-                halide_assert(NULL, prev_hash_entry != NULL);
-                prev_hash_entry->next = prune_candidate->next;
-            }
+// Puts the entry in the ring just behind the hand, so that it is the
+// last one the hand reaches.
+WEAK void clock_insert(CacheShard &shard, CacheEntry *entry) {
+    if (shard.hand == NULL) {
+        entry->clock_next = entry;
+        entry->clock_prev = entry;
+        shard.hand = entry;
+    } else {
+        entry->clock_next = shard.hand;
+        entry->clock_prev = shard.hand->clock_prev;
+        entry->clock_prev->clock_next = entry;
+        shard.hand->clock_prev = entry;
+    }
+    shard.entry_count++;
+}
 
-            // Remove from less recent chain.
-            if (least_recently_used == prune_candidate) {
-                least_recently_used = more_recent;
-            }
-            if (more_recent != NULL) {
-                more_recent->less_recent = prune_candidate->less_recent;
-            }
+WEAK void evict(CacheShard &shard, CacheEntry *entry) {
+    // Remove from hash table
+    CacheEntry **prev = &bucket_of(shard, entry->hash);
+    while (*prev != NULL && *prev != entry) {
+        prev = &(*prev)->next;
+    }
+    halide_assert(NULL, *prev != NULL);
+    *prev = entry->next;
 
-            // Remove from more recent chain.
-            if (most_recently_used == prune_candidate) {
-                most_recently_used = prune_candidate->less_recent;
-            }
-            if (prune_candidate->less_recent != NULL) {
-                prune_candidate->less_recent = more_recent;
-            }
+    // Remove from the ring.
+    if (entry->clock_next == entry) {
+        shard.hand = NULL;
+    } else {
+        entry->clock_prev->clock_next = entry->clock_next;
+        entry->clock_next->clock_prev = entry->clock_prev;
+        if (shard.hand == entry) {
+            shard.hand = entry->clock_next;
+        }
+    }
+    shard.entry_count--;
 
-            // Decrease cache used amount.
-            for (uint32_t i = 0; i < prune_candidate->tuple_count; i++) {
-                current_cache_size -= prune_candidate->buf[i].size_in_bytes();
-            }
+    // Decrease cache used amount.
+    for (uint32_t i = 0; i < entry->tuple_count; i++) {
+        shard.size -= entry->buf[i].size_in_bytes();
+    }
+    shard.evictions++;
 
-            // Deallocate the entry.
-            prune_candidate->destroy();
-            halide_free(NULL, prune_candidate);
-        }
+    // Deallocate the entry.
+    entry->destroy();
+    halide_free(NULL, entry);
+}
 
-        prune_candidate = more_recent;
+// Evicts up to MAX_EVICTIONS entries of the shard, whose lock must be
+// held, while the cache does not fit with HEADROOM bytes to spare. The
+// hand makes at most one sweep of the shard. It clears the referenced
+// bit of the entries it passes, and evicts the first one that is
+// neither referenced since the last sweep nor in use. Returns the
+// number of entries evicted.
+WEAK int prune_shard(CacheShard &shard, int64_t headroom, int max_evictions) {
+#if CACHE_DEBUGGING
+    validate_shard(shard);
+#endif
+    int evicted = 0;
+    int64_t steps = shard.entry_count;
+    while (evicted < max_evictions &&
+           current_cache_size() + headroom > max_cache_size &&
+           shard.hand != NULL && steps-- > 0) {
+        CacheEntry *candidate = shard.hand;
+        shard.hand = candidate->clock_next;
+        if (candidate->in_use_count > 0) {
+            continue;
+        }
+        if (candidate->referenced) {
+            candidate->referenced = false;
+            continue;
+        }
+        evict(shard, candidate);
+        evicted++;
     }
 #if CACHE_DEBUGGING
-    validate_cache();
+    validate_shard(shard);
 #endif
+    return evicted;
+}
+
+// The shard the next pruning starts at.
+WEAK uint32_t next_prune_shard = 0;
+
+// Prunes the shards in turn, never holding more than one lock, until
+// the cache fits with HEADROOM bytes to spare. Each turn evicts at most
+// one entry per shard, and each pruning starts at the next shard, so
+// that the hands of all the shards advance together, as one clock over
+// the whole cache would: an entry used since the hand last passed it
+// is only evicted once the other shards have nothing older to evict.
+// Two turns without an eviction clear every referenced bit, so stop
+// after them if all the entries left are in use.
+WEAK void prune_cache(int64_t headroom) {
+    uint32_t start = __sync_fetch_and_add(&next_prune_shard, 1);
+    int idle_turns = 0;
+    while (idle_turns < 2 && current_cache_size() + headroom > max_cache_size) {
+        bool evicted = false;
+        for (size_t i = 0; i < kCacheShards && current_cache_size() + headroom > max_cache_size; i++) {
+            CacheShard &shard = cache_shards[(start + i) % kCacheShards];
+            ScopedMutexLock lock(&shard.lock);
+            if (prune_shard(shard, headroom, 1) > 0) {
+                evicted = true;
+            }
+        }
+        idle_turns = evicted ? 0 : idle_turns + 1;
+    }
 }
 
 }}} // namespace Halide::Runtime::Internal
@@ -320,18 +418,24 @@ WEAK void halide_memoization_cache_set_size(int64_t size) {
         size = kDefaultCacheSize;
     }
 
-    ScopedMutexLock lock(&memoization_lock);
-
     max_cache_size = size;
-    prune_cache();
+    prune_cache(0);
 }
 
 WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cache_key, int32_t size,
                                          halide_buffer_t *computed_bounds, int32_t tuple_count, halide_buffer_t **tuple_buffers) {
-    uint32_t h = djb_hash(cache_key, size);
-    uint32_t index = h % kHashTableSize;
+    // The key does not hold the computed bounds, so mix them in, to
+    // spread the realizations of a Func over different regions (e.g.
+    // at each iteration of a parallel loop) over the shards.
+    uint32_t h = hash_key(cache_key, size);
+    for (int i = 0; i < computed_bounds->dimensions; i++) {
+        h = (h ^ (uint32_t)computed_bounds->dim[i].min) * 0x01000193;
+        h = (h ^ (uint32_t)computed_bounds->dim[i].extent) * 0x01000193;
+    }
+    h ^= h >> 16;
+    CacheShard &shard = shard_of(h);
 
-    ScopedMutexLock lock(&memoization_lock);
+    ScopedMutexLock lock(&shard.lock);
 
 #if CACHE_DEBUGGING
     debug_print_key(user_context, "halide_memoization_cache_lookup", cache_key, size);
@@ -346,7 +450,7 @@ WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cach
     }
 #endif
 
-    CacheEntry *entry = cache_entries[index];
+    CacheEntry *entry = bucket_of(shard, h);
     while (entry != NULL) {
         if (entry->hash == h && entry->key_size == (size_t)size &&
             keys_equal(entry->key, cache_key, size) &&
@@ -360,24 +464,8 @@ WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cach
             }
 
             if (all_bounds_equal) {
-                if (entry != most_recently_used) {
-                    halide_assert(user_context, entry->more_recent != NULL);
-                    if (entry->less_recent != NULL) {
-                        entry->less_recent->more_recent = entry->more_recent;
-                    } else {
-                        halide_assert(user_context, least_recently_used == entry);
-                        least_recently_used = entry->more_recent;
-                    }
-                    halide_assert(user_context, entry->more_recent != NULL);
-                    entry->more_recent->less_recent = entry->less_recent;
-
-                    entry->more_recent = NULL;
-                    entry->less_recent = most_recently_used;
-                    if (most_recently_used != NULL) {
-                        most_recently_used->more_recent = entry;
-                    }
-                    most_recently_used = entry;
-                }
+                entry->referenced = true;
+                shard.hits++;
 
                 for (int32_t i = 0; i < tuple_count; i++) {
                     halide_buffer_t *buf = tuple_buffers[i];
@@ -392,6 +480,8 @@ WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cach
         entry = entry->next;
     }
 
+    shard.misses++;
+
     for (int32_t i = 0; i < tuple_count; i++) {
         halide_buffer_t *buf = tuple_buffers[i];
 
@@ -411,7 +501,7 @@ WEAK int halide_memoization_cache_lookup(void *user_context, const uint8_t *cach
     }
 
 #if CACHE_DEBUGGING
-    validate_cache();
+    validate_shard(shard);
 #endif
 
     return 1;
@@ -423,10 +513,20 @@ WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache
     debug(user_context) << "halide_memoization_cache_store\n";
 
     uint32_t h = get_pointer_to_header(tuple_buffers[0]->host)->hash;
+    CacheShard &shard = shard_of(h);
 
-    uint32_t index = h % kHashTableSize;
+    uint64_t added_size = 0;
+    {
+        for (int32_t i = 0; i < tuple_count; i++) {
+            halide_buffer_t *buf = tuple_buffers[i];
+            added_size += buf->size_in_bytes();
+        }
+    }
+
+    // Make room in all the shards before taking the lock of this one.
+    prune_cache(added_size);
 
-    ScopedMutexLock lock(&memoization_lock);
+    ScopedMutexLock lock(&shard.lock);
 
 #if CACHE_DEBUGGING
     debug_print_key(user_context, "halide_memoization_cache_store", cache_key, size);
@@ -441,7 +541,7 @@ WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache
     }
 #endif
 
-    CacheEntry *entry = cache_entries[index];
+    CacheEntry *entry = bucket_of(shard, h);
     while (entry != NULL) {
         if (entry->hash == h && entry->key_size == (size_t)size &&
             keys_equal(entry->key, cache_key, size) &&
@@ -473,15 +573,10 @@ WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache
         entry = entry->next;
     }
 
-    uint64_t added_size = 0;
-    {
-        for (int32_t i = 0; i < tuple_count; i++) {
-            halide_buffer_t *buf = tuple_buffers[i];
-            added_size += buf->size_in_bytes();
-        }
-    }
-    current_cache_size += added_size;
-    prune_cache();
+    // Other threads may have stored entries since prune_cache(); if
+    // so, make room in this shard.
+    shard.size += added_size;
+    prune_shard(shard, 0, 1);
 
     CacheEntry *new_entry = (CacheEntry *)halide_malloc(NULL, sizeof(CacheEntry));
     bool inited = false;
@@ -489,7 +584,7 @@ WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache
         inited = new_entry->init(cache_key, size, h, computed_bounds, tuple_count, tuple_buffers);
     }
     if (!inited) {
-        current_cache_size -= added_size;
+        shard.size -= added_size;
 
         // This entry is still in use by the caller. Mark it as having no cache entry
         // so halide_memoization_cache_release can free the buffer.
@@ -503,16 +598,9 @@ WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache
         return 0;
     }
 
-    new_entry->next = cache_entries[index];
-    new_entry->less_recent = most_recently_used;
-    if (most_recently_used != NULL) {
-        most_recently_used->more_recent = new_entry;
-    }
-    most_recently_used = new_entry;
-    if (least_recently_used == NULL) {
-        least_recently_used = new_entry;
-    }
-    cache_entries[index] = new_entry;
+    new_entry->next = bucket_of(shard, h);
+    bucket_of(shard, h) = new_entry;
+    clock_insert(shard, new_entry);
 
     new_entry->in_use_count = tuple_count;
 
@@ -521,7 +609,7 @@ WEAK int halide_memoization_cache_store(void *user_context, const uint8_t *cache
     }
 
 #if CACHE_DEBUGGING
-    validate_cache();
+    validate_shard(shard);
 #endif
     debug(user_context) << "Exiting halide_memoization_cache_store\n";
 
@@ -536,12 +624,13 @@ WEAK void halide_memoization_cache_release(void *user_context, void *host) {
     if (entry == NULL) {
         halide_free(user_context, header);
     } else {
-        ScopedMutexLock lock(&memoization_lock);
+        CacheShard &shard = shard_of(entry->hash);
+        ScopedMutexLock lock(&shard.lock);
 
         halide_assert(user_context, entry->in_use_count > 0);
         entry->in_use_count--;
 #if CACHE_DEBUGGING
-        validate_cache();
+        validate_shard(shard);
 #endif
     }
 
@@ -550,20 +639,38 @@ WEAK void halide_memoization_cache_release(void *user_context, void *host) {
 
 WEAK void halide_memoization_cache_cleanup() {
     debug(NULL) << "halide_memoization_cache_cleanup\n";
-    for (size_t i = 0; i < kHashTableSize; i++) {
-        CacheEntry *entry = cache_entries[i];
-        cache_entries[i] = NULL;
-        while (entry != NULL) {
-            CacheEntry *next = entry->next;
-            entry->destroy();
-            halide_free(NULL, entry);
-            entry = next;
+    for (size_t s = 0; s < kCacheShards; s++) {
+        CacheShard &shard = cache_shards[s];
+        for (size_t i = 0; i < kBucketsPerShard; i++) {
+            CacheEntry *entry = shard.buckets[i];
+            shard.buckets[i] = NULL;
+            while (entry != NULL) {
+                CacheEntry *next = entry->next;
+                entry->destroy();
+                halide_free(NULL, entry);
+                entry = next;
+            }
         }
+        shard.hand = NULL;
+        shard.entry_count = 0;
+        shard.size = 0;
+        shard.hits = shard.misses = shard.evictions = 0;
+        halide_mutex_destroy(&shard.lock);
     }
-    current_cache_size = 0;
-    most_recently_used = NULL;
-    least_recently_used = NULL;
-    halide_mutex_destroy(&memoization_lock);
+}
+
+WEAK void halide_memoization_cache_get_stats(struct halide_memoization_cache_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    for (size_t i = 0; i < kCacheShards; i++) {
+        CacheShard &shard = cache_shards[i];
+        ScopedMutexLock lock(&shard.lock);
+        stats->hits += shard.hits;
+        stats->misses += shard.misses;
+        stats->evictions += shard.evictions;
+        stats->entries += shard.entry_count;
+        stats->current_size += shard.size;
+    }
+    stats->max_size = max_cache_size;
 }
 
 namespace {
@@ -165,6 +165,11 @@ WEAK int halide_set_num_threads(int n) {
     return old_custom_num_threads;
 }
 
+WEAK int halide_set_thread_affinity(int mode) {
+    // Grand Central Dispatch owns the threads.
+    return halide_thread_affinity_none;
+}
+
 WEAK halide_do_task_t halide_set_custom_do_task(halide_do_task_t f) {
     halide_do_task_t result = custom_do_task;
     custom_do_task = f;
@@ -11,6 +11,18 @@ int halide_host_cpu_count() {
     return 4;
 }
 
+int halide_host_numa_nodes(int *node_of_cpu, int num_cpus) {
+    for (int i = 0; i < num_cpus; i++) {
+        node_of_cpu[i] = 0;
+    }
+    return 1;
+}
+
+int halide_pin_current_thread(const int *cpus, int num_cpus) {
+    // The hardware threads are interchangeable.
+    return 0;
+}
+
 namespace {
 struct spawned_thread {
     void (*f)(void *);
@@ -1,11 +1,61 @@
 #include "HalideRuntime.h"
+#include "runtime_internal.h"
 
 extern "C" {
 
 extern long sysconf(int);
+extern size_t fread(void *, size_t, size_t, void *);
 
 WEAK int halide_host_cpu_count() {
     return sysconf(84);
 }
 
+WEAK int halide_host_numa_nodes(int *node_of_cpu, int num_cpus) {
+    for (int i = 0; i < num_cpus; i++) {
+        node_of_cpu[i] = 0;
+    }
+
+    // Node ids may have holes, e.g. for nodes with memory but no cpus,
+    // so look at all the possible ones.
+    const int max_nodes = 1024;
+    int num_nodes = 0;
+    for (int node = 0; node < max_nodes; node++) {
+        char path[64];
+        char *end = halide_string_to_string(path, path + sizeof(path), "/sys/devices/system/node/node");
+        end = halide_int64_to_string(end, path + sizeof(path), node, 1);
+        halide_string_to_string(end, path + sizeof(path), "/cpulist");
+        void *f = fopen(path, "r");
+        if (!f) {
+            continue;
+        }
+
+        // The list of cpus of the node, e.g. "0-15,32-47".
+        char list[4096];
+        size_t len = fread(list, 1, sizeof(list) - 1, f);
+        fclose(f);
+        list[len] = 0;
+
+        bool has_cpus = false;
+        const char *p = list;
+        while (*p >= '0' && *p <= '9') {
+            int first = atoi(p), last = first;
+            while (*p >= '0' && *p <= '9') p++;
+            if (*p == '-') {
+                p++;
+                last = atoi(p);
+                while (*p >= '0' && *p <= '9') p++;
+            }
+            if (*p == ',') p++;
+            for (int cpu = first; cpu <= last && cpu < num_cpus; cpu++) {
+                node_of_cpu[cpu] = num_nodes;
+                has_cpus = true;
+            }
+        }
+        if (has_cpus) {
+            num_nodes++;
+        }
+    }
+    return num_nodes > 0 ? num_nodes : 1;
+}
+
 }
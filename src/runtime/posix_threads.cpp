@@ -28,6 +28,7 @@ extern int pthread_mutex_init(halide_mutex *mutex, const void *attr);
 extern int pthread_mutex_lock(halide_mutex *mutex);
 extern int pthread_mutex_unlock(halide_mutex *mutex);
 extern int pthread_mutex_destroy(halide_mutex *mutex);
+extern int sched_setaffinity(int pid, size_t cpusetsize, const void *mask);
 
 } // extern "C"
 
@@ -91,4 +92,17 @@ WEAK void halide_cond_wait(struct halide_cond *cond, struct halide_mutex *mutex)
     pthread_cond_wait(cond, mutex);
 }
 
+WEAK int halide_pin_current_thread(const int *cpus, int num_cpus) {
+    // A cpu_set_t of the size used by glibc.
+    const int max_cpus = 1024;
+    uint64_t mask[max_cpus / 64];
+    memset(mask, 0, sizeof(mask));
+    for (int i = 0; i < num_cpus; i++) {
+        if (cpus[i] >= 0 && cpus[i] < max_cpus) {
+            mask[cpus[i] / 64] |= (uint64_t)1 << (cpus[i] % 64);
+        }
+    }
+    return sched_setaffinity(0, sizeof(mask), mask);
+}
+
 } // extern "C"
@@ -135,6 +135,13 @@ WEAK int halide_profiler_pipeline_start(void *user_context,
                                         int num_funcs,
                                         const uint64_t *func_names);
 WEAK int halide_host_cpu_count();
+// Writes the NUMA node of each of the first num_cpus cpus of the host
+// to node_of_cpu, numbering the nodes that have cpus from zero, and
+// returns the number of nodes.
+WEAK int halide_host_numa_nodes(int *node_of_cpu, int num_cpus);
+// Restricts the calling thread to the given cpus. Returns zero on
+// success.
+WEAK int halide_pin_current_thread(const int *cpus, int num_cpus);
 
 WEAK int halide_device_and_host_malloc(void *user_context, struct halide_buffer_t *buf,
                                        const struct halide_device_interface_t *device_interface);
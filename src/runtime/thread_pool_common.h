@@ -1,25 +1,55 @@
+#include "scoped_spin_lock.h"
 
 namespace Halide { namespace Runtime { namespace Internal {
 
 struct work {
+    // Next job in the deque the job was pushed onto
     work *next_job;
     int (*f)(void *, int, uint8_t *);
     void *user_context;
-    int next, max;
+    // Tasks [next, max) are not claimed yet. Threads claim ranges of
+    // them with a compare-and-swap on next.
+    volatile int next;
+    int max;
     uint8_t *closure;
-    int active_workers;
+    // The threads other than the owner that hold a reference to the
+    // job. A thread only takes one while the job is in a deque.
+    volatile int active_workers;
     int exit_status;
     bool running() { return next < max || active_workers > 0; }
 };
 
 // The work queue and thread pool is weak, so one big work queue is shared by all halide functions
-#define MAX_THREADS 64
+// The state of a thread is allocated when the thread is created, so
+// this only bounds the damage of a bad HL_NUM_THREADS.
+#define MAX_THREADS 1024
+
+// The jobs pushed by the threads owning a deque. A thread works on
+// the newest job of its own deque first, so nested parallelism
+// finishes the inner loops first, and steals the oldest job of another
+// deque, which usually has the most tasks left. The lock only guards
+// the list; claiming tasks does not take it.
+struct work_deque {
+    volatile int lock;
+    work *jobs;
+
+    // The worker owning the deque (MAX_THREADS for the shared one),
+    // and the NUMA node it runs on (see halide_set_thread_affinity).
+    int id, node;
+};
+
 struct work_queue_t {
-    // all fields are protected by this mutex.
+    // Guards the fields below that are not atomic, and the sleeping
+    // and waking up of threads. Scheduling tasks does not take it.
     halide_mutex mutex;
 
-    // Singly linked list for job stack
-    work *jobs;
+    // A deque per worker thread, and one shared by the threads
+    // outside the pool calling do_par_for.
+    work_deque *deques[MAX_THREADS];
+    work_deque shared_deque;
+
+    // The number of jobs in the deques with tasks left to claim.
+    volatile int pending_jobs;
 
     // Worker threads are divided into an 'A' team and a 'B' team. The
     // B team sleeps on the wakeup_b_team condition variable. The A
@@ -29,7 +59,7 @@ struct work_queue_t {
     // a_team_size < target_a_team_size.
     int a_team_size, target_a_team_size;
 
-    // Broadcast when a job completes.
+    // Broadcast when the last worker leaves a job.
     halide_cond wakeup_owners;
 
     // Broadcast whenever items are added to the work queue.
@@ -48,6 +78,17 @@ struct work_queue_t {
     // The desired number threads doing work.
     int desired_num_threads;
 
+    // The halide_thread_affinity_t of the workers, whether it was
+    // chosen yet, and a count of its changes, so that workers notice
+    // when they should move.
+    int affinity, affinity_generation;
+    bool affinity_chosen;
+
+    // The NUMA node of each cpu, loaded when the workers are first
+    // pinned.
+    int *node_of_cpu;
+    int num_cpus, num_nodes;
+
     // Global flags indicating the threadpool should shut down, and
     // whether the thread pool has been initialized.
     bool shutdown, initialized;
@@ -68,6 +109,99 @@ WEAK int clamp_num_threads(int desired_num_threads) {
     return desired_num_threads;
 }
 
+WEAK int default_thread_affinity() {
+    char *affinity_str = getenv("HL_THREAD_AFFINITY");
+    if (!affinity_str || !strcmp(affinity_str, "none")) {
+        return halide_thread_affinity_none;
+    } else if (!strcmp(affinity_str, "compact")) {
+        return halide_thread_affinity_compact;
+    } else if (!strcmp(affinity_str, "scatter")) {
+        return halide_thread_affinity_scatter;
+    } else if (!strcmp(affinity_str, "numa")) {
+        return halide_thread_affinity_numa;
+    }
+    halide_error(NULL, "HL_THREAD_AFFINITY must be one of none, compact, scatter or numa.");
+    return halide_thread_affinity_none;
+}
+
+WEAK void load_numa_topology() {
+    if (!work_queue.node_of_cpu) {
+        work_queue.num_cpus = halide_host_cpu_count();
+        if (work_queue.num_cpus < 1) {
+            work_queue.num_cpus = 1;
+        }
+        work_queue.node_of_cpu = (int *)malloc(work_queue.num_cpus * sizeof(int));
+        work_queue.num_nodes = halide_host_numa_nodes(work_queue.node_of_cpu, work_queue.num_cpus);
+    }
+}
+
+// Returns the index-th cpu of NODE, counting around, and the number
+// of cpus of the node in *count.
+WEAK int cpu_of_node(int node, int index, int *count) {
+    *count = 0;
+    for (int cpu = 0; cpu < work_queue.num_cpus; cpu++) {
+        *count += (work_queue.node_of_cpu[cpu] == node);
+    }
+    if (*count == 0) {
+        return 0;
+    }
+    int seen = 0;
+    for (int cpu = 0; cpu < work_queue.num_cpus; cpu++) {
+        if (work_queue.node_of_cpu[cpu] == node && seen++ == index % *count) {
+            return cpu;
+        }
+    }
+    return 0;
+}
+
+// Moves the calling worker to the cpus of the current affinity
+// mode. Returns whether it is pinned. Called with the lock held.
+WEAK bool pin_worker(work_deque *own, bool pinned) {
+    int mode = work_queue.affinity;
+    own->node = 0;
+    if (mode == halide_thread_affinity_none && !pinned) {
+        return false;
+    }
+
+    load_numa_topology();
+    int num_cpus = work_queue.num_cpus;
+    int num_nodes = work_queue.num_nodes;
+    int *cpus = (int *)malloc(num_cpus * sizeof(int));
+    int count = 0;
+    if (mode == halide_thread_affinity_none) {
+        // Let the thread run anywhere again.
+        for (int cpu = 0; cpu < num_cpus; cpu++) {
+            cpus[count++] = cpu;
+        }
+    } else if (mode == halide_thread_affinity_compact) {
+        // The cpus numbered node after node.
+        int rank = own->id % num_cpus;
+        for (int node = 0; node < num_nodes && !count; node++) {
+            int node_cpus;
+            cpu_of_node(node, 0, &node_cpus);
+            if (rank < node_cpus) {
+                cpus[count++] = cpu_of_node(node, rank, &node_cpus);
+                own->node = node;
+            }
+            rank -= node_cpus;
+        }
+    } else {
+        own->node = own->id % num_nodes;
+        int node_cpus;
+        int cpu = cpu_of_node(own->node, own->id / num_nodes, &node_cpus);
+        if (mode == halide_thread_affinity_scatter) {
+            cpus[count++] = cpu;
+        } else {
+            for (int c = 0; c < node_cpus; c++) {
+                cpus[count++] = cpu_of_node(own->node, c, &node_cpus);
+            }
+        }
+    }
+    halide_pin_current_thread(cpus, count);
+    free(cpus);
+    return mode != halide_thread_affinity_none;
+}
+
 WEAK int default_desired_num_threads() {
     int desired_num_threads = 0;
     char *threads_str = getenv("HL_NUM_THREADS");
@@ -83,75 +217,156 @@ WEAK int default_desired_num_threads() {
     return desired_num_threads;
 }
 
-WEAK void worker_thread_already_locked(work *owned_job) {
-    // If I'm a job owner, then I was the thread that called
-    // do_par_for, and I should only stay in this function until my
-    // job is complete. If I'm a lowly worker thread, I should stay in
-    // this function as long as the work queue is running.
-    while (owned_job != NULL ? owned_job->running()
-           : work_queue.running()) {
-
-        if (work_queue.jobs == NULL) {
-            if (owned_job) {
-                // There are no jobs pending. Wait for the last worker
-                // to signal that the job is finished.
-                halide_cond_wait(&work_queue.wakeup_owners, &work_queue.mutex);
-            } else if (work_queue.a_team_size <= work_queue.target_a_team_size) {
-                // There are no jobs pending. Wait until more jobs are enqueued.
-                halide_cond_wait(&work_queue.wakeup_a_team, &work_queue.mutex);
-            } else {
-                // There are no jobs pending, and there are too many
-                // threads in the A team. Transition to the B team
-                // until the wakeup_b_team condition is fired.
-                work_queue.a_team_size--;
-                halide_cond_wait(&work_queue.wakeup_b_team, &work_queue.mutex);
-                work_queue.a_team_size++;
-            }
-        } else {
-            // Grab the next job.
-            work *job = work_queue.jobs;
+// The deque of the worker running on this thread, set when the worker
+// starts. It stays NULL on the threads outside the pool.
+WEAK __thread work_deque *worker_deque = NULL;
 
-            // Claim a task from it.
-            work myjob = *job;
-            job->next++;
+// Returns the deque of the calling worker, or the shared one if the
+// caller is not a worker.
+WEAK work_deque *home_deque() {
+    return worker_deque ? worker_deque : &work_queue.shared_deque;
+}
 
-            // If there were no more tasks pending for this job,
-            // remove it from the stack.
-            if (job->next == job->max) {
-                work_queue.jobs = job->next_job;
-            }
+WEAK void push_job(work_deque *d, work *job) {
+    ScopedSpinLock lock(&d->lock);
+    job->next_job = d->jobs;
+    d->jobs = job;
+}
 
-            // Increment the active_worker count so that other threads
-            // are aware that this job is still in progress even
-            // though there are no outstanding tasks for it.
-            job->active_workers++;
+WEAK void remove_job(work_deque *d, work *job) {
+    ScopedSpinLock lock(&d->lock);
+    work **p = &d->jobs;
+    while (*p && *p != job) {
+        p = &(*p)->next_job;
+    }
+    if (*p) {
+        *p = job->next_job;
+    }
+}
 
-            // Release the lock and do the task.
-            halide_mutex_unlock(&work_queue.mutex);
-            int result = halide_do_task(myjob.user_context, myjob.f, myjob.next,
-                                        myjob.closure);
-            halide_mutex_lock(&work_queue.mutex);
+// Takes a reference to a job of D with tasks left: the newest one if
+// D is the deque of the caller, the oldest one otherwise.
+WEAK work *take_job(work_deque *d, bool own) {
+    if (d->jobs == NULL) {
+        return NULL;
+    }
+    ScopedSpinLock lock(&d->lock);
+    work *found = NULL;
+    for (work *job = d->jobs; job; job = job->next_job) {
+        if (job->next < job->max) {
+            found = job;
+            if (own) break;
+        }
+    }
+    if (found) {
+        __sync_add_and_fetch(&found->active_workers, 1);
+    }
+    return found;
+}
 
+// Claims a range of tasks [*begin, *end) of JOB without locking. The
+// ranges shrink as the job runs out of tasks (guided scheduling), so
+// that threads claim few times and still finish at about the same time.
+WEAK bool claim_tasks(work *job, int *begin, int *end) {
+    int threads = work_queue.desired_num_threads;
+    int next = job->next;
+    while (next < job->max) {
+        int chunk = (job->max - next) / (2 * (threads > 0 ? threads : 1));
+        if (chunk < 1) {
+            chunk = 1;
+        }
+        int old = __sync_val_compare_and_swap(&job->next, next, next + chunk);
+        if (old == next) {
+            if (next + chunk == job->max) {
+                __sync_sub_and_fetch(&work_queue.pending_jobs, 1);
+            }
+            *begin = next;
+            *end = next + chunk;
+            return true;
+        }
+        next = old;
+    }
+    return false;
+}
+
+// Runs tasks of JOB until none is left to claim.
+WEAK void run_tasks(work *job) {
+    int begin, end;
+    while (claim_tasks(job, &begin, &end)) {
+        for (int i = begin; i < end; i++) {
+            int result = halide_do_task(job->user_context, job->f, i, job->closure);
             // If this task failed, set the exit status on the job.
             if (result) {
                 job->exit_status = result;
             }
+        }
+    }
+}
 
-            // We are no longer active on this job
-            job->active_workers--;
+// Finds a job in the deque OWN, or steals one from another deque, and
+// works on it. Returns false if there was nothing to do.
+WEAK bool run_any_job(work_deque *own) {
+    work *job = take_job(own, true);
+    if (!job) {
+        job = take_job(&work_queue.shared_deque, false);
+    }
 
-            // If the job is done and I'm not the owner of it, wake up
-            // the owner.
-            if (!job->running() && job != owned_job) {
-                halide_cond_broadcast(&work_queue.wakeup_owners);
+    // Steal from the workers on our node first, whose caches and
+    // memory are closer, then from the other ones.
+    int n = work_queue.threads_created;
+    for (int local = 1; local >= 0 && !job; local--) {
+        for (int i = 1; i <= n && !job; i++) {
+            work_deque *d = work_queue.deques[(own->id + i) % n];
+            if ((d->node == own->node) == (local == 1)) {
+                job = take_job(d, false);
             }
         }
     }
+    if (!job) {
+        return false;
+    }
+
+    run_tasks(job);
+
+    // We are no longer active on this job. The owner may return as
+    // soon as the count drops to zero, so don't touch the job after.
+    if (__sync_sub_and_fetch(&job->active_workers, 1) == 0) {
+        halide_mutex_lock(&work_queue.mutex);
+        halide_cond_broadcast(&work_queue.wakeup_owners);
+        halide_mutex_unlock(&work_queue.mutex);
+    }
+    return true;
 }
 
-WEAK void worker_thread(void *) {
+WEAK void worker_thread(void *arg) {
+    work_deque *own = work_queue.deques[(intptr_t)arg];
+    worker_deque = own;
+    int generation = -1;
+    bool pinned = false;
+
     halide_mutex_lock(&work_queue.mutex);
-    worker_thread_already_locked(NULL);
+    while (work_queue.running()) {
+        if (generation != work_queue.affinity_generation) {
+            generation = work_queue.affinity_generation;
+            pinned = pin_worker(own, pinned);
+        }
+        if (work_queue.pending_jobs > 0) {
+            halide_mutex_unlock(&work_queue.mutex);
+            while (run_any_job(own)) {
+            }
+            halide_mutex_lock(&work_queue.mutex);
+        } else if (work_queue.a_team_size <= work_queue.target_a_team_size) {
+            // There are no jobs pending. Wait until more jobs are enqueued.
+            halide_cond_wait(&work_queue.wakeup_a_team, &work_queue.mutex);
+        } else {
+            // There are no jobs pending, and there are too many
+            // threads in the A team. Transition to the B team
+            // until the wakeup_b_team condition is fired.
+            work_queue.a_team_size--;
+            halide_cond_wait(&work_queue.wakeup_b_team, &work_queue.mutex);
+            work_queue.a_team_size++;
+        }
+    }
     halide_mutex_unlock(&work_queue.mutex);
 }
 
@@ -168,6 +383,10 @@ WEAK int halide_default_do_task(void *user_context, halide_task_t f, int idx,
 
 WEAK int halide_default_do_par_for(void *user_context, halide_task_t f,
                                    int min, int size, uint8_t *closure) {
+    if (size <= 0) {
+        return 0;
+    }
+
     // Grab the lock. If it hasn't been initialized yet, then the
     // field will be zero-initialized because it's a static global.
     halide_mutex_lock(&work_queue.mutex);
@@ -177,7 +396,16 @@ WEAK int halide_default_do_par_for(void *user_context, halide_task_t f,
         halide_cond_init(&work_queue.wakeup_owners);
         halide_cond_init(&work_queue.wakeup_a_team);
         halide_cond_init(&work_queue.wakeup_b_team);
-        work_queue.jobs = NULL;
+        work_queue.shared_deque.lock = 0;
+        work_queue.shared_deque.jobs = NULL;
+        work_queue.shared_deque.id = MAX_THREADS;
+        work_queue.shared_deque.node = -1;
+        work_queue.pending_jobs = 0;
+
+        if (!work_queue.affinity_chosen) {
+            work_queue.affinity = default_thread_affinity();
+            work_queue.affinity_chosen = true;
+        }
 
         // Compute the desired number of threads to use. Other code
         // can also mess with this value, but only when the work queue
@@ -197,8 +425,17 @@ WEAK int halide_default_do_par_for(void *user_context, halide_task_t f,
     while (work_queue.threads_created < work_queue.desired_num_threads - 1) {
         // We might need to make some new threads, if work_queue.desired_num_threads has
         // increased.
-        work_queue.threads[work_queue.threads_created++] =
-            halide_spawn_thread(worker_thread, NULL);
+        int id = work_queue.threads_created;
+        work_deque *d = (work_deque *)malloc(sizeof(work_deque));
+        d->lock = 0;
+        d->jobs = NULL;
+        d->id = id;
+        d->node = 0;
+        work_queue.deques[id] = d;
+        // Threads stealing work read the deques without the lock.
+        __sync_synchronize();
+        work_queue.threads_created++;
+        work_queue.threads[id] = halide_spawn_thread(worker_thread, (void *)(intptr_t)id);
     }
 
     // Make the job.
@@ -211,7 +448,7 @@ WEAK int halide_default_do_par_for(void *user_context, halide_task_t f,
     job.exit_status = 0;     // The job hasn't failed yet
     job.active_workers = 0;  // Nobody is working on this yet
 
-    if (!work_queue.jobs && size < work_queue.desired_num_threads) {
+    if (!work_queue.pending_jobs && size < work_queue.desired_num_threads) {
         // If there's no nested parallelism happening and there are
         // fewer tasks to do than threads, then set the target A team
         // size so that some threads will put themselves to sleep
@@ -225,9 +462,10 @@ WEAK int halide_default_do_par_for(void *user_context, halide_task_t f,
         work_queue.target_a_team_size = work_queue.desired_num_threads;
     }
 
-    // Push the job onto the stack.
-    job.next_job = work_queue.jobs;
-    work_queue.jobs = &job;
+    // Push the job onto the deque of this thread.
+    work_deque *home = home_deque();
+    push_job(home, &job);
+    __sync_add_and_fetch(&work_queue.pending_jobs, 1);
 
     // Wake up our A team.
     halide_cond_broadcast(&work_queue.wakeup_a_team);
@@ -238,10 +476,27 @@ WEAK int halide_default_do_par_for(void *user_context, halide_task_t f,
         halide_cond_broadcast(&work_queue.wakeup_b_team);
     }
 
+    halide_mutex_unlock(&work_queue.mutex);
+
     // Do some work myself.
-    worker_thread_already_locked(&job);
+    run_tasks(&job);
 
-    halide_mutex_unlock(&work_queue.mutex);
+    // Every task is claimed. Take the job out of the deque, so that no
+    // other thread can take a new reference to it.
+    remove_job(home, &job);
+
+    // Help with other jobs until the workers still running tasks of
+    // mine are done with them.
+    while (job.active_workers > 0) {
+        if (run_any_job(home)) {
+            continue;
+        }
+        halide_mutex_lock(&work_queue.mutex);
+        if (job.active_workers > 0 && !work_queue.pending_jobs) {
+            halide_cond_wait(&work_queue.wakeup_owners, &work_queue.mutex);
+        }
+        halide_mutex_unlock(&work_queue.mutex);
+    }
 
     // Return zero if the job succeeded, otherwise return the exit
     // status of one of the failing jobs (whichever one failed last).
@@ -265,6 +520,25 @@ WEAK int halide_set_num_threads(int n) {
     return old;
 }
 
+WEAK int halide_set_thread_affinity(int mode) {
+    if (mode < halide_thread_affinity_none || mode > halide_thread_affinity_numa) {
+        halide_error(NULL, "halide_set_thread_affinity: unknown mode.");
+        return -1;
+    }
+    halide_mutex_lock(&work_queue.mutex);
+    int old = work_queue.affinity_chosen ? work_queue.affinity : default_thread_affinity();
+    work_queue.affinity = mode;
+    work_queue.affinity_chosen = true;
+    work_queue.affinity_generation++;
+    if (work_queue.initialized) {
+        // Wake up the workers, so that they move.
+        halide_cond_broadcast(&work_queue.wakeup_a_team);
+        halide_cond_broadcast(&work_queue.wakeup_b_team);
+    }
+    halide_mutex_unlock(&work_queue.mutex);
+    return old;
+}
+
 WEAK void halide_shutdown_thread_pool() {
     if (!work_queue.initialized) return;
 
@@ -280,7 +554,11 @@ WEAK void halide_shutdown_thread_pool() {
     // Wait until they leave
     for (int i = 0; i < work_queue.threads_created; i++) {
         halide_join_thread(work_queue.threads[i]);
+        free(work_queue.deques[i]);
     }
+    work_queue.threads_created = 0;
+    free(work_queue.node_of_cpu);
+    work_queue.node_of_cpu = NULL;
 
     // Tidy up
     halide_mutex_destroy(&work_queue.mutex);
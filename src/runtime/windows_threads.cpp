@@ -26,6 +26,11 @@ extern WIN32API void DeleteCriticalSection(CriticalSection *);
 extern WIN32API void EnterCriticalSection(CriticalSection *);
 extern WIN32API void LeaveCriticalSection(CriticalSection *);
 extern WIN32API int32_t WaitForSingleObject(Thread, int32_t timeout);
+extern WIN32API Thread GetCurrentThread();
+extern WIN32API uint16_t GetActiveProcessorGroupCount();
+extern WIN32API uint32_t GetActiveProcessorCount(uint16_t group);
+extern WIN32API bool GetLogicalProcessorInformationEx(int32_t relationship, void *buffer, uint32_t *length);
+extern WIN32API bool SetThreadGroupAffinity(Thread, const void *group_affinity, void *previous_group_affinity);
 extern WIN32API bool InitOnceExecuteOnce(InitOnce *, bool WIN32API (*f)(InitOnce *, void *, void **), void *, void **);
 
 } // extern "C"
@@ -42,6 +47,36 @@ WEAK WIN32API bool init_mutex(InitOnce *, void *mutex_arg, void **) {
     return true;
 }
 
+// The affinity of a thread to the cpus of one processor group.
+struct GroupAffinity {
+    uintptr_t mask;
+    uint16_t group;
+    uint16_t reserved[3];
+};
+
+// The head of an entry of the array that
+// GetLogicalProcessorInformationEx fills for RelationNumaNode, up to
+// the mask of the first group of the node.
+struct NumaNodeInformation {
+    int32_t relationship;
+    uint32_t size;
+    uint32_t node_number;
+    uint8_t reserved[20];
+    GroupAffinity group_mask;
+};
+
+const int32_t RelationNumaNode = 1;
+
+// Halide numbers the cpus of all the processor groups in turn, so the
+// cpus of a group start after those of the groups before it.
+WEAK int first_cpu_of_group(int group) {
+    int cpu = 0;
+    for (int g = 0; g < group; g++) {
+        cpu += GetActiveProcessorCount(g);
+    }
+    return cpu;
+}
+
 struct spawned_thread {
     void(*f)(void *);
     void *closure;
@@ -122,4 +157,79 @@ WEAK int halide_host_cpu_count() {
     }
 }
 
+WEAK int halide_host_numa_nodes(int *node_of_cpu, int num_cpus) {
+    for (int i = 0; i < num_cpus; i++) {
+        node_of_cpu[i] = 0;
+    }
+
+    uint32_t length = 0;
+    GetLogicalProcessorInformationEx(RelationNumaNode, NULL, &length);
+    if (length == 0) {
+        return 1;
+    }
+    uint8_t *info = (uint8_t *)malloc(length);
+    if (!info || !GetLogicalProcessorInformationEx(RelationNumaNode, info, &length)) {
+        free(info);
+        return 1;
+    }
+
+    // Node numbers may have holes, e.g. for nodes with memory but no
+    // cpus, so the nodes with cpus are numbered in the order they come.
+    int num_nodes = 0;
+    for (uint32_t offset = 0; offset < length;) {
+        const NumaNodeInformation *node = (const NumaNodeInformation *)(info + offset);
+        if (node->size == 0) {
+            break;
+        }
+        offset += node->size;
+        if (node->relationship != RelationNumaNode) {
+            continue;
+        }
+        const GroupAffinity &affinity = node->group_mask;
+        int first_cpu = first_cpu_of_group(affinity.group);
+        int group_cpus = GetActiveProcessorCount(affinity.group);
+        bool has_cpus = false;
+        for (int bit = 0; bit < group_cpus && bit < (int)(8 * sizeof(affinity.mask)); bit++) {
+            int cpu = first_cpu + bit;
+            if (((affinity.mask >> bit) & 1) && cpu < num_cpus) {
+                node_of_cpu[cpu] = num_nodes;
+                has_cpus = true;
+            }
+        }
+        if (has_cpus) {
+            num_nodes++;
+        }
+    }
+    free(info);
+    return num_nodes > 0 ? num_nodes : 1;
+}
+
+WEAK int halide_pin_current_thread(const int *cpus, int num_cpus) {
+    // A thread runs in one processor group, so only the cpus in the
+    // group of the first one are used.
+    GroupAffinity affinity;
+    memset(&affinity, 0, sizeof(affinity));
+    int group_begin = -1, group_end = -1;
+    int groups = GetActiveProcessorGroupCount();
+    for (int g = 0; g < groups && group_begin < 0 && num_cpus > 0; g++) {
+        int begin = first_cpu_of_group(g);
+        int end = begin + GetActiveProcessorCount(g);
+        if (cpus[0] >= begin && cpus[0] < end) {
+            affinity.group = g;
+            group_begin = begin;
+            group_end = end;
+        }
+    }
+    for (int i = 0; i < num_cpus; i++) {
+        if (cpus[i] >= group_begin && cpus[i] < group_end &&
+            cpus[i] - group_begin < (int)(8 * sizeof(affinity.mask))) {
+            affinity.mask |= (uintptr_t)1 << (cpus[i] - group_begin);
+        }
+    }
+    if (affinity.mask == 0) {
+        return -1;
+    }
+    return SetThreadGroupAffinity(GetCurrentThread(), &affinity, NULL) ? 0 : -1;
+}
+
 } // extern "C"
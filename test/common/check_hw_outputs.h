@@ -0,0 +1,69 @@
+#ifndef CHECK_HW_OUTPUTS_H
+#define CHECK_HW_OUTPUTS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "test/common/halide_test_dirs.h"
+
+// Helpers for the tests that check the designs the FIRRTL and HLS
+// backends write for the hardware accelerators of a pipeline.
+
+inline bool contains(const std::string &s, const std::string &sub) {
+    return s.find(sub) != std::string::npos;
+}
+
+// Counts the occurrences of sub in s, overlapping ones included.
+inline int count(const std::string &s, const std::string &sub) {
+    int n = 0;
+    for (size_t pos = s.find(sub); pos != std::string::npos; pos = s.find(sub, pos + 1)) {
+        n++;
+    }
+    return n;
+}
+
+inline std::string read_file(const std::string &name) {
+    std::ifstream f(name);
+    std::stringstream ss;
+    ss << f.rdbuf();
+    return ss.str();
+}
+
+// compile_to_firrtl() and compile_to_hls() write the designs of the
+// accelerators (hls_target.fir, hls_target.cpp, ...) to the working
+// directory. This makes a directory of the test temp dir for the test
+// called name, removes the designs of earlier runs from it, and makes
+// it the working directory, so that tests running at the same time do
+// not read each other's designs. Returns the path of the directory,
+// which ends in a separator.
+inline std::string enter_hw_test_dir(const std::string &name) {
+    std::string dir = Halide::Internal::get_test_tmp_dir() + name;
+#ifdef _WIN32
+    _mkdir(dir.c_str());
+    int err = _chdir(dir.c_str());
+#else
+    mkdir(dir.c_str(), 0777);
+    int err = chdir(dir.c_str());
+#endif
+    if (err != 0) {
+        printf("Could not enter the directory %s\n", dir.c_str());
+        exit(-1);
+    }
+    const char *designs[] = {"hls_target.fir", "hls_target.cpp", "hls_target.h",
+                             "hls_target_model.cpp", "hls_target_report.json"};
+    for (const char *d : designs) {
+        remove(d);
+    }
+    return dir + "/";
+}
+
+#endif  // CHECK_HW_OUTPUTS_H
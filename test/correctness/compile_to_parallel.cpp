@@ -0,0 +1,66 @@
+#include "Halide.h"
+#include <stdio.h>
+
+#include "test/common/halide_test_dirs.h"
+
+using namespace Halide;
+
+#ifdef _MSC_VER
+const char *lib_ext = ".lib";
+const char *obj_ext = ".obj";
+#else
+const char *lib_ext = ".a";
+const char *obj_ext = ".o";
+#endif
+
+// Compiles the module of j, which has a function for the pipeline and
+// one for its legacy wrapper, with the given number of threads.
+void testCompileToOutput(Func j, int threads) {
+    static char buf[32];
+    snprintf(buf, sizeof(buf), "HL_NUM_COMPILE_THREADS=%d", threads);
+    putenv(buf);
+
+    std::string fn_object = Internal::get_test_tmp_dir() + "compile_to_parallel_" + std::to_string(threads);
+    std::string expected_lib = fn_object + lib_ext;
+    std::string expected_obj = fn_object + obj_ext;
+    std::string expected_bc = fn_object + ".bc";
+
+    Internal::ensure_no_file_exists(expected_lib);
+    Internal::ensure_no_file_exists(expected_obj);
+    Internal::ensure_no_file_exists(expected_bc);
+
+    Module m = j.compile_to_module(j.infer_arguments(), "compile_to_parallel");
+    if (m.functions().size() < 2) {
+        printf("Expected more than one function in the module\n");
+        exit(-1);
+    }
+
+    // Only a static library: an object per function.
+    m.compile(Outputs().static_library(expected_lib));
+    Internal::assert_file_exists(expected_lib);
+
+    // The functions linked into one llvm module.
+    m.compile(Outputs().object(expected_obj).bitcode(expected_bc));
+    Internal::assert_file_exists(expected_obj);
+    Internal::assert_file_exists(expected_bc);
+}
+
+int main(int argc, char **argv) {
+    Param<float> factor("factor");
+    Func f, g, h, j;
+    Var x, y;
+    f(x, y) = x + y;
+    g(x, y) = cast<float>(f(x, y) + f(x+1, y));
+    h(x, y) = f(x, y) + g(x, y);
+    j(x, y) = h(x, y) * 2 * factor;
+
+    f.compute_root();
+    g.compute_root();
+    h.compute_root();
+
+    testCompileToOutput(j, 1);
+    testCompileToOutput(j, 4);
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,170 @@
+#include "Halide.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "test/common/check_hw_outputs.h"
+
+using namespace Halide;
+
+// A strict recursive-descent check of the JSON grammar.
+class JSONChecker {
+    const std::string &s;
+    size_t pos = 0;
+
+    void skip_space() {
+        while (pos < s.size() && (s[pos] == ' ' || s[pos] == '\t' || s[pos] == '\n' || s[pos] == '\r')) {
+            pos++;
+        }
+    }
+
+    bool accept(char c) {
+        skip_space();
+        if (pos < s.size() && s[pos] == c) {
+            pos++;
+            return true;
+        }
+        return false;
+    }
+
+    bool literal(const char *word) {
+        size_t n = strlen(word);
+        if (s.compare(pos, n, word) != 0) return false;
+        pos += n;
+        return true;
+    }
+
+    bool digits() {
+        size_t start = pos;
+        while (pos < s.size() && isdigit((unsigned char)s[pos])) pos++;
+        return pos > start;
+    }
+
+    bool string_value() {
+        if (!accept('"')) return false;
+        while (pos < s.size() && s[pos] != '"') {
+            if ((unsigned char)s[pos] < 0x20) return false;
+            if (s[pos] == '\\') {
+                pos++;
+                if (pos >= s.size()) return false;
+                if (s[pos] == 'u') {
+                    for (int i = 0; i < 4; i++) {
+                        if (++pos >= s.size() || !isxdigit((unsigned char)s[pos])) return false;
+                    }
+                } else if (!strchr("\"\\/bfnrt", s[pos])) {
+                    return false;
+                }
+            }
+            pos++;
+        }
+        return accept('"');
+    }
+
+    bool number() {
+        if (pos < s.size() && s[pos] == '-') pos++;
+        if (pos < s.size() && s[pos] == '0') {
+            pos++;
+        } else if (!digits()) {
+            return false;
+        }
+        if (pos < s.size() && s[pos] == '.') {
+            pos++;
+            if (!digits()) return false;
+        }
+        if (pos < s.size() && (s[pos] == 'e' || s[pos] == 'E')) {
+            pos++;
+            if (pos < s.size() && (s[pos] == '+' || s[pos] == '-')) pos++;
+            if (!digits()) return false;
+        }
+        return true;
+    }
+
+    bool value() {
+        skip_space();
+        if (pos >= s.size()) return false;
+        switch (s[pos]) {
+        case '{':
+            pos++;
+            if (accept('}')) return true;
+            do {
+                skip_space();
+                if (!string_value() || !accept(':') || !value()) return false;
+            } while (accept(','));
+            return accept('}');
+        case '[':
+            pos++;
+            if (accept(']')) return true;
+            do {
+                if (!value()) return false;
+            } while (accept(','));
+            return accept(']');
+        case '"':
+            return string_value();
+        case 't':
+            return literal("true");
+        case 'f':
+            return literal("false");
+        case 'n':
+            return literal("null");
+        default:
+            return number();
+        }
+    }
+
+public:
+    JSONChecker(const std::string &s) : s(s) {}
+
+    // Returns the offset of the first error, or npos if s is a single
+    // JSON value.
+    size_t check() {
+        bool ok = value();
+        skip_space();
+        return ok && pos == s.size() ? std::string::npos : pos;
+    }
+};
+
+int main(int argc, char **argv) {
+    std::string dir = enter_hw_test_dir("hw_firrtl_report");
+
+    ImageParam in(UInt(8), 2);
+    Var x("x"), y("y"), xo("xo"), yo("yo"), xi("xi"), yi("yi");
+    Func in_copy("in_copy"), hw_output("hw_output"), output("output");
+
+    in_copy(x, y) = in(x, y);
+    hw_output(x, y) = cast<uint8_t>((cast<uint16_t>(in_copy(x, y)) + in_copy(x + 1, y) +
+                                     in_copy(x, y + 1) + in_copy(x + 1, y + 1)) / 4);
+    output(x, y) = hw_output(x, y);
+
+    output.tile(x, y, xo, yo, xi, yi, 64, 64);
+    in_copy.compute_at(output, xo);
+    hw_output.compute_at(output, xo).tile(x, y, xo, yo, xi, yi, 64, 64);
+    hw_output.accelerate({in_copy}, xi, xo);
+
+    // The report is written next to the testbench, without overwriting it.
+    std::string tb = dir + "hw_firrtl_report.v";
+    std::string report_file = dir + "hw_firrtl_report_report.json";
+    Internal::ensure_no_file_exists(tb);
+    Internal::ensure_no_file_exists(report_file);
+    output.compile_to_firrtl(tb, {in}, "hw_firrtl_report");
+    Internal::assert_file_exists(tb);
+    Internal::assert_file_exists(report_file);
+
+    std::string report = read_file(report_file);
+    size_t error = JSONChecker(report).check();
+    if (error != std::string::npos) {
+        printf("The report is not valid JSON at offset %d:\n%s\n", (int)error, report.c_str());
+        return -1;
+    }
+    if (!contains(report, "\"design\":") || !contains(report, "\"components\":") ||
+        !contains(report, "\"total\":") || !contains(report, "\"lut\":")) {
+        printf("Expected the estimates of the design and its components in:\n%s\n", report.c_str());
+        return -1;
+    }
+    if (contains(read_file(tb), "\"components\":")) {
+        printf("The report overwrote the testbench %s\n", tb.c_str());
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
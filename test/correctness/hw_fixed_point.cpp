@@ -0,0 +1,47 @@
+#include "Halide.h"
+#include <stdio.h>
+
+#include "test/common/check_hw_outputs.h"
+
+using namespace Halide;
+
+// Compiles a pipeline computing in floating point on the accelerator
+// to FIRRTL, in fixed point with frac_bits fraction bits, and returns
+// the design.
+std::string compile_design(const std::string &dir, int frac_bits) {
+    ImageParam in(UInt(8), 2);
+    Var x("x"), y("y"), xo("xo"), yo("yo"), xi("xi"), yi("yi");
+    Func in_copy("in_copy"), hw_output("hw_output"), output("output");
+
+    in_copy(x, y) = in(x, y);
+    hw_output(x, y) = cast<uint8_t>(cast<float>(in_copy(x, y)) * 0.75f + 0.5f);
+    output(x, y) = hw_output(x, y);
+
+    output.tile(x, y, xo, yo, xi, yi, 64, 64);
+    in_copy.compute_at(output, xo);
+    hw_output.compute_at(output, xo).tile(x, y, xo, yo, xi, yi, 64, 64);
+    hw_output.accelerate({in_copy}, xi, xo);
+    hw_output.fixed_point(frac_bits);
+
+    std::string tb = dir + "hw_fixed_point_" + std::to_string(frac_bits) + ".fir";
+    Internal::ensure_no_file_exists(tb);
+    output.compile_to_firrtl(tb, {in}, "hw_fixed_point");
+    Internal::assert_file_exists(tb);
+
+    // The design of the accelerator is written to the working directory.
+    return read_file("hls_target.fir");
+}
+
+int main(int argc, char **argv) {
+    // The accelerator carries the float values in fixed point, with
+    // no floating-point operator modules.
+    std::string dir = enter_hw_test_dir("hw_fixed_point");
+    std::string fixed_design = compile_design(dir, 8);
+    if (fixed_design.empty() || fixed_design.find("extmodule") != std::string::npos) {
+        printf("Expected no floating-point operator modules in the fixed-point design\n");
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include "Halide.h"
+#include <stdio.h>
+
+#include "test/common/check_hw_outputs.h"
+
+using namespace Halide;
+
+// An accelerated pipeline whose datapath multiplies neighbouring
+// pixels, started every third cycle.
+Func build(ImageParam in) {
+    Var x("x"), y("y"), xo("xo"), yo("yo"), xi("xi"), yi("yi");
+    Func in_copy("in_copy"), hw_output("hw_output"), output("output");
+
+    in_copy(x, y) = cast<uint16_t>(in(x, y));
+    hw_output(x, y) = in_copy(x, y) * in_copy(x + 1, y) + in_copy(x, y + 1) * in_copy(x + 1, y + 1);
+    output(x, y) = hw_output(x, y);
+
+    output.tile(x, y, xo, yo, xi, yi, 64, 64);
+    in_copy.compute_at(output, xo);
+    hw_output.compute_at(output, xo).tile(x, y, xo, yo, xi, yi, 64, 64);
+    hw_output.accelerate({in_copy}, xi, xo);
+    hw_output.initiation_interval(3);
+    return output;
+}
+
+int main(int argc, char **argv) {
+    ImageParam in(UInt(8), 2);
+    std::string dir = enter_hw_test_dir("hw_initiation_interval");
+
+    {
+        std::string tb = dir + "hw_initiation_interval.fir";
+        Internal::ensure_no_file_exists(tb);
+        build(in).compile_to_firrtl(tb, {in}, "hw_initiation_interval");
+        Internal::assert_file_exists(tb);
+
+        // The design of the accelerator is written to the working
+        // directory, the test directory. The ForBlock steps in phases,
+        // and its multipliers are shared between them.
+        std::string design = read_file("hls_target.fir");
+        if (!contains(design, "initiation interval=3") ||
+            !contains(design, "reg ii_phase") ||
+            !contains(design, "shared_mul")) {
+            printf("Expected a ForBlock with an interval of 3 in:\n%s\n", design.c_str());
+            return -1;
+        }
+    }
+
+    {
+        std::string c_file = dir + "hw_initiation_interval.cpp";
+        Internal::ensure_no_file_exists(c_file);
+        build(in).compile_to_hls(c_file, {in}, "hw_initiation_interval");
+        Internal::assert_file_exists(c_file);
+
+        // The kernels are written to the working directory.
+        std::string code = read_file("hls_target.cpp");
+        if (!contains(code, "#pragma HLS PIPELINE II=3")) {
+            printf("Expected a pipeline with an interval of 3 in:\n%s\n", code.c_str());
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "Halide.h"
+#include <stdio.h>
+
+#include "test/common/check_hw_outputs.h"
+
+using namespace Halide;
+
+// The consumer reads a ping-pong buffered function of the tile mirrored
+// in x and in y, which no stencil window of a line buffer could serve.
+Func build(ImageParam in) {
+    Var x("x"), y("y"), xo("xo"), yo("yo"), xi("xi"), yi("yi");
+    Func in_copy("in_copy"), flip("flip"), hw_output("hw_output"), output("output");
+
+    in_copy(x, y) = in(x, y);
+    flip(x, y) = in_copy(x, y) + 1;
+    hw_output(x, y) = flip(63 - x, y) / 2 + flip(x, 63 - y) / 2;
+    output(x, y) = hw_output(x, y);
+
+    output.bound(x, 0, 64).bound(y, 0, 64);
+    output.tile(x, y, xo, yo, xi, yi, 64, 64);
+    in_copy.compute_at(output, xo);
+    hw_output.compute_at(output, xo).tile(x, y, xo, yo, xi, yi, 64, 64);
+    hw_output.accelerate({in_copy}, xi, xo);
+    flip.linebuffer().ping_pong();
+    return output;
+}
+
+int main(int argc, char **argv) {
+    ImageParam in(UInt(8), 2);
+    std::string dir = enter_hw_test_dir("hw_ping_pong");
+
+    {
+        std::string tb = dir + "hw_ping_pong.fir";
+        Internal::ensure_no_file_exists(tb);
+        build(in).compile_to_firrtl(tb, {in}, "hw_ping_pong");
+        Internal::assert_file_exists(tb);
+
+        // The design of the accelerator is written to the working directory.
+        std::string design = read_file("hls_target.fir");
+
+        // Both banks are synchronous-read memories with one write and
+        // one read port each, which the two accesses take turns on.
+        if (!contains(design, "smem  bank0") || !contains(design, "smem  bank1") ||
+            contains(design, "cmem  bank")) {
+            printf("Expected the ping-pong banks in smem:\n%s\n", design.c_str());
+            return -1;
+        }
+        if (count(design, "write mport bank0") != 1 || count(design, "read mport bank0") != 1 ||
+            count(design, "write mport bank1") != 1 || count(design, "read mport bank1") != 1 ||
+            contains(design, "infer mport bank")) {
+            printf("Expected a write and a read port per bank:\n%s\n", design.c_str());
+            return -1;
+        }
+        if (!contains(design, "initiation interval=3")) {
+            printf("Expected the consumer to take three cycles for its two reads:\n%s\n", design.c_str());
+            return -1;
+        }
+    }
+
+    {
+        std::string c_file = dir + "hw_ping_pong.cpp";
+        Internal::ensure_no_file_exists(c_file);
+        build(in).compile_to_hls(c_file, {in}, "hw_ping_pong");
+        Internal::assert_file_exists(c_file);
+
+        // The kernels are written to the working directory.
+        std::string code = read_file("hls_target.cpp");
+        if (!contains(code, "flip_pingpong[") || !contains(code, "core=RAM_2P_BRAM")) {
+            printf("Expected a ping-pong buffered array in:\n%s\n", code.c_str());
+            return -1;
+        }
+    }
+
+    printf("Success!\n");
+    return 0;
+}
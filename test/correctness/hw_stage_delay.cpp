@@ -0,0 +1,66 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <sstream>
+
+#include "test/common/check_hw_outputs.h"
+
+using namespace Halide;
+
+// Compiles a pipeline with a long chain of operations on the
+// accelerator to FIRRTL, and returns the deepest ForBlock pipeline.
+int compile_pipeline_depth(const std::string &dir, float ns) {
+    ImageParam in(UInt(8), 2);
+    Var x("x"), y("y"), xo("xo"), yo("yo"), xi("xi"), yi("yi");
+    Func in_copy("in_copy"), hw_output("hw_output"), output("output");
+
+    in_copy(x, y) = in(x, y);
+    Expr e = cast<uint32_t>(in_copy(x, y));
+    for (int i = 0; i < 4; i++) {
+        e = e * (i + 3) + (i + 7);
+    }
+    hw_output(x, y) = cast<uint8_t>(e >> 8);
+    output(x, y) = hw_output(x, y);
+
+    output.tile(x, y, xo, yo, xi, yi, 64, 64);
+    in_copy.compute_at(output, xo);
+    hw_output.compute_at(output, xo).tile(x, y, xo, yo, xi, yi, 64, 64);
+    hw_output.accelerate({in_copy}, xi, xo);
+    if (ns > 0) {
+        hw_output.stage_delay(ns);
+    }
+
+    std::string tb = dir + "hw_stage_delay.fir";
+    Internal::ensure_no_file_exists(tb);
+    Internal::ensure_no_file_exists("hls_target.fir");
+    output.compile_to_firrtl(tb, {in}, "hw_stage_delay");
+    Internal::assert_file_exists(tb);
+
+    // The design of the accelerator is written to the working directory.
+    std::istringstream design(read_file("hls_target.fir"));
+    std::string line;
+    const std::string key = "pipeline depth=";
+    int depth = 0;
+    while (std::getline(design, line)) {
+        size_t pos = line.find(key);
+        if (pos != std::string::npos) {
+            depth = std::max(depth, atoi(line.c_str() + pos + key.size()));
+        }
+    }
+    return depth;
+}
+
+int main(int argc, char **argv) {
+    std::string dir = enter_hw_test_dir("hw_stage_delay");
+
+    // Without a stage delay, the datapath is not split into stages.
+    int unscheduled = compile_pipeline_depth(dir, 0);
+    int scheduled = compile_pipeline_depth(dir, 1.0f);
+    if (unscheduled <= 0 || scheduled <= unscheduled) {
+        printf("Expected a deeper pipeline with a stage delay: %d vs %d stages\n",
+               scheduled, unscheduled);
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include "Halide.h"
+#include <stdio.h>
+
+#include "test/common/check_hw_outputs.h"
+
+using namespace Halide;
+
+// Compiles a 5-tap blur on the accelerator to FIRRTL, with its output
+// vectorized by the given width, and returns the design. The rows of
+// the input and of the output tile are multiples of the width.
+std::string compile_design(const std::string &dir, int width) {
+    ImageParam in(UInt(8), 2);
+    Var x("x"), y("y"), xo("xo"), yo("yo"), xi("xi"), yi("yi");
+    Func in_copy("in_copy"), hw_output("hw_output"), output("output");
+
+    in_copy(x, y) = in(x, y);
+    Expr sum = cast<uint16_t>(in_copy(x, y));
+    for (int i = 1; i < 5; i++) {
+        sum += in_copy(x + i, y);
+    }
+    hw_output(x, y) = cast<uint8_t>(sum / 5);
+    output(x, y) = hw_output(x, y);
+
+    output.tile(x, y, xo, yo, xi, yi, 60, 64);
+    in_copy.compute_at(output, xo);
+    hw_output.compute_at(output, xo).tile(x, y, xo, yo, xi, yi, 60, 64);
+    hw_output.accelerate({in_copy}, xi, xo);
+    if (width > 1) {
+        hw_output.vectorize(xi, width);
+    }
+
+    std::string tb = dir + "hw_vectorize.fir";
+    Internal::ensure_no_file_exists(tb);
+    Internal::ensure_no_file_exists("hls_target.fir");
+    output.compile_to_firrtl(tb, {in}, "hw_vectorize");
+    Internal::assert_file_exists(tb);
+
+    // The design of the accelerator is written to the working directory.
+    return read_file("hls_target.fir");
+}
+
+int main(int argc, char **argv) {
+    std::string dir = enter_hw_test_dir("hw_vectorize");
+
+    // The window of the blur advances by a pixel per step, or by the
+    // vector width when the datapath is replicated.
+    std::string design = compile_design(dir, 1);
+    if (!contains(design, "stencil_steps=[1][1]") || contains(design, "stencil_steps=[4]")) {
+        printf("Expected a step of one pixel in:\n%s\n", design.c_str());
+        return -1;
+    }
+
+    design = compile_design(dir, 4);
+    if (!contains(design, "stencil_steps=[4][1]")) {
+        printf("Expected a step of four pixels in:\n%s\n", design.c_str());
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <dirent.h>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+using namespace Halide;
+
+std::vector<std::string> cached_objects(const std::string &dir) {
+    std::vector<std::string> paths;
+    DIR *d = opendir(dir.c_str());
+    while (struct dirent *e = d ? readdir(d) : nullptr) {
+        std::string name = e->d_name;
+        if (name.size() > 2 && name.substr(name.size() - 2) == ".o") {
+            paths.push_back(dir + "/" + name);
+        }
+    }
+    if (d) {
+        closedir(d);
+    }
+    return paths;
+}
+
+int main(int argc, char **argv) {
+    std::string dir = Internal::dir_make_temp();
+    Internal::jit_cache_set_directory(dir);
+
+    Var x, y;
+    Func f;
+    f(x, y) = x * y + 3;
+    f.realize(100, 100);
+
+    if (Internal::jit_cache_get_stats().stores == 0) {
+        printf("Nothing was stored in the JIT cache\n");
+        return -1;
+    }
+
+    // A new shared runtime is the same module as the one just
+    // released, so its object code comes from the cache.
+    Internal::JITSharedRuntime::release_all();
+    Func g;
+    g(x, y) = x * y + 3;
+    Buffer<int> out = g.realize(100, 100);
+
+    if (Internal::jit_cache_get_stats().hits == 0) {
+        printf("The shared runtime was not loaded from the JIT cache\n");
+        return -1;
+    }
+
+    for (int y = 0; y < out.height(); y++) {
+        for (int x = 0; x < out.width(); x++) {
+            if (out(x, y) != x * y + 3) {
+                printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), x * y + 3);
+                return -1;
+            }
+        }
+    }
+
+    // An object stored under the name of another module is not loaded,
+    // as its header holds the full key of the module it came from.
+    std::vector<std::string> paths = cached_objects(dir);
+    if (paths.size() >= 2) {
+        std::vector<std::string> contents;
+        for (const std::string &path : paths) {
+            std::ifstream in(path, std::ios::binary);
+            std::stringstream ss;
+            ss << in.rdbuf();
+            contents.push_back(ss.str());
+        }
+        for (size_t i = 0; i < paths.size(); i++) {
+            std::ofstream out(paths[(i + 1) % paths.size()], std::ios::binary | std::ios::trunc);
+            out << contents[i];
+        }
+
+        int64_t hits = Internal::jit_cache_get_stats().hits;
+        Internal::JITSharedRuntime::release_all();
+        Func h;
+        h(x, y) = x * y + 3;
+        out = h.realize(100, 100);
+        if (Internal::jit_cache_get_stats().hits != hits) {
+            printf("An object of another module was loaded from the JIT cache\n");
+            return -1;
+        }
+        for (int y = 0; y < out.height(); y++) {
+            for (int x = 0; x < out.width(); x++) {
+                if (out(x, y) != x * y + 3) {
+                    printf("out(%d, %d) = %d instead of %d\n", x, y, out(x, y), x * y + 3);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    // Shrinking the cache evicts the objects.
+    Internal::jit_cache_set_size(1);
+    if (Internal::jit_cache_get_stats().evictions == 0) {
+        printf("Nothing was evicted from the JIT cache\n");
+        return -1;
+    }
+
+    Internal::jit_cache_clear();
+    Internal::jit_cache_set_directory("");
+    Internal::jit_cache_set_size(0);
+    Internal::dir_rmdir(dir);
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+
+#include "test/common/halide_test_dirs.h"
+
+using namespace Halide;
+
+bool contains(const std::string &s, const std::string &sub) {
+    return s.find(sub) != std::string::npos;
+}
+
+std::string compile(Func output, ImageParam input, Target target, const std::string &name) {
+    std::string c_file = Internal::get_test_tmp_dir() + name + ".c";
+    Internal::ensure_no_file_exists(c_file);
+    output.compile_to_zynq_c(c_file, {input}, name, target);
+    Internal::assert_file_exists(c_file);
+
+    std::ifstream f(c_file);
+    std::stringstream ss;
+    ss << f.rdbuf();
+    return ss.str();
+}
+
+int main(int argc, char **argv) {
+    // The accelerator writes three channels per pixel, so its output
+    // is streamed as a 3-D slice.
+    ImageParam input(UInt(8), 2, "input");
+    Var x("x"), y("y"), c("c"), xo("xo"), yo("yo"), xi("xi"), yi("yi");
+    Func in("in"), hw_output("hw_output"), output("output");
+
+    in(x, y) = input(x, y);
+    hw_output(c, x, y) = in(x, y) / cast<uint8_t>(c + 1);
+    output(x, y, c) = hw_output(c, x, y);
+
+    output.bound(x, 0, 256).bound(y, 0, 256).bound(c, 0, 3);
+    in.compute_root();
+    hw_output.compute_root();
+    hw_output.tile(x, y, xo, yo, xi, yi, 256, 256)
+        .reorder(c, xi, yi, xo, yo);
+    hw_output.accelerate({in}, xi, xo);
+    hw_output.unroll(xi).unroll(c);
+
+    // Scatter-gather DMA needs a driver with PROCESS_IMAGE_SG, so by
+    // default the channels are folded into the pixel depth.
+    Target target(Target::Linux, Target::ARM, 32, {Target::Zynq});
+    std::string code = compile(output, input, target, "zynq_sg_dma_off");
+    if (!contains(code, "halide_zynq_subimage(") ||
+        contains(code, "halide_zynq_subimage_nd(") ||
+        contains(code, "_sg_on(")) {
+        printf("Unexpected scatter-gather DMA in:\n%s\n", code.c_str());
+        return -1;
+    }
+
+    code = compile(output, input, target.with_feature(Target::ZynqSG), "zynq_sg_dma_on");
+    if (!contains(code, "halide_zynq_subimage_nd(") ||
+        !contains(code, "_sg_on(")) {
+        printf("Expected scatter-gather DMA in:\n%s\n", code.c_str());
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,51 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+
+#include "test/common/halide_test_dirs.h"
+
+using namespace Halide;
+
+bool contains(const std::string &s, const std::string &sub) {
+    return s.find(sub) != std::string::npos;
+}
+
+int main(int argc, char **argv) {
+    // The accelerator input is a plain copy of the input image, so it
+    // can be streamed from the image when that is a CMA buffer.
+    ImageParam input(UInt(8), 2, "input");
+    Var x("x"), y("y"), xo("xo"), yo("yo"), xi("xi"), yi("yi");
+    Func in("in"), hw_output("hw_output"), output("output");
+
+    in(x, y) = input(x, y);
+    hw_output(x, y) = in(x, y) / 2;
+    output(x, y) = hw_output(x, y);
+
+    output.tile(x, y, xo, yo, xi, yi, 256, 256);
+    output.bound(x, 0, 256).bound(y, 0, 256);
+    in.compute_at(output, xo);
+    hw_output.compute_at(output, xo).tile(x, y, xo, yo, xi, yi, 256, 256);
+    hw_output.accelerate({in}, xi, xo);
+
+    std::string c_file = Internal::get_test_tmp_dir() + "zynq_stream_in_place.c";
+    Internal::ensure_no_file_exists(c_file);
+    Target target(Target::Linux, Target::ARM, 32, {Target::Zynq});
+    output.compile_to_zynq_c(c_file, {input}, "zynq_stream_in_place", target);
+    Internal::assert_file_exists(c_file);
+
+    std::ifstream f(c_file);
+    std::stringstream ss;
+    ss << f.rdbuf();
+    std::string code = ss.str();
+
+    // Only buffers of the Zynq runtime are streamed in place; a
+    // device handle of another device is not a cma_buffer_t.
+    if (!contains(code, "halide_zynq_device_interface()")) {
+        printf("Unexpected check for a device-resident input in:\n%s\n", code.c_str());
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include "Halide.h"
+#include <stdio.h>
+#include <fstream>
+#include <sstream>
+
+#include "test/common/halide_test_dirs.h"
+
+using namespace Halide;
+
+bool contains(const std::string &s, const std::string &sub) {
+    return s.find(sub) != std::string::npos;
+}
+
+int main(int argc, char **argv) {
+    // Two accelerators, each with a parameter of its own.
+    ImageParam input(UInt(8), 2, "input");
+    Param<uint8_t> gain("gain"), offset("offset");
+    Var x("x"), y("y"), xo("xo"), yo("yo"), xi("xi"), yi("yi");
+    Func in1("in1"), hw_output1("hw_output1"), scaled("scaled");
+    Func in2("in2"), hw_output2("hw_output2"), output("output");
+
+    in1(x, y) = input(x, y);
+    hw_output1(x, y) = cast<uint8_t>(min(cast<uint16_t>(in1(x, y)) * gain / 16, 255));
+    scaled(x, y) = hw_output1(x, y);
+    in2(x, y) = scaled(x, y);
+    hw_output2(x, y) = cast<uint8_t>(min(cast<uint16_t>(in2(x, y)) + offset, 255));
+    output(x, y) = hw_output2(x, y);
+
+    scaled.compute_root().tile(x, y, xo, yo, xi, yi, 256, 256);
+    scaled.bound(x, 0, 256).bound(y, 0, 256);
+    in1.compute_at(scaled, xo);
+    hw_output1.compute_at(scaled, xo).tile(x, y, xo, yo, xi, yi, 256, 256);
+    hw_output1.accelerate({in1}, xi, xo);
+
+    output.tile(x, y, xo, yo, xi, yi, 256, 256);
+    output.bound(x, 0, 256).bound(y, 0, 256);
+    in2.compute_at(output, xo);
+    hw_output2.compute_at(output, xo).tile(x, y, xo, yo, xi, yi, 256, 256);
+    hw_output2.accelerate({in2}, xi, xo);
+
+    std::string c_file = Internal::get_test_tmp_dir() + "zynq_two_accelerators.c";
+    Internal::ensure_no_file_exists(c_file);
+    Target target(Target::Linux, Target::ARM, 32, {Target::Zynq});
+    output.compile_to_zynq_c(c_file, {input, gain, offset}, "zynq_two_accelerators", target);
+    Internal::assert_file_exists(c_file);
+
+    std::ifstream f(c_file);
+    std::stringstream ss;
+    ss << f.rdbuf();
+    std::string code = ss.str();
+
+    // The register setters follow the names gen_reg_api.py gives the
+    // IPs hls_target and hls_target1.
+    if (!contains(code, "halide_zynq_set__gain(_gain);") ||
+        !contains(code, "halide_zynq_set_hls_target1_offset(_offset);")) {
+        printf("Unexpected register setters in:\n%s\n", code.c_str());
+        return -1;
+    }
+
+    // Each accelerator launches on its own device.
+    if (!contains(code, "(_cma_bufs)") ||
+        !contains(code, "_on(1, _cma_bufs)") ||
+        contains(code, "_on(2, ")) {
+        printf("Unexpected accelerator launches in:\n%s\n", code.c_str());
+        return -1;
+    }
+
+    // The C backend has no thread pool, so the tile loops stay serial.
+    if (contains(code, "#pragma omp")) {
+        printf("Unexpected parallel loop in:\n%s\n", code.c_str());
+        return -1;
+    }
+
+    printf("Success!\n");
+    return 0;
+}
@@ -0,0 +1,26 @@
+#include <stdio.h>
+#include "Halide.h"
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    // The host sends IEEE-754 bits, which a fixed-point accelerator
+    // cannot take as input.
+    ImageParam in(Float(32), 2);
+    Var x, y, xo, yo, xi, yi;
+    Func in_copy, hw_output, output;
+
+    in_copy(x, y) = in(x, y);
+    hw_output(x, y) = cast<uint8_t>(in_copy(x, y) * 0.75f);
+    output(x, y) = hw_output(x, y);
+
+    output.tile(x, y, xo, yo, xi, yi, 64, 64);
+    in_copy.compute_at(output, xo);
+    hw_output.compute_at(output, xo).tile(x, y, xo, yo, xi, yi, 64, 64);
+    hw_output.accelerate({in_copy}, xi, xo).fixed_point(8);
+
+    output.compile_to_firrtl("hw_fixed_point_float_io.fir", {in}, "hw_fixed_point_float_io");
+
+    printf("Should have gotten an error about floating-point IO!\n");
+    return -1;
+}
@@ -0,0 +1,29 @@
+#include "Halide.h"
+#include <stdio.h>
+
+#include "test/common/halide_test_dirs.h"
+
+using namespace Halide;
+
+int main(int argc, char **argv) {
+    ImageParam in(UInt(8), 2);
+    Var x("x"), y("y"), xo("xo"), yo("yo"), xi("xi"), yi("yi");
+    Func in_copy("in_copy"), hw_output("hw_output"), output("output");
+
+    in_copy(x, y) = in(x, y);
+    hw_output(x, y) = cast<uint8_t>(cast<float>(in_copy(x, y)) * 0.75f + 0.5f);
+    output(x, y) = hw_output(x, y);
+
+    output.tile(x, y, xo, yo, xi, yi, 64, 64);
+    in_copy.compute_at(output, xo);
+    hw_output.compute_at(output, xo).tile(x, y, xo, yo, xi, yi, 64, 64);
+    hw_output.accelerate({in_copy}, xi, xo);
+
+    // The FIRRTL backend has no floating-point cores, so the
+    // accelerator must be scheduled with fixed_point().
+    output.compile_to_firrtl(Internal::get_test_tmp_dir() + "hw_float_without_fixed_point.fir",
+                             {in}, "hw_float_without_fixed_point");
+
+    printf("Success!\n");
+    return 0;
+}
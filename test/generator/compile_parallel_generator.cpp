@@ -0,0 +1,47 @@
+#include "Halide.h"
+
+namespace {
+
+// A pipeline of a few stages, compiled with its functions split across
+// threads, or in one piece with compile_threads=1, so that the test can
+// check that both builds compute the same. The extern stage uses the old
+// buffer_t, so the module also has a wrapper with internal linkage.
+class CompileParallel : public Halide::Generator<CompileParallel> {
+public:
+    GeneratorParam<int> compile_threads{ "compile_threads", 4 };
+
+    Input<Buffer<uint8_t>> input{ "input", 2 };
+    Input<float> gain{ "gain", 1.0f };
+
+    Output<Buffer<float>> output{ "output", 2 };
+
+    void generate() {
+        // Module::compile() reads the number of threads when the
+        // generated module is compiled, after generate() returns.
+        static std::string env;
+        env = "HL_NUM_COMPILE_THREADS=" + std::to_string((int)compile_threads);
+        putenv(&env[0]);
+
+        blur_x(x, y) = (cast<float>(input(x, y)) + input(x + 1, y) + input(x + 2, y)) / 3.0f;
+        blur_y(x, y) = (blur_x(x, y) + blur_x(x, y + 1) + blur_x(x, y + 2)) / 3.0f;
+        offset.define_extern("compile_parallel_offset", {blur_y}, Float(32), 2,
+                             NameMangling::Default,
+                             true /* uses old buffer_t */);
+        output(x, y) = offset(x, y) * gain;
+    }
+
+    void schedule() {
+        blur_x.compute_at(blur_y, y).vectorize(x, 8);
+        blur_y.compute_root().vectorize(x, 8);
+        offset.compute_root();
+        output.parallel(y).vectorize(x, 8);
+    }
+
+private:
+    Var x{"x"}, y{"y"};
+    Func blur_x{"blur_x"}, blur_y{"blur_y"}, offset{"offset"};
+};
+
+HALIDE_REGISTER_GENERATOR(CompileParallel, "compile_parallel")
+
+}  // namespace
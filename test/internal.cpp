@@ -17,6 +17,9 @@
 #include "Interval.h"
 #include "Associativity.h"
 #include "Generator.h"
+#include "SizeFIFODepths.h"
+#include "AnalyzeDataflow.h"
+#include "CoScheduleHWTiles.h"
 
 using namespace Halide;
 using namespace Halide::Internal;
@@ -39,6 +42,9 @@ int main(int argc, const char **argv) {
     interval_test();
     associativity_test();
     generator_test();
+    size_fifo_depths_test();
+    analyze_dataflow_test();
+    co_schedule_hw_tiles_test();
 
     return 0;
 }
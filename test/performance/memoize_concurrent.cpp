@@ -0,0 +1,113 @@
+#include "Halide.h"
+#include <cstdio>
+#include "halide_benchmark.h"
+
+using namespace Halide;
+using namespace Halide::Tools;
+
+#define W 256
+#define H 2048
+
+int main(int argc, char **argv) {
+    Var x, y;
+    Func reference;
+
+    // Every row of f is a separate entry of the memoization cache, and
+    // the rows of g look them up from all the threads at once.
+    auto math = [](Expr e) {
+        e = cast<float>(e);
+        for (int i = 0; i < 10; i++) e = sqrt(cos(sin(e)));
+        return e;
+    };
+    reference(x, y) = math(x + y) + math(x + 1 + y);
+
+    Buffer<float> im(W, H);
+    double time_1 = 0;
+    for (int t = 1; t <= 16; t *= 2) {
+        static char buf[32];
+        snprintf(buf, sizeof(buf), "HL_NUM_THREADS=%d", t);
+        putenv(buf);
+        Halide::Internal::JITSharedRuntime::release_all();
+        Halide::Internal::JITSharedRuntime::memoization_cache_set_size(64 << 20);
+
+        // The thread count and the cache are those of the runtime the
+        // module is compiled against, so the Funcs are defined anew for
+        // each count: a Func keeps its compiled module otherwise.
+        Func f, g;
+        f(x, y) = math(x + y);
+        g(x, y) = f(x, y) + f(x + 1, y);
+        f.compute_at(g, y).memoize();
+        g.parallel(y);
+        g.compile_jit();
+
+        // Fill the cache, then time the lookups.
+        g.realize(im);
+        double time = benchmark(3, 10, [&]() { g.realize(im); });
+        if (t == 1) {
+            time_1 = time;
+        }
+
+        halide_memoization_cache_stats_t stats;
+        Halide::Internal::JITSharedRuntime::memoization_cache_get_stats(&stats);
+        printf("%2d threads: %f ms (speedup %f), %llu hits, %llu misses, %llu evictions\n",
+               t, time * 1e3, time_1 / time,
+               (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+               (unsigned long long)stats.evictions);
+
+        if (stats.misses != H || stats.hits == 0) {
+            printf("Expected %d misses, one per row, and hits on the following runs\n", H);
+            return -1;
+        }
+        if (t == 16 && time_1 / time < 1.5) {
+            fprintf(stderr, "WARNING: Concurrent cache lookups should scale\n");
+        }
+    }
+
+    Buffer<float> correct = reference.realize(W, H);
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            if (im(x, y) != correct(x, y)) {
+                printf("im(%d, %d) = %f instead of %f\n", x, y, im(x, y), correct(x, y));
+                return -1;
+            }
+        }
+    }
+
+    {
+        // Entries that keep getting hit survive pruning. The cache holds
+        // eight tiles, and every other realization is of a new key,
+        // which evicts an older entry: never the hot one.
+        Halide::Internal::JITSharedRuntime::release_all();
+        Halide::Internal::JITSharedRuntime::memoization_cache_set_size(8 * W * 16 * sizeof(float));
+
+        Param<int> key;
+        Func f, g;
+        f(x, y) = math(x + y + key);
+        g(x, y) = f(x, y);
+        f.compute_root().memoize();
+
+        Buffer<float> tile(W, 16);
+        const int hot = 1000, cold = 64;
+        for (int i = 0; i < cold; i++) {
+            key.set(hot);
+            g.realize(tile);
+            key.set(i);
+            g.realize(tile);
+        }
+
+        halide_memoization_cache_stats_t stats;
+        Halide::Internal::JITSharedRuntime::memoization_cache_get_stats(&stats);
+        printf("Hot entry: %llu hits, %llu misses, %llu evictions\n",
+               (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+               (unsigned long long)stats.evictions);
+        if (stats.hits != cold - 1 || stats.misses != cold + 1) {
+            printf("Expected the hot entry to hit %d times\n", cold - 1);
+            return -1;
+        }
+    }
+
+    Halide::Internal::JITSharedRuntime::memoization_cache_set_size(0);
+
+    printf("Success!\n");
+    return 0;
+}
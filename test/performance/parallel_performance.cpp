@@ -43,6 +43,60 @@ int main(int argc, char **argv) {
     double speedup = serialTime / parallelTime;
     printf("Speedup: %f\n", speedup);
 
+    // Scaling with the number of threads, up to the cap of the thread
+    // pool, for the coarse-grained loop above and for a fine-grained
+    // loop of many cheap tasks, which mostly measures the cost of
+    // handing out tasks. The thread count is read when the runtime of
+    // a new JIT module starts, so the Funcs are defined anew for each
+    // count: a Func keeps its compiled module otherwise.
+    const int max_threads = 1024;
+    Buffer<int> imh(64, 64 * 1024);
+
+    double coarse_time_1 = 0, fine_time_1 = 0;
+    for (int t = 1; t <= max_threads; t *= 2) {
+        static char buf[32];
+        snprintf(buf, sizeof(buf), "HL_NUM_THREADS=%d", t);
+        putenv(buf);
+        Halide::Internal::JITSharedRuntime::release_all();
+
+        Func coarse, fine;
+        coarse(x, y) = math;
+        coarse.parallel(y);
+        fine(x, y) = x * y + 1;
+        fine.parallel(y);
+        coarse.compile_jit();
+        fine.compile_jit();
+        coarse.realize(imf);
+
+        double coarse_time = benchmark(3, 1, [&]() { coarse.realize(imf); });
+        double fine_time = benchmark(3, 1, [&]() { fine.realize(imh); });
+        if (t == 1) {
+            coarse_time_1 = coarse_time;
+            fine_time_1 = fine_time;
+        }
+        printf("%4d threads: coarse %f ms (speedup %f), fine %f ms (speedup %f)\n",
+               t, coarse_time * 1e3, coarse_time_1 / coarse_time,
+               fine_time * 1e3, fine_time_1 / fine_time);
+    }
+
+    for (int y = 0; y < H; y++) {
+        for (int x = 0; x < W; x++) {
+            if (imf(x, y) != img(x, y)) {
+                printf("imf(%d, %d) = %f\n", x, y, imf(x, y));
+                printf("img(%d, %d) = %f\n", x, y, img(x, y));
+                return -1;
+            }
+        }
+    }
+    for (int y = 0; y < imh.height(); y++) {
+        for (int x = 0; x < imh.width(); x++) {
+            if (imh(x, y) != x * y + 1) {
+                printf("imh(%d, %d) = %d\n", x, y, imh(x, y));
+                return -1;
+            }
+        }
+    }
+
     if (speedup < 1.5) {
         fprintf(stderr, "WARNING: Parallel should be faster\n");
         return 0;